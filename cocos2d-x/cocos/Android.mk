@@ -9,8 +9,10 @@ LOCAL_ARM_MODE := arm
 
 ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
 MATHNEONFILE := math/MathUtil.cpp.neon
+WEBSOCKETUTILSFILE := network/WebSocketUtils.cpp.neon
 else
 MATHNEONFILE := math/MathUtil.cpp
+WEBSOCKETUTILSFILE := network/WebSocketUtils.cpp
 endif
 
 LOCAL_SRC_FILES := \
@@ -199,12 +201,20 @@ endif # USE_AUDIO
 ifeq ($(USE_SOCKET),1)
 LOCAL_SRC_FILES += \
 network/SocketIO.cpp \
-network/WebSocket-okhttp_android.cpp \
+$(WEBSOCKETUTILSFILE) \
+network/WebSocketDeflate.cpp \
 network/WebSocketServer.cpp \
 scripting/js-bindings/manual/jsb_socketio.cpp \
 scripting/js-bindings/manual/jsb_websocket.cpp \
 scripting/js-bindings/manual/jsb_websocket_server.cpp
 
+# WebSocket transport: OkHttp through JNI by default, USE_NATIVE_WEBSOCKET := 1 selects the C++ one
+ifeq ($(USE_NATIVE_WEBSOCKET),1)
+LOCAL_SRC_FILES += network/WebSocket-native.cpp
+else
+LOCAL_SRC_FILES += network/WebSocket-okhttp_android.cpp
+endif # USE_NATIVE_WEBSOCKET
+
 LOCAL_STATIC_LIBRARIES += libwebsockets_static
 LOCAL_STATIC_LIBRARIES += cocos_ssl_static
 LOCAL_STATIC_LIBRARIES += cocos_crypto_static
@@ -0,0 +1,2159 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+
+/**
+ * WebSocket transport written in C++ (RFC 6455), the alternative to WebSocket-okhttp_android.cpp.
+ * All connections share one network thread which drives non-blocking sockets with poll(), wss:// goes through
+ * OpenSSL and permessage-deflate through WebSocketDeflate. Events are delivered on the game thread once per frame.
+ * Only POSIX sockets are used, so it builds for Android (USE_NATIVE_WEBSOCKET := 1 in Android.mk) as well as Linux.
+ */
+
+#include "network/WebSocket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include "base/ccMacros.h"
+#include "base/CCScheduler.h"
+#include "platform/CCApplication.h"
+#include "platform/CCFileUtils.h"
+#include "platform/CCPlatformConfig.h"
+#include "network/WebSocketDeflate.h"
+#include "network/WebSocketUtils.h"
+
+using cocos2d::network::WebSocket;
+using cocos2d::network::WebSocketDeflate;
+
+namespace {
+
+const int64_t CONNECT_TIMEOUT_MS = 30 * 1000; // DNS, TCP, TLS and the HTTP upgrade together
+const int64_t CLOSE_TIMEOUT_MS = 5 * 1000;    // how long to wait for the server to finish the closing handshake
+const int64_t MAX_POLL_TIMEOUT_MS = 1000;
+const size_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+const size_t MAX_HANDSHAKE_SIZE = 16 * 1024;
+const size_t READ_CHUNK_SIZE = 16 * 1024;
+const size_t MAX_RETAINED_READ_BUFFER = 256 * 1024;
+const char *WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const size_t MAX_TLS_SESSIONS = 64;
+const char *TLS_SESSION_FILE = "websocket_tls_sessions";
+const uint32_t TLS_SESSION_FILE_MAGIC = 0x57535331; // "WSS1"
+const char *RECONNECT_SCHEDULER_KEY = "WebSocketReconnect";
+#if CC_TARGET_PLATFORM == CC_PLATFORM_ANDROID
+const char *ANDROID_CA_DIRECTORY = "/system/etc/security/cacerts";
+#endif
+
+const uint8_t OPCODE_CONTINUATION = 0x0;
+const uint8_t OPCODE_TEXT = 0x1;
+const uint8_t OPCODE_BINARY = 0x2;
+const uint8_t OPCODE_CLOSE = 0x8;
+const uint8_t OPCODE_PING = 0x9;
+const uint8_t OPCODE_PONG = 0xA;
+
+const int CLOSE_NORMAL = 1000;
+const int CLOSE_PROTOCOL_ERROR = 1002;
+const int CLOSE_NO_STATUS = 1005;
+const int CLOSE_ABNORMAL = 1006;
+const int CLOSE_INVALID_PAYLOAD = 1007;
+const int CLOSE_MESSAGE_TOO_BIG = 1009;
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    });
+    return s;
+}
+
+std::string trim(const std::string &s) {
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+// true if the comma separated header value contains token, compared case-insensitively
+bool hasToken(const std::string &value, const char *token) {
+    std::string lower = toLower(value);
+    size_t pos = 0;
+    while (pos <= lower.size()) {
+        size_t next = lower.find(',', pos);
+        std::string item = trim(lower.substr(pos, next == std::string::npos ? std::string::npos : next - pos));
+        if (item == token) {
+            return true;
+        }
+        if (next == std::string::npos) {
+            break;
+        }
+        pos = next + 1;
+    }
+    return false;
+}
+
+std::string base64Encode(const uint8_t *data, size_t len) {
+    std::string out(4 * ((len + 2) / 3) + 1, '\0');
+    int n = EVP_EncodeBlock(reinterpret_cast<unsigned char *>(&out[0]), data, static_cast<int>(len));
+    out.resize(static_cast<size_t>(n));
+    return out;
+}
+
+void randomBytes(uint8_t *out, size_t len) {
+    if (RAND_bytes(out, static_cast<int>(len)) == 1) {
+        return;
+    }
+    static thread_local std::mt19937 fallback{std::random_device{}()};
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = static_cast<uint8_t>(fallback());
+    }
+}
+
+struct ParsedUrl {
+    bool secure{false};
+    std::string host;       // without the brackets of an IPv6 literal
+    std::string port;
+    std::string hostHeader; // value of the Host header
+    std::string resource;   // path and query
+};
+
+bool parseUrl(const std::string &url, ParsedUrl &out) {
+    std::string scheme = toLower(url.substr(0, url.find("://")));
+    size_t pos;
+    if (scheme == "ws") {
+        out.secure = false;
+        pos = 5;
+    } else if (scheme == "wss") {
+        out.secure = true;
+        pos = 6;
+    } else {
+        return false;
+    }
+    size_t end = url.find_first_of("/?#", pos);
+    std::string authority = url.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    size_t at = authority.rfind('@');
+    if (at != std::string::npos) {
+        authority = authority.substr(at + 1);
+    }
+    out.resource = end == std::string::npos ? "/" : url.substr(end, url.find('#', end) - end);
+    if (out.resource.empty() || out.resource[0] != '/') {
+        out.resource.insert(0, "/");
+    }
+
+    std::string port;
+    if (!authority.empty() && authority[0] == '[') {
+        size_t closing = authority.find(']');
+        if (closing == std::string::npos) {
+            return false;
+        }
+        out.host = authority.substr(1, closing - 1);
+        if (closing + 1 < authority.size()) {
+            if (authority[closing + 1] != ':') {
+                return false;
+            }
+            port = authority.substr(closing + 2);
+        }
+    } else {
+        size_t colon = authority.rfind(':');
+        out.host = authority.substr(0, colon);
+        if (colon != std::string::npos) {
+            port = authority.substr(colon + 1);
+        }
+    }
+    if (out.host.empty()) {
+        return false;
+    }
+    if (port.empty()) {
+        out.port = out.secure ? "443" : "80";
+    } else {
+        char *endPtr = nullptr;
+        long value = strtol(port.c_str(), &endPtr, 10);
+        if (*endPtr != '\0' || value <= 0 || value > 65535) {
+            return false;
+        }
+        out.port = port;
+    }
+    out.hostHeader = authority;
+    return true;
+}
+
+int addCertificates(X509_STORE *store, BIO *bio) {
+    int count = 0;
+    while (X509 *cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) {
+        if (X509_STORE_add_cert(store, cert) == 1) {
+            ++count;
+        }
+        X509_free(cert);
+    }
+    ERR_clear_error(); // end of input is reported as an error
+    return count;
+}
+
+// PEM certificates, or DER certificates (.cer) like CertificateFactory accepts on the OkHttp path
+int addCertificates(X509_STORE *store, const std::string &data) {
+    BIO *bio = BIO_new_mem_buf(data.data(), static_cast<int>(data.size()));
+    int count = addCertificates(store, bio);
+    BIO_free(bio);
+    if (count > 0) {
+        return count;
+    }
+    const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+    const unsigned char *end = p + data.size();
+    while (p < end) {
+        X509 *cert = d2i_X509(nullptr, &p, static_cast<long>(end - p));
+        if (cert == nullptr) {
+            break;
+        }
+        if (X509_STORE_add_cert(store, cert) == 1) {
+            ++count;
+        }
+        X509_free(cert);
+    }
+    ERR_clear_error();
+    return count;
+}
+
+bool isIPAddress(const std::string &host) {
+    unsigned char buf[sizeof(in6_addr)];
+    return inet_pton(AF_INET, host.c_str(), buf) == 1 || inet_pton(AF_INET6, host.c_str(), buf) == 1;
+}
+
+// Client TLS sessions (session tickets and session IDs) by CA file and host:port, shared by every connection so
+// that reconnects resume instead of running a full handshake. Network thread only. Sessions of connections which
+// asked for it are also written to app storage and loaded by the first such connection after a restart.
+class TLSSessionCache {
+public:
+    static TLSSessionCache *getInstance() {
+        static auto *instance = new TLSSessionCache();
+        return instance;
+    }
+
+    // a session to resume for key, nullptr if none or expired. The cache keeps the ownership
+    SSL_SESSION *get(const std::string &key) {
+        auto it = _sessions.find(key);
+        if (it == _sessions.end()) {
+            return nullptr;
+        }
+        if (!isUsable(it->second.session)) {
+            SSL_SESSION_free(it->second.session);
+            _sessions.erase(it);
+            return nullptr;
+        }
+        return it->second.session;
+    }
+
+    // takes the ownership of session, a later one for the same key replaces it (e.g. a fresh TLS 1.3 ticket)
+    void put(const std::string &key, SSL_SESSION *session, bool persistent) {
+        auto it = _sessions.find(key);
+        if (it != _sessions.end()) {
+            SSL_SESSION_free(it->second.session);
+            it->second = {session, persistent};
+        } else {
+            if (_sessions.size() >= MAX_TLS_SESSIONS) {
+                evictOldest();
+            }
+            _sessions.emplace(key, Entry{session, persistent});
+        }
+        if (persistent) {
+            save();
+        }
+    }
+
+    // reads the sessions saved by a previous run once, entries already in memory are newer and win
+    void load(const std::string &path) {
+        if (!_path.empty()) {
+            return;
+        }
+        _path = path;
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return;
+        }
+        uint32_t magic = 0;
+        if (fread(&magic, sizeof(magic), 1, file) == 1 && magic == TLS_SESSION_FILE_MAGIC) {
+            std::string key;
+            std::vector<uint8_t> der;
+            uint32_t keyLen = 0;
+            uint32_t derLen = 0;
+            while (fread(&keyLen, sizeof(keyLen), 1, file) == 1 && keyLen <= 1024) {
+                key.resize(keyLen);
+                if (fread(&key[0], 1, keyLen, file) != keyLen || fread(&derLen, sizeof(derLen), 1, file) != 1 ||
+                    derLen > 64 * 1024) {
+                    break;
+                }
+                der.resize(derLen);
+                if (fread(der.data(), 1, derLen, file) != derLen) {
+                    break;
+                }
+                const unsigned char *p = der.data();
+                SSL_SESSION *session = d2i_SSL_SESSION(nullptr, &p, static_cast<long>(derLen));
+                if (session == nullptr) {
+                    continue;
+                }
+                if (_sessions.count(key) != 0 || !isUsable(session) || _sessions.size() >= MAX_TLS_SESSIONS) {
+                    SSL_SESSION_free(session);
+                    continue;
+                }
+                _sessions.emplace(key, Entry{session, true});
+            }
+        }
+        fclose(file);
+    }
+
+private:
+    struct Entry {
+        SSL_SESSION *session;
+        bool persistent;
+    };
+
+    static bool isUsable(SSL_SESSION *session) {
+        return SSL_SESSION_is_resumable(session) == 1 &&
+               SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) > static_cast<long>(time(nullptr));
+    }
+
+    void evictOldest() {
+        auto oldest = _sessions.begin();
+        for (auto it = _sessions.begin(); it != _sessions.end(); ++it) {
+            if (SSL_SESSION_get_time(it->second.session) < SSL_SESSION_get_time(oldest->second.session)) {
+                oldest = it;
+            }
+        }
+        SSL_SESSION_free(oldest->second.session);
+        _sessions.erase(oldest);
+    }
+
+    void save() {
+        if (_path.empty()) {
+            return;
+        }
+        std::string tmpPath = _path + ".tmp";
+        FILE *file = fopen(tmpPath.c_str(), "wb");
+        if (file == nullptr) {
+            CCLOGWARN("WebSocket: can't write the TLS session cache %s, errno: %d", tmpPath.c_str(), errno);
+            return;
+        }
+        bool ok = fwrite(&TLS_SESSION_FILE_MAGIC, sizeof(TLS_SESSION_FILE_MAGIC), 1, file) == 1;
+        std::vector<uint8_t> der;
+        for (const auto &it : _sessions) {
+            int derLen = it.second.persistent ? i2d_SSL_SESSION(it.second.session, nullptr) : 0;
+            if (derLen <= 0) {
+                continue;
+            }
+            der.resize(static_cast<size_t>(derLen));
+            unsigned char *p = der.data();
+            i2d_SSL_SESSION(it.second.session, &p);
+            auto keyLen = static_cast<uint32_t>(it.first.size());
+            auto len = static_cast<uint32_t>(derLen);
+            ok = ok && fwrite(&keyLen, sizeof(keyLen), 1, file) == 1 &&
+                 fwrite(it.first.data(), 1, keyLen, file) == keyLen &&
+                 fwrite(&len, sizeof(len), 1, file) == 1 &&
+                 fwrite(der.data(), 1, der.size(), file) == der.size();
+        }
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tmpPath.c_str(), _path.c_str()) != 0) {
+            remove(tmpPath.c_str());
+        }
+    }
+
+    std::unordered_map<std::string, Entry> _sessions;
+    std::string _path;
+};
+
+// new session callback of every SSL_CTX, defined after Connection
+int onNewTLSSession(SSL *ssl, SSL_SESSION *session);
+
+// modification time of a CA file, 0 for files packed in the apk which can't change while the app runs.
+// Game thread, FileUtils may call into Java.
+int64_t getCAFileStamp(const std::string &caFilePath) {
+    if (caFilePath.empty()) {
+        return 0;
+    }
+    std::string fullPath = cocos2d::FileUtils::getInstance()->fullPathForFilename(caFilePath);
+    struct stat st;
+    if (fullPath.empty() || stat(fullPath.c_str(), &st) != 0) {
+        return 0;
+    }
+    return static_cast<int64_t>(st.st_mtime);
+}
+
+// SSL_CTX per CA file, kept for the lifetime of the process and rebuilt when the file was modified.
+// Used on the network thread and by WebSocket::preloadCAFile, parsing a large bundle blocks the other caller.
+// Returns nullptr when no trusted certificate could be loaded, such a context would never verify the server.
+SSL_CTX *getSSLContext(const std::string &caFilePath, int64_t stamp) {
+    struct Context {
+        int64_t stamp;
+        SSL_CTX *ctx;
+    };
+    static std::mutex mutex;
+    static std::unordered_map<std::string, Context> contexts;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = contexts.find(caFilePath);
+    if (it != contexts.end()) {
+        if (it->second.stamp == stamp) {
+            return it->second.ctx;
+        }
+        // connections still using the old context hold their own reference
+        SSL_CTX_free(it->second.ctx);
+        contexts.erase(it);
+    }
+    OPENSSL_init_ssl(0, nullptr);
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == nullptr) {
+        return nullptr;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // sessions are kept by TLSSessionCache per host:port, OpenSSL's internal cache is for servers
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, onNewTLSSession);
+
+    int loaded = 0;
+    X509_STORE *store = SSL_CTX_get_cert_store(ctx);
+    if (!caFilePath.empty()) {
+        // read through FileUtils, the file may be packed in the apk
+        loaded = addCertificates(store, cocos2d::FileUtils::getInstance()->getStringFromFile(caFilePath));
+    } else {
+#if CC_TARGET_PLATFORM == CC_PLATFORM_ANDROID
+        // the system trust store is a directory of PEM files named after the legacy subject hash,
+        // which OpenSSL's hashed directory lookup can't use, so load every file once
+        if (DIR *dir = opendir(ANDROID_CA_DIRECTORY)) {
+            while (struct dirent *entry = readdir(dir)) {
+                if (entry->d_name[0] == '.') {
+                    continue;
+                }
+                std::string path = std::string(ANDROID_CA_DIRECTORY) + "/" + entry->d_name;
+                if (BIO *bio = BIO_new_file(path.c_str(), "r")) {
+                    loaded += addCertificates(store, bio);
+                    BIO_free(bio);
+                }
+            }
+            closedir(dir);
+        }
+#else
+        loaded = SSL_CTX_set_default_verify_paths(ctx) == 1 ? 1 : 0;
+#endif
+    }
+    if (loaded == 0) {
+        // not cached, the file may be fixed before the next attempt
+        CCLOGERROR("WebSocket: no trusted certificate found in %s",
+                   caFilePath.empty() ? "the system trust store" : caFilePath.c_str());
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    contexts.emplace(caFilePath, Context{stamp, ctx});
+    return ctx;
+}
+
+// Event produced on the network thread and delivered on the game thread
+struct Event {
+    enum class Type {
+        OPEN,
+        MESSAGE,
+        CLOSED,
+        ERROR
+    };
+    Type type{Type::MESSAGE};
+    bool isBinary{false};
+    int code{0};               // close code for CLOSED, WebSocket::ErrorCode for ERROR
+    size_t length{0};          // MESSAGE only, text payloads are NUL terminated and the terminator isn't counted
+    std::vector<uint8_t> data; // MESSAGE only
+    std::string text;          // protocol for OPEN, reason otherwise
+    std::string headers;       // OPEN only, the response header lines separated by '\n'
+    std::string extensions;    // OPEN only
+    WebSocket::HandshakeInfo handshake; // OPEN only
+    int64_t postedUs{0};
+};
+
+void dispatchConnectionEvents(uint64_t handle);
+void deliverConnectionMessage(uint64_t handle, Event &event);
+
+// message sent while reconnecting, replayed once the connection is open again
+struct QueuedMessage {
+    std::vector<uint8_t> data;
+    bool isBinary{false};
+};
+
+class Connection;
+
+// The network thread, shared by every connection and never stopped once started
+class EventLoop {
+public:
+    static EventLoop *getInstance() {
+        static auto *instance = new EventLoop();
+        return instance;
+    }
+
+    void add(const std::shared_ptr<Connection> &connection) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _added.push_back(connection);
+        }
+        wakeup();
+    }
+
+    void wakeup() {
+        if (_wakeupPipe[1] >= 0 && !_wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+            char c = 0;
+            (void)write(_wakeupPipe[1], &c, 1);
+        }
+    }
+
+private:
+    EventLoop() {
+        if (pipe(_wakeupPipe) == 0) {
+            fcntl(_wakeupPipe[0], F_SETFL, fcntl(_wakeupPipe[0], F_GETFL) | O_NONBLOCK);
+            fcntl(_wakeupPipe[1], F_SETFL, fcntl(_wakeupPipe[1], F_GETFL) | O_NONBLOCK);
+        } else {
+            CCLOGERROR("WebSocket: failed to create the wakeup pipe, errno: %d", errno);
+            _wakeupPipe[0] = _wakeupPipe[1] = -1;
+        }
+        std::thread(&EventLoop::run, this).detach();
+    }
+
+    void run();
+
+    int _wakeupPipe[2]{-1, -1};
+    std::atomic<bool> _wakeupPending{false};
+    std::mutex _mutex;
+    std::vector<std::shared_ptr<Connection>> _added;
+    std::vector<std::shared_ptr<Connection>> _connections; // network thread only
+};
+
+// State of one connection. The public part is called on the game thread, everything else runs on the network
+// thread. WebSocketImpl and the EventLoop share the ownership, so either side may let go first.
+class Connection final : public std::enable_shared_from_this<Connection> {
+public:
+    Connection(uint64_t handle, const ParsedUrl &url, const std::string &protocols,
+               const std::string &caFilePath, const WebSocket::Options &options,
+               const std::shared_ptr<cocos2d::network::WebSocketUtils::WaterMarks> &waterMarks)
+    : _handle(handle),
+      _waterMarks(waterMarks),
+      _url(url),
+      _protocols(protocols),
+      _caFilePath(caFilePath),
+      _caFileStamp(url.secure ? getCAFileStamp(caFilePath) : 0),
+      // a session must not be resumed under a different trust store
+      _tlsSessionKey(caFilePath + "\n" + std::to_string(_caFileStamp) + "\n" + url.host + ":" + url.port),
+      _startUs(nowUs()),
+      _pingIntervalMs(static_cast<int64_t>(std::max(0.0F, options.pingInterval) * 1000)),
+      _deadPeerTimeoutMs(options.deadPeerTimeout > 0 ? static_cast<int64_t>(options.deadPeerTimeout * 1000)
+                                                     : _pingIntervalMs),
+      _deliverOnNetworkThread(options.messageDelivery == WebSocket::MessageDelivery::TRANSPORT_THREAD) {
+        if (options.persistTlsSessions && url.secure) {
+            // resolved here, FileUtils may call into Java which the network thread shouldn't
+            _tlsSessionFile = cocos2d::FileUtils::getInstance()->getWritablePath() + TLS_SESSION_FILE;
+        }
+        if (options.perMessageDeflate) {
+            WebSocketDeflate::Config config;
+            config.clientMaxWindowBits = options.clientMaxWindowBits;
+            config.serverMaxWindowBits = options.serverMaxWindowBits;
+            config.clientNoContextTakeover = !options.contextTakeover;
+            config.serverNoContextTakeover = !options.contextTakeover;
+            _deflate.reset(new WebSocketDeflate(config));
+        }
+    }
+
+    ~Connection() {
+        closeSocket();
+        if (_addresses != nullptr) {
+            freeaddrinfo(_addresses);
+        }
+        if (_resolvedAddresses != nullptr) {
+            freeaddrinfo(_resolvedAddresses);
+        }
+    }
+
+    // game thread
+
+    bool sendMessage(const uint8_t *data, size_t len, bool isBinary) {
+        uint8_t opcode = isBinary ? OPCODE_BINARY : OPCODE_TEXT;
+        // compression state is only touched here after OPEN was delivered, so it needs no lock
+        if (_deflate && _deflate->shouldCompress(len)) {
+            if (!_deflate->compress(data, len, _compressed)) {
+                return false;
+            }
+            return queueFrame(opcode, true, _compressed.data(), _compressed.size());
+        }
+        return queueFrame(opcode, false, data, len);
+    }
+
+    void close(int code, const std::string &reason) {
+        uint8_t payload[125];
+        size_t len = 0;
+        if (code != CLOSE_NO_STATUS) {
+            payload[0] = static_cast<uint8_t>(code >> 8);
+            payload[1] = static_cast<uint8_t>(code & 0xff);
+            size_t reasonLen = std::min(reason.size(), sizeof(payload) - 2);
+            // don't cut a UTF-8 sequence
+            while (reasonLen > 0 && reasonLen < reason.size() &&
+                   (static_cast<uint8_t>(reason[reasonLen]) & 0xC0) == 0x80) {
+                --reasonLen;
+            }
+            memcpy(payload + 2, reason.data(), reasonLen);
+            len = 2 + reasonLen;
+        }
+        queueFrame(OPCODE_CLOSE, false, payload, len);
+    }
+
+    // drops the connection without a closing handshake, the network thread reports CLOSED
+    void abort() {
+        _aborted.store(true, std::memory_order_release);
+        EventLoop::getInstance()->wakeup();
+    }
+
+    size_t getBufferedAmount() const { return _bufferedAmount.load(std::memory_order_relaxed); }
+    WebSocket::RoundTripTime getRoundTripTime() const { return _roundTrips.get(); }
+
+    void takeEvents(std::vector<Event> &events) {
+        _dispatchScheduled.store(false, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(_eventMutex);
+        events.swap(_events);
+    }
+
+    // network thread
+
+    // prepares the next poll(), false once the connection is finished and can be dropped
+    bool update(int64_t now);
+    int getFd() const { return _fd; }
+    short getPollEvents();
+    int64_t getDeadline() const;
+    void onPoll(short revents, int64_t now);
+    void onNewTLSSession(SSL_SESSION *session);
+
+private:
+    enum class Phase {
+        RESOLVING,
+        CONNECTING,
+        TLS_HANDSHAKE,
+        HTTP_HANDSHAKE,
+        OPEN,
+        CLOSING,
+        FINISHED
+    };
+
+    // frames are masked and appended to _pending by the sending thread, the network thread swaps it with _out
+    bool queueFrame(uint8_t opcode, bool compressed, const uint8_t *data, size_t len);
+    void postEvent(Event &&event);
+    void scheduleDispatch();
+    void addBufferedAmount(size_t len);
+    void removeBufferedAmount(size_t len);
+
+    void startResolve();
+    void connectNext(int64_t now);
+    void onConnected(int64_t now);
+    void continueTLSHandshake(int64_t now);
+    void startHttpHandshake();
+    bool processHandshakeResponse();
+    void processFrames(int64_t now);
+    bool processControlFrame(uint8_t opcode, const uint8_t *payload, size_t len, int64_t now);
+    void updateKeepAlive(int64_t now);
+    bool finishMessage(const uint8_t *payload, size_t len, bool compressed, uint8_t opcode);
+    void readAvailable(int64_t now);
+    bool flush();
+    void onTransportClosed();
+
+    void failConnection(WebSocket::ErrorCode code, const std::string &reason);
+    void failProtocol(int closeCode, const char *reason);
+    void finishClosed();
+    void closeSocket();
+
+    ssize_t readSome(uint8_t *buf, size_t len);
+    ssize_t writeSome(const uint8_t *buf, size_t len);
+
+    const uint64_t _handle;
+    // shared by the connections of a WebSocket, so the state survives a reconnect
+    const std::shared_ptr<cocos2d::network::WebSocketUtils::WaterMarks> _waterMarks;
+    const ParsedUrl _url;
+    const std::string _protocols;
+    const std::string _caFilePath;
+    const int64_t _caFileStamp;
+    const std::string _tlsSessionKey;
+    std::string _tlsSessionFile; // empty unless the sessions are persisted
+    const int64_t _startUs;
+    int64_t _tlsStartUs{0};
+    WebSocket::HandshakeInfo _handshake;
+    const int64_t _pingIntervalMs;
+    const int64_t _deadPeerTimeoutMs;
+    const bool _deliverOnNetworkThread; // Options::messageDelivery
+    int64_t _nextPingAt{0};
+    int64_t _pongDeadline{0};
+    uint64_t _pingSentUs{0}; // payload of the ping awaiting its pong, 0 if none
+    cocos2d::network::WebSocketUtils::RoundTripEstimator _roundTrips;
+    std::unique_ptr<WebSocketDeflate> _deflate;
+    std::vector<uint8_t> _compressed; // game thread only
+
+    Phase _phase{Phase::RESOLVING};
+    bool _resolveStarted{false};
+    int _fd{-1};
+    SSL *_ssl{nullptr};
+    bool _sslWantsWrite{false};
+    addrinfo *_addresses{nullptr};
+    addrinfo *_nextAddress{nullptr};
+    int64_t _deadline{0};
+    std::string _handshakeKey;
+
+    std::vector<uint8_t> _in; // bytes received and not parsed yet are [_inBegin, _inEnd)
+    size_t _inBegin{0};
+    size_t _inEnd{0};
+    std::vector<uint8_t> _message; // fragments of the message being received
+    uint8_t _messageOpcode{0};
+    bool _messageCompressed{false};
+    bool _inMessage{false};
+    std::vector<uint8_t> _out;
+    size_t _outOffset{0};
+    bool _closeReceived{false};
+    int _closeCode{CLOSE_ABNORMAL};
+    std::string _closeReason;
+
+    std::mutex _resolveMutex;
+    bool _resolved{false};
+    int _resolveError{0};
+    addrinfo *_resolvedAddresses{nullptr};
+
+    std::mutex _sendMutex;
+    std::vector<uint8_t> _pending;
+    bool _closeQueued{false}; // no frame may follow the close frame
+    std::atomic<size_t> _bufferedAmount{0};
+    std::atomic<bool> _aborted{false};
+
+    std::mutex _eventMutex;
+    std::vector<Event> _events;
+    std::atomic<bool> _dispatchScheduled{false};
+};
+
+bool Connection::queueFrame(uint8_t opcode, bool compressed, const uint8_t *data, size_t len) {
+    uint8_t header[14];
+    size_t headerLen = 2;
+    header[0] = static_cast<uint8_t>(0x80 | (compressed ? 0x40 : 0) | opcode);
+    if (len < 126) {
+        header[1] = static_cast<uint8_t>(0x80 | len);
+    } else if (len <= 0xFFFF) {
+        header[1] = 0x80 | 126;
+        header[2] = static_cast<uint8_t>(len >> 8);
+        header[3] = static_cast<uint8_t>(len);
+        headerLen = 4;
+    } else {
+        header[1] = 0x80 | 127;
+        for (int i = 0; i < 8; ++i) {
+            header[2 + i] = static_cast<uint8_t>(static_cast<uint64_t>(len) >> (56 - 8 * i));
+        }
+        headerLen = 10;
+    }
+    uint8_t *key = header + headerLen;
+    randomBytes(key, 4);
+    headerLen += 4;
+    {
+        std::lock_guard<std::mutex> lock(_sendMutex);
+        if (_closeQueued) {
+            return false;
+        }
+        _closeQueued = opcode == OPCODE_CLOSE;
+        size_t offset = _pending.size();
+        _pending.insert(_pending.end(), header, header + headerLen);
+        _pending.insert(_pending.end(), data, data + len);
+        cocos2d::network::WebSocketUtils::applyMask(_pending.data() + offset + headerLen, len, key);
+    }
+    addBufferedAmount(headerLen + len);
+    EventLoop::getInstance()->wakeup();
+    return true;
+}
+
+// the water marks are checked by WebSocketImpl::dispatchEvents, a crossing only has to schedule one
+void Connection::addBufferedAmount(size_t len) {
+    size_t amount = _bufferedAmount.fetch_add(len, std::memory_order_relaxed) + len;
+    if (_waterMarks->crossed(amount)) {
+        scheduleDispatch();
+    }
+}
+
+void Connection::removeBufferedAmount(size_t len) {
+    size_t amount = _bufferedAmount.fetch_sub(len, std::memory_order_relaxed) - len;
+    if (_waterMarks->crossed(amount)) {
+        scheduleDispatch();
+    }
+}
+
+void Connection::postEvent(Event &&event) {
+    event.postedUs = nowUs();
+    {
+        std::lock_guard<std::mutex> lock(_eventMutex);
+        _events.push_back(std::move(event));
+    }
+    scheduleDispatch();
+}
+
+void Connection::scheduleDispatch() {
+    // at most one pending dispatch per connection, everything posted until it runs is delivered in one pass
+    if (_dispatchScheduled.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    uint64_t handle = _handle;
+    cocos2d::Application::getInstance()->getScheduler()->performFunctionInCocosThread([handle]() {
+        dispatchConnectionEvents(handle);
+    });
+}
+
+bool Connection::update(int64_t now) {
+    if (_phase == Phase::FINISHED) {
+        return false;
+    }
+    if (_aborted.load(std::memory_order_acquire)) {
+        _closeCode = CLOSE_ABNORMAL;
+        _closeReason.clear();
+        finishClosed();
+        return false;
+    }
+    switch (_phase) {
+        case Phase::RESOLVING: {
+            // copied under the lock, the resolver thread writes them
+            bool resolved = false;
+            int resolveError = 0;
+            if (!_resolveStarted) {
+                _deadline = now + CONNECT_TIMEOUT_MS;
+                startResolve();
+            } else {
+                std::lock_guard<std::mutex> lock(_resolveMutex);
+                resolved = _resolved;
+                resolveError = _resolveError;
+                if (resolved) {
+                    _addresses = _resolvedAddresses;
+                    _resolvedAddresses = nullptr;
+                    _nextAddress = _addresses;
+                }
+            }
+            if (_addresses != nullptr) {
+                connectNext(now);
+            } else if (resolved && resolveError != 0) {
+                failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE,
+                               std::string("failed to resolve ") + _url.host + ": " + gai_strerror(resolveError));
+            }
+            break;
+        }
+        case Phase::OPEN: {
+            {
+                std::lock_guard<std::mutex> lock(_sendMutex);
+                if (_closeQueued) {
+                    _phase = Phase::CLOSING;
+                    _deadline = now + CLOSE_TIMEOUT_MS;
+                }
+            }
+            if (_phase == Phase::OPEN && _pingIntervalMs > 0) {
+                updateKeepAlive(now);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if (_phase < Phase::OPEN && now >= _deadline) {
+        failConnection(WebSocket::ErrorCode::TIME_OUT, "connection timed out");
+    } else if (_phase == Phase::CLOSING && now >= _deadline) {
+        finishClosed();
+    }
+    return _phase != Phase::FINISHED;
+}
+
+int64_t Connection::getDeadline() const {
+    if (_phase != Phase::OPEN) {
+        return _deadline;
+    }
+    // the connect deadline is long gone, only the keep-alive timers wake the loop while open
+    if (_pingIntervalMs <= 0) {
+        return 0;
+    }
+    return _pingSentUs != 0 ? _pongDeadline : _nextPingAt;
+}
+
+void Connection::updateKeepAlive(int64_t now) {
+    if (_nextPingAt == 0) {
+        _nextPingAt = now + _pingIntervalMs;
+        return;
+    }
+    if (_pingSentUs != 0) {
+        if (now >= _pongDeadline) {
+            failConnection(WebSocket::ErrorCode::TIME_OUT,
+                           "no pong within " + std::to_string(_deadPeerTimeoutMs) + "ms");
+        }
+        return;
+    }
+    if (now < _nextPingAt) {
+        return;
+    }
+    // the send time is the payload, so the pong identifies the ping it answers
+    uint64_t sentUs = static_cast<uint64_t>(nowUs());
+    uint8_t payload[8];
+    for (int i = 0; i < 8; ++i) {
+        payload[i] = static_cast<uint8_t>(sentUs >> (56 - 8 * i));
+    }
+    if (queueFrame(OPCODE_PING, false, payload, sizeof(payload))) {
+        _pingSentUs = sentUs;
+        _pongDeadline = now + _deadPeerTimeoutMs;
+    }
+    _nextPingAt = now + _pingIntervalMs;
+}
+
+short Connection::getPollEvents() {
+    switch (_phase) {
+        case Phase::RESOLVING:
+        case Phase::FINISHED:
+            return 0;
+        case Phase::CONNECTING:
+            return POLLOUT;
+        case Phase::TLS_HANDSHAKE:
+            return _sslWantsWrite ? POLLOUT : POLLIN;
+        default:
+            break;
+    }
+    bool hasOutput = _outOffset < _out.size() || _sslWantsWrite;
+    if (!hasOutput) {
+        std::lock_guard<std::mutex> lock(_sendMutex);
+        hasOutput = !_pending.empty();
+    }
+    return static_cast<short>(POLLIN | (hasOutput ? POLLOUT : 0));
+}
+
+void Connection::onPoll(short revents, int64_t now) {
+    switch (_phase) {
+        case Phase::CONNECTING:
+            onConnected(now);
+            return;
+        case Phase::TLS_HANDSHAKE:
+            continueTLSHandshake(now);
+            return;
+        case Phase::HTTP_HANDSHAKE:
+        case Phase::OPEN:
+        case Phase::CLOSING:
+            break;
+        default:
+            return;
+    }
+    if (revents & (POLLIN | POLLERR | POLLHUP)) {
+        readAvailable(now);
+    }
+    if (_phase != Phase::FINISHED && !flush()) {
+        onTransportClosed();
+    }
+}
+
+void Connection::startResolve() {
+    _resolveStarted = true;
+    // getaddrinfo blocks, resolve on a short-lived thread so the other connections keep running
+    std::shared_ptr<Connection> self = shared_from_this();
+    std::thread([self]() {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_ADDRCONFIG;
+        addrinfo *result = nullptr;
+        int error = getaddrinfo(self->_url.host.c_str(), self->_url.port.c_str(), &hints, &result);
+        {
+            std::lock_guard<std::mutex> lock(self->_resolveMutex);
+            self->_resolved = true;
+            self->_resolveError = error != 0 ? error : (result == nullptr ? EAI_NONAME : 0);
+            self->_resolvedAddresses = result;
+        }
+        EventLoop::getInstance()->wakeup();
+    }).detach();
+}
+
+void Connection::connectNext(int64_t now) {
+    while (_nextAddress != nullptr) {
+        addrinfo *address = _nextAddress;
+        _nextAddress = _nextAddress->ai_next;
+        closeSocket();
+        _fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (_fd < 0) {
+            continue;
+        }
+        fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+        fcntl(_fd, F_SETFD, FD_CLOEXEC);
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // small game messages must not wait for Nagle
+#ifdef SO_NOSIGPIPE
+        setsockopt(_fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        if (::connect(_fd, address->ai_addr, address->ai_addrlen) == 0) {
+            _phase = Phase::CONNECTING;
+            onConnected(now);
+            return;
+        }
+        if (errno == EINPROGRESS) {
+            _phase = Phase::CONNECTING;
+            return;
+        }
+    }
+    failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "failed to connect to " + _url.host);
+}
+
+void Connection::onConnected(int64_t now) {
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0 || error != 0) {
+        connectNext(now); // try the next address
+        return;
+    }
+    if (!_url.secure) {
+        startHttpHandshake();
+        return;
+    }
+    SSL_CTX *ctx = getSSLContext(_caFilePath, _caFileStamp);
+    if (ctx == nullptr) {
+        failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "no trusted certificates to verify the server with");
+        return;
+    }
+    _ssl = SSL_new(ctx);
+    if (_ssl == nullptr) {
+        failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "failed to create the TLS session");
+        return;
+    }
+    SSL_set_fd(_ssl, _fd);
+    if (isIPAddress(_url.host)) {
+        // SNI carries host names only, IP literals are matched against the iPAddress subject alt names
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(_ssl), _url.host.c_str());
+    } else {
+        SSL_set_tlsext_host_name(_ssl, _url.host.c_str());
+        SSL_set1_host(_ssl, _url.host.c_str());
+    }
+    SSL_set_app_data(_ssl, this);
+    TLSSessionCache *sessions = TLSSessionCache::getInstance();
+    if (!_tlsSessionFile.empty()) {
+        sessions->load(_tlsSessionFile);
+    }
+    if (SSL_SESSION *session = sessions->get(_tlsSessionKey)) {
+        SSL_set_session(_ssl, session);
+    }
+    _tlsStartUs = nowUs();
+    _phase = Phase::TLS_HANDSHAKE;
+    continueTLSHandshake(now);
+}
+
+void Connection::continueTLSHandshake(int64_t /*now*/) {
+    ERR_clear_error();
+    int ret = SSL_connect(_ssl);
+    if (ret == 1) {
+        _sslWantsWrite = false;
+        _handshake.secure = true;
+        _handshake.sessionResumed = SSL_session_reused(_ssl) == 1;
+        // TLS 1.3 always takes one round trip, TLS 1.2 takes two unless abbreviated by resumption
+        _handshake.tlsRoundTrips = (SSL_version(_ssl) >= TLS1_3_VERSION || _handshake.sessionResumed) ? 1 : 2;
+        _handshake.tlsHandshakeTime = static_cast<float>(nowUs() - _tlsStartUs) / 1000.0F;
+        startHttpHandshake();
+        return;
+    }
+    int error = SSL_get_error(_ssl, ret);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        _sslWantsWrite = error == SSL_ERROR_WANT_WRITE;
+        return;
+    }
+    std::string reason = "TLS handshake failed";
+    long verifyResult = SSL_get_verify_result(_ssl);
+    if (verifyResult != X509_V_OK) {
+        reason += std::string(": ") + X509_verify_cert_error_string(verifyResult);
+    } else if (unsigned long sslError = ERR_get_error()) {
+        char buf[256];
+        ERR_error_string_n(sslError, buf, sizeof(buf));
+        reason += std::string(": ") + buf;
+    }
+    failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, reason);
+}
+
+void Connection::startHttpHandshake() {
+    uint8_t nonce[16];
+    randomBytes(nonce, sizeof(nonce));
+    _handshakeKey = base64Encode(nonce, sizeof(nonce));
+
+    std::string request;
+    request.reserve(512);
+    request.append("GET ").append(_url.resource).append(" HTTP/1.1\r\n");
+    request.append("Host: ").append(_url.hostHeader).append("\r\n");
+    request.append("Upgrade: websocket\r\n");
+    request.append("Connection: Upgrade\r\n");
+    request.append("Sec-WebSocket-Key: ").append(_handshakeKey).append("\r\n");
+    request.append("Sec-WebSocket-Version: 13\r\n");
+    if (!_protocols.empty()) {
+        request.append("Sec-WebSocket-Protocol: ").append(_protocols).append("\r\n");
+    }
+    if (_deflate) {
+        request.append("Sec-WebSocket-Extensions: ").append(_deflate->getOffer()).append("\r\n");
+    }
+    request.append("\r\n");
+
+    _phase = Phase::HTTP_HANDSHAKE;
+    _out.assign(request.begin(), request.end());
+    _outOffset = 0;
+    addBufferedAmount(request.size());
+    if (!flush()) {
+        onTransportClosed();
+    }
+}
+
+bool Connection::processHandshakeResponse() {
+    const char *begin = reinterpret_cast<const char *>(_in.data() + _inBegin);
+    const char *end = reinterpret_cast<const char *>(_in.data() + _inEnd);
+    const char *terminator = "\r\n\r\n";
+    const char *headerEnd = std::search(begin, end, terminator, terminator + 4);
+    if (headerEnd == end) {
+        if (_inEnd - _inBegin > MAX_HANDSHAKE_SIZE) {
+            failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "handshake response too large");
+        }
+        return false;
+    }
+    std::string response(begin, headerEnd);
+    _inBegin += response.size() + 4;
+
+    size_t lineEnd = response.find("\r\n");
+    std::string statusLine = response.substr(0, lineEnd);
+    if (statusLine.compare(0, 9, "HTTP/1.1 ") != 0 || statusLine.compare(9, 3, "101") != 0) {
+        failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "unexpected handshake response: " + statusLine);
+        return false;
+    }
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    std::string accept = _handshakeKey + WEBSOCKET_GUID;
+    SHA1(reinterpret_cast<const unsigned char *>(accept.data()), accept.size(), digest);
+    std::string expectedAccept = base64Encode(digest, sizeof(digest));
+
+    bool upgraded = false;
+    bool connectionUpgrade = false;
+    bool accepted = false;
+    std::string protocol;
+    std::string extensions;
+    std::string headers;
+    size_t pos = lineEnd == std::string::npos ? response.size() : lineEnd + 2;
+    while (pos < response.size()) {
+        size_t next = response.find("\r\n", pos);
+        std::string line = response.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+        pos = next == std::string::npos ? response.size() : next + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = toLower(trim(line.substr(0, colon)));
+        std::string value = trim(line.substr(colon + 1));
+        headers.append(line.substr(0, colon)).append(": ").append(value).append("\n");
+        if (name == "upgrade") {
+            upgraded = toLower(value) == "websocket";
+        } else if (name == "connection") {
+            connectionUpgrade = hasToken(value, "upgrade");
+        } else if (name == "sec-websocket-accept") {
+            accepted = value == expectedAccept;
+        } else if (name == "sec-websocket-protocol") {
+            protocol = value;
+        } else if (name == "sec-websocket-extensions") {
+            extensions = extensions.empty() ? value : extensions + ", " + value;
+        }
+    }
+    if (!upgraded || !connectionUpgrade || !accepted) {
+        failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "invalid handshake response");
+        return false;
+    }
+    if (!protocol.empty() && !hasToken(_protocols, toLower(protocol).c_str())) {
+        failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "server selected a protocol which wasn't offered");
+        return false;
+    }
+    if (!extensions.empty() && (!_deflate || !_deflate->accept(extensions))) {
+        failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "server selected an extension which wasn't offered");
+        return false;
+    }
+
+    _phase = Phase::OPEN;
+    Event event;
+    event.type = Event::Type::OPEN;
+    event.text = protocol;
+    event.headers = std::move(headers);
+    event.extensions = _deflate ? _deflate->getExtensions() : "";
+    _handshake.connectTime = static_cast<float>(nowUs() - _startUs) / 1000.0F;
+    event.handshake = _handshake;
+    CCLOG("WebSocket (%s) connected in %.1fms, TLS %.1fms %d RTT%s", _url.host.c_str(), _handshake.connectTime,
+          _handshake.tlsHandshakeTime, _handshake.tlsRoundTrips, _handshake.sessionResumed ? " (resumed)" : "");
+    postEvent(std::move(event));
+    return true;
+}
+
+void Connection::processFrames(int64_t now) {
+    while (_phase == Phase::OPEN || _phase == Phase::CLOSING) {
+        if (_closeReceived) {
+            _inBegin = _inEnd; // nothing may follow the close frame
+            return;
+        }
+        const uint8_t *p = _in.data() + _inBegin;
+        size_t available = _inEnd - _inBegin;
+        if (available < 2) {
+            return;
+        }
+        bool fin = (p[0] & 0x80) != 0;
+        bool rsv1 = (p[0] & 0x40) != 0;
+        uint8_t opcode = p[0] & 0x0F;
+        size_t headerLen = 2;
+        uint64_t len = p[1] & 0x7F;
+        if (len == 126) {
+            headerLen = 4;
+            if (available < headerLen) {
+                return;
+            }
+            len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+        } else if (len == 127) {
+            headerLen = 10;
+            if (available < headerLen) {
+                return;
+            }
+            len = 0;
+            for (int i = 0; i < 8; ++i) {
+                len = (len << 8) | p[2 + i];
+            }
+        }
+        if ((p[1] & 0x80) != 0) {
+            failProtocol(CLOSE_PROTOCOL_ERROR, "masked frame from server");
+            return;
+        }
+        if ((p[0] & 0x30) != 0) {
+            failProtocol(CLOSE_PROTOCOL_ERROR, "reserved bits set");
+            return;
+        }
+        if (len > MAX_MESSAGE_SIZE - _message.size()) {
+            failProtocol(CLOSE_MESSAGE_TOO_BIG, "message too big");
+            return;
+        }
+        if (available - headerLen < len) {
+            return; // wait for the rest of the frame
+        }
+        const uint8_t *payload = p + headerLen;
+        size_t payloadLen = static_cast<size_t>(len);
+        _inBegin += headerLen + payloadLen;
+
+        if (opcode >= OPCODE_CLOSE) {
+            if (!fin || payloadLen > 125 || rsv1) {
+                failProtocol(CLOSE_PROTOCOL_ERROR, "invalid control frame");
+                return;
+            }
+            if (!processControlFrame(opcode, payload, payloadLen, now)) {
+                return;
+            }
+            continue;
+        }
+
+        if (opcode == OPCODE_CONTINUATION) {
+            if (!_inMessage || rsv1) {
+                failProtocol(CLOSE_PROTOCOL_ERROR, "unexpected continuation frame");
+                return;
+            }
+        } else if (opcode == OPCODE_TEXT || opcode == OPCODE_BINARY) {
+            if (_inMessage) {
+                failProtocol(CLOSE_PROTOCOL_ERROR, "expected a continuation frame");
+                return;
+            }
+            if (rsv1 && (!_deflate || !_deflate->isNegotiated())) {
+                failProtocol(CLOSE_PROTOCOL_ERROR, "compressed frame without permessage-deflate");
+                return;
+            }
+            if (fin) {
+                // unfragmented, deliver straight from the read buffer
+                if (!finishMessage(payload, payloadLen, rsv1, opcode)) {
+                    return;
+                }
+                continue;
+            }
+            _inMessage = true;
+            _messageOpcode = opcode;
+            _messageCompressed = rsv1;
+        } else {
+            failProtocol(CLOSE_PROTOCOL_ERROR, "unknown opcode");
+            return;
+        }
+
+        _message.insert(_message.end(), payload, payload + payloadLen);
+        if (fin) {
+            _inMessage = false;
+            bool ok = finishMessage(_message.data(), _message.size(), _messageCompressed, _messageOpcode);
+            _message.clear();
+            if (!ok) {
+                return;
+            }
+        }
+    }
+}
+
+bool Connection::processControlFrame(uint8_t opcode, const uint8_t *payload, size_t len, int64_t now) {
+    switch (opcode) {
+        case OPCODE_PING:
+            queueFrame(OPCODE_PONG, false, payload, len);
+            return true;
+        case OPCODE_PONG:
+            if (_pingSentUs != 0 && len == 8) {
+                uint64_t sentUs = 0;
+                for (size_t i = 0; i < 8; ++i) {
+                    sentUs = (sentUs << 8) | payload[i];
+                }
+                if (sentUs == _pingSentUs) { // unsolicited pongs are ignored
+                    _roundTrips.addSample(static_cast<float>(static_cast<uint64_t>(nowUs()) - sentUs) / 1000.0F);
+                    _pingSentUs = 0;
+                }
+            }
+            return true;
+        case OPCODE_CLOSE: {
+            int code = CLOSE_NO_STATUS;
+            if (len == 1) {
+                failProtocol(CLOSE_PROTOCOL_ERROR, "invalid close frame");
+                return false;
+            }
+            if (len >= 2) {
+                code = (payload[0] << 8) | payload[1];
+                bool valid = (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) ||
+                             (code >= 3000 && code <= 4999);
+                if (!valid) {
+                    failProtocol(CLOSE_PROTOCOL_ERROR, "invalid close code");
+                    return false;
+                }
+                if (!cocos2d::network::WebSocketUtils::isValidUTF8(payload + 2, len - 2)) {
+                    failProtocol(CLOSE_INVALID_PAYLOAD, "invalid close reason");
+                    return false;
+                }
+            }
+            _closeReceived = true;
+            _closeCode = code;
+            _closeReason.assign(reinterpret_cast<const char *>(payload) + (len >= 2 ? 2 : 0), len >= 2 ? len - 2 : 0);
+            close(code == CLOSE_NO_STATUS ? CLOSE_NORMAL : code, ""); // ignored if we already sent ours
+            if (_phase == Phase::OPEN) {
+                _phase = Phase::CLOSING;
+                _deadline = now + CLOSE_TIMEOUT_MS;
+            }
+            return false;
+        }
+        default:
+            failProtocol(CLOSE_PROTOCOL_ERROR, "unknown opcode");
+            return false;
+    }
+}
+
+bool Connection::finishMessage(const uint8_t *payload, size_t len, bool compressed, uint8_t opcode) {
+    bool isBinary = opcode == OPCODE_BINARY;
+    Event event;
+    event.type = Event::Type::MESSAGE;
+    event.isBinary = isBinary;
+    if (compressed) {
+        if (!_deflate->decompress(payload, len, event.data, MAX_MESSAGE_SIZE)) {
+            failProtocol(CLOSE_MESSAGE_TOO_BIG, "failed to decompress message");
+            return false;
+        }
+    } else {
+        event.data.reserve(len + 1);
+        event.data.assign(payload, payload + len);
+    }
+    event.length = event.data.size();
+    if (!isBinary) {
+        if (!cocos2d::network::WebSocketUtils::isValidUTF8(event.data.data(), event.length)) {
+            failProtocol(CLOSE_INVALID_PAYLOAD, "invalid UTF-8 in text message");
+            return false;
+        }
+        event.data.push_back('\0'); // script bindings read text as a C string
+    }
+    if (_deliverOnNetworkThread) {
+        event.postedUs = nowUs();
+        deliverConnectionMessage(_handle, event);
+        return true;
+    }
+    postEvent(std::move(event));
+    return true;
+}
+
+void Connection::readAvailable(int64_t now) {
+    while (_phase == Phase::HTTP_HANDSHAKE || _phase == Phase::OPEN || _phase == Phase::CLOSING) {
+        if (_inBegin == _inEnd) {
+            _inBegin = _inEnd = 0;
+            if (_in.size() > MAX_RETAINED_READ_BUFFER) {
+                std::vector<uint8_t>().swap(_in); // don't keep the memory of one huge message
+            }
+        }
+        if (_in.size() - _inEnd < READ_CHUNK_SIZE) {
+            if (_inBegin > 0) {
+                memmove(_in.data(), _in.data() + _inBegin, _inEnd - _inBegin);
+                _inEnd -= _inBegin;
+                _inBegin = 0;
+            }
+            if (_in.size() - _inEnd < READ_CHUNK_SIZE) {
+                _in.resize(_inEnd + READ_CHUNK_SIZE);
+            }
+        }
+        ssize_t n = readSome(_in.data() + _inEnd, _in.size() - _inEnd);
+        if (n == 0) {
+            return;
+        }
+        if (n < 0) {
+            onTransportClosed();
+            return;
+        }
+        _inEnd += static_cast<size_t>(n);
+        if (_phase == Phase::HTTP_HANDSHAKE && !processHandshakeResponse()) {
+            continue;
+        }
+        processFrames(now);
+    }
+}
+
+bool Connection::flush() {
+    while (true) {
+        if (_outOffset == _out.size()) {
+            _out.clear();
+            _outOffset = 0;
+            std::lock_guard<std::mutex> lock(_sendMutex);
+            if (_pending.empty()) {
+                return true;
+            }
+            _out.swap(_pending);
+        }
+        ssize_t n = writeSome(_out.data() + _outOffset, _out.size() - _outOffset);
+        if (n < 0) {
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        _outOffset += static_cast<size_t>(n);
+        removeBufferedAmount(static_cast<size_t>(n));
+    }
+}
+
+void Connection::onTransportClosed() {
+    if (_phase < Phase::OPEN) {
+        failConnection(WebSocket::ErrorCode::CONNECTION_FAILURE, "connection closed during the handshake");
+    } else if (_closeReceived) {
+        finishClosed();
+    } else {
+        failConnection(WebSocket::ErrorCode::UNKNOWN, "connection lost");
+    }
+}
+
+void Connection::onNewTLSSession(SSL_SESSION *session) {
+    TLSSessionCache::getInstance()->put(_tlsSessionKey, session, !_tlsSessionFile.empty());
+}
+
+int onNewTLSSession(SSL *ssl, SSL_SESSION *session) {
+    auto *connection = static_cast<Connection *>(SSL_get_app_data(ssl));
+    if (connection == nullptr) {
+        return 0;
+    }
+    connection->onNewTLSSession(session);
+    return 1; // the cache took the reference
+}
+
+void Connection::failConnection(WebSocket::ErrorCode code, const std::string &reason) {
+    CCLOG("WebSocket (%s) failed: %s", _url.host.c_str(), reason.c_str());
+    closeSocket();
+    _phase = Phase::FINISHED;
+    Event event;
+    event.type = Event::Type::ERROR;
+    event.code = static_cast<int>(code);
+    event.text = reason;
+    postEvent(std::move(event));
+}
+
+void Connection::failProtocol(int closeCode, const char *reason) {
+    // send our close frame if possible but don't wait for the server, RFC 6455 7.1.7
+    close(closeCode, "");
+    flush();
+    failConnection(WebSocket::ErrorCode::UNKNOWN, reason);
+}
+
+void Connection::finishClosed() {
+    if (_ssl != nullptr) {
+        // OpenSSL marks the session as not resumable when it's freed without close_notify
+        ERR_clear_error();
+        SSL_shutdown(_ssl);
+    }
+    closeSocket();
+    _phase = Phase::FINISHED;
+    Event event;
+    event.type = Event::Type::CLOSED;
+    event.code = _closeCode;
+    event.text = _closeReason;
+    postEvent(std::move(event));
+}
+
+void Connection::closeSocket() {
+    if (_ssl != nullptr) {
+        SSL_free(_ssl);
+        _ssl = nullptr;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+ssize_t Connection::readSome(uint8_t *buf, size_t len) {
+    if (_ssl != nullptr) {
+        ERR_clear_error();
+        int n = SSL_read(_ssl, buf, static_cast<int>(std::min(len, static_cast<size_t>(INT32_MAX))));
+        if (n > 0) {
+            return n;
+        }
+        int error = SSL_get_error(_ssl, n);
+        if (error == SSL_ERROR_WANT_READ) {
+            return 0;
+        }
+        if (error == SSL_ERROR_WANT_WRITE) {
+            _sslWantsWrite = true;
+            return 0;
+        }
+        return -1;
+    }
+    ssize_t n = recv(_fd, buf, len, 0);
+    if (n > 0) {
+        return n;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    return -1;
+}
+
+ssize_t Connection::writeSome(const uint8_t *buf, size_t len) {
+    if (_ssl != nullptr) {
+        ERR_clear_error();
+        _sslWantsWrite = false;
+        int n = SSL_write(_ssl, buf, static_cast<int>(std::min(len, static_cast<size_t>(INT32_MAX))));
+        if (n > 0) {
+            return n;
+        }
+        int error = SSL_get_error(_ssl, n);
+        if (error == SSL_ERROR_WANT_WRITE) {
+            _sslWantsWrite = true;
+            return 0;
+        }
+        return error == SSL_ERROR_WANT_READ ? 0 : -1;
+    }
+    ssize_t n = send(_fd, buf, len, 0);
+    if (n >= 0) {
+        return n;
+    }
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+}
+
+void EventLoop::run() {
+    // a write to a socket reset by the peer must fail with EPIPE instead of killing the process
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+    std::vector<pollfd> fds;
+    std::vector<Connection *> polled;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _connections.insert(_connections.end(), _added.begin(), _added.end());
+            _added.clear();
+        }
+
+        int64_t now = nowMs();
+        int64_t timeout = MAX_POLL_TIMEOUT_MS;
+        fds.clear();
+        polled.clear();
+        fds.push_back({_wakeupPipe[0], POLLIN, 0});
+        polled.push_back(nullptr);
+        for (size_t i = 0; i < _connections.size();) {
+            Connection *connection = _connections[i].get();
+            if (!connection->update(now)) {
+                _connections[i] = std::move(_connections.back());
+                _connections.pop_back();
+                continue;
+            }
+            ++i;
+            if (connection->getDeadline() > 0) {
+                timeout = std::min(timeout, std::max<int64_t>(0, connection->getDeadline() - now));
+            }
+            short events = connection->getPollEvents();
+            if (events != 0 && connection->getFd() >= 0) {
+                fds.push_back({connection->getFd(), events, 0});
+                polled.push_back(connection);
+            }
+        }
+
+        int ret = poll(fds.data(), static_cast<nfds_t>(fds.size()), static_cast<int>(timeout));
+        if (ret < 0 && errno != EINTR) {
+            CCLOGERROR("WebSocket: poll failed, errno: %d", errno);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        if (fds[0].revents != 0) {
+            char buf[64];
+            while (read(_wakeupPipe[0], buf, sizeof(buf)) > 0) {
+            }
+            _wakeupPending.store(false, std::memory_order_release);
+        }
+        now = nowMs();
+        for (size_t i = 1; i < fds.size(); ++i) {
+            // also called without events, so data queued since the last poll gets written right away
+            polled[i]->onPoll(fds[i].revents, now);
+        }
+    }
+}
+
+} // namespace
+
+class WebSocketImpl final {
+public:
+    static cocos2d::network::WebSocketUtils::HandleTable<WebSocketImpl> allConnections;
+    using Pin = cocos2d::network::WebSocketUtils::HandleTable<WebSocketImpl>::Pin;
+
+    static void closeAllConnections();
+
+    explicit WebSocketImpl(cocos2d::network::WebSocket *websocket);
+    ~WebSocketImpl();
+
+    bool init(const cocos2d::network::WebSocket::Delegate &delegate,
+              const std::string &url,
+              const std::vector<std::string> *protocols,
+              const std::string &caFilePath,
+              const cocos2d::network::WebSocket::Options &options);
+
+    void send(const std::string &message);
+    void send(const unsigned char *binaryMsg, unsigned int len);
+    void sendBatch(const WebSocket::OutgoingMessage *messages, size_t count);
+    void close();
+    void closeAsync();
+    void closeAsync(int code, const std::string &reason);
+    cocos2d::network::WebSocket::State getReadyState() const { return _readyState; }
+    const std::string &getUrl() const { return _url; }
+    const std::string &getProtocol() const { return _selectedProtocol; }
+    const cocos2d::network::WebSocket::HandshakeInfo &getHandshakeInfo() const { return _handshakeInfo; }
+    cocos2d::network::WebSocket::Delegate *getDelegate() const { return _delegate; }
+
+    size_t getBufferedAmount() const { return _connection ? _connection->getBufferedAmount() : 0; }
+    WebSocket::RoundTripTime getRoundTripTime() const {
+        return _connection ? _connection->getRoundTripTime() : WebSocket::RoundTripTime();
+    }
+    WebSocket::Metrics getMetrics() const { return _metrics.snapshot(); }
+    std::string getExtensions() const { return _extensions; }
+    std::string getResponseHeader(const std::string &name) const { return _responseHeaders.get(name); }
+
+    void dispatchEvents();
+    // network thread with MessageDelivery::TRANSPORT_THREAD, game thread otherwise
+    void deliverMessage(Event &event);
+
+private:
+    void checkWaterMarks();
+    void onOpen(Event &event);
+    void onMessage(Event &event);
+    void onClose();
+    void onError(int code);
+
+    void connect();
+    bool shouldReconnect() const;
+    void scheduleReconnect();
+    bool queueMessage(const uint8_t *data, size_t len, bool isBinary);
+    void replayQueuedMessages();
+    void sendMessage(const uint8_t *data, size_t len, bool isBinary);
+
+    WebSocket *_socket{nullptr};
+    WebSocket::Delegate *_delegate{nullptr};
+    std::shared_ptr<Connection> _connection;
+    ParsedUrl _parsedUrl;
+    std::string _caFilePath;
+    WebSocket::Options _options;
+    uint64_t _handle{0};
+    std::string _protocolString;
+    std::string _selectedProtocol;
+    std::string _url;
+    std::string _extensions;
+    cocos2d::network::WebSocketUtils::HeaderBlock _responseHeaders;
+    WebSocket::HandshakeInfo _handshakeInfo;
+    WebSocket::State _readyState{WebSocket::State::CONNECTING};
+    cocos2d::network::WebSocketUtils::MetricsRecorder _metrics;
+    std::shared_ptr<cocos2d::network::WebSocketUtils::WaterMarks> _waterMarks{
+        std::make_shared<cocos2d::network::WebSocketUtils::WaterMarks>()};
+    bool *_destroyed{nullptr}; // set while dispatching, a delegate may delete the WebSocket in its callback
+
+    int _reconnectAttempt{0};
+    bool _reconnectScheduled{false};
+    bool _closeRequested{false}; // set by close(), the connection is never reopened afterwards
+    std::deque<QueuedMessage> _sendQueue;
+    size_t _queuedBytes{0};
+};
+
+cocos2d::network::WebSocketUtils::HandleTable<WebSocketImpl> WebSocketImpl::allConnections;
+
+namespace {
+void dispatchConnectionEvents(uint64_t handle) {
+    WebSocketImpl *ws = WebSocketImpl::allConnections.get(handle);
+    if (ws != nullptr) {
+        ws->dispatchEvents();
+    }
+}
+
+void deliverConnectionMessage(uint64_t handle, Event &event) {
+    // the destructor of the WebSocketImpl waits for the pin, so it can't be destroyed during onMessage
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, handle);
+    WebSocketImpl *ws = pin.get();
+    if (ws != nullptr) {
+        ws->deliverMessage(event);
+    }
+}
+} // namespace
+
+void WebSocketImpl::closeAllConnections() {
+    for (uint64_t handle : allConnections.getHandles()) {
+        WebSocketImpl *ws = allConnections.get(handle);
+        if (ws != nullptr) {
+            ws->closeAsync();
+        }
+    }
+}
+
+WebSocketImpl::WebSocketImpl(WebSocket *websocket) : _socket(websocket) {
+    _handle = allConnections.add(this);
+}
+
+WebSocketImpl::~WebSocketImpl() {
+    if (_destroyed != nullptr) {
+        *_destroyed = true;
+    }
+    if (_reconnectScheduled) {
+        cocos2d::Application::getInstance()->getScheduler()->unschedule(RECONNECT_SCHEDULER_KEY, this);
+    }
+    if (_connection) {
+        // events still posted for this handle are dropped by dispatchConnectionEvents
+        _connection->abort();
+        _connection.reset();
+    }
+    allConnections.remove(_handle);
+}
+
+bool WebSocketImpl::init(const cocos2d::network::WebSocket::Delegate &delegate, const std::string &url,
+                         const std::vector<std::string> *protocols, const std::string &caFilePath,
+                         const cocos2d::network::WebSocket::Options &options) {
+    ParsedUrl parsedUrl;
+    if (!parseUrl(url, parsedUrl)) {
+        CCLOGERROR("WebSocketImpl::init invalid url: %s", url.c_str());
+        return false;
+    }
+    _url = url;
+    _delegate = const_cast<WebSocket::Delegate *>(&delegate);
+    if (protocols != nullptr && !protocols->empty()) {
+        auto it = protocols->begin();
+        while (it != protocols->end()) {
+            _protocolString.append(*it++);
+            if (it != protocols->end()) {
+                _protocolString.append(", ");
+            }
+        }
+    }
+    _parsedUrl = parsedUrl;
+    _caFilePath = caFilePath;
+    _options = options;
+    _waterMarks->init(options.bufferedAmountHighWaterMark, options.bufferedAmountLowWaterMark);
+    connect();
+    return true;
+}
+
+void WebSocketImpl::connect() {
+    // a new connection per attempt, the SSL_CTX and the TLS sessions are shared
+    _connection = std::make_shared<Connection>(_handle, _parsedUrl, _protocolString, _caFilePath, _options,
+                                               _waterMarks);
+    EventLoop::getInstance()->add(_connection);
+    _readyState = WebSocket::State::CONNECTING;
+}
+
+bool WebSocketImpl::shouldReconnect() const {
+    const WebSocket::ReconnectPolicy &policy = _options.reconnect;
+    return policy.enabled && !_closeRequested && (policy.maxAttempts <= 0 || _reconnectAttempt < policy.maxAttempts);
+}
+
+void WebSocketImpl::scheduleReconnect() {
+    ++_reconnectAttempt;
+    _metrics.onReconnect();
+    float delay = cocos2d::network::WebSocketUtils::getReconnectDelay(_options.reconnect, _reconnectAttempt);
+    _readyState = WebSocket::State::CONNECTING;
+    _reconnectScheduled = true;
+    uint64_t handle = _handle;
+    cocos2d::Application::getInstance()->getScheduler()->schedule([handle](float /*dt*/) {
+        WebSocketImpl *ws = allConnections.get(handle);
+        if (ws != nullptr) {
+            ws->_reconnectScheduled = false;
+            ws->connect();
+        }
+    }, this, 0, 0, delay, false, RECONNECT_SCHEDULER_KEY);
+    CCLOG("WebSocket (%s) reconnecting in %.2fs, attempt %d", _url.c_str(), delay, _reconnectAttempt);
+    _delegate->onReconnecting(_socket, _reconnectAttempt, delay);
+}
+
+bool WebSocketImpl::queueMessage(const uint8_t *data, size_t len, bool isBinary) {
+    if (!_options.reconnect.enabled || _closeRequested || _readyState != WebSocket::State::CONNECTING) {
+        return false;
+    }
+    if (_queuedBytes + len > _options.reconnect.maxQueuedBytes) {
+        CCLOGWARN("WebSocket (%s) send queue is full, %u bytes dropped", _url.c_str(), static_cast<unsigned>(len));
+        return false;
+    }
+    QueuedMessage message;
+    message.data.assign(data, data + len);
+    message.isBinary = isBinary;
+    _sendQueue.push_back(std::move(message));
+    _queuedBytes += len;
+    return true;
+}
+
+void WebSocketImpl::replayQueuedMessages() {
+    std::deque<QueuedMessage> queue;
+    queue.swap(_sendQueue);
+    _queuedBytes = 0;
+    for (auto &message : queue) {
+        sendMessage(message.data.data(), message.data.size(), message.isBinary);
+    }
+}
+
+void WebSocketImpl::sendMessage(const uint8_t *data, size_t len, bool isBinary) {
+    if (_connection->sendMessage(data, len, isBinary)) {
+        _metrics.onMessageSent(len, isBinary);
+    }
+}
+
+void WebSocketImpl::send(const std::string &message) {
+    const auto *data = reinterpret_cast<const uint8_t *>(message.data());
+    if (_readyState == WebSocket::State::OPEN) {
+        sendMessage(data, message.length(), false);
+    } else if (!queueMessage(data, message.length(), false)) {
+        CCLOG("Couldn't send message since WebSocket wasn't opened!");
+    }
+}
+
+void WebSocketImpl::send(const unsigned char *binaryMsg, unsigned int len) {
+    if (_readyState == WebSocket::State::OPEN) {
+        sendMessage(binaryMsg, len, true);
+    } else if (!queueMessage(binaryMsg, len, true)) {
+        CCLOG("Couldn't send message since WebSocket wasn't opened!");
+    }
+}
+
+void WebSocketImpl::sendBatch(const WebSocket::OutgoingMessage *messages, size_t count) {
+    // nothing to amortize here, frames are queued directly and the wakeups of the network thread coalesce
+    for (size_t i = 0; i < count; ++i) {
+        const WebSocket::OutgoingMessage &message = messages[i];
+        if (_readyState == WebSocket::State::OPEN) {
+            sendMessage(message.data, message.len, message.isBinary);
+        } else if (!queueMessage(message.data, message.len, message.isBinary)) {
+            CCLOG("Couldn't send message since WebSocket wasn't opened!");
+        }
+    }
+}
+
+void WebSocketImpl::close() {
+    closeAsync(); // the closing handshake always completes on the network thread
+}
+
+void WebSocketImpl::closeAsync() {
+    closeAsync(CLOSE_NORMAL, "normal closure");
+}
+
+void WebSocketImpl::closeAsync(int code, const std::string &reason) {
+    if (_readyState == WebSocket::State::CLOSED || _readyState == WebSocket::State::CLOSING) {
+        CCLOGERROR("close: WebSocket (%p) was closed, no need to close it again!", this);
+        return;
+    }
+    _closeRequested = true;
+    _sendQueue.clear();
+    _queuedBytes = 0;
+    if (_reconnectScheduled) {
+        // no connection between two attempts, report the close asynchronously like a connection would
+        _reconnectScheduled = false;
+        _readyState = WebSocket::State::CLOSING;
+        cocos2d::Application::getInstance()->getScheduler()->unschedule(RECONNECT_SCHEDULER_KEY, this);
+        uint64_t handle = _handle;
+        cocos2d::Application::getInstance()->getScheduler()->performFunctionInCocosThread([handle]() {
+            WebSocketImpl *ws = allConnections.get(handle);
+            if (ws != nullptr) {
+                ws->onClose();
+            }
+        });
+        return;
+    }
+    if (_connection) {
+        if (_readyState == WebSocket::State::OPEN) {
+            _connection->close(code, reason);
+        } else {
+            _connection->abort();
+        }
+    }
+    _readyState = WebSocket::State::CLOSING;
+}
+
+void WebSocketImpl::dispatchEvents() {
+    std::vector<Event> events;
+    _connection->takeEvents(events);
+
+    bool destroyed = false;
+    _destroyed = &destroyed;
+    for (auto &event : events) {
+        switch (event.type) {
+            case Event::Type::OPEN:
+                onOpen(event);
+                break;
+            case Event::Type::MESSAGE:
+                onMessage(event);
+                break;
+            case Event::Type::CLOSED:
+                onClose();
+                break;
+            case Event::Type::ERROR:
+                onError(event.code);
+                break;
+        }
+        if (destroyed) {
+            return;
+        }
+    }
+    checkWaterMarks();
+    if (destroyed) {
+        return;
+    }
+    _destroyed = nullptr;
+}
+
+void WebSocketImpl::checkWaterMarks() {
+    size_t amount = getBufferedAmount();
+    switch (_waterMarks->update(amount)) {
+        case cocos2d::network::WebSocketUtils::WaterMarks::Crossing::HIGH:
+            _delegate->onBufferedAmountHigh(_socket, amount);
+            break;
+        case cocos2d::network::WebSocketUtils::WaterMarks::Crossing::LOW:
+            _delegate->onBufferedAmountLow(_socket, amount);
+            break;
+        case cocos2d::network::WebSocketUtils::WaterMarks::Crossing::NONE:
+            break;
+    }
+}
+
+void WebSocketImpl::onOpen(Event &event) {
+    _selectedProtocol = event.text;
+    _extensions = event.extensions;
+    _handshakeInfo = event.handshake;
+    _responseHeaders.assign(std::move(event.headers));
+    if (_readyState == WebSocket::State::CONNECTING) {
+        _readyState = WebSocket::State::OPEN;
+        _reconnectAttempt = 0;
+        _metrics.onOpen(static_cast<int64_t>(_handshakeInfo.connectTime * 1000));
+        // messages sent while connecting go out before anything sent from onOpen
+        replayQueuedMessages();
+        _delegate->onOpen(_socket);
+    }
+}
+
+void WebSocketImpl::onMessage(Event &event) {
+    if (_readyState == WebSocket::State::CLOSED) {
+        return;
+    }
+    deliverMessage(event);
+}
+
+void WebSocketImpl::deliverMessage(Event &event) {
+    _metrics.onMessageReceived(event.length, nowUs() - event.postedUs);
+    WebSocket::Data data;
+    data.bytes = reinterpret_cast<char *>(event.data.data());
+    data.len = static_cast<ssize_t>(event.length);
+    data.isBinary = event.isBinary;
+    _delegate->onMessage(_socket, data);
+}
+
+void WebSocketImpl::onClose() {
+    if (_readyState != WebSocket::State::CLOSED && shouldReconnect()) {
+        scheduleReconnect();
+        return;
+    }
+    _sendQueue.clear();
+    _queuedBytes = 0;
+    _readyState = WebSocket::State::CLOSED;
+    _delegate->onClose(_socket);
+}
+
+void WebSocketImpl::onError(int code) {
+    if (_readyState != WebSocket::State::CLOSED && shouldReconnect()) {
+        scheduleReconnect();
+        return;
+    }
+    if (_readyState != WebSocket::State::CLOSED) {
+        _readyState = WebSocket::State::CLOSED;
+        bool *destroyed = _destroyed;
+        _delegate->onError(_socket, static_cast<WebSocket::ErrorCode>(code));
+        if (destroyed != nullptr && *destroyed) {
+            return;
+        }
+    }
+    onClose();
+}
+
+namespace cocos2d {
+namespace network {
+/*static*/
+void WebSocket::closeAllConnections() {
+    WebSocketImpl::closeAllConnections();
+}
+
+/*static*/
+void WebSocket::preloadCAFile(const std::string &caFilePath) {
+    int64_t stamp = getCAFileStamp(caFilePath);
+    std::thread([caFilePath, stamp]() {
+        getSSLContext(caFilePath, stamp);
+    }).detach();
+}
+
+/*static*/
+WebSocket::Metrics WebSocket::getGlobalMetrics() {
+    return WebSocketUtils::MetricsRecorder::getGlobal().snapshot();
+}
+
+WebSocket::WebSocket() {
+    _impl = new WebSocketImpl(this);
+}
+
+WebSocket::~WebSocket() {
+    delete _impl;
+}
+
+bool WebSocket::init(const Delegate &delegate,
+                     const std::string &url,
+                     const std::vector<std::string> *protocols /* = nullptr*/,
+                     const std::string &caFilePath /* = ""*/) {
+    return _impl->init(delegate, url, protocols, caFilePath, Options());
+}
+
+bool WebSocket::init(const Delegate &delegate,
+                     const std::string &url,
+                     const std::vector<std::string> *protocols,
+                     const std::string &caFilePath,
+                     const Options &options) {
+    return _impl->init(delegate, url, protocols, caFilePath, options);
+}
+
+void WebSocket::send(const std::string &message) {
+    _impl->send(message);
+}
+
+void WebSocket::send(const unsigned char *binaryMsg, unsigned int len) {
+    _impl->send(binaryMsg, len);
+}
+
+void WebSocket::sendBatch(const OutgoingMessage *messages, size_t count) {
+    _impl->sendBatch(messages, count);
+}
+
+void WebSocket::close() {
+    _impl->close();
+}
+
+void WebSocket::closeAsync() {
+    _impl->closeAsync();
+}
+
+void WebSocket::closeAsync(int code, const std::string &reason) {
+    _impl->closeAsync(code, reason);
+}
+
+WebSocket::State WebSocket::getReadyState() const {
+    return _impl->getReadyState();
+}
+
+std::string WebSocket::getResponseHeader(const std::string &name) const {
+    return _impl->getResponseHeader(name);
+}
+
+std::string WebSocket::getExtensions() const {
+    return _impl->getExtensions();
+}
+
+size_t WebSocket::getBufferedAmount() const {
+    return _impl->getBufferedAmount();
+}
+
+const std::string &WebSocket::getUrl() const {
+    return _impl->getUrl();
+}
+
+const std::string &WebSocket::getProtocol() const {
+    return _impl->getProtocol();
+}
+
+const WebSocket::HandshakeInfo &WebSocket::getHandshakeInfo() const {
+    return _impl->getHandshakeInfo();
+}
+
+WebSocket::RoundTripTime WebSocket::getRoundTripTime() const {
+    return _impl->getRoundTripTime();
+}
+
+WebSocket::Metrics WebSocket::getMetrics() const {
+    return _impl->getMetrics();
+}
+
+WebSocket::Delegate *WebSocket::getDelegate() const {
+    return _impl->getDelegate();
+}
+
+} // namespace network
+} // namespace cocos2d
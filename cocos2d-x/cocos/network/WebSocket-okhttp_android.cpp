@@ -7,9 +7,19 @@
  */
 
 //#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
 #include "WebSocket.h"
+#include "WebSocketUtils.h"
 #include "../platform/CCPlatformConfig.h"
  #include "../base/ccMacros.h"
+#include "../base/CCScheduler.h"
+#include "../platform/CCApplication.h"
 #include "../platform/CCPlatformDefine.h"
 #include "../platform/android/jni/JniHelper.h"
 #include "../base/ccUTF8.h"
@@ -19,45 +29,252 @@
 #ifdef JAVA_CLASS_WEBSOCKET
     #error "JAVA_CLASS_WEBSOCKET is already defined"
 #endif
-#ifdef HANDLE_TO_WS_OKHTTP3
-    #error "HANDLE_TO_WS_OKHTTP3 is already defined"
-#endif
 
 #define JAVA_CLASS_WEBSOCKET "org/cocos2dx/lib/websocket/CocosWebSocket"
-#define HANDLE_TO_WS_OKHTTP3(handler) \
-    reinterpret_cast<WebSocketImpl *>(static_cast<uintptr_t>(handler))
 
 namespace {
-//NOLINTNEXTLINE
-void split_string(const std::string &s, std::vector<std::string> &v, const std::string &c) {
-    v.clear();
-    std::string::size_type pos1;
-    std::string::size_type pos2;
-    pos2 = s.find(c);
-    pos1 = 0;
-    while (std::string::npos != pos2) {
-        v.push_back(s.substr(pos1, pos2 - pos1));
+const char *RECONNECT_SCHEDULER_KEY = "WebSocketReconnect";
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// JNI handles of CocosWebSocket, pinned once by JNI_PATH(NativeInit) when the Java class is initialized
+struct JavaWebSocketClass {
+    jclass clazz{nullptr};
+    jclass stringClass{nullptr};
+    jmethodID ctorID{nullptr};
+    jmethodID connectID{nullptr};
+    jmethodID sendBufferID{nullptr};
+    jmethodID sendStringID{nullptr};
+    jmethodID sendBatchID{nullptr};
+    jmethodID closeID{nullptr};
+    jmethodID removeHandlerID{nullptr};
+};
+JavaWebSocketClass javaWebSocket;
+
+const char *ctorSignature = "(J[Ljava/lang/String;ZJZJJ)V";
 
-        pos1 = pos2 + c.size();
-        pos2 = s.find(c, pos1);
+bool loadJavaWebSocketClass() {
+    if (javaWebSocket.clazz != nullptr) {
+        return true;
     }
-    if (pos1 != s.length()) {
-        v.push_back(s.substr(pos1));
+    // GetMethodID initializes the class, its static block invokes NativeInit which fills javaWebSocket
+    cocos2d::JniMethodInfo t;
+    if (!cocos2d::JniHelper::getCachedMethodInfo(t, JAVA_CLASS_WEBSOCKET, "<init>", ctorSignature)) {
+        return false;
     }
+    return javaWebSocket.clazz != nullptr;
 }
+
+// Native memory handed to Java as a direct ByteBuffer, so an inbound binary frame is written once by Java
+// and read in place by native code. The payload follows the header in the same allocation.
+struct ReceiveBuffer {
+    jobject byteBuffer{nullptr}; // global ref of the direct ByteBuffer wrapping payload()
+    size_t capacity{0};
+
+    uint8_t *payload() { return reinterpret_cast<uint8_t *>(this + 1); }
+    static ReceiveBuffer *fromPayload(void *payload) { return static_cast<ReceiveBuffer *>(payload) - 1; }
+};
+
+// Process-wide pool of ReceiveBuffer with power-of-two size classes. Buffers are acquired on the OkHttp
+// reader thread and released on the thread which dispatched the message.
+class ReceiveBufferPool {
+public:
+    static constexpr size_t MIN_SIZE_SHIFT = 12;   // 4 KB
+    static constexpr size_t MAX_SIZE_SHIFT = 22;   // 4 MB, larger buffers are not pooled
+    static constexpr size_t MAX_FREE_PER_CLASS = 8;
+
+    ReceiveBuffer *acquire(JNIEnv *env, size_t size) {
+        size_t sizeClass = classOf(size);
+        if (sizeClass <= MAX_SIZE_SHIFT) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto &freeList = _free[sizeClass - MIN_SIZE_SHIFT];
+            if (!freeList.empty()) {
+                ReceiveBuffer *buffer = freeList.back();
+                freeList.pop_back();
+                return buffer;
+            }
+        }
+        size_t capacity = sizeClass <= MAX_SIZE_SHIFT ? (static_cast<size_t>(1) << sizeClass) : size;
+        void *memory = malloc(sizeof(ReceiveBuffer) + capacity);
+        if (memory == nullptr) {
+            return nullptr;
+        }
+        auto *buffer = new (memory) ReceiveBuffer();
+        buffer->capacity = capacity;
+        jobject byteBuffer = env->NewDirectByteBuffer(buffer->payload(), static_cast<jlong>(capacity));
+        if (byteBuffer == nullptr) {
+            env->ExceptionClear();
+            free(memory);
+            return nullptr;
+        }
+        buffer->byteBuffer = env->NewGlobalRef(byteBuffer);
+        env->DeleteLocalRef(byteBuffer);
+        return buffer;
+    }
+
+    void release(JNIEnv *env, ReceiveBuffer *buffer) {
+        size_t sizeClass = classOf(buffer->capacity);
+        if (sizeClass <= MAX_SIZE_SHIFT && (static_cast<size_t>(1) << sizeClass) == buffer->capacity) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto &freeList = _free[sizeClass - MIN_SIZE_SHIFT];
+            if (freeList.size() < MAX_FREE_PER_CLASS) {
+                freeList.push_back(buffer);
+                return;
+            }
+        }
+        env->DeleteGlobalRef(buffer->byteBuffer);
+        buffer->~ReceiveBuffer();
+        free(buffer);
+    }
+
+private:
+    static size_t classOf(size_t size) {
+        size_t shift = MIN_SIZE_SHIFT;
+        while (shift <= MAX_SIZE_SHIFT && (static_cast<size_t>(1) << shift) < size) {
+            ++shift;
+        }
+        return shift;
+    }
+
+    std::mutex _mutex;
+    std::vector<ReceiveBuffer *> _free[MAX_SIZE_SHIFT - MIN_SIZE_SHIFT + 1];
+};
+ReceiveBufferPool receiveBufferPool;
+
+// Outbound binary messages are staged in native memory wrapped by a direct ByteBuffer which is reused for
+// every send. Java copies the bytes into the frame synchronously, so a single buffer per connection suffices.
+class SendBuffer {
+public:
+    static constexpr size_t MIN_CAPACITY = 4096;
+
+    // every (re)allocation is counted in Metrics::sendBufferAllocations
+    explicit SendBuffer(cocos2d::network::WebSocketUtils::MetricsRecorder &metrics) : _metrics(metrics) {}
+    ~SendBuffer() { CC_ASSERT(_byteBuffer == nullptr); }
+
+    jobject prepare(JNIEnv *env, const uint8_t *data, size_t len) {
+        jobject byteBuffer = reserve(env, len);
+        if (byteBuffer != nullptr) {
+            memcpy(_data.get(), data, len);
+        }
+        return byteBuffer;
+    }
+
+    // makes room for len bytes, which the caller writes to data()
+    jobject reserve(JNIEnv *env, size_t len) {
+        if (len > _capacity || _byteBuffer == nullptr) {
+            size_t capacity = _capacity > MIN_CAPACITY ? _capacity : MIN_CAPACITY;
+            while (capacity < len) {
+                capacity <<= 1;
+            }
+            reset(env);
+            _data.reset(new (std::nothrow) uint8_t[capacity]);
+            if (!_data) {
+                return nullptr;
+            }
+            jobject byteBuffer = env->NewDirectByteBuffer(_data.get(), static_cast<jlong>(capacity));
+            if (byteBuffer == nullptr) {
+                env->ExceptionClear();
+                _data.reset();
+                return nullptr;
+            }
+            _byteBuffer = env->NewGlobalRef(byteBuffer);
+            env->DeleteLocalRef(byteBuffer);
+            _capacity = capacity;
+            _metrics.onSendBufferAllocation();
+        }
+        return _byteBuffer;
+    }
+
+    uint8_t *data() const { return _data.get(); }
+
+    void reset(JNIEnv *env) {
+        if (_byteBuffer != nullptr) {
+            env->DeleteGlobalRef(_byteBuffer);
+            _byteBuffer = nullptr;
+        }
+        _data.reset();
+        _capacity = 0;
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> _data;
+    size_t _capacity{0};
+    jobject _byteBuffer{nullptr};
+    cocos2d::network::WebSocketUtils::MetricsRecorder &_metrics;
+};
+
+// Lock-free single-producer/single-consumer ring, the producer is the OkHttp reader thread and the
+// consumer is the game thread.
+template <typename T, size_t Capacity>
+class SPSCQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool push(T &&item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        _items[tail & (Capacity - 1)] = std::move(item);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(_items[head & (Capacity - 1)]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T _items[Capacity];
+    std::atomic<size_t> _head{0};
+    char _padding[64]; // keep producer and consumer indices on different cache lines
+    std::atomic<size_t> _tail{0};
+};
+
+struct InboundMessage {
+    std::string data;               // payload when no pooled buffer was available
+    ReceiveBuffer *buffer{nullptr}; // payload written by Java (UTF-8 for text), released after dispatch
+    size_t length{0};
+    bool isBinary{false};
+    int64_t receivedUs{0}; // when the OkHttp reader handed it over
+};
+
+struct ControlEvent {
+    enum class Type {
+        OPEN,
+        CLOSED,
+        ERROR
+    };
+    Type type;
+    int code{0};
+    std::string text;    // protocol for OPEN, reason otherwise
+    std::string headers; // OPEN only
+    cocos2d::network::WebSocket::HandshakeInfo handshake; // OPEN only
+};
+
+// message sent while reconnecting, replayed once the connection is open again
+struct QueuedMessage {
+    std::string data;
+    bool isBinary{false};
+};
 } // namespace
 
 using cocos2d::network::WebSocket;
 class WebSocketImpl final {
 public:
-    static const char *connectID;
-    static const char *removeHandlerID;
-    static const char *sendBinaryID;
-    static const char *sendStringID;
-    static const char *closeID;
-    static const char *getBufferedAmountID;
-    static std::atomic_int64_t idGenerator;
-    static std::unordered_map<int64_t, WebSocketImpl *> allConnections;
+    // Java refers to a WebSocketImpl by its handle in this table, callbacks pin it while they use the object
+    static cocos2d::network::WebSocketUtils::HandleTable<WebSocketImpl> allConnections;
+    using Pin = cocos2d::network::WebSocketUtils::HandleTable<WebSocketImpl>::Pin;
 
     static void closeAllConnections();
 
@@ -66,78 +283,155 @@ public:
 
     bool init(const cocos2d::network::WebSocket::Delegate &delegate,
               const std::string &url,
-              const std::vector<std::string> *protocols = nullptr,
-              const std::string &caFilePath = "");
+              const std::vector<std::string> *protocols,
+              const std::string &caFilePath,
+              const cocos2d::network::WebSocket::Options &options);
 
     void send(const std::string &message);
     void send(const unsigned char *binaryMsg, unsigned int len);
+    void sendBatch(const WebSocket::OutgoingMessage *messages, size_t count);
     void close();
     void closeAsync();
     void closeAsync(int code, const std::string &reason);
     cocos2d::network::WebSocket::State getReadyState() const { return _readyState; }
     const std::string &getUrl() const { return _url; }
     const std::string &getProtocol() const { return _protocolString; }
+    const cocos2d::network::WebSocket::HandshakeInfo &getHandshakeInfo() const { return _handshakeInfo; }
     cocos2d::network::WebSocket::Delegate *getDelegate() const { return _delegate; }
 
-    size_t getBufferedAmount() const;
-    std::string getExtensions() const { return _extensions; }
+    // the size of the OkHttp send queue, pushed by CocosWebSocket on every send and once the writer drained it
+    size_t getBufferedAmount() const { return _bufferedAmount.load(std::memory_order_relaxed); }
+    void updateBufferedAmount(size_t amount);
+    std::string getExtensions() const { return _responseHeaders.get("Sec-WebSocket-Extensions"); }
+    std::string getResponseHeader(const std::string &name) const { return _responseHeaders.get(name); }
+    WebSocket::RoundTripTime getRoundTripTime() const { return _roundTrips.get(); }
+    // called from the keep-alive thread of CocosWebSocket
+    void addRoundTrip(float rtt) { _roundTrips.addSample(rtt); }
+    WebSocket::Metrics getMetrics() const { return _metrics.snapshot(); }
 
-    void onOpen(const std::string &protocol, const std::string &headers);
+    // called from OkHttp threads, events are queued and delivered on the game thread once per frame
+    void enqueueMessage(InboundMessage &&message);
+    void enqueueControlEvent(ControlEvent &&event);
+
+    void onOpen(const std::string &protocol, std::string &&headers,
+                const cocos2d::network::WebSocket::HandshakeInfo &handshake);
     void onClose(int code, const std::string &reason, bool wasClean);
     void onError(int code, const std::string &reason);
-    void onStringMessage(const std::string &message);
+    void onStringMessage(const char *message, size_t len);
     void onBinaryMessage(const uint8_t *buf, size_t len);
 
 private:
+    void connect();
+    bool shouldReconnect() const;
+    void scheduleReconnect();
+    void reconnect();
+    bool queueMessage(const uint8_t *data, size_t len, bool isBinary);
+    void replayQueuedMessages();
+    void sendBinary(const unsigned char *binaryMsg, unsigned int len);
+
+    void scheduleDispatch();
+    void dispatchEvents();
+    bool popMessage(InboundMessage &message);
+    void deliverMessage(InboundMessage &message);
+    void checkWaterMarks();
+
     WebSocket *_socket{nullptr};
     WebSocket::Delegate *_delegate{nullptr};
     jobject _javaSocket{nullptr};
-    int64_t _identifier{0};
+    uint64_t _handle{0};
     std::string _protocolString;
     std::string _selectedProtocol;
     std::string _url;
-    std::string _extensions;
+    std::string _caFilePath;
+    WebSocket::HandshakeInfo _handshakeInfo;
+    cocos2d::network::WebSocketUtils::RoundTripEstimator _roundTrips;
+    cocos2d::network::WebSocketUtils::MetricsRecorder _metrics;
     WebSocket::State _readyState{WebSocket::State::CONNECTING};
-    std::unordered_map<std::string, std::string> _headerMap{};
+    cocos2d::network::WebSocketUtils::HeaderBlock _responseHeaders;
+    SendBuffer _sendBuffer{_metrics};
+
+    WebSocket::ReconnectPolicy _reconnectPolicy;
+    int _reconnectAttempt{0};
+    bool _reconnectScheduled{false};
+    bool _closeRequested{false}; // set by close(), the connection is never reopened afterwards
+    std::deque<QueuedMessage> _sendQueue;
+    size_t _queuedBytes{0};
+
+    bool _deliverOnTransportThread{false}; // Options::messageDelivery, set before Java can call back
+    std::atomic<size_t> _bufferedAmount{0};
+    cocos2d::network::WebSocketUtils::WaterMarks _waterMarks;
+    SPSCQueue<InboundMessage, 512> _inbound;
+    // messages which didn't fit into _inbound, _overflowing stays set until it's drained to keep the order
+    std::deque<InboundMessage> _overflow;
+    std::mutex _overflowMutex;
+    std::atomic<bool> _overflowing{false};
+    std::vector<ControlEvent> _controlEvents;
+    std::mutex _controlMutex;
+    std::atomic<bool> _dispatchScheduled{false};
+    bool *_destroyed{nullptr}; // set while dispatching, a delegate may delete the WebSocket in its callback
 };
 
-const char *WebSocketImpl::connectID = "_connect";
-const char *WebSocketImpl::removeHandlerID = "_removeHander";
-const char *WebSocketImpl::sendBinaryID = "_send";
-const char *WebSocketImpl::sendStringID = "_send";
-const char *WebSocketImpl::closeID = "_close";
-const char *WebSocketImpl::getBufferedAmountID = "_getBufferedAmountID";
-std::atomic_int64_t WebSocketImpl::idGenerator{0};
-std::unordered_map<int64_t, WebSocketImpl *> WebSocketImpl::allConnections{};
+cocos2d::network::WebSocketUtils::HandleTable<WebSocketImpl> WebSocketImpl::allConnections;
 
 void WebSocketImpl::closeAllConnections() {
-    std::unordered_map<int64_t, WebSocketImpl *> tmp = std::move(allConnections);
-    for (auto &t : tmp) {
-        t.second->closeAsync();
+    for (uint64_t handle : allConnections.getHandles()) {
+        WebSocketImpl *impl = allConnections.get(handle);
+        if (impl != nullptr) {
+            impl->closeAsync();
+        }
     }
 }
 
 WebSocketImpl::WebSocketImpl(WebSocket *websocket) : _socket(websocket) {
-    _identifier = idGenerator.fetch_add(1);
-    allConnections.emplace(_identifier, this);
+    _handle = allConnections.add(this);
 }
 
 WebSocketImpl::~WebSocketImpl() {
     auto *env = cocos2d::JniHelper::getEnv();
+    if (_destroyed != nullptr) {
+        *_destroyed = true;
+    }
+    if (_reconnectScheduled) {
+        cocos2d::Application::getInstance()->getScheduler()->unschedule(RECONNECT_SCHEDULER_KEY, this);
+    }
+    // waits for callbacks which pinned this object, later ones can't resolve the handle anymore
+    allConnections.remove(_handle);
+    if (_javaSocket != nullptr) {
+        // stops the callbacks and the keep-alive of the Java object
+        env->CallVoidMethod(_javaSocket, javaWebSocket.removeHandlerID);
+    }
+    InboundMessage message;
+    while (popMessage(message)) {
+        if (message.buffer != nullptr) {
+            receiveBufferPool.release(env, message.buffer);
+        }
+    }
+    _sendBuffer.reset(env);
     env->DeleteGlobalRef(_javaSocket);
     _javaSocket = nullptr;
-    allConnections.erase(_identifier);
 }
 
 bool WebSocketImpl::init(const cocos2d::network::WebSocket::Delegate &delegate, const std::string &url,
-                         const std::vector<std::string> *protocols, const std::string &caFilePath) {
+                         const std::vector<std::string> *protocols, const std::string &caFilePath,
+                         const cocos2d::network::WebSocket::Options &options) {
     auto *env = cocos2d::JniHelper::getEnv();
-    auto handler = static_cast<int64_t>(reinterpret_cast<uintptr_t>(this));
     bool tcpNoDelay = false;
-    bool perMessageDeflate = true;
+    // connect, handshake and write timeout, OkHttp clears the read timeout once the socket is open so a dead
+    // peer is only noticed through the keep-alive pings of Options::pingInterval
     int64_t timeout = 60 * 60 * 1000 /*ms*/;
-    std::vector<std::string> headers;
+    if (!loadJavaWebSocketClass()) {
+        CCLOGERROR("WebSocketImpl::init failed to load %s", JAVA_CLASS_WEBSOCKET);
+        return false;
+    }
+    if (options.perMessageDeflate) {
+        // OkHttp 3.12 fails any frame with RSV1 set, so the extension can't be offered on this transport
+        CCLOGWARN("WebSocketImpl::init permessage-deflate is not supported by the OkHttp transport, ignored");
+    }
     _url = url;
+    _caFilePath = caFilePath;
+    _reconnectPolicy = options.reconnect;
+    _deliverOnTransportThread = options.messageDelivery == WebSocket::MessageDelivery::TRANSPORT_THREAD;
+    _waterMarks.init(options.bufferedAmountHighWaterMark, options.bufferedAmountLowWaterMark);
     _delegate = const_cast<WebSocket::Delegate *>(&delegate);
     if (protocols != nullptr && !protocols->empty()) {
         std::string item;
@@ -152,30 +446,172 @@ bool WebSocketImpl::init(const cocos2d::network::WebSocket::Delegate &delegate,
         CCLOG("WenSocketImpl::init protocols ");
     }
     // header
-    jobject jObj = cocos2d::JniHelper::newObject(JAVA_CLASS_WEBSOCKET, _identifier, handler, headers, tcpNoDelay, perMessageDeflate, timeout);
+    // keep-alive in milliseconds, the dead-peer timeout defaults to the ping interval
+    auto pingInterval = static_cast<int64_t>(std::max(0.0F, options.pingInterval) * 1000);
+    auto deadPeerTimeout = options.deadPeerTimeout > 0 ? static_cast<int64_t>(options.deadPeerTimeout * 1000)
+                                                       : pingInterval;
+    jobjectArray jHeaders = env->NewObjectArray(0, javaWebSocket.stringClass, nullptr);
+    jobject jObj = env->NewObject(javaWebSocket.clazz, javaWebSocket.ctorID,
+                                  static_cast<jlong>(_handle), jHeaders,
+                                  static_cast<jboolean>(tcpNoDelay), static_cast<jlong>(timeout),
+                                  static_cast<jboolean>(options.persistTlsSessions),
+                                  static_cast<jlong>(pingInterval), static_cast<jlong>(deadPeerTimeout));
+    env->DeleteLocalRef(jHeaders);
     _javaSocket = env->NewGlobalRef(jObj);
-    cocos2d::JniHelper::callObjectVoidMethod(jObj, JAVA_CLASS_WEBSOCKET, connectID, url, _protocolString, caFilePath);
     env->DeleteLocalRef(jObj);
+    connect();
+    return true;
+}
+
+void WebSocketImpl::connect() {
+    // a reconnect reuses the Java object, hence the cached OkHttpClient and its TLS sessions
+    auto *env = cocos2d::JniHelper::getEnv();
+    jstring jUrl = cocos2d::StringUtils::newStringUTFJNI(env, _url);
+    jstring jProtocols = cocos2d::StringUtils::newStringUTFJNI(env, _protocolString);
+    jstring jCaFilePath = cocos2d::StringUtils::newStringUTFJNI(env, _caFilePath);
+    env->CallVoidMethod(_javaSocket, javaWebSocket.connectID, jUrl, jProtocols, jCaFilePath);
+    env->DeleteLocalRef(jUrl);
+    env->DeleteLocalRef(jProtocols);
+    env->DeleteLocalRef(jCaFilePath);
     _readyState = WebSocket::State::CONNECTING;
+    _roundTrips.reset();
+}
+
+bool WebSocketImpl::shouldReconnect() const {
+    return _reconnectPolicy.enabled && !_closeRequested &&
+           (_reconnectPolicy.maxAttempts <= 0 || _reconnectAttempt < _reconnectPolicy.maxAttempts);
+}
+
+void WebSocketImpl::scheduleReconnect() {
+    ++_reconnectAttempt;
+    _metrics.onReconnect();
+    float delay = cocos2d::network::WebSocketUtils::getReconnectDelay(_reconnectPolicy, _reconnectAttempt);
+    _readyState = WebSocket::State::CONNECTING;
+    _reconnectScheduled = true;
+    uint64_t handle = _handle;
+    cocos2d::Application::getInstance()->getScheduler()->schedule([handle](float /*dt*/) {
+        WebSocketImpl *impl = allConnections.get(handle);
+        if (impl != nullptr) {
+            impl->reconnect();
+        }
+    }, this, 0, 0, delay, false, RECONNECT_SCHEDULER_KEY);
+    CCLOG("WebSocket (%p) reconnecting in %.2fs, attempt %d", this, delay, _reconnectAttempt);
+    _delegate->onReconnecting(_socket, _reconnectAttempt, delay);
+}
+
+void WebSocketImpl::reconnect() {
+    _reconnectScheduled = false;
+    connect();
+}
+
+bool WebSocketImpl::queueMessage(const uint8_t *data, size_t len, bool isBinary) {
+    if (!_reconnectPolicy.enabled || _closeRequested || _readyState != WebSocket::State::CONNECTING) {
+        return false;
+    }
+    if (_queuedBytes + len > _reconnectPolicy.maxQueuedBytes) {
+        CCLOGWARN("WebSocket (%p) send queue is full, %u bytes dropped", this, static_cast<unsigned>(len));
+        return false;
+    }
+    QueuedMessage message;
+    message.data.assign(reinterpret_cast<const char *>(data), len);
+    message.isBinary = isBinary;
+    _sendQueue.push_back(std::move(message));
+    _queuedBytes += len;
     return true;
 }
 
+void WebSocketImpl::replayQueuedMessages() {
+    std::deque<QueuedMessage> queue;
+    queue.swap(_sendQueue);
+    _queuedBytes = 0;
+    for (auto &message : queue) {
+        if (message.isBinary) {
+            sendBinary(reinterpret_cast<const unsigned char *>(message.data.data()),
+                       static_cast<unsigned int>(message.data.size()));
+        } else {
+            send(message.data);
+        }
+    }
+}
+
 void WebSocketImpl::send(const std::string &message) {
     if (_readyState == WebSocket::State::OPEN) {
-        cocos2d::JniHelper::callObjectVoidMethod(_javaSocket, JAVA_CLASS_WEBSOCKET, sendStringID, message);
-    } else {
+        auto *env = cocos2d::JniHelper::getEnv();
+        int64_t startUs = nowUs();
+        jstring jMessage = cocos2d::StringUtils::newStringUTFJNI(env, message);
+        env->CallVoidMethod(_javaSocket, javaWebSocket.sendStringID, jMessage);
+        env->DeleteLocalRef(jMessage);
+        _metrics.onJniCall(nowUs() - startUs);
+        _metrics.onMessageSent(message.length(), false);
+    } else if (!queueMessage(reinterpret_cast<const uint8_t *>(message.data()), message.length(), false)) {
         CCLOG("Couldn't send message since WebSocket wasn't opened!");
     }
 }
 
 void WebSocketImpl::send(const unsigned char *binaryMsg, unsigned int len) {
     if (_readyState == WebSocket::State::OPEN) {
-        cocos2d::JniHelper::callObjectVoidMethod(_javaSocket, JAVA_CLASS_WEBSOCKET, sendBinaryID, std::make_pair(binaryMsg, static_cast<size_t>(len)));
-    } else {
+        sendBinary(binaryMsg, len);
+    } else if (!queueMessage(binaryMsg, len, true)) {
         CCLOG("Couldn't send message since WebSocket wasn't opened!");
     }
 }
 
+void WebSocketImpl::sendBinary(const unsigned char *binaryMsg, unsigned int len) {
+    auto *env = cocos2d::JniHelper::getEnv();
+    jobject buffer = _sendBuffer.prepare(env, binaryMsg, len);
+    if (buffer == nullptr) {
+        CCLOGERROR("WebSocket (%p) failed to allocate %u bytes for sending", this, len);
+        return;
+    }
+    int64_t startUs = nowUs();
+    env->CallVoidMethod(_javaSocket, javaWebSocket.sendBufferID, buffer, 0, static_cast<jint>(len));
+    _metrics.onJniCall(nowUs() - startUs);
+    _metrics.onMessageSent(len, true);
+}
+
+// A batch is packed into the send buffer as a native-order uint32 header per message, the payload length with
+// the top bit set for binary messages, followed by the payload. CocosWebSocket._sendBatch unpacks it.
+void WebSocketImpl::sendBatch(const WebSocket::OutgoingMessage *messages, size_t count) {
+    if (_readyState != WebSocket::State::OPEN) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!queueMessage(messages[i].data, messages[i].len, messages[i].isBinary)) {
+                CCLOG("Couldn't send message since WebSocket wasn't opened!");
+            }
+        }
+        return;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += sizeof(uint32_t) + messages[i].len;
+    }
+    if (total == 0) {
+        return;
+    }
+    if (total > INT32_MAX) {
+        CCLOGERROR("WebSocket (%p) batch of %u bytes is too large", this, static_cast<unsigned>(total));
+        return;
+    }
+    auto *env = cocos2d::JniHelper::getEnv();
+    jobject buffer = _sendBuffer.reserve(env, total);
+    if (buffer == nullptr) {
+        CCLOGERROR("WebSocket (%p) failed to allocate %u bytes for sending", this, static_cast<unsigned>(total));
+        return;
+    }
+    uint8_t *out = _sendBuffer.data();
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t header = messages[i].len | (messages[i].isBinary ? 0x80000000U : 0);
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + sizeof(header), messages[i].data, messages[i].len);
+        out += sizeof(header) + messages[i].len;
+    }
+    int64_t startUs = nowUs();
+    env->CallVoidMethod(_javaSocket, javaWebSocket.sendBatchID, buffer, static_cast<jint>(total));
+    _metrics.onJniCall(nowUs() - startUs);
+    for (size_t i = 0; i < count; ++i) {
+        _metrics.onMessageSent(messages[i].len, messages[i].isBinary);
+    }
+}
+
 void WebSocketImpl::close() {
     closeAsync(); // close only run in async mode
 }
@@ -194,45 +630,86 @@ void WebSocketImpl::closeAsync(int code, const std::string &reason) {
         CCLOGERROR("close: WebSocket (%p) was closed, no need to close it again!", this);
         return;
     }
+    _closeRequested = true;
+    _sendQueue.clear();
+    _queuedBytes = 0;
     _readyState = WebSocket::State::CLOSING; // update state -> CLOSING
-    cocos2d::JniHelper::callObjectVoidMethod(_javaSocket, JAVA_CLASS_WEBSOCKET, closeID, code, reason);
+    if (_reconnectScheduled) {
+        // no transport between two attempts, report the close like the transport would
+        _reconnectScheduled = false;
+        cocos2d::Application::getInstance()->getScheduler()->unschedule(RECONNECT_SCHEDULER_KEY, this);
+        ControlEvent event;
+        event.type = ControlEvent::Type::CLOSED;
+        event.code = code;
+        event.text = reason;
+        enqueueControlEvent(std::move(event));
+        return;
+    }
+    auto *env = cocos2d::JniHelper::getEnv();
+    jstring jReason = cocos2d::StringUtils::newStringUTFJNI(env, reason);
+    env->CallVoidMethod(_javaSocket, javaWebSocket.closeID, static_cast<jint>(code), jReason);
+    env->DeleteLocalRef(jReason);
 }
 
-size_t WebSocketImpl::getBufferedAmount() const {
-    jlong buffAmount = cocos2d::JniHelper::callObjectLongMethod(_javaSocket, JAVA_CLASS_WEBSOCKET, getBufferedAmountID);
-    return static_cast<size_t>(buffAmount);
+// only reported by CocosWebSocket under its _bufferedAmountLock, the stores arrive in the order the sizes were read
+void WebSocketImpl::updateBufferedAmount(size_t amount) {
+    _bufferedAmount.store(amount, std::memory_order_relaxed);
+    if (_waterMarks.crossed(amount)) {
+        scheduleDispatch();
+    }
+}
+
+void WebSocketImpl::checkWaterMarks() {
+    size_t amount = _bufferedAmount.load(std::memory_order_relaxed);
+    switch (_waterMarks.update(amount)) {
+        case cocos2d::network::WebSocketUtils::WaterMarks::Crossing::HIGH:
+            _delegate->onBufferedAmountHigh(_socket, amount);
+            break;
+        case cocos2d::network::WebSocketUtils::WaterMarks::Crossing::LOW:
+            _delegate->onBufferedAmountLow(_socket, amount);
+            break;
+        case cocos2d::network::WebSocketUtils::WaterMarks::Crossing::NONE:
+            break;
+    }
 }
 
-void WebSocketImpl::onOpen(const std::string &protocol, const std::string &headers) {
+void WebSocketImpl::onOpen(const std::string &protocol, std::string &&headers,
+                           const WebSocket::HandshakeInfo &handshake) {
     CCLOG("WebSocketImpl::onOpen  ");
     _selectedProtocol = protocol;
-    std::vector<std::string> headerTokens;
-    split_string(headers, headerTokens, "\n");
-    std::vector<std::string> headerKV;
-    for (auto &kv : headerTokens) {
-        split_string(kv, headerKV, ": ");
-        _headerMap.insert(std::pair<std::string, std::string>(headerKV[0],
-                                                              headerKV[1]));
-        if (headerKV[0] == "Sec-WebSocket-Extensions") {
-            _extensions = headerKV[1];
-        }
-    }
+    _handshakeInfo = handshake;
+    // parsed by the first getResponseHeader
+    _responseHeaders.assign(std::move(headers));
     if (_readyState == WebSocket::State::CLOSING || _readyState == WebSocket::State::CLOSED) {
         CCLOG("websocket is closing");
     } else {
         CCLOG("WebSocketImpl:: delegate->onOpen  ");
         _readyState = WebSocket::State::OPEN; // update state -> OPEN
+        _reconnectAttempt = 0;
+        _metrics.onOpen(static_cast<int64_t>(handshake.connectTime * 1000));
+        // messages sent while connecting go out before anything sent from onOpen
+        replayQueuedMessages();
         _delegate->onOpen(_socket);
     }
 }
 
-void WebSocketImpl::onClose(int code, const std::string &reason, bool wasClean) {
+void WebSocketImpl::onClose(int /*code*/, const std::string & /*reason*/, bool /*wasClean*/) {
+    if (_readyState != WebSocket::State::CLOSED && shouldReconnect()) {
+        scheduleReconnect();
+        return;
+    }
+    _sendQueue.clear();
+    _queuedBytes = 0;
     _readyState = WebSocket::State::CLOSED; // update state -> CLOSED
     _delegate->onClose(_socket);
 }
 
 void WebSocketImpl::onError(int code, const std::string &reason) {
     CCLOG("WebSocket (%p) onError, state: %d ...", this, (int)_readyState);
+    if (_readyState != WebSocket::State::CLOSED && shouldReconnect()) {
+        scheduleReconnect();
+        return;
+    }
     if (_readyState != WebSocket::State::CLOSED) {
         _readyState = WebSocket::State::CLOSED; // update state -> CLOSED
         _delegate->onError(_socket, static_cast<WebSocket::ErrorCode>(code));
@@ -248,14 +725,137 @@ void WebSocketImpl::onBinaryMessage(const uint8_t *buf, size_t len) {
     _delegate->onMessage(_socket, data);
 }
 
-void WebSocketImpl::onStringMessage(const std::string &message) {
+void WebSocketImpl::onStringMessage(const char *message, size_t len) {
+    // message is NUL terminated, script bindings read it as a C string
     WebSocket::Data data;
-    data.bytes = const_cast<char *>(message.c_str());
-    data.len = static_cast<ssize_t>(message.length());
+    data.bytes = const_cast<char *>(message);
+    data.len = static_cast<ssize_t>(len);
     data.isBinary = false;
     _delegate->onMessage(_socket, data);
 }
 
+void WebSocketImpl::enqueueMessage(InboundMessage &&message) {
+    message.receivedUs = nowUs();
+    if (_deliverOnTransportThread) {
+        // the caller pinned this object, the destructor waits until the delegate returns
+        deliverMessage(message);
+        return;
+    }
+    if (_overflowing.load(std::memory_order_acquire) || !_inbound.push(std::move(message))) {
+        std::lock_guard<std::mutex> lock(_overflowMutex);
+        _overflow.push_back(std::move(message));
+        _overflowing.store(true, std::memory_order_release);
+    }
+    scheduleDispatch();
+}
+
+void WebSocketImpl::enqueueControlEvent(ControlEvent &&event) {
+    {
+        std::lock_guard<std::mutex> lock(_controlMutex);
+        _controlEvents.push_back(std::move(event));
+    }
+    scheduleDispatch();
+}
+
+bool WebSocketImpl::popMessage(InboundMessage &message) {
+    if (_inbound.pop(message)) {
+        return true;
+    }
+    if (!_overflowing.load(std::memory_order_acquire)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_overflowMutex);
+    if (_overflow.empty()) {
+        _overflowing.store(false, std::memory_order_release);
+        return false;
+    }
+    message = std::move(_overflow.front());
+    _overflow.pop_front();
+    if (_overflow.empty()) {
+        _overflowing.store(false, std::memory_order_release);
+    }
+    return true;
+}
+
+void WebSocketImpl::deliverMessage(InboundMessage &message) {
+    _metrics.onMessageReceived(message.buffer != nullptr ? message.length : message.data.length(),
+                               nowUs() - message.receivedUs);
+    if (message.buffer != nullptr) {
+        if (message.isBinary) {
+            onBinaryMessage(message.buffer->payload(), message.length);
+        } else {
+            onStringMessage(reinterpret_cast<const char *>(message.buffer->payload()), message.length);
+        }
+        receiveBufferPool.release(cocos2d::JniHelper::getEnv(), message.buffer);
+        message.buffer = nullptr;
+    } else if (message.isBinary) {
+        onBinaryMessage(reinterpret_cast<const uint8_t *>(message.data.data()), message.data.length());
+    } else {
+        onStringMessage(message.data.c_str(), message.data.length());
+    }
+}
+
+void WebSocketImpl::scheduleDispatch() {
+    // at most one pending dispatch per connection, everything queued until it runs is drained in one pass
+    if (_dispatchScheduled.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    uint64_t handle = _handle;
+    cocos2d::Application::getInstance()->getScheduler()->performFunctionInCocosThread([handle]() {
+        WebSocketImpl *impl = allConnections.get(handle);
+        if (impl != nullptr) {
+            impl->dispatchEvents();
+        }
+    });
+}
+
+void WebSocketImpl::dispatchEvents() {
+    _dispatchScheduled.store(false, std::memory_order_release);
+    std::vector<ControlEvent> controlEvents;
+    {
+        std::lock_guard<std::mutex> lock(_controlMutex);
+        controlEvents.swap(_controlEvents);
+    }
+
+    bool destroyed = false;
+    _destroyed = &destroyed;
+
+    // OPEN precedes every message and CLOSED/ERROR follow the last one, deliver them around the messages
+    for (auto &event : controlEvents) {
+        if (event.type == ControlEvent::Type::OPEN) {
+            onOpen(event.text, std::move(event.headers), event.handshake);
+            if (destroyed) {
+                return;
+            }
+        }
+    }
+
+    InboundMessage message;
+    while (popMessage(message)) {
+        deliverMessage(message);
+        if (destroyed) {
+            return;
+        }
+    }
+
+    checkWaterMarks();
+    if (destroyed) {
+        return;
+    }
+
+    for (auto &event : controlEvents) {
+        if (event.type == ControlEvent::Type::CLOSED) {
+            onClose(event.code, event.text, true);
+        } else if (event.type == ControlEvent::Type::ERROR) {
+            onError(event.code, event.text);
+        }
+        if (destroyed) {
+            return;
+        }
+    }
+    _destroyed = nullptr;
+}
+
 namespace cocos2d {
 namespace network {
 /*static*/
@@ -263,6 +863,17 @@ void WebSocket::closeAllConnections() {
     WebSocketImpl::closeAllConnections();
 }
 
+/*static*/
+void WebSocket::preloadCAFile(const std::string &caFilePath) {
+    // parsed on a Java thread and cached by CocosWebSocket per path and modification time
+    cocos2d::JniHelper::callStaticVoidMethod(JAVA_CLASS_WEBSOCKET, "preloadCAFile", caFilePath);
+}
+
+/*static*/
+WebSocket::Metrics WebSocket::getGlobalMetrics() {
+    return WebSocketUtils::MetricsRecorder::getGlobal().snapshot();
+}
+
 WebSocket::WebSocket() {
     _impl = new WebSocketImpl(this);
 }
@@ -275,7 +886,15 @@ bool WebSocket::init(const Delegate &delegate,
                      const std::string &url,
                      const std::vector<std::string> *protocols /* = nullptr*/,
                      const std::string &caFilePath /* = ""*/) {
-    return _impl->init(delegate, url, protocols, caFilePath);
+    return _impl->init(delegate, url, protocols, caFilePath, Options());
+}
+
+bool WebSocket::init(const Delegate &delegate,
+                     const std::string &url,
+                     const std::vector<std::string> *protocols,
+                     const std::string &caFilePath,
+                     const Options &options) {
+    return _impl->init(delegate, url, protocols, caFilePath, options);
 }
 
 void WebSocket::send(const std::string &message) {
@@ -286,6 +905,10 @@ void WebSocket::send(const unsigned char *binaryMsg, unsigned int len) {
     _impl->send(binaryMsg, len);
 }
 
+void WebSocket::sendBatch(const OutgoingMessage *messages, size_t count) {
+    _impl->sendBatch(messages, count);
+}
+
 void WebSocket::close() {
     _impl->close();
 }
@@ -302,6 +925,10 @@ WebSocket::State WebSocket::getReadyState() const {
     return _impl->getReadyState();
 }
 
+std::string WebSocket::getResponseHeader(const std::string &name) const {
+    return _impl->getResponseHeader(name);
+}
+
 std::string WebSocket::getExtensions() const {
     return _impl->getExtensions();
 }
@@ -318,6 +945,18 @@ const std::string &WebSocket::getProtocol() const {
     return _impl->getProtocol();
 }
 
+const WebSocket::HandshakeInfo &WebSocket::getHandshakeInfo() const {
+    return _impl->getHandshakeInfo();
+}
+
+WebSocket::RoundTripTime WebSocket::getRoundTripTime() const {
+    return _impl->getRoundTripTime();
+}
+
+WebSocket::Metrics WebSocket::getMetrics() const {
+    return _impl->getMetrics();
+}
+
 WebSocket::Delegate *WebSocket::getDelegate() const {
     return _impl->getDelegate();
 }
@@ -332,36 +971,119 @@ extern "C" {
 
 #define JNI_PATH(methodName) Java_org_cocos2dx_lib_websocket_CocosWebSocket_##methodName
 
-JNIEXPORT void JNICALL JNI_PATH(NativeInit)(JNIEnv * /*env*/, jclass /*clazz*/) {
-    // nop
-    // may cache jni objects in the future
-
-    CCLOG("JNI_PATH(NativeInit) 1141...");
+JNIEXPORT void JNICALL JNI_PATH(NativeInit)(JNIEnv *env, jclass clazz) {
+    // runs once from the static initializer of CocosWebSocket, pin the class and the methods used by WebSocketImpl
+    JavaWebSocketClass cls;
+    jclass stringClass = env->FindClass("java/lang/String");
+    cls.stringClass = static_cast<jclass>(env->NewGlobalRef(stringClass));
+    env->DeleteLocalRef(stringClass);
+    cls.ctorID = env->GetMethodID(clazz, "<init>", ctorSignature);
+    cls.connectID = env->GetMethodID(clazz, "_connect", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)V");
+    cls.sendBufferID = env->GetMethodID(clazz, "_sendBuffer", "(Ljava/nio/ByteBuffer;II)V");
+    cls.sendStringID = env->GetMethodID(clazz, "_send", "(Ljava/lang/String;)V");
+    cls.sendBatchID = env->GetMethodID(clazz, "_sendBatch", "(Ljava/nio/ByteBuffer;I)V");
+    cls.closeID = env->GetMethodID(clazz, "_close", "(ILjava/lang/String;)V");
+    cls.removeHandlerID = env->GetMethodID(clazz, "_removeHandler", "()V");
+    if (env->ExceptionCheck() || !cls.ctorID || !cls.connectID || !cls.sendBufferID ||
+        !cls.sendStringID || !cls.sendBatchID || !cls.closeID || !cls.removeHandlerID) {
+        env->ExceptionClear();
+        env->DeleteGlobalRef(cls.stringClass);
+        CCLOGERROR("JNI_PATH(NativeInit): failed to resolve methods of %s", JAVA_CLASS_WEBSOCKET);
+        return;
+    }
+    cls.clazz = static_cast<jclass>(env->NewGlobalRef(clazz));
+    javaWebSocket = cls;
 }
 
 JNIEXPORT void JNICALL
 JNI_PATH(nativeOnStringMessage)(JNIEnv * /*env*/,
                                 jobject /*ctx*/,
                                 jstring msg,
-                                jlong /*identifier*/,
-                                jlong handler) {
-    auto *wsOkHttp3 = HANDLE_TO_WS_OKHTTP3(handler); // NOLINT(performance-no-int-to-ptr)
-    std::string msgStr = cocos2d::JniHelper::jstring2string(msg);
-    wsOkHttp3->onStringMessage(msgStr);
+                                jlong handle) {
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        return;
+    }
+    InboundMessage message;
+    message.data = cocos2d::JniHelper::jstring2string(msg);
+    wsOkHttp3->enqueueMessage(std::move(message));
 }
 
 JNIEXPORT void JNICALL
 JNI_PATH(nativeOnBinaryMessage)(JNIEnv *env,
                                 jobject /*ctx*/,
                                 jbyteArray msg,
-                                jlong /*identifier*/,
-                                jlong handler) {
-    auto *wsOkHttp3 = HANDLE_TO_WS_OKHTTP3(handler); // NOLINT(performance-no-int-to-ptr)
+                                jlong handle) {
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        return;
+    }
     auto len = env->GetArrayLength(static_cast<jbyteArray>(msg));
-    jboolean isCopy = JNI_FALSE;
-    jbyte *array = env->GetByteArrayElements(static_cast<jbyteArray>(msg), &isCopy);
-    wsOkHttp3->onBinaryMessage(reinterpret_cast<uint8_t *>(array), len);
-    env->ReleaseByteArrayElements(static_cast<jbyteArray>(msg), array, JNI_ABORT);
+    InboundMessage message;
+    message.data.resize(static_cast<size_t>(len));
+    env->GetByteArrayRegion(static_cast<jbyteArray>(msg), 0, len, reinterpret_cast<jbyte *>(&message.data[0]));
+    message.isBinary = true;
+    wsOkHttp3->enqueueMessage(std::move(message));
+}
+
+JNIEXPORT jobject JNICALL
+JNI_PATH(nativeAcquireReceiveBuffer)(JNIEnv *env,
+                                     jclass /*clazz*/,
+                                     jint size) {
+    ReceiveBuffer *buffer = receiveBufferPool.acquire(env, static_cast<size_t>(size));
+    return buffer != nullptr ? env->NewLocalRef(buffer->byteBuffer) : nullptr;
+}
+
+JNIEXPORT void JNICALL
+JNI_PATH(nativeReleaseReceiveBuffer)(JNIEnv *env,
+                                     jclass /*clazz*/,
+                                     jobject buffer) {
+    receiveBufferPool.release(env, ReceiveBuffer::fromPayload(env->GetDirectBufferAddress(buffer)));
+}
+
+JNIEXPORT void JNICALL
+JNI_PATH(nativeOnStringBuffer)(JNIEnv *env,
+                               jobject /*ctx*/,
+                               jobject msg,
+                               jint len,
+                               jlong handle) {
+    // Java encoded the frame as UTF-8 into a buffer of at least len + 1 bytes. OkHttp already decoded the frame
+    // into a String, replacing invalid sequences with U+FFFD, so the bytes are valid UTF-8 by construction.
+    ReceiveBuffer *buffer = ReceiveBuffer::fromPayload(env->GetDirectBufferAddress(msg));
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        receiveBufferPool.release(env, buffer);
+        return;
+    }
+    buffer->payload()[len] = '\0';
+    InboundMessage message;
+    message.buffer = buffer;
+    message.length = static_cast<size_t>(len);
+    message.isBinary = false;
+    wsOkHttp3->enqueueMessage(std::move(message));
+}
+
+JNIEXPORT void JNICALL
+JNI_PATH(nativeOnBinaryBuffer)(JNIEnv *env,
+                               jobject /*ctx*/,
+                               jobject msg,
+                               jint len,
+                               jlong handle) {
+    ReceiveBuffer *buffer = ReceiveBuffer::fromPayload(env->GetDirectBufferAddress(msg));
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        receiveBufferPool.release(env, buffer);
+        return;
+    }
+    InboundMessage message;
+    message.buffer = buffer;
+    message.length = static_cast<size_t>(len);
+    message.isBinary = true;
+    wsOkHttp3->enqueueMessage(std::move(message));
 }
 
 JNIEXPORT void JNICALL
@@ -369,14 +1091,27 @@ JNI_PATH(nativeOnOpen)(JNIEnv * /*env*/,
                        jobject /*ctx*/,
                        jstring protocol,
                        jstring header,
-                       jlong /*identifier*/,
-                       jlong handler) {
-    CCLOG("JNI_PATH(nativeOnOpen): 1111");
-    auto *wsOkHttp3 = HANDLE_TO_WS_OKHTTP3(handler); // NOLINT(performance-no-int-to-ptr)
-    auto protocolStr = cocos2d::JniHelper::jstring2string(protocol);
-    auto headerStr = cocos2d::JniHelper::jstring2string(header);
-    CCLOG("JNI_PATH(nativeOnOpen): 2222");
-    wsOkHttp3->onOpen(protocolStr, headerStr);
+                       jboolean secure,
+                       jboolean tlsResumed,
+                       jint tlsRoundTrips,
+                       jlong tlsHandshakeMicros,
+                       jlong connectMicros,
+                       jlong handle) {
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        return;
+    }
+    ControlEvent event;
+    event.type = ControlEvent::Type::OPEN;
+    event.text = cocos2d::JniHelper::jstring2string(protocol);
+    event.headers = cocos2d::JniHelper::jstring2string(header);
+    event.handshake.secure = secure == JNI_TRUE;
+    event.handshake.sessionResumed = tlsResumed == JNI_TRUE;
+    event.handshake.tlsRoundTrips = static_cast<int>(tlsRoundTrips);
+    event.handshake.tlsHandshakeTime = static_cast<float>(tlsHandshakeMicros) / 1000.0F;
+    event.handshake.connectTime = static_cast<float>(connectMicros) / 1000.0F;
+    wsOkHttp3->enqueueControlEvent(std::move(event));
 }
 
 JNIEXPORT void JNICALL
@@ -384,26 +1119,63 @@ JNI_PATH(nativeOnClosed)(JNIEnv * /*env*/,
                          jobject /*ctx*/,
                          jint code,
                          jstring reason,
-                         jlong /*identifier*/,
-                         jlong handler) {
-    auto *wsOkHttp3 = HANDLE_TO_WS_OKHTTP3(handler); // NOLINT(performance-no-int-to-ptr)
-    auto closeReason = cocos2d::JniHelper::jstring2string(reason);
-    wsOkHttp3->onClose(static_cast<int>(code), closeReason, true);
+                         jlong handle) {
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        return;
+    }
+    ControlEvent event;
+    event.type = ControlEvent::Type::CLOSED;
+    event.code = static_cast<int>(code);
+    event.text = cocos2d::JniHelper::jstring2string(reason);
+    wsOkHttp3->enqueueControlEvent(std::move(event));
 }
 
 JNIEXPORT void JNICALL
 JNI_PATH(nativeOnError)(JNIEnv * /*env*/,
                         jobject /*ctx*/,
                         jstring reason,
-                        jlong /*identifier*/,
-                        jlong handler) {
-    auto *wsOkHttp3 = HANDLE_TO_WS_OKHTTP3(handler); // NOLINT(performance-no-int-to-ptr)
-    int unknownError = static_cast<int>(cocos2d::network::WebSocket::ErrorCode::UNKNOWN);
-    auto errorReason = cocos2d::JniHelper::jstring2string(reason);
-    wsOkHttp3->onError(unknownError, errorReason);
+                        jboolean timedOut,
+                        jlong handle) {
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        return;
+    }
+    ControlEvent event;
+    event.type = ControlEvent::Type::ERROR;
+    event.code = static_cast<int>(timedOut == JNI_TRUE ? cocos2d::network::WebSocket::ErrorCode::TIME_OUT
+                                                       : cocos2d::network::WebSocket::ErrorCode::UNKNOWN);
+    event.text = cocos2d::JniHelper::jstring2string(reason);
+    wsOkHttp3->enqueueControlEvent(std::move(event));
 }
 
-#undef JNI_PATH
+JNIEXPORT void JNICALL
+JNI_PATH(nativeOnRoundTrip)(JNIEnv * /*env*/,
+                            jobject /*ctx*/,
+                            jlong micros,
+                            jlong handle) {
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        return;
+    }
+    wsOkHttp3->addRoundTrip(static_cast<float>(micros) / 1000.0F);
 }
 
-#undef HANDLE_TO_WS_OKHTTP3
\ No newline at end of file
+JNIEXPORT void JNICALL
+JNI_PATH(nativeOnBufferedAmount)(JNIEnv * /*env*/,
+                                 jobject /*ctx*/,
+                                 jlong amount,
+                                 jlong handle) {
+    WebSocketImpl::Pin pin(WebSocketImpl::allConnections, static_cast<uint64_t>(handle));
+    WebSocketImpl *wsOkHttp3 = pin.get();
+    if (wsOkHttp3 == nullptr) {
+        return;
+    }
+    wsOkHttp3->updateBufferedAmount(static_cast<size_t>(amount));
+}
+
+#undef JNI_PATH
+}
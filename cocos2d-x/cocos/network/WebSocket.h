@@ -0,0 +1,517 @@
+/****************************************************************************
+ Copyright (c) 2010-2012 cocos2d-x.org
+ Copyright (c) 2013-2016 Chukong Technologies Inc.
+ Copyright (c) 2017-2018 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+
+ "[WebSocket module] is based in part on the work of the libwebsockets  project
+ (http://libwebsockets.org)"
+ ****************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>  // for std::shared_ptr
+#include <atomic>
+#include <condition_variable>
+
+#include "platform/CCPlatformMacros.h"
+#include "platform/CCStdC.h"
+
+#ifndef OBJC_CLASS
+#ifdef __OBJC__
+#define OBJC_CLASS(name) @class name
+#else
+#define OBJC_CLASS(name) class name
+#endif
+#endif // OBJC_CLASS
+
+/**
+ * @addtogroup network
+ * @{
+ */
+
+#if CC_TARGET_PLATFORM == CC_PLATFORM_MAC || CC_TARGET_PLATFORM == CC_PLATFORM_IOS
+OBJC_CLASS(WebSocketImpl);
+#else
+class WebSocketImpl;
+#endif
+
+NS_CC_BEGIN
+
+namespace network {
+
+/**
+ * WebSocket is wrapper of the libwebsockets-protocol, let the develop could call the websocket easily.
+ * Please note that all public methods of WebSocket have to be invoked on Cocos Thread.
+ */
+class CC_DLL WebSocket
+{
+public:
+    /**
+     * Close all connections and wait for all websocket threads to exit
+     * @note This method has to be invoked on Cocos Thread
+     */
+    static void closeAllConnections();
+
+    /**
+     * Parses the certificates of caFilePath in the background and keeps them for the following connections,
+     * call it during startup so that the first wss:// connection doesn't pay for it.
+     * The cache is keyed by the path and the modification time of the file, an updated file is parsed again.
+     */
+    static void preloadCAFile(const std::string& caFilePath);
+
+    /**
+     * Constructor of WebSocket.
+     *
+     * @js ctor
+     */
+    WebSocket();
+    /**
+     * Destructor of WebSocket.
+     *
+     * @js NA
+     * @lua NA
+     */
+    virtual ~WebSocket();
+
+    /**
+     * Data structure for message
+     */
+    struct Data
+    {
+        Data():bytes(nullptr), len(0), issued(0), isBinary(false), ext(nullptr){}
+        char* bytes;
+        ssize_t len, issued;
+        bool isBinary;
+        void* ext;
+        ssize_t getRemain(){return len - issued > 0 ? len - issued: 0;}
+    };
+
+    /**
+     * ErrorCode enum used to represent the error in the websocket.
+     */
+    enum class ErrorCode
+    {
+        TIME_OUT,           /** &lt; value 0 */
+        CONNECTION_FAILURE, /** &lt; value 1 */
+        UNKNOWN,            /** &lt; value 2 */
+    };
+
+    /**
+     *  State enum used to represent the Websocket state.
+     */
+    enum class State
+    {
+        CONNECTING,  /** &lt; value 0 */
+        OPEN,        /** &lt; value 1 */
+        CLOSING,     /** &lt; value 2 */
+        CLOSED,      /** &lt; value 3 */
+    };
+
+    /**
+     * Automatic reconnection, see Options::reconnect.
+     * A connection which fails or is closed by the server is reopened after an exponentially growing delay
+     * instead of reporting onError/onClose. Messages sent meanwhile are queued and sent once it's open again.
+     * onError and onClose are delivered as usual after the last attempt failed or when close() is called.
+     */
+    struct ReconnectPolicy
+    {
+        bool enabled = false;
+        /** Attempts after a loss of the connection, 0 retries forever. Reset once the connection is open again. */
+        int maxAttempts = 10;
+        /** Delay before the first attempt in seconds, doubled for every following attempt. */
+        float initialDelay = 0.5f;
+        /** Upper bound of the delay in seconds. */
+        float maxDelay = 30.0f;
+        /** Randomizes each delay by up to this fraction (0-1) so that clients don't reconnect in lockstep. */
+        float jitter = 0.2f;
+        /** Bytes of messages queued while not open, send fails once they're exceeded. */
+        size_t maxQueuedBytes = 1024 * 1024;
+    };
+
+    /**
+     * Thread on which Delegate::onMessage is called, the other callbacks always run on the game thread.
+     */
+    enum class MessageDelivery
+    {
+        /** Messages are delivered on the game thread once per frame. */
+        GAME_THREAD,
+        /**
+         * Messages are delivered on the transport thread as soon as they arrive, so that large messages can be
+         * decoded without stalling a frame. The messages of a connection are delivered one at a time and in
+         * order, but may arrive before onOpen ran on the game thread. onMessage must not call methods of the
+         * WebSocket nor wait for the game thread, hand the results over with
+         * Scheduler::performFunctionInCocosThread instead. Destroying the WebSocket waits for a running onMessage.
+         * The OkHttp transport has a reader thread per connection, the C++ transport one thread for all of them.
+         */
+        TRANSPORT_THREAD,
+    };
+
+    /**
+     * Optional per-connection settings passed to init.
+     * Transports ignore the settings they don't support, see the notes of each field.
+     */
+    struct Options
+    {
+        /**
+         * Offers the permessage-deflate extension (RFC 7692). The extension selected by the server is
+         * reported by getExtensions(). Not supported by the OkHttp transport.
+         */
+        bool perMessageDeflate = false;
+        /** LZ77 window (9-15 bits) used to compress outbound messages. */
+        int clientMaxWindowBits = 15;
+        /** Largest LZ77 window (9-15 bits) the server may compress with. */
+        int serverMaxWindowBits = 15;
+        /** Keeps the compression window between messages (context takeover), disable to save memory. */
+        bool contextTakeover = true;
+        /**
+         * TLS sessions are always shared between connections of the process so that reconnects resume them.
+         * Also saves them to app storage, which lets the first connection after a restart resume too.
+         */
+        bool persistTlsSessions = false;
+        /** Reconnects with backoff when the connection is lost, disabled by default. */
+        ReconnectPolicy reconnect;
+        /** Seconds between keep-alive pings, each pong updates getRoundTripTime(). 0 sends no pings. */
+        float pingInterval = 0;
+        /**
+         * Seconds to wait for the pong of a ping before the connection is considered dead and fails with
+         * ErrorCode::TIME_OUT, 0 uses pingInterval. Detects half-open connections which never report an error.
+         */
+        float deadPeerTimeout = 0;
+        /** Thread on which onMessage is called, see MessageDelivery. */
+        MessageDelivery messageDelivery = MessageDelivery::GAME_THREAD;
+        /**
+         * Bytes of getBufferedAmount() at which Delegate::onBufferedAmountHigh is called, 0 disables the water
+         * marks. Lets senders pause instead of overrunning the send queue, OkHttp closes the connection once
+         * more than 16 MB are queued.
+         */
+        size_t bufferedAmountHighWaterMark = 0;
+        /** Bytes at which Delegate::onBufferedAmountLow is called after the high water mark was reached. */
+        size_t bufferedAmountLowWaterMark = 0;
+    };
+
+    /**
+     * How the opening handshake went, available once the connection is open.
+     */
+    struct HandshakeInfo
+    {
+        /** The connection uses TLS (wss://). */
+        bool secure = false;
+        /** The TLS session was resumed from a cached session ticket or session ID. */
+        bool sessionResumed = false;
+        /** Round trips spent in the TLS handshake, 0 without TLS. */
+        int tlsRoundTrips = 0;
+        /** Duration of the TLS handshake in milliseconds. */
+        float tlsHandshakeTime = 0;
+        /** Time from init to the connection being open in milliseconds. */
+        float connectTime = 0;
+    };
+
+    /**
+     * Round trips of the keep-alive pings (see Options::pingInterval) in milliseconds, 0 until the first pong.
+     */
+    struct RoundTripTime
+    {
+        /** Shortest round trip of the connection. */
+        float min = 0;
+        /** Smoothed average, every sample moves it by 1/8 of the difference. */
+        float avg = 0;
+        /** 95th percentile of the last 64 round trips. */
+        float p95 = 0;
+        /** Pongs received since the connection was opened. */
+        uint32_t samples = 0;
+    };
+
+    /**
+     * Summary of a duration histogram in milliseconds. Durations are recorded into log-linear buckets,
+     * 8 per power of two, so the percentiles are within about 6% of the exact values.
+     */
+    struct LatencyStats
+    {
+        uint64_t count = 0;
+        float mean = 0;
+        float p50 = 0;
+        float p90 = 0;
+        float p99 = 0;
+        float max = 0;
+    };
+
+    /**
+     * Counters of a connection, see getMetrics() and getGlobalMetrics().
+     * They are recorded with relaxed atomics only and cheap enough to stay enabled in release builds.
+     */
+    struct Metrics
+    {
+        uint64_t messagesSent = 0;
+        /** Payload bytes, framing and compression aren't counted. */
+        uint64_t bytesSent = 0;
+        /** Binary messages, included in messagesSent. */
+        uint64_t binaryMessagesSent = 0;
+        uint64_t messagesReceived = 0;
+        uint64_t bytesReceived = 0;
+        /** Connections which were opened, including reconnects. */
+        uint64_t connections = 0;
+        /** Reconnect attempts scheduled by the ReconnectPolicy. */
+        uint64_t reconnects = 0;
+        /**
+         * Times the direct buffer which binary messages are handed to Java in was (re)allocated.
+         * Stays flat in steady state. OkHttp transport only.
+         */
+        uint64_t sendBufferAllocations = 0;
+        /** Time from starting to connect to the connection being open. */
+        LatencyStats handshakeTime;
+        /** Time from the transport thread receiving a message to Delegate::onMessage. */
+        LatencyStats deliveryLatency;
+        /** Time spent in calls from the game thread into Java while sending, OkHttp transport only. */
+        LatencyStats jniCallTime;
+    };
+
+    /**
+     * The delegate class is used to process websocket events.
+     *
+     * The most member function are pure virtual functions,they should be implemented the in subclass.
+     * @lua NA
+     */
+    class Delegate
+    {
+    public:
+        /** Destructor of Delegate. */
+        virtual ~Delegate() {}
+        /**
+         * This function to be called after the client connection complete a handshake with the remote server.
+         * This means that the WebSocket connection is ready to send and receive data.
+         *
+         * @param ws The WebSocket object connected
+         */
+        virtual void onOpen(WebSocket* ws) = 0;
+        /**
+         * This function to be called when data has appeared from the server for the client connection.
+         *
+         * @note Only the C++ transport (USE_NATIVE_WEBSOCKET) validates text frames and closes with 1007
+         * on malformed UTF-8. OkHttp decodes text frames itself and replaces malformed sequences with
+         * U+FFFD before they reach native code, so on the OkHttp transport such messages are delivered.
+         *
+         * @param ws The WebSocket object connected.
+         * @param data Data object for message.
+         */
+        virtual void onMessage(WebSocket* ws, const Data& data) = 0;
+        /**
+         * When the WebSocket object connected wants to close or the protocol won't get used at all and current _readyState is State::CLOSING,this function is to be called.
+         *
+         * @param ws The WebSocket object connected.
+         */
+        virtual void onClose(WebSocket* ws) = 0;
+        /**
+         * This function is to be called in the following cases:
+         * 1. client connection is failed.
+         * 2. the request client connection has been unable to complete a handshake with the remote server.
+         * 3. the protocol won't get used at all after this callback and current _readyState is State::CONNECTING.
+         * 4. when a socket descriptor needs to be removed from an external polling array. in is again the struct libwebsocket_pollargs containing the fd member to be removed. If you are using the internal polling loop, you can just ignore it and current _readyState is State::CONNECTING.
+         *
+         * @param ws The WebSocket object connected.
+         * @param error WebSocket::ErrorCode enum,would be ErrorCode::TIME_OUT or ErrorCode::CONNECTION_FAILURE.
+         */
+        virtual void onError(WebSocket* ws, const ErrorCode& error) = 0;
+        /**
+         * Called when the connection was lost and ReconnectPolicy schedules a new attempt, the state is
+         * State::CONNECTING again. onOpen is called once the attempt succeeds.
+         *
+         * @param ws The WebSocket object.
+         * @param attempt 1 for the first attempt after the connection was lost.
+         * @param delay Seconds until the attempt starts.
+         */
+        virtual void onReconnecting(WebSocket* /*ws*/, int /*attempt*/, float /*delay*/) {}
+        /**
+         * Called once getBufferedAmount() reached Options::bufferedAmountHighWaterMark, senders should pause
+         * until onBufferedAmountLow. Called on the game thread, at the latest in the frame after the crossing.
+         *
+         * @param ws The WebSocket object.
+         * @param bufferedAmount Bytes queued when the crossing was noticed.
+         */
+        virtual void onBufferedAmountHigh(WebSocket* /*ws*/, size_t /*bufferedAmount*/) {}
+        /**
+         * Called once the buffered amount dropped back to Options::bufferedAmountLowWaterMark after
+         * onBufferedAmountHigh, also when the connection was reopened in the meantime.
+         *
+         * @param ws The WebSocket object.
+         * @param bufferedAmount Bytes queued when the crossing was noticed.
+         */
+        virtual void onBufferedAmountLow(WebSocket* /*ws*/, size_t /*bufferedAmount*/) {}
+    };
+
+
+    /**
+     *  @brief  The initialized method for websocket.
+     *          It needs to be invoked right after websocket instance is allocated.
+     *  @param  delegate The delegate which want to receive event from websocket.
+     *  @param  url      The URL of websocket server.
+     *  @param  protocols The websocket protocols that agree with websocket server
+     *  @param  caFilePath The ca file path for wss connection
+     *  @return true: Success, false: Failure.
+     *  @lua NA
+     */
+    bool init(const Delegate& delegate,
+              const std::string& url,
+              const std::vector<std::string>* protocols = nullptr,
+              const std::string& caFilePath = "");
+
+    /**
+     *  @brief  Same as the init above with additional per-connection options.
+     *  @param  options Settings of this connection, see WebSocket::Options.
+     *  @return true: Success, false: Failure.
+     *  @js NA
+     *  @lua NA
+     */
+    bool init(const Delegate& delegate,
+              const std::string& url,
+              const std::vector<std::string>* protocols,
+              const std::string& caFilePath,
+              const Options& options);
+
+    /**
+     *  @brief Sends string data to websocket server.
+     *
+     *  @param message string data.
+     *  @lua sendstring
+     */
+    void send(const std::string& message);
+
+    /**
+     *  @brief Sends binary data to websocket server.
+     *
+     *  @param binaryMsg binary string data.
+     *  @param len the size of binary string data.
+     *  @lua sendstring
+     */
+    void send(const unsigned char* binaryMsg, unsigned int len);
+
+    /**
+     * A message passed to sendBatch(). The bytes only need to stay valid during the call.
+     */
+    struct OutgoingMessage
+    {
+        const unsigned char* data;
+        unsigned int len;
+        bool isBinary;
+    };
+
+    /**
+     *  @brief Sends several messages in order, as if send() was called for each of them.
+     *  @note The OkHttp transport hands the whole batch to Java in a single call, which is cheaper than
+     *        calling send() for each of the small messages sent every frame.
+     *  @lua NA
+     */
+    void sendBatch(const OutgoingMessage* messages, size_t count);
+
+    /**
+     *  @brief Closes the connection to server synchronously.
+     *  @note It's a synchronous method, it will not return until websocket thread exits.
+     */
+    void close();
+
+    /**
+     *  @brief Closes the connection to server asynchronously.
+     *  @note It's an asynchronous method, it just notifies websocket thread to exit and returns directly,
+     *        If using 'closeAsync' to close websocket connection,
+     *        be careful of not using destructed variables in the callback of 'onClose'.
+     */
+    void closeAsync();
+
+    /**
+     *  @brief Closes the connection to server asynchronously.
+     *  @note It's an asynchronous method, it just notifies websocket thread to exit and returns directly,
+     *        If using 'closeAsync' to close websocket connection,
+     *        be careful of not using destructed variables in the callback of 'onClose'.
+     *  @param code close reason
+     *  @param reason reason text description
+     */
+    void closeAsync(int code, const std::string &reason);
+
+    /**
+     *  @brief Gets current state of connection.
+     *  @return State the state value could be State::CONNECTING, State::OPEN, State::CLOSING or State::CLOSED
+     */
+    State getReadyState() const;
+
+    /**
+     *  @brief Gets the URL of websocket connection.
+     */
+    const std::string& getUrl() const;
+
+    /**
+     *  @brief Returns the number of bytes of data that have been queued using calls to send() but not yet transmitted to the network.
+     */
+    size_t getBufferedAmount() const;
+
+    /**
+     *  @brief Returns the extensions selected by the server.
+     */
+    std::string getExtensions() const;
+
+    /**
+     *  @brief Gets a header of the server's handshake response, the name is case-insensitive.
+     *  @return The value, repeated headers are joined by ", ". Empty if there is no such header.
+     */
+    std::string getResponseHeader(const std::string& name) const;
+
+    /**
+     *  @brief Gets the protocol selected by websocket server.
+     */
+    const std::string& getProtocol() const;
+
+    /**
+     *  @brief Gets the statistics of the opening handshake, e.g. whether the TLS session was resumed.
+     */
+    const HandshakeInfo& getHandshakeInfo() const;
+
+    /**
+     *  @brief Gets the round trip times measured with the keep-alive pings of the current connection.
+     */
+    RoundTripTime getRoundTripTime() const;
+
+    /**
+     *  @brief Gets a snapshot of the metrics of this WebSocket, counted over all of its reconnects.
+     */
+    Metrics getMetrics() const;
+
+    /**
+     * Gets the metrics of all WebSocket connections since the start of the process.
+     */
+    static Metrics getGlobalMetrics();
+
+    Delegate* getDelegate() const;
+
+private:
+
+    // The following properties will be accessed on websocket thread
+    WebSocketImpl* _impl;
+};
+
+} // namespace network
+
+NS_CC_END
+
+// end group
+/// @}
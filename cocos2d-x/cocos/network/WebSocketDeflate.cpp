@@ -0,0 +1,305 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "network/WebSocketDeflate.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+#include "base/ccMacros.h"
+
+namespace {
+
+const char *EXTENSION_NAME = "permessage-deflate";
+const uint8_t DEFLATE_TAIL[] = {0x00, 0x00, 0xff, 0xff};
+const int MIN_WINDOW_BITS = 9;
+
+std::string trim(const std::string &s) {
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+std::vector<std::string> split(const std::string &s, char c) {
+    std::vector<std::string> ret;
+    size_t pos = 0;
+    while (true) {
+        size_t next = s.find(c, pos);
+        ret.push_back(trim(s.substr(pos, next == std::string::npos ? std::string::npos : next - pos)));
+        if (next == std::string::npos) {
+            break;
+        }
+        pos = next + 1;
+    }
+    return ret;
+}
+
+// parses the value of *_max_window_bits, -1 if missing, 0 if invalid
+int parseWindowBits(const std::string &value) {
+    if (value.empty()) {
+        return -1;
+    }
+    std::string v = value;
+    if (v.size() >= 2 && v.front() == '"' && v.back() == '"') {
+        v = v.substr(1, v.size() - 2);
+    }
+    char *end = nullptr;
+    long bits = strtol(v.c_str(), &end, 10);
+    if (end == v.c_str() || *end != '\0' || bits < 8 || bits > 15) {
+        return 0;
+    }
+    return static_cast<int>(bits);
+}
+
+} // namespace
+
+namespace cocos2d {
+namespace network {
+
+WebSocketDeflate::WebSocketDeflate(const Config &config)
+: _config(config) {
+    // zlib silently raises an 8 bit raw deflate window to 9, so 8 is never offered
+    _config.clientMaxWindowBits = std::min(15, std::max(MIN_WINDOW_BITS, _config.clientMaxWindowBits));
+    _config.serverMaxWindowBits = std::min(15, std::max(MIN_WINDOW_BITS, _config.serverMaxWindowBits));
+}
+
+WebSocketDeflate::~WebSocketDeflate() {
+    if (_compressor) {
+        deflateEnd(_compressor.get());
+    }
+    if (_decompressor) {
+        inflateEnd(_decompressor.get());
+    }
+}
+
+std::string WebSocketDeflate::getOffer() const {
+    std::string offer = EXTENSION_NAME;
+    // announce that we can honor any client window the server picks
+    offer.append("; client_max_window_bits");
+    if (_config.clientMaxWindowBits < 15) {
+        offer.append("=").append(std::to_string(_config.clientMaxWindowBits));
+    }
+    if (_config.serverMaxWindowBits < 15) {
+        offer.append("; server_max_window_bits=").append(std::to_string(_config.serverMaxWindowBits));
+    }
+    if (_config.clientNoContextTakeover) {
+        offer.append("; client_no_context_takeover");
+    }
+    if (_config.serverNoContextTakeover) {
+        offer.append("; server_no_context_takeover");
+    }
+    return offer;
+}
+
+bool WebSocketDeflate::accept(const std::string &responseHeader) {
+    _negotiated = false;
+    _extensions.clear();
+
+    std::string selected;
+    int selectedClientBits = 0;
+    bool selectedClientNoContextTakeover = false;
+    bool selectedServerNoContextTakeover = false;
+    for (const auto &extension : split(responseHeader, ',')) {
+        if (extension.empty()) {
+            continue;
+        }
+        std::vector<std::string> params = split(extension, ';');
+        // permessage-deflate is the only extension offered, and only once
+        if (params[0] != EXTENSION_NAME || !selected.empty()) {
+            CCLOGERROR("WebSocketDeflate: unexpected extension %s", extension.c_str());
+            return false;
+        }
+
+        int clientBits = _config.clientMaxWindowBits;
+        bool clientNoContextTakeover = _config.clientNoContextTakeover;
+        bool serverNoContextTakeover = false;
+        std::vector<std::string> keys;
+        for (size_t i = 1; i < params.size(); ++i) {
+            size_t eq = params[i].find('=');
+            std::string key = trim(params[i].substr(0, eq));
+            std::string value = eq == std::string::npos ? "" : trim(params[i].substr(eq + 1));
+            // RFC 7692 7: a parameter may appear only once
+            if (std::find(keys.begin(), keys.end(), key) != keys.end()) {
+                CCLOGERROR("WebSocketDeflate: duplicate parameter %s", key.c_str());
+                return false;
+            }
+            keys.push_back(key);
+            if (key == "client_max_window_bits") {
+                int bits = parseWindowBits(value);
+                // compressing with a wider window than the server allowed would break its inflater
+                if (bits < MIN_WINDOW_BITS) {
+                    return false;
+                }
+                clientBits = std::min(clientBits, bits);
+            } else if (key == "server_max_window_bits") {
+                int bits = parseWindowBits(value);
+                if (bits <= 0 || bits > _config.serverMaxWindowBits) {
+                    return false;
+                }
+            } else if (key == "client_no_context_takeover" && value.empty()) {
+                clientNoContextTakeover = true;
+            } else if (key == "server_no_context_takeover" && value.empty()) {
+                serverNoContextTakeover = true;
+            } else {
+                CCLOGERROR("WebSocketDeflate: unexpected parameter %s", params[i].c_str());
+                return false;
+            }
+        }
+        if (_config.serverNoContextTakeover && !serverNoContextTakeover) {
+            return false;
+        }
+
+        selected = extension;
+        selectedClientBits = clientBits;
+        selectedClientNoContextTakeover = clientNoContextTakeover;
+        selectedServerNoContextTakeover = serverNoContextTakeover;
+    }
+    if (selected.empty()) {
+        return true;
+    }
+
+    _compressWindowBits = selectedClientBits;
+    _compressReset = selectedClientNoContextTakeover;
+    _decompressReset = selectedServerNoContextTakeover;
+    _extensions = selected;
+    _negotiated = initStreams();
+    return _negotiated;
+}
+
+bool WebSocketDeflate::initStreams() {
+    _compressor.reset(new z_stream_s());
+    if (deflateInit2(_compressor.get(), _config.compressionLevel, Z_DEFLATED, -_compressWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        _compressor.reset();
+        return false;
+    }
+    // the server never uses a window larger than 15 bits, inflating with the largest one is always safe
+    _decompressor.reset(new z_stream_s());
+    if (inflateInit2(_decompressor.get(), -15) != Z_OK) {
+        _decompressor.reset();
+        return false;
+    }
+    return true;
+}
+
+bool WebSocketDeflate::compress(const uint8_t *data, size_t len, std::vector<uint8_t> &out) {
+    if (!_compressor) {
+        return false;
+    }
+    if (len == 0) {
+        // RFC 7692 7.2.3.6, the header of the empty stored block. zlib writes nothing when the previous message
+        // was flushed already, and the tail the receiver appends would then be misread as a stored block header.
+        out.assign(1, 0x00);
+        return true;
+    }
+    z_stream_s *stream = _compressor.get();
+    out.resize(deflateBound(stream, static_cast<uLong>(len)) + 16);
+    stream->next_in = const_cast<Bytef *>(data);
+    stream->avail_in = static_cast<uInt>(len);
+    size_t produced = 0;
+    int ret;
+    do {
+        if (produced == out.size()) {
+            out.resize(out.size() * 2);
+        }
+        stream->next_out = out.data() + produced;
+        stream->avail_out = static_cast<uInt>(out.size() - produced);
+        ret = deflate(stream, Z_SYNC_FLUSH);
+        produced = out.size() - stream->avail_out;
+    } while (ret == Z_OK && (stream->avail_in > 0 || stream->avail_out == 0));
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return false;
+    }
+    // a sync flush always ends with an empty stored block, RFC 7692 7.2.1 removes it
+    if (produced >= sizeof(DEFLATE_TAIL) &&
+        memcmp(out.data() + produced - sizeof(DEFLATE_TAIL), DEFLATE_TAIL, sizeof(DEFLATE_TAIL)) == 0) {
+        produced -= sizeof(DEFLATE_TAIL);
+    }
+    out.resize(produced);
+    if (_compressReset) {
+        deflateReset(stream);
+    }
+    return true;
+}
+
+bool WebSocketDeflate::decompress(const uint8_t *data, size_t len, std::vector<uint8_t> &out, size_t maxSize) {
+    if (!_decompressor) {
+        return false;
+    }
+    z_stream_s *stream = _decompressor.get();
+    // one spare byte so that a message of exactly maxSize bytes can be told apart from a larger one
+    size_t limit = maxSize + 1;
+    out.resize(std::min(limit, std::max<size_t>(len * 4, 1024)));
+    size_t produced = 0;
+
+    // feed the payload followed by the tail that the sender stripped
+    const uint8_t *inputs[] = {data, DEFLATE_TAIL};
+    size_t inputLengths[] = {len, sizeof(DEFLATE_TAIL)};
+    // the previous deflate stream ended (BFINAL) and no byte of a new one was read since
+    bool streamEnded = false;
+    for (int i = 0; i < 2; ++i) {
+        if (i == 1 && streamEnded) {
+            // the tail completes the empty stored block of a sync flush, after a final block there is none
+            // and fed to a new stream it would be a truncated stored block which breaks the next message
+            break;
+        }
+        stream->next_in = const_cast<Bytef *>(inputs[i]);
+        stream->avail_in = static_cast<uInt>(inputLengths[i]);
+        while (stream->avail_in > 0) {
+            if (produced == out.size()) {
+                if (out.size() >= limit) {
+                    return false;
+                }
+                out.resize(std::min(limit, out.size() * 2));
+            }
+            stream->next_out = out.data() + produced;
+            stream->avail_out = static_cast<uInt>(out.size() - produced);
+            int ret = inflate(stream, Z_SYNC_FLUSH);
+            produced = out.size() - stream->avail_out;
+            if (ret == Z_STREAM_END) {
+                // the server ended the deflate stream (BFINAL), what follows starts a new one
+                inflateReset(stream);
+                streamEnded = true;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                return false;
+            } else {
+                streamEnded = false;
+            }
+        }
+    }
+    if (produced > maxSize) {
+        return false;
+    }
+    out.resize(produced);
+    if (_decompressReset) {
+        inflateReset(stream);
+    }
+    return true;
+}
+
+} // namespace network
+} // namespace cocos2d
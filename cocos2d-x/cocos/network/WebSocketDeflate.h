@@ -0,0 +1,92 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct z_stream_s;
+
+namespace cocos2d {
+namespace network {
+
+/**
+ * permessage-deflate (RFC 7692) for the client side of a WebSocket connection.
+ * Builds the Sec-WebSocket-Extensions offer, validates the server response and compresses / decompresses
+ * whole messages with zlib. The LZ77 window is kept between messages unless no_context_takeover was negotiated.
+ */
+class WebSocketDeflate final {
+public:
+    struct Config {
+        int clientMaxWindowBits{15};        // window used to compress outbound messages (9-15)
+        int serverMaxWindowBits{15};        // largest window the server may compress with (9-15)
+        bool clientNoContextTakeover{false}; // reset the compressor after every outbound message
+        bool serverNoContextTakeover{false}; // ask the server to reset its compressor after every message
+        int compressionLevel{6};
+        size_t minCompressSize{64};         // smaller messages are sent uncompressed
+    };
+
+    explicit WebSocketDeflate(const Config &config);
+    ~WebSocketDeflate();
+
+    /** Value of the Sec-WebSocket-Extensions request header. */
+    std::string getOffer() const;
+
+    /**
+     * Applies the Sec-WebSocket-Extensions response header. Returns false when the server answered with
+     * extensions or parameters which were not offered or appear twice, or with a client window below 9 bits
+     * which zlib can't honor, in which case the connection must be failed.
+     * isNegotiated() tells whether compression is in use afterwards.
+     */
+    bool accept(const std::string &responseHeader);
+    bool isNegotiated() const { return _negotiated; }
+    const std::string &getExtensions() const { return _extensions; }
+
+    /** Whether a message of this size should be compressed, RSV1 is set on its first frame. */
+    bool shouldCompress(size_t len) const { return _negotiated && len >= _config.minCompressSize; }
+
+    /** Compresses a whole message, the trailing 0x00 0x00 0xff 0xff is removed as required by RFC 7692. */
+    bool compress(const uint8_t *data, size_t len, std::vector<uint8_t> &out);
+
+    /** Decompresses a whole message whose first frame had RSV1 set, fails if it grows beyond maxSize. */
+    bool decompress(const uint8_t *data, size_t len, std::vector<uint8_t> &out, size_t maxSize);
+
+private:
+    bool initStreams();
+
+    Config _config;
+    bool _negotiated{false};
+    bool _compressReset{false};
+    bool _decompressReset{false};
+    int _compressWindowBits{15};
+    std::string _extensions;
+    std::unique_ptr<z_stream_s> _compressor;
+    std::unique_ptr<z_stream_s> _decompressor;
+};
+
+} // namespace network
+} // namespace cocos2d
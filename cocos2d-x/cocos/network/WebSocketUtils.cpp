@@ -0,0 +1,614 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "network/WebSocketUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+// NEON on arm (armeabi-v7a builds this file with .neon), SSE2 on x86 with an AVX2 variant picked at runtime
+#if defined(__aarch64__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define WEBSOCKET_SIMD_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define WEBSOCKET_SIMD_SSE2 1
+    #if defined(__GNUC__) || defined(__clang__)
+        #include <immintrin.h>
+        #define WEBSOCKET_SIMD_AVX2 1
+        #define WEBSOCKET_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+namespace {
+
+#if WEBSOCKET_SIMD_AVX2
+bool hasAVX2() {
+    static const bool supported = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return supported;
+}
+#endif
+
+// index of the first non-ASCII byte at or after i, or a position at most 15 bytes before it
+inline size_t skipASCII(const uint8_t *data, size_t i, size_t len) {
+#if WEBSOCKET_SIMD_NEON
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t chunk = vld1q_u8(data + i);
+        uint8x8_t folded = vorr_u8(vget_low_u8(chunk), vget_high_u8(chunk));
+        if ((vget_lane_u64(vreinterpret_u64_u8(folded), 0) & 0x8080808080808080ULL) != 0) {
+            break;
+        }
+    }
+#elif WEBSOCKET_SIMD_SSE2
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i))) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, data + i, sizeof(chunk));
+        if ((chunk & 0x8080808080808080ULL) != 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+bool isValidUTF8Scalar(const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        // JSON payloads are mostly ASCII, skip it in blocks
+        i = skipASCII(data, i, len);
+        if (i == len) {
+            break;
+        }
+
+        uint8_t c = data[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+
+        size_t n;
+        uint8_t lo = 0x80;
+        uint8_t hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            if (c == 0xE0) {
+                lo = 0xA0; // overlong
+            } else if (c == 0xED) {
+                hi = 0x9F; // surrogates
+            }
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            if (c == 0xF0) {
+                lo = 0x90; // overlong
+            } else if (c == 0xF4) {
+                hi = 0x8F; // above U+10FFFF
+            }
+        } else {
+            return false;
+        }
+
+        if (len - i <= n) {
+            return false;
+        }
+        if (data[i + 1] < lo || data[i + 1] > hi) {
+            return false;
+        }
+        for (size_t k = 2; k <= n; ++k) {
+            if ((data[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+#if defined(__aarch64__) || WEBSOCKET_SIMD_AVX2
+// Lookup-table validation of Keiser and Lemire ("Validating UTF-8 In Less Than One Instruction Per Byte").
+// The high nibble of the previous byte, its low nibble and the high nibble of the current byte each select
+// the set of errors they could be part of, a byte pair is invalid when all three agree. Sequences longer
+// than two bytes are checked separately by requiring continuation bytes after 3 and 4 byte leads.
+const uint8_t TOO_SHORT = 1 << 0;      // lead byte not followed by enough continuation bytes
+const uint8_t TOO_LONG = 1 << 1;       // continuation byte after ASCII
+const uint8_t OVERLONG_3 = 1 << 2;     // E0 80..9F
+const uint8_t TOO_LARGE = 1 << 3;      // F4 90..BF and F5..FF
+const uint8_t SURROGATE = 1 << 4;      // ED A0..BF
+const uint8_t OVERLONG_2 = 1 << 5;     // C0, C1
+const uint8_t TOO_LARGE_1000 = 1 << 6; // F5..FF followed by 80..8F
+const uint8_t OVERLONG_4 = 1 << 6;     // F0 80..8F
+const uint8_t TWO_CONTS = 1 << 7;      // two continuation bytes, valid only inside a 3 or 4 byte sequence
+const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// indexed by the high nibble of the previous byte
+const uint8_t BYTE_1_HIGH[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+// indexed by the low nibble of the previous byte
+const uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+// indexed by the high nibble of the current byte
+const uint8_t BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+#endif
+
+#if defined(__aarch64__)
+struct NEONUTF8Checker {
+    uint8x16_t byte1High{vld1q_u8(BYTE_1_HIGH)};
+    uint8x16_t byte1Low{vld1q_u8(BYTE_1_LOW)};
+    uint8x16_t byte2High{vld1q_u8(BYTE_2_HIGH)};
+    uint8x16_t error{vdupq_n_u8(0)};
+    uint8x16_t prevInput{vdupq_n_u8(0)};
+    uint8x16_t prevIncomplete{vdupq_n_u8(0)};
+
+    void check(uint8x16_t input) {
+        if (vmaxvq_u8(input) < 0x80) {
+            error = vorrq_u8(error, prevIncomplete);
+            prevIncomplete = vdupq_n_u8(0);
+            prevInput = input;
+            return;
+        }
+        uint8x16_t prev1 = vextq_u8(prevInput, input, 15);
+        uint8x16_t specialCases = vandq_u8(vandq_u8(vqtbl1q_u8(byte1High, vshrq_n_u8(prev1, 4)),
+                                                    vqtbl1q_u8(byte1Low, vandq_u8(prev1, vdupq_n_u8(0x0F)))),
+                                           vqtbl1q_u8(byte2High, vshrq_n_u8(input, 4)));
+        uint8x16_t isThirdByte = vqsubq_u8(vextq_u8(prevInput, input, 14), vdupq_n_u8(0xE0 - 1));
+        uint8x16_t isFourthByte = vqsubq_u8(vextq_u8(prevInput, input, 13), vdupq_n_u8(0xF0 - 1));
+        uint8x16_t mustBeContinuation = vandq_u8(vcgtq_u8(vorrq_u8(isThirdByte, isFourthByte), vdupq_n_u8(0)),
+                                                 vdupq_n_u8(0x80));
+        error = vorrq_u8(error, veorq_u8(mustBeContinuation, specialCases));
+        // a lead byte in the last 1-3 positions needs continuation bytes from the next block
+        static const uint8_t maxValue[16] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                             0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1};
+        prevIncomplete = vqsubq_u8(input, vld1q_u8(maxValue));
+        prevInput = input;
+    }
+};
+
+bool isValidUTF8NEON(const uint8_t *data, size_t len) {
+    NEONUTF8Checker checker;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        checker.check(vld1q_u8(data + i));
+    }
+    if (i < len) {
+        uint8_t tail[16] = {0};
+        memcpy(tail, data + i, len - i);
+        checker.check(vld1q_u8(tail));
+    }
+    return vmaxvq_u8(vorrq_u8(checker.error, checker.prevIncomplete)) == 0;
+}
+#endif
+
+#if WEBSOCKET_SIMD_AVX2
+WEBSOCKET_TARGET_AVX2 inline __m256i broadcastTable(const uint8_t *table) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(table)));
+}
+
+WEBSOCKET_TARGET_AVX2 inline __m256i highNibbles(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+WEBSOCKET_TARGET_AVX2 bool isValidUTF8AVX2(const uint8_t *data, size_t len) {
+    const __m256i byte1High = broadcastTable(BYTE_1_HIGH);
+    const __m256i byte1Low = broadcastTable(BYTE_1_LOW);
+    const __m256i byte2High = broadcastTable(BYTE_2_HIGH);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxValue = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                              static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1),
+                                              static_cast<char>(0xC0 - 1));
+    __m256i error = zero;
+    __m256i prevInput = zero;
+    __m256i prevIncomplete = zero;
+    uint8_t tail[32];
+    for (size_t i = 0; i < len; i += 32) {
+        const uint8_t *block = data + i;
+        if (len - i < 32) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, block, len - i);
+            block = tail;
+        }
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prevIncomplete);
+            prevIncomplete = zero;
+            prevInput = input;
+            continue;
+        }
+        // the last bytes of the previous block followed by this block, lane by lane
+        __m256i shifted = _mm256_permute2x128_si256(prevInput, input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+        __m256i specialCases = _mm256_and_si256(
+            _mm256_and_si256(_mm256_shuffle_epi8(byte1High, highNibbles(prev1)),
+                             _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+            _mm256_shuffle_epi8(byte2High, highNibbles(input)));
+        __m256i isThirdByte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 1)));
+        __m256i isFourthByte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 1)));
+        __m256i mustBeContinuation = _mm256_and_si256(
+            _mm256_cmpgt_epi8(_mm256_or_si256(isThirdByte, isFourthByte), zero),
+            _mm256_set1_epi8(static_cast<char>(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(mustBeContinuation, specialCases));
+        prevIncomplete = _mm256_subs_epu8(input, maxValue);
+        prevInput = input;
+    }
+    error = _mm256_or_si256(error, prevIncomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+WEBSOCKET_TARGET_AVX2 size_t applyMaskAVX2(uint8_t *data, size_t len, uint32_t key32) {
+    const __m256i key = _mm256_set1_epi32(static_cast<int>(key32));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        auto *p = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), key));
+    }
+    return i;
+}
+#endif
+
+} // namespace
+
+namespace cocos2d {
+namespace network {
+namespace WebSocketUtils {
+
+bool isValidUTF8(const uint8_t *data, size_t len) {
+#if defined(__aarch64__)
+    if (len >= 16) {
+        return isValidUTF8NEON(data, len);
+    }
+#elif WEBSOCKET_SIMD_AVX2
+    if (len >= 32 && hasAVX2()) {
+        return isValidUTF8AVX2(data, len);
+    }
+#endif
+    return isValidUTF8Scalar(data, len);
+}
+
+void applyMask(uint8_t *data, size_t len, const uint8_t key[4]) {
+    // every block size used below is a multiple of 4, so the key phase stays aligned with i
+    uint32_t key32;
+    memcpy(&key32, key, sizeof(key32));
+    size_t i = 0;
+#if WEBSOCKET_SIMD_AVX2
+    if (len >= 64 && hasAVX2()) {
+        i = applyMaskAVX2(data, len, key32);
+    }
+#endif
+#if WEBSOCKET_SIMD_NEON
+    const uint8x16_t key128 = vreinterpretq_u8_u32(vdupq_n_u32(key32));
+    for (; i + 16 <= len; i += 16) {
+        vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), key128));
+    }
+#elif WEBSOCKET_SIMD_SSE2
+    const __m128i key128 = _mm_set1_epi32(static_cast<int>(key32));
+    for (; i + 16 <= len; i += 16) {
+        auto *p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+    }
+#endif
+    uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, data + i, sizeof(chunk));
+        chunk ^= key64;
+        memcpy(data + i, &chunk, sizeof(chunk));
+    }
+    for (; i < len; ++i) {
+        data[i] ^= key[i & 3];
+    }
+}
+
+float getReconnectDelay(const WebSocket::ReconnectPolicy &policy, int attempt) {
+    static std::mt19937 random{std::random_device{}()};
+    float delay = std::min(policy.maxDelay, policy.initialDelay * std::pow(2.0F, static_cast<float>(std::min(attempt - 1, 30))));
+    float jitter = std::min(1.0F, std::max(0.0F, policy.jitter));
+    std::uniform_real_distribution<float> distribution(1.0F - jitter, 1.0F + jitter);
+    return std::max(0.0F, delay * distribution(random));
+}
+
+void RoundTripEstimator::addSample(float rtt) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_count == 0) {
+        _min = rtt;
+        _smoothed = rtt;
+    } else {
+        _min = std::min(_min, rtt);
+        // gain of 1/8 like the SRTT of TCP (RFC 6298)
+        _smoothed += (rtt - _smoothed) / 8.0F;
+    }
+    _window[_count % WINDOW] = rtt;
+    ++_count;
+}
+
+void RoundTripEstimator::reset() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _min = 0;
+    _smoothed = 0;
+    _count = 0;
+}
+
+WebSocket::RoundTripTime RoundTripEstimator::get() const {
+    WebSocket::RoundTripTime result;
+    float window[WINDOW];
+    size_t size = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        result.min = _min;
+        result.avg = _smoothed;
+        result.samples = _count;
+        size = _count < WINDOW ? _count : WINDOW;
+        std::copy(_window, _window + size, window);
+    }
+    if (size > 0) {
+        // nearest rank
+        size_t rank = (size * 95 + 99) / 100 - 1;
+        std::nth_element(window, window + rank, window + size);
+        result.p95 = window[rank];
+    }
+    return result;
+}
+
+int LatencyHistogram::getBucket(uint64_t micros) {
+    if (micros < 2 * SUB_BUCKETS) {
+        return static_cast<int>(micros);
+    }
+    int exponent = 63 - __builtin_clzll(micros);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    // the 3 bits below the leading one select the linear bucket
+    int sub = static_cast<int>(micros >> (exponent - 3)) & (SUB_BUCKETS - 1);
+    return 2 * SUB_BUCKETS + (exponent - 4) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::getBucketValue(int bucket) {
+    if (bucket < 2 * SUB_BUCKETS) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int exponent = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 4;
+    uint64_t sub = static_cast<uint64_t>((bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS);
+    uint64_t width = 1ULL << (exponent - 3);
+    return (SUB_BUCKETS + sub) * width + width / 2;
+}
+
+void LatencyHistogram::record(int64_t micros) {
+    uint64_t value = micros > 0 ? static_cast<uint64_t>(micros) : 0;
+    _counts[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+WebSocket::LatencyStats LatencyHistogram::snapshot() const {
+    // the buckets are read one by one, a sample recorded meanwhile may be missing from the percentiles
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        counts[i] = _counts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    WebSocket::LatencyStats stats;
+    if (total == 0) {
+        return stats;
+    }
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    stats.count = total;
+    stats.mean = static_cast<float>(_sum.load(std::memory_order_relaxed)) / static_cast<float>(total) / 1000.0F;
+    stats.max = static_cast<float>(max) / 1000.0F;
+    const double quantiles[] = {0.5, 0.9, 0.99};
+    float *results[] = {&stats.p50, &stats.p90, &stats.p99};
+    uint64_t seen = 0;
+    int bucket = 0;
+    for (int q = 0; q < 3; ++q) {
+        auto rank = static_cast<uint64_t>(std::ceil(quantiles[q] * static_cast<double>(total)));
+        while (bucket < BUCKETS - 1 && seen + counts[bucket] < rank) {
+            seen += counts[bucket++];
+        }
+        *results[q] = static_cast<float>(std::min(getBucketValue(bucket), max)) / 1000.0F;
+    }
+    return stats;
+}
+
+MetricsRecorder &MetricsRecorder::getGlobal() {
+    static auto *global = new MetricsRecorder(Root());
+    return *global;
+}
+
+void MetricsRecorder::onMessageSent(size_t bytes, bool isBinary) {
+    for (MetricsRecorder *m = this; m != nullptr; m = m->_parent) {
+        m->_messagesSent.fetch_add(1, std::memory_order_relaxed);
+        m->_bytesSent.fetch_add(bytes, std::memory_order_relaxed);
+        if (isBinary) {
+            m->_binaryMessagesSent.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void MetricsRecorder::onMessageReceived(size_t bytes, int64_t deliveryMicros) {
+    for (MetricsRecorder *m = this; m != nullptr; m = m->_parent) {
+        m->_messagesReceived.fetch_add(1, std::memory_order_relaxed);
+        m->_bytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+        m->_deliveryLatency.record(deliveryMicros);
+    }
+}
+
+void MetricsRecorder::onJniCall(int64_t micros) {
+    for (MetricsRecorder *m = this; m != nullptr; m = m->_parent) {
+        m->_jniCallTime.record(micros);
+    }
+}
+
+void MetricsRecorder::onOpen(int64_t handshakeMicros) {
+    for (MetricsRecorder *m = this; m != nullptr; m = m->_parent) {
+        m->_connections.fetch_add(1, std::memory_order_relaxed);
+        m->_handshakeTime.record(handshakeMicros);
+    }
+}
+
+void MetricsRecorder::onReconnect() {
+    for (MetricsRecorder *m = this; m != nullptr; m = m->_parent) {
+        m->_reconnects.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void MetricsRecorder::onSendBufferAllocation() {
+    for (MetricsRecorder *m = this; m != nullptr; m = m->_parent) {
+        m->_sendBufferAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+WebSocket::Metrics MetricsRecorder::snapshot() const {
+    WebSocket::Metrics metrics;
+    metrics.messagesSent = _messagesSent.load(std::memory_order_relaxed);
+    metrics.bytesSent = _bytesSent.load(std::memory_order_relaxed);
+    metrics.binaryMessagesSent = _binaryMessagesSent.load(std::memory_order_relaxed);
+    metrics.messagesReceived = _messagesReceived.load(std::memory_order_relaxed);
+    metrics.bytesReceived = _bytesReceived.load(std::memory_order_relaxed);
+    metrics.connections = _connections.load(std::memory_order_relaxed);
+    metrics.reconnects = _reconnects.load(std::memory_order_relaxed);
+    metrics.sendBufferAllocations = _sendBufferAllocations.load(std::memory_order_relaxed);
+    metrics.handshakeTime = _handshakeTime.snapshot();
+    metrics.deliveryLatency = _deliveryLatency.snapshot();
+    metrics.jniCallTime = _jniCallTime.snapshot();
+    return metrics;
+}
+
+namespace {
+bool equalsIgnoreCase(const char *a, const char *b, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        char x = a[i];
+        char y = b[i];
+        x = (x >= 'A' && x <= 'Z') ? static_cast<char>(x - 'A' + 'a') : x;
+        y = (y >= 'A' && y <= 'Z') ? static_cast<char>(y - 'A' + 'a') : y;
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+void HeaderBlock::assign(std::string &&block) {
+    _block = std::move(block);
+    _spans.clear();
+    _indexed = false;
+}
+
+void HeaderBlock::index() const {
+    _indexed = true;
+    const char *data = _block.data();
+    size_t size = _block.size();
+    size_t pos = 0;
+    while (pos < size) {
+        const char *newline = static_cast<const char *>(memchr(data + pos, '\n', size - pos));
+        size_t end = newline != nullptr ? static_cast<size_t>(newline - data) : size;
+        const char *colon = static_cast<const char *>(memchr(data + pos, ':', end - pos));
+        if (colon != nullptr) {
+            size_t nameEnd = static_cast<size_t>(colon - data);
+            size_t valueBegin = nameEnd + 1;
+            size_t valueEnd = end;
+            while (valueBegin < valueEnd && (data[valueBegin] == ' ' || data[valueBegin] == '\t')) {
+                ++valueBegin;
+            }
+            while (valueEnd > valueBegin &&
+                   (data[valueEnd - 1] == ' ' || data[valueEnd - 1] == '\t' || data[valueEnd - 1] == '\r')) {
+                --valueEnd;
+            }
+            Span span;
+            span.nameBegin = static_cast<uint32_t>(pos);
+            span.nameLength = static_cast<uint32_t>(nameEnd - pos);
+            span.valueBegin = static_cast<uint32_t>(valueBegin);
+            span.valueLength = static_cast<uint32_t>(valueEnd - valueBegin);
+            _spans.push_back(span);
+        }
+        pos = end + 1;
+    }
+}
+
+std::string HeaderBlock::get(const std::string &name) const {
+    if (!_indexed) {
+        index();
+    }
+    std::string value;
+    bool found = false;
+    for (const auto &span : _spans) {
+        if (span.nameLength != name.size() || !equalsIgnoreCase(_block.data() + span.nameBegin, name.data(), name.size())) {
+            continue;
+        }
+        if (found) {
+            value.append(", ");
+        }
+        value.append(_block, span.valueBegin, span.valueLength);
+        found = true;
+    }
+    return value;
+}
+
+} // namespace WebSocketUtils
+} // namespace network
+} // namespace cocos2d
@@ -0,0 +1,364 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "network/WebSocket.h"
+
+// Internal helpers shared by the WebSocket backends, not part of the public network API.
+namespace cocos2d {
+namespace network {
+namespace WebSocketUtils {
+
+/**
+ * Checks that a text frame payload is well-formed UTF-8 (RFC 3629): no overlong encodings,
+ * no surrogates and nothing above U+10FFFF.
+ */
+bool isValidUTF8(const uint8_t *data, size_t len);
+
+/**
+ * XORs a payload in place with the 4-byte masking key of a client frame (RFC 6455 5.3).
+ * Masking is its own inverse, the same call unmasks.
+ */
+void applyMask(uint8_t *data, size_t len, const uint8_t key[4]);
+
+/**
+ * Slot map from 64-bit handles to the objects of a backend, the handles are what Java and other threads hold
+ * instead of pointers. A handle is a slot index plus the generation of the slot, which changes when the object
+ * is removed, so a stale handle never resolves again, even once the slot is reused.
+ * add, remove and get run on the game thread. Other threads resolve a handle through a Pin, which is
+ * lock-free and keeps remove() from returning until the pin is released.
+ */
+template <typename T>
+class HandleTable {
+    struct Slot {
+        std::atomic<uint32_t> generation{1};
+        std::atomic<uint32_t> pins{0};
+        std::atomic<T *> object{nullptr};
+        uint32_t nextFree{0}; // guarded by _mutex
+    };
+
+public:
+    HandleTable() = default;
+    ~HandleTable() {
+        for (auto &chunk : _chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+    HandleTable(const HandleTable &) = delete;
+    HandleTable &operator=(const HandleTable &) = delete;
+
+    // Holds the object of a handle for the lifetime of the pin, remove() blocks until the last pin is released.
+    class Pin {
+    public:
+        Pin(HandleTable &table, uint64_t handle)
+        : _table(table) {
+            Slot *slot = table.getSlot(handle);
+            if (slot == nullptr) {
+                return;
+            }
+            // seq_cst on both sides: either remove() sees the pin or the pin sees the new generation
+            slot->pins.fetch_add(1);
+            _generation = static_cast<uint32_t>(handle >> 32);
+            if (slot->generation.load() == _generation) {
+                _slot = slot;
+                _object = slot->object.load();
+            } else {
+                table.unpin(slot, _generation);
+            }
+        }
+        ~Pin() {
+            if (_slot != nullptr) {
+                _table.unpin(_slot, _generation);
+            }
+        }
+        Pin(const Pin &) = delete;
+        Pin &operator=(const Pin &) = delete;
+
+        T *get() const { return _object; }
+
+    private:
+        HandleTable &_table;
+        Slot *_slot{nullptr};
+        T *_object{nullptr};
+        uint32_t _generation{0};
+    };
+
+    uint64_t add(T *object) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint32_t index = 0;
+        if (_freeHead != 0) {
+            index = _freeHead - 1;
+            _freeHead = getSlotAt(index)->nextFree;
+        } else {
+            index = _size++;
+            if (index % CHUNK_SIZE == 0) {
+                if (index / CHUNK_SIZE >= MAX_CHUNKS) {
+                    --_size;
+                    return 0;
+                }
+                _chunks[index / CHUNK_SIZE].store(new Slot[CHUNK_SIZE], std::memory_order_release);
+            }
+        }
+        Slot *slot = getSlotAt(index);
+        slot->object.store(object);
+        return (static_cast<uint64_t>(slot->generation.load()) << 32) | (index + 1);
+    }
+
+    void remove(uint64_t handle) {
+        Slot *slot = getSlot(handle);
+        if (slot == nullptr || slot->generation.load() != static_cast<uint32_t>(handle >> 32)) {
+            return;
+        }
+        slot->generation.fetch_add(1);
+        if (slot->pins.load() != 0) {
+            std::unique_lock<std::mutex> lock(_unpinMutex);
+            _unpinned.wait(lock, [slot]() { return slot->pins.load() == 0; });
+        }
+        slot->object.store(nullptr);
+        std::lock_guard<std::mutex> lock(_mutex);
+        slot->nextFree = _freeHead;
+        _freeHead = static_cast<uint32_t>(handle & 0xFFFFFFFF);
+    }
+
+    // game thread only, objects are destroyed there too so nothing needs to be pinned
+    T *get(uint64_t handle) const {
+        Slot *slot = getSlot(handle);
+        if (slot == nullptr || slot->generation.load(std::memory_order_relaxed) != static_cast<uint32_t>(handle >> 32)) {
+            return nullptr;
+        }
+        return slot->object.load(std::memory_order_relaxed);
+    }
+
+    std::vector<uint64_t> getHandles() const {
+        std::vector<uint64_t> handles;
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (uint32_t index = 0; index < _size; ++index) {
+            Slot *slot = getSlotAt(index);
+            if (slot->object.load(std::memory_order_relaxed) != nullptr) {
+                handles.push_back((static_cast<uint64_t>(slot->generation.load()) << 32) | (index + 1));
+            }
+        }
+        return handles;
+    }
+
+private:
+    static const uint32_t CHUNK_SIZE = 64;
+
+    // A changed generation means remove() may be waiting for the last pin. It bumps the generation before it
+    // reads the pin count, so when this still sees the old generation remove() is going to read 0 by itself.
+    void unpin(Slot *slot, uint32_t generation) {
+        if (slot->pins.fetch_sub(1) == 1 && slot->generation.load() != generation) {
+            std::lock_guard<std::mutex> lock(_unpinMutex);
+            _unpinned.notify_all();
+        }
+    }
+
+    static const uint32_t MAX_CHUNKS = 256;
+
+    // chunks are never freed, so a slot stays addressable while another thread resolves a stale handle
+    Slot *getSlotAt(uint32_t index) const {
+        Slot *chunk = _chunks[index / CHUNK_SIZE].load(std::memory_order_acquire);
+        return chunk != nullptr ? chunk + index % CHUNK_SIZE : nullptr;
+    }
+    Slot *getSlot(uint64_t handle) const {
+        auto index = static_cast<uint32_t>(handle & 0xFFFFFFFF);
+        if (index == 0 || index > MAX_CHUNKS * CHUNK_SIZE) {
+            return nullptr;
+        }
+        return getSlotAt(index - 1);
+    }
+
+    std::atomic<Slot *> _chunks[MAX_CHUNKS]{};
+    mutable std::mutex _mutex;
+    std::mutex _unpinMutex;
+    std::condition_variable _unpinned;
+    uint32_t _size{0};     // slots handed out so far, guarded by _mutex
+    uint32_t _freeHead{0}; // index + 1 of the first free slot, guarded by _mutex
+};
+
+/**
+ * Hysteresis between Options::bufferedAmountHighWaterMark and bufferedAmountLowWaterMark. Transports call
+ * crossed() from any thread when the buffered amount changes and schedule a dispatch if it returns true, the
+ * dispatch calls update() on the game thread to learn which callback is due.
+ */
+class WaterMarks {
+public:
+    enum class Crossing {
+        NONE,
+        HIGH,
+        LOW
+    };
+
+    void init(size_t high, size_t low) {
+        _high = high;
+        _low = low < high ? low : high;
+    }
+
+    bool crossed(size_t amount) const {
+        if (_high == 0) {
+            return false;
+        }
+        return _above.load(std::memory_order_relaxed) ? amount <= _low : amount >= _high;
+    }
+
+    Crossing update(size_t amount) {
+        if (!crossed(amount)) {
+            return Crossing::NONE;
+        }
+        bool above = !_above.load(std::memory_order_relaxed);
+        _above.store(above, std::memory_order_relaxed);
+        return above ? Crossing::HIGH : Crossing::LOW;
+    }
+
+private:
+    size_t _high{0}; // 0 disables both marks
+    size_t _low{0};
+    std::atomic<bool> _above{false};
+};
+
+/**
+ * Seconds to wait before reconnect attempt `attempt` (from 1): policy.initialDelay doubled for every attempt up
+ * to policy.maxDelay, randomized by policy.jitter. Game thread only, the random engine is shared.
+ */
+float getReconnectDelay(const WebSocket::ReconnectPolicy &policy, int attempt);
+
+/**
+ * Response headers of the opening handshake. The block of "Name: value\n" lines is kept as it arrived and only
+ * indexed by the first lookup, so a connection whose headers are never read doesn't parse them at all.
+ * Game thread only.
+ */
+class HeaderBlock {
+public:
+    void assign(std::string &&block);
+    /** Case-insensitive, values of repeated headers are joined by ", ". Empty if there is no such header. */
+    std::string get(const std::string &name) const;
+
+private:
+    struct Span {
+        uint32_t nameBegin;
+        uint32_t nameLength;
+        uint32_t valueBegin;
+        uint32_t valueLength;
+    };
+    void index() const;
+
+    std::string _block;
+    mutable std::vector<Span> _spans;
+    mutable bool _indexed{false};
+};
+
+/**
+ * Statistics of the ping round trips of a connection. Samples are added by the transport thread and read on
+ * the game thread.
+ */
+class RoundTripEstimator {
+public:
+    /** Adds one round trip in milliseconds. */
+    void addSample(float rtt);
+    /** Forgets every sample, called when a new connection is opened. */
+    void reset();
+    WebSocket::RoundTripTime get() const;
+
+private:
+    static const size_t WINDOW = 64; // samples kept for the percentile
+
+    mutable std::mutex _mutex;
+    float _min{0};
+    float _smoothed{0};
+    uint32_t _count{0};
+    float _window[WINDOW]{};
+};
+
+/**
+ * Lock-free histogram of durations in microseconds, HDR style: exact below 16us, then 8 linear buckets per
+ * power of two up to about 9.5 hours. Recording is a few relaxed atomic adds, any thread may record.
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKETS = 8;
+    static const int MAX_EXPONENT = 35; // values of 2^36us and more share the last bucket
+    static const int BUCKETS = 2 * SUB_BUCKETS + (MAX_EXPONENT - 3) * SUB_BUCKETS;
+
+    void record(int64_t micros);
+    WebSocket::LatencyStats snapshot() const;
+
+    static int getBucket(uint64_t micros);
+    static uint64_t getBucketValue(int bucket); // middle of the bucket
+
+private:
+    std::atomic<uint64_t> _counts[BUCKETS]{};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _max{0};
+};
+
+/**
+ * Counters behind WebSocket::Metrics. Every WebSocket owns one, which adds everything it records to the
+ * process-wide instance returned by getGlobal() as well.
+ */
+class MetricsRecorder {
+public:
+    MetricsRecorder() : _parent(&getGlobal()) {}
+    MetricsRecorder(const MetricsRecorder &) = delete;
+    MetricsRecorder &operator=(const MetricsRecorder &) = delete;
+
+    static MetricsRecorder &getGlobal();
+
+    void onMessageSent(size_t bytes, bool isBinary);
+    void onMessageReceived(size_t bytes, int64_t deliveryMicros);
+    void onJniCall(int64_t micros);
+    void onOpen(int64_t handshakeMicros);
+    void onReconnect();
+    void onSendBufferAllocation();
+
+    WebSocket::Metrics snapshot() const;
+
+private:
+    struct Root {};
+    explicit MetricsRecorder(Root /*root*/) {}
+
+    MetricsRecorder *_parent{nullptr};
+    std::atomic<uint64_t> _messagesSent{0};
+    std::atomic<uint64_t> _bytesSent{0};
+    std::atomic<uint64_t> _binaryMessagesSent{0};
+    std::atomic<uint64_t> _messagesReceived{0};
+    std::atomic<uint64_t> _bytesReceived{0};
+    std::atomic<uint64_t> _connections{0};
+    std::atomic<uint64_t> _reconnects{0};
+    std::atomic<uint64_t> _sendBufferAllocations{0};
+    LatencyHistogram _handshakeTime;
+    LatencyHistogram _deliveryLatency;
+    LatencyHistogram _jniCallTime;
+};
+
+} // namespace WebSocketUtils
+} // namespace network
+} // namespace cocos2d
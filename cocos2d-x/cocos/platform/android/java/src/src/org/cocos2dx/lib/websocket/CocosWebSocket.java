@@ -1,9 +1,11 @@
 package org.cocos2dx.lib.websocket;
 
+import android.content.Context;
+import android.net.SSLCertificateSocketFactory;
+import android.net.SSLSessionCache;
 import android.os.Build;
 import android.util.Log;
 
-import org.cocos2dx.lib.Cocos2dxHelper;
 import org.cocos2dx.lib.GlobalObject;
 
 import org.cocos2dx.okhttp3.CipherSuite;
@@ -15,19 +17,40 @@ import org.cocos2dx.okhttp3.Response;
 import org.cocos2dx.okhttp3.WebSocketListener;
 import org.cocos2dx.okio.ByteString;
 
+import java.io.File;
 import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.InputStream;
+import java.lang.reflect.Field;
+import java.lang.reflect.Method;
+import java.net.SocketTimeoutException;
 import java.net.URI;
-import java.security.GeneralSecurityException;
-import java.security.KeyManagementException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.CharBuffer;
+import java.nio.charset.Charset;
+import java.nio.charset.CharsetEncoder;
+import java.nio.charset.CoderResult;
 import java.security.KeyStore;
-import java.security.NoSuchAlgorithmException;
-import java.security.SecureRandom;
 import java.util.Collections;
+import java.util.HashMap;
 import java.util.List;
+import java.util.Map;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentMap;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Executors;
+import java.util.concurrent.FutureTask;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.ScheduledExecutorService;
+import java.util.concurrent.ScheduledFuture;
+import java.util.concurrent.ThreadFactory;
 import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicBoolean;
 
+import javax.net.ssl.HandshakeCompletedEvent;
+import javax.net.ssl.HandshakeCompletedListener;
 import javax.net.ssl.HostnameVerifier;
 import javax.net.ssl.HttpsURLConnection;
 import javax.net.ssl.SSLContext;
@@ -46,39 +69,314 @@ public class CocosWebSocket extends WebSocketListener {
         NativeInit();
     }
 
-    private static class _WebSocketContext {
-        long identifier;
-        long handlerPtr;
+    // Clients are cached per (CA file, secure, tcpNoDelay, timeout, persistTlsSessions) and all derived from
+    // _rootClient, so they share its dispatcher and connection pool. TLS settings are cached per CA file,
+    // sockets of the same CA file use one SSLContext and therefore one client session cache, which resumes
+    // sessions (tickets and session IDs) per host:port across connections. The parsed CA file is cached
+    // per path and modification time, everything built on it is dropped when the file changes. CA files are
+    // parsed without holding the class lock, a connection only waits for the file it uses.
+    private static OkHttpClient                    _rootClient  = null;
+    private static final Map<String, _Client>      _clientCache = new HashMap<>();
+    private static final Map<String, _TlsConfig>   _tlsCache    = new HashMap<>();
+    private static final ConcurrentMap<String, _TrustStore> _trustCache = new ConcurrentHashMap<>();
+
+    private static final int _TLS_SESSION_CACHE_SIZE = 64;
+    // StandardCharsets needs API 19
+    private static final Charset _UTF8 = Charset.forName("UTF-8");
+
+    private static class _TrustStore {
+        final long                          stamp;
+        final FutureTask<X509TrustManager>  task;
+
+        _TrustStore(long stamp, FutureTask<X509TrustManager> task) {
+            this.stamp = stamp;
+            this.task  = task;
+        }
+    }
+
+    private static class _TlsConfig {
+        X509TrustManager trustManager;
+        SSLSocketFactory socketFactory;
+    }
+
+    private static class _Client {
+        _TlsConfig   tls;
+        OkHttpClient client;
+    }
+
+    // The TLS handshake runs on the dispatcher thread which later calls onOpen, so the socket created there
+    // is handed over through a thread local.
+    private static class _TlsHandshake implements HandshakeCompletedListener {
+        SSLSocket     socket;
+        long          startNanos;
+        long          startMillis;
+        volatile long endNanos;
+
+        @Override
+        public void handshakeCompleted(HandshakeCompletedEvent event) {
+            endNanos = System.nanoTime();
+        }
+    }
+    private static final ThreadLocal<_TlsHandshake> _lastTlsHandshake = new ThreadLocal<>();
+
+    // Keep-alive. OkHttp 3.12 pings at a fixed interval but never tells when the pong arrives, so pings are
+    // written by the package-private RealWebSocket.writePingFrame() on the writer executor of the socket and the
+    // pong is noticed by polling receivedPongCount(), both reached by reflection. If they can't be found the
+    // pingInterval of OkHttp is used instead, which still detects a dead peer but measures no round trips.
+    private static ScheduledExecutorService _keepAliveExecutor = null;
+    private static Field                    _writerExecutor    = null;
+    private static Method                   _writePingFrame    = null;
+    private static Method                   _receivedPongCount = null;
+    private static boolean                  _keepAliveResolved = false;
+
+    // One ping at a time, the next is sent after the pong of the previous one, which also keeps
+    // writePingFrame() from failing the socket on its own. Runs on _keepAliveExecutor except for the write.
+    private class _KeepAlive implements Runnable {
+        final org.cocos2dx.okhttp3.WebSocket webSocket;
+        ScheduledFuture<?>                   future;
+        volatile boolean                     stopped;
+        volatile long                        sentNanos; // set by the writer right before the ping goes out
+        long                                 queuedNanos;
+        int                                  expectedPongs;
+        boolean                              awaitingPong;
+
+        _KeepAlive(org.cocos2dx.okhttp3.WebSocket webSocket) {
+            this.webSocket = webSocket;
+        }
+
+        void stop() {
+            stopped = true;
+            if (future != null) {
+                future.cancel(false);
+            }
+        }
+
+        @Override
+        public void run() {
+            if (stopped || awaitingPong) {
+                return;
+            }
+            try {
+                final ScheduledExecutorService writer = (ScheduledExecutorService) _writerExecutor.get(webSocket);
+                if (writer == null) {
+                    return; // OkHttp starts the writer right after onOpen
+                }
+                expectedPongs = (Integer) _receivedPongCount.invoke(webSocket) + 1;
+                sentNanos     = 0;
+                queuedNanos   = System.nanoTime();
+                awaitingPong  = true;
+                writer.execute(new Runnable() {
+                    @Override
+                    public void run() {
+                        sentNanos = System.nanoTime();
+                        try {
+                            _writePingFrame.invoke(webSocket);
+                        } catch (Exception e) {
+                            Log.e(_TAG, "failed to write ping: " + e);
+                        }
+                    }
+                });
+                _keepAliveExecutor.schedule(checkPong, 1, TimeUnit.MILLISECONDS);
+            } catch (RejectedExecutionException e) {
+                stop(); // the socket is shutting down
+            } catch (Exception e) {
+                Log.e(_TAG, "keep-alive stopped: " + e);
+                stop();
+            }
+        }
+
+        private final Runnable checkPong = new Runnable() {
+            @Override
+            public void run() {
+                if (stopped) {
+                    return;
+                }
+                final long now  = System.nanoTime();
+                final long sent = sentNanos;
+                try {
+                    if (sent != 0 && (Integer) _receivedPongCount.invoke(webSocket) >= expectedPongs) {
+                        awaitingPong = false;
+                        _onRoundTrip((now - sent) / 1000);
+                        return;
+                    }
+                } catch (Exception e) {
+                    Log.e(_TAG, "keep-alive stopped: " + e);
+                    stop();
+                    return;
+                }
+                final long waitedMillis = (now - queuedNanos) / 1000000;
+                if (waitedMillis >= _deadPeerTimeoutMillis) {
+                    _peerTimedOut = true;
+                    stop();
+                    webSocket.cancel(); // reported by onFailure
+                    return;
+                }
+                // a round trip reads at most 1/16 too long, while a dead peer costs only a few polls
+                _keepAliveExecutor.schedule(this, Math.max(1, waitedMillis / 16), TimeUnit.MILLISECONDS);
+            }
+        };
+    }
+
+    // Native code reads the size of the send queue from a value pushed from here instead of calling
+    // queueSize(). Sends report it right away, the drain is reported by a task queued on the writer executor
+    // behind the frames, which runs once the writer caught up. Without the executor the queue is polled instead.
+    // Every report reads queueSize() and hands it to native code under _bufferedAmountLock, so a stale size
+    // read by one thread can't overwrite a newer one reported by the other.
+    private class _DrainReport implements Runnable {
+        final org.cocos2dx.okhttp3.WebSocket webSocket;
+        final AtomicBoolean                  pending = new AtomicBoolean();
+        volatile boolean                     stopped;
+
+        _DrainReport(org.cocos2dx.okhttp3.WebSocket webSocket) {
+            this.webSocket = webSocket;
+        }
+
+        void schedule() {
+            if (stopped || !pending.compareAndSet(false, true)) {
+                return;
+            }
+            try {
+                final ScheduledExecutorService writer = _writerExecutor != null
+                    ? (ScheduledExecutorService) _writerExecutor.get(webSocket) : null;
+                if (writer != null) {
+                    writer.execute(this);
+                } else {
+                    _keepAliveExecutor.schedule(this, 10, TimeUnit.MILLISECONDS);
+                }
+            } catch (RejectedExecutionException e) {
+                pending.set(false); // the socket is shutting down, its queue won't drain anymore
+            } catch (IllegalAccessException e) {
+                pending.set(false);
+                Log.e(_TAG, "failed to report the send queue: " + e);
+            }
+        }
+
+        @Override
+        public void run() {
+            pending.set(false);
+            final long size;
+            synchronized (_bufferedAmountLock) {
+                if (stopped) {
+                    return;
+                }
+                size = webSocket.queueSize();
+                nativeOnBufferedAmount(size, _handle);
+            }
+            if (size > 0) {
+                schedule();
+            }
+        }
     }
-    private static Dispatcher dispatcher = null;
 
     private final long              _timeout;
-    private final boolean           _perMessageDeflate;
     private final boolean           _tcpNoDelay;
+    private final boolean           _persistTlsSessions;
+    private final long              _pingIntervalMillis;
+    private final long              _deadPeerTimeoutMillis;
     private final                   String[] _header;
-    private final _WebSocketContext _wsContext =
-        new _WebSocketContext();
+    // generation-tagged slot in the native handle table, stale values are ignored by native code
+    private volatile long           _handle;
 
     private org.cocos2dx.okhttp3.WebSocket _webSocket;
     private OkHttpClient                   _client;
+    private long                           _connectStartNanos;
+    private boolean                        _secure;
+    private _KeepAlive                     _keepAlive;
+    private volatile _DrainReport          _drainReport;
+    private final Object                   _bufferedAmountLock = new Object();
+    private volatile boolean               _peerTimedOut;
+    // only used on the OkHttp reader thread
+    private final CharsetEncoder           _utf8Encoder = _UTF8.newEncoder();
+    // only used by _sendBatch, on the game thread
+    private byte[]                         _batchText;
+
+    CocosWebSocket(long handle, String[] header, boolean tcpNoDelay,
+                   long timeout, boolean persistTlsSessions, long pingInterval,
+                   long deadPeerTimeout) {
+        _handle                = handle;
+        _header                = header;
+        _tcpNoDelay            = tcpNoDelay;
+        _timeout               = timeout;
+        _persistTlsSessions    = persistTlsSessions;
+        _pingIntervalMillis    = pingInterval;
+        _deadPeerTimeoutMillis = deadPeerTimeout;
+    }
+
+    private static synchronized boolean _resolveKeepAlive() {
+        if (!_keepAliveResolved) {
+            _keepAliveResolved = true;
+            // also polls the send queue when the writer executor can't be reached, see _DrainReport
+            _keepAliveExecutor = Executors.newSingleThreadScheduledExecutor(new ThreadFactory() {
+                @Override
+                public Thread newThread(Runnable runnable) {
+                    Thread thread = new Thread(runnable, "cocos-websocket-ping");
+                    thread.setDaemon(true);
+                    return thread;
+                }
+            });
+            try {
+                Class<?> cls = Class.forName("org.cocos2dx.okhttp3.internal.ws.RealWebSocket");
+                Field executor = cls.getDeclaredField("executor");
+                Method writePingFrame = cls.getDeclaredMethod("writePingFrame");
+                Method receivedPongCount = cls.getDeclaredMethod("receivedPongCount");
+                executor.setAccessible(true);
+                writePingFrame.setAccessible(true);
+                receivedPongCount.setAccessible(true);
+                _writerExecutor    = executor;
+                _writePingFrame    = writePingFrame;
+                _receivedPongCount = receivedPongCount;
+            } catch (Exception e) {
+                Log.w(_TAG, "OkHttp internals not found, pinging without round trips: " + e);
+            }
+        }
+        return _receivedPongCount != null;
+    }
 
-    CocosWebSocket(long ptr, long handler, String[] header, boolean tcpNoDelay,
-                   boolean perMessageDeflate, long timeout) {
-        _wsContext.identifier = ptr;
-        _wsContext.handlerPtr = handler;
-        _header               = header;
-        _tcpNoDelay           = tcpNoDelay;
-        _perMessageDeflate    = perMessageDeflate;
-        _timeout              = timeout;
+    private synchronized void _startKeepAlive(org.cocos2dx.okhttp3.WebSocket webSocket) {
+        _stopKeepAlive();
+        _keepAlive = new _KeepAlive(webSocket);
+        _keepAlive.future = _keepAliveExecutor.scheduleAtFixedRate(
+            _keepAlive, _pingIntervalMillis, _pingIntervalMillis, TimeUnit.MILLISECONDS);
     }
 
-    private void _removeHandler() {
-        synchronized (_wsContext) {
-            _wsContext.identifier = 0;
-            _wsContext.handlerPtr = 0;
+    private synchronized void _stopKeepAlive() {
+        if (_keepAlive != null) {
+            _keepAlive.stop();
+            _keepAlive = null;
         }
     }
 
+    private void _onRoundTrip(long micros) {
+        nativeOnRoundTrip(micros, _handle);
+    }
+
+    // no report of the stopped socket reaches native code once this returned
+    private void _stopDrainReport() {
+        final _DrainReport drainReport = _drainReport;
+        if (drainReport != null) {
+            synchronized (_bufferedAmountLock) {
+                drainReport.stopped = true;
+            }
+        }
+    }
+
+    // the size of the send queue after a send, reported to native code by the sender itself
+    private void _reportQueued() {
+        final _DrainReport drainReport = _drainReport;
+        if (drainReport != null) {
+            drainReport.schedule();
+        }
+        synchronized (_bufferedAmountLock) {
+            nativeOnBufferedAmount(_webSocket.queueSize(), _handle);
+        }
+    }
+
+    private void _removeHandler() {
+        _stopKeepAlive();
+        _stopDrainReport();
+        _handle = 0;
+    }
+
     private void _send(final byte[] msg) {
         //        Log.d(_TAG, "try sending binary msg");
         if (null == _webSocket) {
@@ -88,34 +386,65 @@ public class CocosWebSocket extends WebSocketListener {
 
         ByteString byteString = ByteString.of(msg);
         _webSocket.send(byteString);
+        _reportQueued();
     }
 
-    private void _send(final String msg) {
-        //        Log.d(_TAG, "try sending string msg: " + msg);
+    private void _sendBuffer(final ByteBuffer buffer, final int offset, final int length) {
         if (null == _webSocket) {
             Log.e(_TAG, "WebSocket hasn't connected yet");
             return;
         }
 
-        _webSocket.send(msg);
+        // the buffer is reused by native code, ByteString.of copies the bytes before the frame is queued
+        buffer.clear();
+        buffer.limit(offset + length);
+        buffer.position(offset);
+        _webSocket.send(ByteString.of(buffer));
+        _reportQueued();
     }
 
-    /**
-     * Returns the VM's default SSL socket factory, using {@code trustManager} for
-     * trusted root certificates.
-     */
-    private SSLSocketFactory
-    defaultSslSocketFactory(X509TrustManager trustManager)
-        throws NoSuchAlgorithmException, KeyManagementException {
-        SSLContext   sslContext = SSLContext.getInstance("TLS");
-        SecureRandom random;
-        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.O) {
-            random = SecureRandom.getInstanceStrong();
-        } else {
-            random = SecureRandom.getInstance("SHA1PRNG");
+    // messages packed by WebSocket::sendBatch, each one is a native-order int header followed by the payload,
+    // the header is the payload length with the sign bit set for binary messages
+    private void _sendBatch(final ByteBuffer buffer, final int length) {
+        if (null == _webSocket) {
+            Log.e(_TAG, "WebSocket hasn't connected yet");
+            return;
+        }
+
+        buffer.order(ByteOrder.nativeOrder());
+        int position = 0;
+        while (position < length) {
+            buffer.clear();
+            final int header = buffer.getInt(position);
+            final int size = header & Integer.MAX_VALUE;
+            position += 4;
+            buffer.limit(position + size);
+            buffer.position(position);
+            // copies the payload, the buffer is reused by native code
+            if (header < 0) {
+                _webSocket.send(ByteString.of(buffer));
+            } else {
+                // decoded from a reused array, a ByteString would be one more copy per message
+                if (_batchText == null || _batchText.length < size) {
+                    _batchText = new byte[Math.max(size, 256)];
+                }
+                buffer.get(_batchText, 0, size);
+                _webSocket.send(new String(_batchText, 0, size, _UTF8));
+            }
+            position += size;
+        }
+        _reportQueued();
+    }
+
+    private void _send(final String msg) {
+        //        Log.d(_TAG, "try sending string msg: " + msg);
+        if (null == _webSocket) {
+            Log.e(_TAG, "WebSocket hasn't connected yet");
+            return;
         }
-        sslContext.init(null, new TrustManager[] {trustManager}, random);
-        return sslContext.getSocketFactory();
+
+        _webSocket.send(msg);
+        _reportQueued();
     }
 
     private String[] javaNames(List<CipherSuite> cipherSuites) {
@@ -130,21 +459,228 @@ public class CocosWebSocket extends WebSocketListener {
         }
     }
 
+    private static OkHttpClient _getClient(final String caFilePath, boolean secure,
+                                           final boolean tcpNoDelay, long timeout,
+                                           boolean persistTlsSessions, long pingInterval)
+        throws Exception {
+        final String key = caFilePath + '\n' + secure + '\n' + tcpNoDelay + '\n' + timeout + '\n' + persistTlsSessions +
+                           '\n' + pingInterval;
+        final _TlsConfig tls = (secure || tcpNoDelay) ? _getTlsConfig(secure ? caFilePath : "", persistTlsSessions) : null;
+        synchronized (CocosWebSocket.class) {
+            return _getClientLocked(key, secure && !caFilePath.isEmpty(), tcpNoDelay, timeout, pingInterval, tls);
+        }
+    }
+
+    // called with the class lock held
+    private static OkHttpClient _getClientLocked(String key, boolean verifyHostname, final boolean tcpNoDelay,
+                                                 long timeout, long pingInterval, _TlsConfig tls) {
+        _Client cached = _clientCache.get(key);
+        if (cached != null && cached.tls == tls) {
+            return cached.client;
+        }
+        if (_rootClient == null) {
+            Dispatcher dispatcher = new Dispatcher();
+            // a WebSocket holds its dispatcher slot until it is closed, the default of 5 per host would queue
+            // new connections behind sockets which are still closing
+            dispatcher.setMaxRequests(256);
+            dispatcher.setMaxRequestsPerHost(256);
+            _rootClient = new OkHttpClient.Builder()
+                              .dispatcher(dispatcher)
+                              .protocols(Collections.singletonList(Protocol.HTTP_1_1))
+                              .build();
+        }
+
+        OkHttpClient.Builder builder =
+            _rootClient.newBuilder()
+                .readTimeout(timeout, TimeUnit.MILLISECONDS)
+                .writeTimeout(timeout, TimeUnit.MILLISECONDS)
+                .connectTimeout(timeout, TimeUnit.MILLISECONDS)
+                .pingInterval(pingInterval, TimeUnit.MILLISECONDS);
+
+        if (verifyHostname) {
+            builder.hostnameVerifier(new HostnameVerifier() {
+                @Override
+                public boolean verify(String hostname, SSLSession session) {
+                    HostnameVerifier hv = HttpsURLConnection.getDefaultHostnameVerifier();
+                    return hv.verify(hostname, session);
+                }
+            });
+        }
+        if (tls != null) {
+            SSLSocketFactory customSslSocketFactory =
+                new CocosDelegatingSSLSocketFactory(tls.socketFactory) {
+                    @Override
+                    protected SSLSocket configureSocket(SSLSocket socket)
+                        throws          IOException {
+                        socket.setTcpNoDelay(tcpNoDelay);
+                        // TLSv1.2 is disabled default below API20----
+                        // https://developer.android.com/reference/javax/net/ssl/SSLSocket
+                        if (Build.VERSION.SDK_INT <= Build.VERSION_CODES.KITKAT_WATCH) {
+                            socket.setEnabledProtocols(new String[] {"TLSv1.2"});
+                        }
+                        // OkHttp starts the handshake right after creating the socket
+                        _TlsHandshake handshake = new _TlsHandshake();
+                        handshake.socket      = socket;
+                        handshake.startNanos  = System.nanoTime();
+                        handshake.startMillis = System.currentTimeMillis();
+                        socket.addHandshakeCompletedListener(handshake);
+                        _lastTlsHandshake.set(handshake);
+                        return socket;
+                    }
+                };
+            builder.sslSocketFactory(customSslSocketFactory, tls.trustManager);
+        }
+        cached = new _Client();
+        cached.tls = tls;
+        cached.client = builder.build();
+        _clientCache.put(key, cached);
+        return cached.client;
+    }
+
+    // assets can't change while the app runs, files are checked by their modification time
+    private static long _caFileStamp(String caFilePath) {
+        if (caFilePath.isEmpty() || caFilePath.startsWith("assets/")) {
+            return 0;
+        }
+        return new File(caFilePath).lastModified();
+    }
+
+    private static X509TrustManager _getTrustManager(final String caFilePath) throws Exception {
+        final long stamp = _caFileStamp(caFilePath);
+        _TrustStore trust;
+        while (true) {
+            trust = _trustCache.get(caFilePath);
+            if (trust != null && trust.stamp == stamp) {
+                break;
+            }
+            // the thread which publishes the entry parses the file, the others wait for its result
+            final _TrustStore fresh = new _TrustStore(stamp, new FutureTask<>(new Callable<X509TrustManager>() {
+                @Override
+                public X509TrustManager call() throws Exception {
+                    return _loadTrustManager(caFilePath);
+                }
+            }));
+            if (trust == null ? _trustCache.putIfAbsent(caFilePath, fresh) == null
+                              : _trustCache.replace(caFilePath, trust, fresh)) {
+                fresh.task.run();
+                trust = fresh;
+                break;
+            }
+        }
+        try {
+            return trust.task.get();
+        } catch (ExecutionException e) {
+            // not cached, the file may be fixed before the next attempt
+            _trustCache.remove(caFilePath, trust);
+            Throwable cause = e.getCause();
+            throw cause instanceof Exception ? (Exception) cause : e;
+        }
+    }
+
+    private static X509TrustManager _loadTrustManager(String caFilePath) throws Exception {
+        final long startNanos = System.nanoTime();
+        KeyStore keyStore = null;
+        if (!caFilePath.isEmpty()) {
+            InputStream caInput;
+            if (caFilePath.startsWith("assets/")) {
+                caInput = GlobalObject.getContext().getResources().getAssets().open(caFilePath);
+            } else {
+                caInput = new FileInputStream(caFilePath);
+            }
+            try {
+                if (caFilePath.toLowerCase().endsWith(".pem")) {
+                    keyStore = CocosWebSocketUtils.GetPEMKeyStore(caInput);
+                } else {
+                    keyStore = CocosWebSocketUtils.GetCERKeyStore(caInput);
+                }
+            } finally {
+                caInput.close();
+            }
+        }
+        X509TrustManager trustManager = CocosWebSocketUtils.GetTrustManager(keyStore);
+        Log.d(_TAG, "trust store '" + caFilePath + "' loaded in " + (System.nanoTime() - startNanos) / 1000 + "us");
+        return trustManager;
+    }
+
+    /**
+     * Parses caFilePath on a background thread so that the first connection using it finds it cached.
+     * Called by WebSocket::preloadCAFile.
+     */
+    public static void preloadCAFile(final String caFilePath) {
+        new Thread(new Runnable() {
+            @Override
+            public void run() {
+                try {
+                    _getTlsConfig(caFilePath, false);
+                } catch (Exception e) {
+                    Log.e(_TAG, "failed to preload '" + caFilePath + "': " + e.getMessage());
+                }
+            }
+        }, "cocos-websocket-ca").start();
+    }
+
+    private static _TlsConfig _getTlsConfig(String caFilePath, boolean persistSessions)
+        throws Exception {
+        final String key = caFilePath + '\n' + persistSessions;
+        final X509TrustManager trustManager = _getTrustManager(caFilePath);
+        _TlsConfig tls;
+        synchronized (CocosWebSocket.class) {
+            tls = _tlsCache.get(key);
+            if (tls != null && tls.trustManager == trustManager) {
+                return tls;
+            }
+        }
+        tls = new _TlsConfig();
+        tls.trustManager = trustManager;
+        if (persistSessions) {
+            // SSLSessionCache writes the client sessions to app storage, so the first connection after a cold
+            // start can resume. One directory per CA file, a session must not outlive the trust it was made with.
+            Context context = GlobalObject.getContext();
+            File dir = new File(context.getDir("cocos-websocket-tls", Context.MODE_PRIVATE),
+                                Integer.toHexString(caFilePath.hashCode()));
+            if (!dir.isDirectory() && !dir.mkdirs()) {
+                throw new IOException("can't create TLS session cache " + dir);
+            }
+            // a timeout of 0 leaves the handshake to the socket timeouts set by OkHttp
+            SSLCertificateSocketFactory factory =
+                (SSLCertificateSocketFactory) SSLCertificateSocketFactory.getDefault(0, new SSLSessionCache(dir));
+            factory.setTrustManagers(new TrustManager[] {tls.trustManager});
+            tls.socketFactory = factory;
+        } else {
+            SSLContext sslContext = SSLContext.getInstance("TLS");
+            // null selects the default SecureRandom, which never blocks unlike getInstanceStrong()
+            sslContext.init(null, new TrustManager[] {tls.trustManager}, null);
+            sslContext.getClientSessionContext().setSessionCacheSize(_TLS_SESSION_CACHE_SIZE);
+            tls.socketFactory = sslContext.getSocketFactory();
+        }
+        synchronized (CocosWebSocket.class) {
+            // keep the config built concurrently by another thread, its session cache may be in use already
+            _TlsConfig published = _tlsCache.get(key);
+            if (published != null && published.trustManager == trustManager) {
+                return published;
+            }
+            _tlsCache.put(key, tls);
+        }
+        return tls;
+    }
+
     private void _connect(final String url, final String protocols,
                           final String caFilePath) {
         Log.d(_TAG, "connect ws url: '" + url + "' ,protocols: '" + protocols + "' ,ca_: '" + caFilePath + "'");
-        Request.Builder requestBuilder = new Request.Builder().url(url);
+        _connectStartNanos = System.nanoTime();
+        // a reconnect starts with an empty queue, whatever the previous socket left in its own
+        _stopDrainReport();
+        synchronized (_bufferedAmountLock) {
+            nativeOnBufferedAmount(0, _handle);
+        }
+        // OkHttp throws IllegalArgumentException for a url it can't parse
+        Request.Builder requestBuilder = new Request.Builder();
         URI uriObj = null;
         try {
             requestBuilder = requestBuilder.url(url.trim());
             uriObj = URI.create(url);
         } catch (NullPointerException | IllegalArgumentException  e) {
-            Cocos2dxHelper.runOnGLThread(() -> {
-                synchronized (_wsContext) {
-                    nativeOnError("invalid url", _wsContext.identifier,
-                        _wsContext.handlerPtr);
-                }
-            });
+            nativeOnError("invalid url", false, _handle);
             return;
         }
         if (!protocols.isEmpty()) {
@@ -162,187 +698,124 @@ public class CocosWebSocket extends WebSocketListener {
 
         Request request = requestBuilder.build();
 
-        if(dispatcher == null) {
-            dispatcher = new Dispatcher();
-        }
-
-
-
-        OkHttpClient.Builder builder =
-            new OkHttpClient.Builder()
-                .dispatcher(dispatcher)
-
-                .protocols(Collections.singletonList(Protocol.HTTP_1_1))
-                .readTimeout(_timeout, TimeUnit.MILLISECONDS)
-                .writeTimeout(_timeout, TimeUnit.MILLISECONDS)
-                .connectTimeout(_timeout, TimeUnit.MILLISECONDS);
-
-        if (_perMessageDeflate) {
-            // 开启压缩扩展, 开启 Gzip 压缩
-            builder.addInterceptor(new CocosGzipRequestInterceptor());
-        }
-        KeyStore keyStore = null;
-        if (url.toLowerCase().startsWith("wss://") && !caFilePath.isEmpty()) {
-            try {
-                InputStream caInput = null;
-
-                if (caFilePath.startsWith("assets/")) {
-                    caInput = GlobalObject.getContext().getResources().getAssets().open(caFilePath);
-                } else {
-                    caInput = new FileInputStream(caFilePath);
-                }
-                if (caFilePath.toLowerCase().endsWith(".pem")) {
-                    keyStore = CocosWebSocketUtils.GetPEMKeyStore(caInput);
-                } else {
-                    keyStore = CocosWebSocketUtils.GetCERKeyStore(caInput);
-                }
-            } catch (Exception e) {
-                e.printStackTrace();
-                String msg = e.getMessage();
-                final String errMsg = msg != null ? msg : "unknown error";
-                Cocos2dxHelper.runOnGLThread(() -> {
-                    synchronized (_wsContext) {
-                        nativeOnError(errMsg, _wsContext.identifier, _wsContext.handlerPtr);
-                    }
-                });
-                return;
-            }
-
-            builder.hostnameVerifier(new HostnameVerifier() {
-                @Override
-                public boolean verify(String hostname, SSLSession session) {
-                    Log.d(_TAG, "ca hostname: " + hostname);
-                    HostnameVerifier hv = HttpsURLConnection.getDefaultHostnameVerifier();
-                    return hv.verify(hostname, session);
-                }
-            });
-        }
-        if (url.toLowerCase().startsWith("wss://") || _tcpNoDelay) {
-            try {
-                X509TrustManager trustManager =
-                    CocosWebSocketUtils.GetTrustManager(keyStore);
-                SSLContext   sslContext = SSLContext.getInstance("TLS");
-                SecureRandom random;
-                if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.O) {
-                    random = SecureRandom.getInstanceStrong();
-                    Log.d(_TAG, "random use strong" );
-                } else {
-                    random = SecureRandom.getInstance("SHA1PRNG");
-                    Log.d(_TAG, "random use SHA1PRNG" );
-                }
-                sslContext.init(null, new TrustManager[] {trustManager}, random);
-                SSLSocketFactory sslSocketFactory = sslContext.getSocketFactory();
-                SSLSocketFactory customSslSocketFactory =
-                    new CocosDelegatingSSLSocketFactory(sslSocketFactory) {
-                        @Override
-                        protected SSLSocket configureSocket(SSLSocket socket)
-                            throws          IOException {
-                            socket.setTcpNoDelay(_tcpNoDelay);
-                            // TLSv1.2 is disabled default below API20----
-                            // https://developer.android.com/reference/javax/net/ssl/SSLSocket
-                            if (Build.VERSION.SDK_INT <= Build.VERSION_CODES.KITKAT_WATCH) {
-                                socket.setEnabledProtocols(new String[] {"TLSv1.2"});
-                            }
-                            return socket;
-                        }
-                    };
-                builder.sslSocketFactory(customSslSocketFactory, trustManager);
-            } catch (GeneralSecurityException e) {
-                e.printStackTrace();
-                String msg = e.getMessage();
-                final String errMsg = msg != null ? msg : "unknown error";
-                Cocos2dxHelper.runOnGLThread(() -> {
-                    synchronized (_wsContext) {
-                        nativeOnError(errMsg, _wsContext.identifier, _wsContext.handlerPtr);
-                    }
-                });
-                return;
-            }
+        _secure = url.toLowerCase().startsWith("wss://");
+        _peerTimedOut = false;
+        // OkHttp only pings by itself when the round trips can't be measured
+        final long okHttpPingInterval = (_pingIntervalMillis > 0 && !_resolveKeepAlive()) ? _pingIntervalMillis : 0;
+        try {
+            _client = _getClient(caFilePath, _secure, _tcpNoDelay, _timeout, _persistTlsSessions, okHttpPingInterval);
+        } catch (Exception e) {
+            e.printStackTrace();
+            String msg = e.getMessage();
+            final String errMsg = msg != null ? msg : "unknown error";
+            nativeOnError(errMsg, false, _handle);
+            return;
         }
-        _client    = builder.build();
-
-        _debugInfo(request,_client);
+        Log.d(_TAG, "client ready in " + (System.nanoTime() - _connectStartNanos) / 1000 + "us");
 
         _webSocket = _client.newWebSocket(request, this);
     }
 
-    private  void _debugInfo( Request r, OkHttpClient c){
-        System.out.println("=== OkHttpClient.Builder ===");
-        System.out.println("Connect Timeout: " + c.connectTimeoutMillis() + "ms");
-        System.out.println("Read Timeout: " + c.readTimeoutMillis() + "ms");
-        System.out.println("Write Timeout: " + c.writeTimeoutMillis() + "ms");
-        System.out.println("Protocols: " + c.protocols());
-        System.out.println("Proxy: " + c.proxy());
-        System.out.println("SSL Socket Factory: " + c.sslSocketFactory());
-        System.out.println("Hostname Verifier: " + c.hostnameVerifier());
-
-    // 打印 Request 信息
-        System.out.println("\n=== Request ===");
-        System.out.println("URL: " + r.url());
-        System.out.println("Method: " + r.method());
-        System.out.println("Headers: " + r.headers());
-        System.out.println("Body: " + r.body());
-//        System.out.println("Tags: " + r.tags());
-        System.out.println("Full Request: " + r);
-    }
-
-
     private void _close(final int code, final String reason) {
-        _webSocket.close(code, reason);
+        _stopKeepAlive();
+        // null when _connect failed before creating the socket, e.g. on an invalid url
+        if (_webSocket != null) {
+            _webSocket.close(code, reason);
+        }
         // _client.dispatcher().executorService().shutdown();
     }
 
-    private long _getBufferedAmountID() {
-        return _webSocket.queueSize();
-    }
-
     private void output(final String content) {
         Log.w(_TAG, content);
     }
 
     @Override
     public void onOpen(org.cocos2dx.okhttp3.WebSocket _webSocket, Response response) {
-        output("WebSocket onOpen _client: " + _client);
-        output("WebSocket onOpen response.protocol().toString(): " + response.protocol().toString());
-        output("WebSocket onOpen response.headers().toString(): " + response.headers().toString());
-        Log.d("MyWebSocketDebug", "Scheduling nativeOnOpen on game thread..."); // 添加日志点 1
-        Cocos2dxHelper.runOnGLThread(() -> {
-            Log.d("MyWebSocketDebug", "Now on game thread, entering synchronized block..."); // 添加日志点 2
-            synchronized (_wsContext) {
-                Log.d("MyWebSocketDebug", "Inside synchronized block, about to call nativeOnOpen..."); // 添加日志点 3
-                try {
-                    nativeOnOpen(response.protocol().toString(),
-                            response.headers().toString(), _wsContext.identifier,
-                            _wsContext.handlerPtr);
-                    Log.d("MyWebSocketDebug", "Call to nativeOnOpen finished (or threw exception)."); // 添加日志点 4
-                } catch (Throwable t) {
-                    Log.e("MyWebSocketDebug", "Exception occurred during nativeOnOpen call or inside it:", t); // 捕获潜在错误
-                }
+        final long connectMicros = (System.nanoTime() - _connectStartNanos) / 1000;
+        boolean resumed = false;
+        int tlsRoundTrips = 0;
+        long tlsMicros = 0;
+        _TlsHandshake handshake = _lastTlsHandshake.get();
+        _lastTlsHandshake.remove();
+        // a record older than this connection belongs to a socket that failed before opening
+        if (_secure && handshake != null && handshake.startNanos >= _connectStartNanos) {
+            SSLSession session = handshake.socket.getSession();
+            // a resumed session keeps the creation time of the handshake which established it
+            resumed = session.getCreationTime() < handshake.startMillis;
+            tlsRoundTrips = ("TLSv1.3".equals(session.getProtocol()) || resumed) ? 1 : 2;
+            if (handshake.endNanos != 0) {
+                tlsMicros = (handshake.endNanos - handshake.startNanos) / 1000;
             }
-            Log.d("MyWebSocketDebug", "Exited synchronized block."); // 添加日志点 5
-        });
-        Log.d("MyWebSocketDebug", "Scheduled nativeOnOpen, onOpen method exiting."); // 添加日志点 6
+        }
+        Log.d(_TAG, "connected in " + connectMicros / 1000 + "ms" + (_secure ? ", TLS " + tlsMicros / 1000 + "ms " +
+                    tlsRoundTrips + " RTT" + (resumed ? " (resumed)" : "") : ""));
+        if (_resolveKeepAlive() && _pingIntervalMillis > 0) {
+            _startKeepAlive(_webSocket);
+        }
+        _stopDrainReport();
+        _drainReport = new _DrainReport(_webSocket);
+        nativeOnOpen(response.protocol().toString(),
+            response.headers().toString(), _secure, resumed, tlsRoundTrips,
+            tlsMicros, connectMicros, _handle);
     }
 
     @Override
     public void onMessage(org.cocos2dx.okhttp3.WebSocket _webSocket, String text) {
         //        output("Receiving string msg: " + text);
-        Cocos2dxHelper.runOnGLThread(() -> {
-            synchronized (_wsContext) {
-                nativeOnStringMessage(text, _wsContext.identifier, _wsContext.handlerPtr);
+        // hand the frame to native code as UTF-8 bytes, skipping the jstring conversion
+        final int size = _utf8Length(text);
+        final ByteBuffer buffer = nativeAcquireReceiveBuffer(size + 1);
+        if (buffer != null) {
+            buffer.clear();
+            _utf8Encoder.reset();
+            CoderResult result = _utf8Encoder.encode(CharBuffer.wrap(text), buffer, true);
+            if (!result.isError()) {
+                result = _utf8Encoder.flush(buffer);
             }
-        });
+            // OkHttp's decoder never yields lone surrogates, this only guards against a size mismatch
+            if (!result.isError() && buffer.position() == size) {
+                nativeOnStringBuffer(buffer, size, _handle);
+                return;
+            }
+            nativeReleaseReceiveBuffer(buffer);
+        }
+        nativeOnStringMessage(text, _handle);
     }
 
     @Override
     public void onMessage(org.cocos2dx.okhttp3.WebSocket _webSocket, ByteString bytes) {
         //        output("Receiving binary msg");
-        Cocos2dxHelper.runOnGLThread(() -> {
-            synchronized (_wsContext) {
-                nativeOnBinaryMessage(bytes.toByteArray(), _wsContext.identifier,
-                    _wsContext.handlerPtr);
+        final int size = bytes.size();
+        // write the payload straight into pooled native memory, it is read in place by native code
+        final ByteBuffer buffer = nativeAcquireReceiveBuffer(size);
+        if (buffer != null) {
+            buffer.clear();
+            buffer.put(bytes.asByteBuffer());
+            nativeOnBinaryBuffer(buffer, size, _handle);
+            return;
+        }
+        nativeOnBinaryMessage(bytes.toByteArray(), _handle);
+    }
+
+    private static int _utf8Length(String text) {
+        final int length = text.length();
+        int size = length;
+        for (int i = 0; i < length; i++) {
+            char c = text.charAt(i);
+            if (c < 0x80) {
+                continue;
             }
-        });
+            if (c < 0x800) {
+                size += 1;
+            } else if (Character.isHighSurrogate(c) && i + 1 < length &&
+                       Character.isLowSurrogate(text.charAt(i + 1))) {
+                size += 2; // 2 chars -> 4 bytes
+                i++;
+            } else {
+                size += 2;
+            }
+        }
+        return size;
     }
 
     @Override
@@ -358,46 +831,60 @@ public class CocosWebSocket extends WebSocketListener {
     public void onFailure(org.cocos2dx.okhttp3.WebSocket _webSocket, Throwable t,
                           Response response) {
         final String msg;
-        if (t != null) {
+        if (_peerTimedOut) {
+            msg = "no pong within " + _deadPeerTimeoutMillis + "ms";
+        } else if (t != null) {
             msg = t.getMessage() == null ?  t.getClass().getSimpleName() : t.getMessage();
         } else {
             msg = "";
         }
+        // OkHttp's own pings fail the socket with a SocketTimeoutException as well
+        final boolean timedOut = _peerTimedOut || t instanceof SocketTimeoutException;
         output("onFailure Error : " + msg);
-        Cocos2dxHelper.runOnGLThread(() -> {
-            synchronized (_wsContext) {
-                nativeOnError(msg, _wsContext.identifier, _wsContext.handlerPtr);
-            }
-        });
+        _lastTlsHandshake.remove();
+        _stopKeepAlive();
+        _stopDrainReport();
+        nativeOnError(msg, timedOut, _handle);
     }
 
     @Override
     public void onClosed(org.cocos2dx.okhttp3.WebSocket _webSocket, int code,
                          String reason) {
         output("onClosed : " + code + " / " + reason);
-        Cocos2dxHelper.runOnGLThread(() -> {
-            synchronized (_wsContext) {
-                nativeOnClosed(code, reason, _wsContext.identifier,
-                    _wsContext.handlerPtr);
-            }
-        });
+        _stopKeepAlive();
+        _stopDrainReport();
+        nativeOnClosed(code, reason, _handle);
     }
 
     private static native void NativeInit();
 
-    private native void nativeOnStringMessage(final String msg, long identifier,
-                                              long handler);
+    private native void nativeOnStringMessage(final String msg, long handle);
+
+    private native void nativeOnBinaryMessage(final byte[] msg, long handle);
+
+    private static native ByteBuffer nativeAcquireReceiveBuffer(int size);
+
+    private static native void nativeReleaseReceiveBuffer(ByteBuffer buffer);
 
-    private native void nativeOnBinaryMessage(final byte[] msg, long identifier,
-                                              long handler);
+    private native void nativeOnStringBuffer(final ByteBuffer msg, int length,
+                                             long handle);
+
+    private native void nativeOnBinaryBuffer(final ByteBuffer msg, int length,
+                                             long handle);
 
     private native void nativeOnOpen(final String protocol,
-                                     final String headerString, long identifier,
-                                     long handler);
+                                     final String headerString, boolean secure,
+                                     boolean tlsResumed, int tlsRoundTrips,
+                                     long tlsHandshakeMicros, long connectMicros,
+                                     long handle);
 
     private native void nativeOnClosed(final int code, final String reason,
-                                       long identifier, long handler);
+                                       long handle);
+
+    private native void nativeOnError(final String msg, boolean timedOut,
+                                      long handle);
+
+    private native void nativeOnRoundTrip(long micros, long handle);
 
-    private native void nativeOnError(final String msg, long identifier,
-                                      long handler);
+    private native void nativeOnBufferedAmount(long amount, long handle);
 }
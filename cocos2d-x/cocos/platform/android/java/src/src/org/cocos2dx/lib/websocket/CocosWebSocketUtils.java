@@ -50,6 +50,8 @@ class CocosWebSocketUtils {
     KeyStore keyStore = KeyStore.getInstance(KeyStore.getDefaultType());
     keyStore.load(null);
     int index = 0;
+    // one factory for the whole bundle, getInstance looks up the provider every time
+    CertificateFactory factory = CertificateFactory.getInstance("X.509");
 
     BufferedReader bufferedReader =
         new BufferedReader(new InputStreamReader(inputStream));
@@ -61,7 +63,7 @@ class CocosWebSocketUtils {
           if (carBegin.contains("END CERTIFICATE")) {
             String hexString = stringBuilder.toString();
             byte[] bytes = Base64.decode(hexString, Base64.DEFAULT);
-            Certificate certificate = _GenerateCertificateFromDER(bytes);
+            Certificate certificate = _GenerateCertificateFromDER(factory, bytes);
             keyStore.setCertificateEntry(Integer.toString(index++),
                                          certificate);
             break;
@@ -78,9 +80,8 @@ class CocosWebSocketUtils {
     return keyStore;
   }
 
-  private static Certificate _GenerateCertificateFromDER(byte[] certBytes)
+  private static Certificate _GenerateCertificateFromDER(CertificateFactory factory, byte[] certBytes)
       throws CertificateException {
-    CertificateFactory factory = CertificateFactory.getInstance("X.509");
     return factory.generateCertificate(new ByteArrayInputStream(certBytes));
   }
 }
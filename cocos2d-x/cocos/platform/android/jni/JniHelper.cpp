@@ -27,6 +27,9 @@ THE SOFTWARE.
 #include <android/log.h>
 #include <string.h>
 #include <pthread.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #include "base/ccUTF8.h"
 
@@ -34,6 +37,18 @@ THE SOFTWARE.
 #define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
 #define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
 
+// Android before 10 emulates thread_local with __emutls_get_address, which is slower than pthread_getspecific,
+// ELF TLS (Android 10+ and other platforms) makes it a plain load.
+#ifndef CC_JNI_THREAD_LOCAL_ENV
+#if defined(__ANDROID__) && (!defined(__ANDROID_API__) || __ANDROID_API__ < 29)
+#define CC_JNI_THREAD_LOCAL_ENV 0
+#else
+#define CC_JNI_THREAD_LOCAL_ENV 1
+#endif
+#endif
+
+// JNIEnv of the threads attached by cacheEnv, its destructor detaches them on exit. The value is cleared before the
+// destructor runs, so a later destructor on the same thread that calls getEnv() attaches again.
 static pthread_key_t g_key;
 
 jclass _getClassID(const char *className) {
@@ -60,7 +75,242 @@ jclass _getClassID(const char *className) {
     return _clazz;
 }
 
-void _detachCurrentThread(void* a) {
+namespace {
+    // A resolved method, immutable once published in the table below.
+    struct CachedMethodInfo {
+        std::string className;
+        std::string methodName;
+        std::string signature;
+        bool        isStatic;
+        size_t      hash;
+        jclass      classID;
+        jmethodID   methodID;
+    };
+
+    // Open-addressed table of CachedMethodInfo, read without locks. Slots only go from null to an entry, a full
+    // table is replaced by a larger copy, so a reader sees either a complete entry or an empty slot.
+    struct MethodTable {
+        explicit MethodTable(size_t capacity)
+        : mask(capacity - 1)
+        , slots(new std::atomic<const CachedMethodInfo *>[capacity]) {
+            for (size_t i = 0; i < capacity; ++i) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        size_t mask;
+        size_t count{0};
+        std::unique_ptr<std::atomic<const CachedMethodInfo *>[]> slots;
+    };
+
+    // What a class loader change or a table resize replaced. Another thread may still be reading a table or calling
+    // through a class or the class loader it just got, so they are freed one class loader change later.
+    struct RetiredMethodCache {
+        std::vector<std::unique_ptr<MethodTable>> tables;
+        std::vector<std::unique_ptr<CachedMethodInfo>> methods;
+        std::vector<jobject> globalRefs;
+    };
+
+    // Global-ref classes keyed by class name, and the method table. Writers hold g_methodCacheMutex.
+    std::mutex g_methodCacheMutex;
+    std::unordered_map<std::string, jclass> g_classCache;
+    std::atomic<MethodTable *> g_methodTable{nullptr};
+    std::unique_ptr<MethodTable> g_ownedMethodTable;
+    std::vector<std::unique_ptr<CachedMethodInfo>> g_methods;
+    RetiredMethodCache g_retired;
+
+    uint64_t _mixHash(uint64_t hash, uint64_t value) {
+        hash = (hash ^ value) * 0x100000001b3ULL;
+        return hash ^ (hash >> 32);
+    }
+
+    // Only the length and the first and last 8 bytes, hashing every byte took longer than the lookup it saves.
+    // Names that share those only cost a longer probe, entries are matched on the whole strings.
+    uint64_t _hashString(uint64_t hash, const char *str) {
+        size_t len = strlen(str);
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        if (len >= sizeof(uint64_t)) {
+            memcpy(&head, str, sizeof(head));
+            memcpy(&tail, str + len - sizeof(tail), sizeof(tail));
+        } else {
+            for (size_t i = 0; i < len; ++i) {
+                head |= static_cast<uint64_t>(static_cast<unsigned char>(str[i])) << (i * 8);
+            }
+        }
+        return _mixHash(_mixHash(hash, head ^ len), tail);
+    }
+
+    size_t _hashMethod(const char *className, const char *methodName, const char *paramCode, bool isStatic) {
+        uint64_t hash = 0xcbf29ce484222325ULL ^ (isStatic ? 1U : 0U);
+        hash = _hashString(hash, className);
+        hash = _hashString(hash, methodName);
+        hash = _hashString(hash, paramCode);
+        return static_cast<size_t>(hash);
+    }
+
+    const CachedMethodInfo *_findMethod(const MethodTable *table, size_t hash, const char *className,
+                                        const char *methodName, const char *paramCode, bool isStatic) {
+        if (!table) {
+            return nullptr;
+        }
+        for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+            const CachedMethodInfo *method = table->slots[i].load(std::memory_order_acquire);
+            if (!method) {
+                return nullptr;
+            }
+            if (method->hash == hash && method->isStatic == isStatic && strcmp(method->methodName.c_str(), methodName) == 0 &&
+                strcmp(method->signature.c_str(), paramCode) == 0 && strcmp(method->className.c_str(), className) == 0) {
+                return method;
+            }
+        }
+    }
+
+    void _insertMethod(MethodTable *table, const CachedMethodInfo *method) {
+        size_t i = method->hash & table->mask;
+        while (table->slots[i].load(std::memory_order_relaxed)) {
+            i = (i + 1) & table->mask;
+        }
+        table->slots[i].store(method, std::memory_order_release);
+        ++table->count;
+    }
+
+    // Java is never called with g_methodCacheMutex held, class initializers may re-enter JniHelper.
+    jclass _getCachedClassID(JNIEnv *env, const char *className) {
+        {
+            std::lock_guard<std::mutex> lock(g_methodCacheMutex);
+            auto it = g_classCache.find(className);
+            if (it != g_classCache.end()) {
+                return it->second;
+            }
+        }
+        jclass localClass = _getClassID(className);
+        if (nullptr == localClass) {
+            return nullptr;
+        }
+        jclass globalClass = (jclass) env->NewGlobalRef(localClass);
+        env->DeleteLocalRef(localClass);
+
+        std::lock_guard<std::mutex> lock(g_methodCacheMutex);
+        auto result = g_classCache.emplace(className, globalClass);
+        if (!result.second) {
+            // resolved concurrently by another thread
+            env->DeleteGlobalRef(globalClass);
+        }
+        return result.first->second;
+    }
+
+    bool _getCachedMethodInfo(cocos2d::JniMethodInfo &methodinfo,
+                              const char *className,
+                              const char *methodName,
+                              const char *paramCode,
+                              bool isStatic) {
+        if ((nullptr == className) ||
+            (nullptr == methodName) ||
+            (nullptr == paramCode)) {
+            return false;
+        }
+
+        JNIEnv *env = cocos2d::JniHelper::getEnv();
+        if (!env) {
+            return false;
+        }
+
+        size_t hash = _hashMethod(className, methodName, paramCode, isStatic);
+        const CachedMethodInfo *cached = _findMethod(g_methodTable.load(std::memory_order_acquire), hash,
+                                                     className, methodName, paramCode, isStatic);
+        if (cached) {
+            methodinfo.classID = cached->classID;
+            methodinfo.env = env;
+            methodinfo.methodID = cached->methodID;
+            return true;
+        }
+
+        jclass classID = _getCachedClassID(env, className);
+        if (! classID) {
+            LOGE("Failed to find class %s", className);
+            env->ExceptionClear();
+            return false;
+        }
+
+        jmethodID methodID = isStatic ? env->GetStaticMethodID(classID, methodName, paramCode)
+                                      : env->GetMethodID(classID, methodName, paramCode);
+        if (! methodID) {
+            LOGE("Failed to find %smethod id of %s", isStatic ? "static " : "", methodName);
+            env->ExceptionClear();
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(g_methodCacheMutex);
+            MethodTable *table = g_ownedMethodTable.get();
+            // resolved concurrently by another thread, or the class loader changed since classID was looked up
+            auto classIt = g_classCache.find(className);
+            if (!_findMethod(table, hash, className, methodName, paramCode, isStatic) &&
+                classIt != g_classCache.end() && classIt->second == classID) {
+                // keep the load factor at 1/2 so that probes stay short and always reach an empty slot
+                if (!table || (table->count + 1) * 2 > table->mask + 1) {
+                    std::unique_ptr<MethodTable> grown(new MethodTable(table ? (table->mask + 1) * 2 : 64));
+                    for (const auto &method : g_methods) {
+                        _insertMethod(grown.get(), method.get());
+                    }
+                    g_methodTable.store(grown.get(), std::memory_order_release);
+                    if (g_ownedMethodTable) {
+                        g_retired.tables.push_back(std::move(g_ownedMethodTable));
+                    }
+                    g_ownedMethodTable = std::move(grown);
+                    table = g_ownedMethodTable.get();
+                }
+                g_methods.emplace_back(new CachedMethodInfo{className, methodName, paramCode, isStatic, hash,
+                                                            classID, methodID});
+                _insertMethod(table, g_methods.back().get());
+            }
+        }
+
+        methodinfo.classID = classID;
+        methodinfo.env = env;
+        methodinfo.methodID = methodID;
+        return true;
+    }
+
+    // ASCII is valid modified UTF-8, so NewStringUTF takes it as is and the UTF-16 copy
+    // made by newStringUTFJNI is only needed for other text.
+    jstring _newStringJNI(JNIEnv *env, const char *str, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            unsigned char c = static_cast<unsigned char>(str[i]);
+            if (c == 0 || c >= 0x80) {
+                return cocos2d::StringUtils::newStringUTFJNI(env, std::string(str, len));
+            }
+        }
+        return env->NewStringUTF(str);
+    }
+} // namespace
+
+// JNIEnv of the threads attached by the VM or their owner (the GL thread, Java threads), who detach them
+#if CC_JNI_THREAD_LOCAL_ENV
+static thread_local JNIEnv *t_env = nullptr;
+
+static inline JNIEnv *_getOwnedEnv() {
+    return t_env;
+}
+
+static inline void _setOwnedEnv(JNIEnv *env) {
+    t_env = env;
+}
+#else
+static pthread_key_t g_ownedEnvKey;
+
+static inline JNIEnv *_getOwnedEnv() {
+    return (JNIEnv *)pthread_getspecific(g_ownedEnvKey);
+}
+
+static inline void _setOwnedEnv(JNIEnv *env) {
+    pthread_setspecific(g_ownedEnvKey, env);
+}
+#endif
+
+// the thread_local may already be freed here, only the JavaVM is touched
+void _detachCurrentThread(void* /*env*/) {
     cocos2d::JniHelper::getJavaVM()->DetachCurrentThread();
 }
 
@@ -74,17 +324,16 @@ namespace cocos2d {
     jobject JniHelper::_activity = nullptr;
 
     JavaVM* JniHelper::getJavaVM() {
-        pthread_t thisthread = pthread_self();
-        LOGD("JniHelper::getJavaVM(), pthread_self() = %ld", thisthread);
         return _psJavaVM;
     }
 
     void JniHelper::setJavaVM(JavaVM *javaVM) {
-        pthread_t thisthread = pthread_self();
-        LOGD("JniHelper::setJavaVM(%p), pthread_self() = %ld", javaVM, thisthread);
         _psJavaVM = javaVM;
 
         pthread_key_create(&g_key, _detachCurrentThread);
+#if !CC_JNI_THREAD_LOCAL_ENV
+        pthread_key_create(&g_ownedEnvKey, nullptr);
+#endif
     }
 
     JNIEnv* JniHelper::cacheEnv(JavaVM* jvm) {
@@ -94,8 +343,8 @@ namespace cocos2d {
         
         switch (ret) {
         case JNI_OK :
-            // Success!
-            pthread_setspecific(g_key, _env);
+            // Success! Attached by the VM or its owner, who is responsible for detaching it
+            _setOwnedEnv(_env);
             return _env;
 
         case JNI_EDETACHED :
@@ -106,7 +355,7 @@ namespace cocos2d {
 
                     return nullptr;
                 } else {
-                // Success : Attached and obtained JNIEnv!
+                // Success : Attached and obtained JNIEnv! Detach it when the thread exits
                 pthread_setspecific(g_key, _env);
                 return _env;
             }
@@ -114,6 +363,7 @@ namespace cocos2d {
         case JNI_EVERSION :
             // Cannot recover from this error
             LOGE("JNI interface version 1.4 not supported");
+            // fall through
         default :
             LOGE("Failed to get the environment using GetEnv()");
             return nullptr;
@@ -121,7 +371,9 @@ namespace cocos2d {
     }
 
     JNIEnv* JniHelper::getEnv() {
-        JNIEnv *_env = (JNIEnv *)pthread_getspecific(g_key);
+        JNIEnv *_env = _getOwnedEnv();
+        if (_env == nullptr)
+            _env = (JNIEnv *)pthread_getspecific(g_key);
         if (_env == nullptr)
             _env = JniHelper::cacheEnv(_psJavaVM);
         return _env;
@@ -132,6 +384,9 @@ namespace cocos2d {
     }
 
     bool JniHelper::setClassLoaderFrom(jobject activityinstance) {
+        // classes resolved through the previous class loader are stale now
+        JniHelper::clearMethodCache();
+
         JniMethodInfo _getclassloaderMethod;
         if (!JniHelper::getMethodInfo_DefaultClassLoader(_getclassloaderMethod,
                                                          "android/content/Context",
@@ -155,6 +410,16 @@ namespace cocos2d {
             return false;
         }
 
+        {
+            // readers may still be loading classes through the previous class loader
+            std::lock_guard<std::mutex> lock(g_methodCacheMutex);
+            if (JniHelper::classloader) {
+                g_retired.globalRefs.push_back(JniHelper::classloader);
+            }
+            if (JniHelper::_activity) {
+                g_retired.globalRefs.push_back(JniHelper::_activity);
+            }
+        }
         JniHelper::classloader = cocos2d::JniHelper::getEnv()->NewGlobalRef(_c);
         JniHelper::loadclassMethod_methodID = _m.methodID;
         JniHelper::_activity = cocos2d::JniHelper::getEnv()->NewGlobalRef(activityinstance);
@@ -273,6 +538,43 @@ namespace cocos2d {
         return true;
     }
 
+    bool JniHelper::getCachedStaticMethodInfo(JniMethodInfo &methodinfo,
+                                              const char *className,
+                                              const char *methodName,
+                                              const char *paramCode) {
+        return _getCachedMethodInfo(methodinfo, className, methodName, paramCode, true);
+    }
+
+    bool JniHelper::getCachedMethodInfo(JniMethodInfo &methodinfo,
+                                        const char *className,
+                                        const char *methodName,
+                                        const char *paramCode) {
+        return _getCachedMethodInfo(methodinfo, className, methodName, paramCode, false);
+    }
+
+    void JniHelper::clearMethodCache() {
+        JNIEnv *env = JniHelper::getEnv();
+        std::lock_guard<std::mutex> lock(g_methodCacheMutex);
+        // a whole class loader change has passed since these were replaced, nobody is still using them
+        if (env) {
+            for (jobject ref : g_retired.globalRefs) {
+                env->DeleteGlobalRef(ref);
+            }
+        }
+        g_retired = RetiredMethodCache();
+
+        for (const auto& it : g_classCache) {
+            g_retired.globalRefs.push_back(it.second);
+        }
+        g_classCache.clear();
+        g_methodTable.store(nullptr, std::memory_order_release);
+        if (g_ownedMethodTable) {
+            g_retired.tables.push_back(std::move(g_ownedMethodTable));
+        }
+        g_retired.methods = std::move(g_methods);
+        g_methods.clear();
+    }
+
     std::string JniHelper::jstring2string(jstring jstr) {
         if (jstr == nullptr) {
             return "";
@@ -288,41 +590,40 @@ namespace cocos2d {
         return strValue;
     }
 
-    jstring JniHelper::convert(JniHelper::LocalRefMapType &localRefs, cocos2d::JniMethodInfo& t, const char* x) {
-        jstring ret = nullptr;
-        if (x)
-          ret = cocos2d::StringUtils::newStringUTFJNI(t.env, x);
-
-        localRefs[t.env].push_back(ret);
+    jstring JniHelper::convert(JniHelper::LocalRefs &localRefs, cocos2d::JniMethodInfo& t, const char* x) {
+        if (!x) {
+            return nullptr;
+        }
+        jstring ret = _newStringJNI(t.env, x, strlen(x));
+        localRefs.push(ret);
         return ret;
     }
 
-    jstring JniHelper::convert(JniHelper::LocalRefMapType &localRefs, cocos2d::JniMethodInfo& t, const std::string& x) {
-        return convert(localRefs, t, x.c_str());
+    jstring JniHelper::convert(JniHelper::LocalRefs &localRefs, cocos2d::JniMethodInfo& t, const std::string& x) {
+        jstring ret = _newStringJNI(t.env, x.c_str(), x.size());
+        localRefs.push(ret);
+        return ret;
     }
 
 
-    jobject JniHelper::convert(JniHelper::LocalRefMapType &localRefs, cocos2d::JniMethodInfo &t, const std::vector<std::string> &x) {
-        jclass stringClass = _getClassID("java/lang/String");
+    jobject JniHelper::convert(JniHelper::LocalRefs &localRefs, cocos2d::JniMethodInfo &t, const std::vector<std::string> &x) {
+        jclass stringClass = _getCachedClassID(t.env, "java/lang/String");
         jobjectArray ret = t.env->NewObjectArray(x.size(), stringClass, nullptr);
-        for (auto i = 0; i < x.size(); i++) {
-            jstring jstr = cocos2d::StringUtils::newStringUTFJNI(t.env, x[i]);
+        for (jsize i = 0; i < static_cast<jsize>(x.size()); i++) {
+            jstring jstr = _newStringJNI(t.env, x[i].c_str(), x[i].size());
             t.env->SetObjectArrayElement(ret, i, jstr);
             t.env->DeleteLocalRef(jstr);
         }
-        (localRefs)[t.env].push_back(ret);
+        localRefs.push(ret);
         return ret;
     }
 
-    void JniHelper::deleteLocalRefs(JNIEnv* env, JniHelper::LocalRefMapType &localRefs) {
+    void JniHelper::deleteLocalRefs(JNIEnv* env, JniHelper::LocalRefs &localRefs) {
         if (!env) {
             return;
         }
 
-        for (const auto& ref : localRefs[env]) {
-            env->DeleteLocalRef(ref);
-        }
-        localRefs[env].clear();
+        localRefs.deleteAll(env);
     }
 
     void JniHelper::reportError(const std::string& className, const std::string& methodName, const std::string& signature) {
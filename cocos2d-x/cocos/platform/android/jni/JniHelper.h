@@ -52,7 +52,44 @@ class CC_DLL JniHelper
 {
 public:
 
-    typedef std::unordered_map<JNIEnv *, std::vector<jobject >> LocalRefMapType;
+    /**
+     * Local references created while the arguments of a call are converted, deleted once the call returned.
+     * The storage is provided by LocalRefArray on the stack of the caller, sized from the argument pack, since
+     * every argument creates at most one reference.
+     */
+    class LocalRefs
+    {
+    public:
+        LocalRefs(jobject *refs, size_t capacity) : _refs(refs), _capacity(capacity) {}
+        LocalRefs(const LocalRefs &) = delete;
+        LocalRefs &operator=(const LocalRefs &) = delete;
+
+        void push(jobject ref) {
+            CC_ASSERT(_count < _capacity);
+            _refs[_count++] = ref;
+        }
+
+        void deleteAll(JNIEnv *env) {
+            while (_count > 0) {
+                env->DeleteLocalRef(_refs[--_count]);
+            }
+        }
+
+    private:
+        jobject *_refs;
+        size_t _capacity;
+        size_t _count{0};
+    };
+
+    template <size_t N>
+    class LocalRefArray : public LocalRefs
+    {
+    public:
+        LocalRefArray() : LocalRefs(_storage, N) {}
+
+    private:
+        jobject _storage[N > 0 ? N : 1];
+    };
 
     static void setJavaVM(JavaVM *javaVM);
     static JavaVM* getJavaVM();
@@ -69,6 +106,21 @@ public:
                               const char *methodName,
                               const char *paramCode);
 
+    /**
+     * Same as getStaticMethodInfo / getMethodInfo, but the class and method IDs are resolved once
+     * and kept in a process-wide registry keyed by (class, method, signature). The returned classID
+     * is a global reference owned by the registry, callers must not delete it.
+     * The registry is cleared whenever setClassLoaderFrom is invoked.
+     */
+    static bool getCachedStaticMethodInfo(JniMethodInfo &methodinfo,
+                                          const char *className,
+                                          const char *methodName,
+                                          const char *paramCode);
+    static bool getCachedMethodInfo(JniMethodInfo &methodinfo,
+                                    const char *className,
+                                    const char *methodName,
+                                    const char *paramCode);
+
     static std::string jstring2string(jstring str);
 
     static jmethodID loadclassMethod_methodID;
@@ -81,11 +133,10 @@ public:
         jobject ret = nullptr;
         static const char* methodName = "<init>";
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")V";
-        if (cocos2d::JniHelper::getMethodInfo(t, className.c_str(), methodName, signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'V'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedMethodInfo(t, className.c_str(), methodName, signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             ret = t.env->NewObject(t.classID, t.methodID, cocos2d::JniHelper::convert(localRefs,t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -99,11 +150,10 @@ public:
                                      const std::string& methodName, 
                                      Ts... xs) {
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")V";
-        if (cocos2d::JniHelper::getMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'V'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             t.env->CallVoidMethod(object, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -117,11 +167,10 @@ public:
                                      Ts... xs) {
         float ret = 0.0f;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")F";
-        if (cocos2d::JniHelper::getMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'F'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             ret = t.env->CallFloatMethod(object, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -136,11 +185,10 @@ public:
                                        Ts... xs) {
         long ret = 0;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")J";
-        if (cocos2d::JniHelper::getMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'J'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             ret = t.env->CallLongMethod(object, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -155,11 +203,10 @@ public:
                                      Ts... xs) {
         jbyteArray ret = nullptr;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")[B";
-        if (cocos2d::JniHelper::getMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'[', 'B'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             ret = (jbyteArray)t.env->CallObjectMethod(object, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -172,11 +219,10 @@ public:
                                      const std::string& methodName, 
                                      Ts... xs) {
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")V";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'V'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             t.env->CallStaticVoidMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -189,11 +235,10 @@ public:
                                         Ts... xs) {
         jboolean jret = JNI_FALSE;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")Z";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'Z'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             jret = t.env->CallStaticBooleanMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -207,11 +252,10 @@ public:
                                    Ts... xs) {
         jint ret = 0;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")I";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
-            ret = t.env->CallStaticIntMethod(t.classID, t.methodID, convert(t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
+        const char* signature = getJNIMethodSignature<JniChars<'I'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
+            ret = t.env->CallStaticIntMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -225,11 +269,10 @@ public:
                                        Ts... xs) {
         jfloat ret = 0.0;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")F";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'F'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             ret = t.env->CallStaticFloatMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -243,11 +286,10 @@ public:
                                        Ts... xs) {
         jlong ret = 0;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")J";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'J'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             ret = t.env->CallStaticLongMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -262,9 +304,9 @@ public:
                                        Ts... xs) {
         static float ret[32];
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")[F";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'[', 'F'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             jfloatArray array = (jfloatArray) t.env->CallStaticObjectMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
             jsize len = t.env->GetArrayLength(array);
             if (len <= 32) {
@@ -275,7 +317,6 @@ public:
                 };
             }
             t.env->DeleteLocalRef(array);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
             return &ret[0];
         } else {
@@ -290,9 +331,9 @@ public:
                                        Ts... xs) {
         Vec3 ret;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")[F";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'[', 'F'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             jfloatArray array = (jfloatArray) t.env->CallStaticObjectMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
             jsize len = t.env->GetArrayLength(array);
             if (len == 3) {
@@ -303,7 +344,6 @@ public:
                 t.env->ReleaseFloatArrayElements(array, elems, 0);
             }
             t.env->DeleteLocalRef(array);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -317,11 +357,10 @@ public:
                                          Ts... xs) {
         jdouble ret = 0.0;
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")D";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniChars<'D'>, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             ret = t.env->CallStaticDoubleMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
-            t.env->DeleteLocalRef(t.classID);
             deleteLocalRefs(t.env, localRefs);
         } else {
             reportError(className, methodName, signature);
@@ -336,12 +375,11 @@ public:
         std::string ret;
 
         cocos2d::JniMethodInfo t;
-        std::string signature = "(" + std::string(getJNISignature(xs...)) + ")Ljava/lang/String;";
-        if (cocos2d::JniHelper::getStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature.c_str())) {
-            LocalRefMapType localRefs;
+        const char* signature = getJNIMethodSignature<JniStringChars, Ts...>();
+        if (cocos2d::JniHelper::getCachedStaticMethodInfo(t, className.c_str(), methodName.c_str(), signature)) {
+            LocalRefArray<sizeof...(Ts)> localRefs;
             jstring jret = (jstring)t.env->CallStaticObjectMethod(t.classID, t.methodID, convert(localRefs, t, xs)...);
             ret = cocos2d::JniHelper::jstring2string(jret);
-            t.env->DeleteLocalRef(t.classID);
             t.env->DeleteLocalRef(jret);
             deleteLocalRefs(t.env, localRefs);
         } else {
@@ -357,30 +395,37 @@ private:
                                                  const char *methodName,
                                                  const char *paramCode);
 
+    static void clearMethodCache();
+
     static JavaVM* _psJavaVM;
     
     static jobject _activity;
 
-    static jstring convert(LocalRefMapType &localRefs, cocos2d::JniMethodInfo& t, const char* x);
+    static jstring convert(LocalRefs &localRefs, cocos2d::JniMethodInfo& t, const char* x);
 
-    static jstring convert(LocalRefMapType &localRefs, cocos2d::JniMethodInfo& t, const std::string& x);
+    // otherwise the pass-through template below would hand the pointer itself to Java
+    static jstring convert(LocalRefs &localRefs, cocos2d::JniMethodInfo& t, char* x) {
+        return convert(localRefs, t, static_cast<const char*>(x));
+    }
+
+    static jstring convert(LocalRefs &localRefs, cocos2d::JniMethodInfo& t, const std::string& x);
 
-	static jobject convert(LocalRefMapType &localRefs, cocos2d::JniMethodInfo &t, const std::vector<std::string> &x);
+	static jobject convert(LocalRefs &localRefs, cocos2d::JniMethodInfo &t, const std::vector<std::string> &x);
 
     template <typename T>
-    static T convert(LocalRefMapType &localRefs, cocos2d::JniMethodInfo&, T x) {
+    static T convert(LocalRefs &localRefs, cocos2d::JniMethodInfo&, T x) {
         return x;
     }
 
     template <typename T>
-    static jobject convert(LocalRefMapType &localRefs, cocos2d::JniMethodInfo &t, std::pair<T *, size_t> data) {
+    static jobject convert(LocalRefs &localRefs, cocos2d::JniMethodInfo &t, std::pair<T *, size_t> data) {
         jobject ret = nullptr;
 
 #define JNI_SET_TYPED_ARRAY(lowercase, camelCase)                                                                   \
     j##lowercase##Array array = t.env->New##camelCase##Array(data.second);                                         \
     t.env->Set##camelCase##ArrayRegion(array, 0, data.second, reinterpret_cast<const j##lowercase *>(data.first)); \
     if (array) {                                                                                                    \
-        (localRefs)[t.env].push_back(array);                                                                      \
+        localRefs.push(array);                                                                                    \
     }                                                                                                               \
     ret = static_cast<jobject>(array);
 
@@ -403,14 +448,14 @@ private:
     }
 
     template <typename T, typename A>
-    static typename std::enable_if<std::is_arithmetic<T>::value, jobject>::type convert(LocalRefMapType &localRefs, cocos2d::JniMethodInfo &t, const std::vector<T, A> &data) {
+    static typename std::enable_if<std::is_arithmetic<T>::value, jobject>::type convert(LocalRefs &localRefs, cocos2d::JniMethodInfo &t, const std::vector<T, A> &data) {
         jobject ret = nullptr;
 
 #define JNI_SET_TYPED_ARRAY(lowercase, camelCase)                                                                    \
     j##lowercase##Array array = t.env->New##camelCase##Array(data.size());                                          \
     t.env->Set##camelCase##ArrayRegion(array, 0, data.size(), reinterpret_cast<const j##lowercase *>(data.data())); \
     if (array) {                                                                                                     \
-        (localRefs)[t.env].push_back(array);                                                                       \
+        localRefs.push(array);                                                                                     \
     }                                                                                                                \
     ret = static_cast<jobject>(array);
 
@@ -430,89 +475,76 @@ private:
         return ret;
     }
 
-    static void deleteLocalRefs(JNIEnv *env, LocalRefMapType &localRefs);
+    static void deleteLocalRefs(JNIEnv *env, LocalRefs &localRefs);
 
-    static std::string getJNISignature() {
-        return "";
-    }
+    // Signatures are assembled from the argument types at compile time, so a call only refers to a static
+    // string: JniChars holds the characters, JniSignature maps an argument type to them.
+    template <char... Cs>
+    struct JniChars {
+        static constexpr char value[sizeof...(Cs) + 1] = {Cs..., '\0'};
+    };
 
-    static std::string getJNISignature(bool) {
-        return "Z";
-    }
-
-    // jchar is unsigned 16 bits, we do char => jchar conversion on purpose
-    static std::string getJNISignature(char) {
-        return "C";
-    }
+    using JniStringChars = JniChars<'L', 'j', 'a', 'v', 'a', '/', 'l', 'a', 'n', 'g', '/', 'S', 't', 'r', 'i', 'n', 'g', ';'>;
 
+    template <typename... Ts>
+    struct JniConcat {
+        using type = JniChars<>;
+    };
 
-    static std::string getJNISignature(unsigned char /*unused*/) {
-        return "B"; // same as jbyte
-    }
-
-    static std::string getJNISignature(jshort) {
-        return "S";
-    }
-
-    static std::string getJNISignature(jint) {
-        return "I";
-    }
-
-    static std::string getJNISignature(jlong) {
-        return "J";
-    }
-
-    static std::string getJNISignature(jfloat) {
-        return "F";
-    }
-
-    static std::string getJNISignature(jdouble) {
-        return "D";
-    }
-
-    static std::string getJNISignature(jbyteArray) {
-        return "[B";
-    }
-
-    static std::string getJNISignature(jintArray /*unused*/) {
-        return "[I";
-    }
-
-    static std::string getJNISignature(const char * /*unused*/) {
-        return "Ljava/lang/String;";
-    }
+    template <char... As, char... Bs, typename... Ts>
+    struct JniConcat<JniChars<As...>, JniChars<Bs...>, Ts...> {
+        using type = typename JniConcat<JniChars<As..., Bs...>, Ts...>::type;
+    };
 
-    static std::string getJNISignature(const std::string&) {
-        return "Ljava/lang/String;";
-    }
+    template <char... Cs>
+    struct JniConcat<JniChars<Cs...>> {
+        using type = JniChars<Cs...>;
+    };
 
     template <typename T>
-    static std::string getJNISignature(T x) {
+    struct JniSignature {
         // This template should never be instantiated
-        static_assert(sizeof(x) == 0, "Unsupported argument type");
-        return "";
-    }
+        static_assert(sizeof(T) == 0, "Unsupported argument type");
+        using type = JniChars<>;
+    };
 
     template <typename T>
-    static std::string getJNISignature(std::pair<T *, size_t> /*x*/) {
-        typename std::remove_pointer<typename std::remove_cv<T>::type>::type m;
-        return std::string("[") + getJNISignature(m);
-    }
+    struct JniSignature<std::pair<T *, size_t>> {
+        using type = typename JniConcat<JniChars<'['>, typename JniSignature<typename std::remove_cv<T>::type>::type>::type;
+    };
 
     template <typename T, typename A>
-    static std::string getJNISignature(const std::vector<T, A> & /*x*/) {
-        T m;
-        return std::string("[") + getJNISignature(m);
-    }
+    struct JniSignature<std::vector<T, A>> {
+        using type = typename JniConcat<JniChars<'['>, typename JniSignature<T>::type>::type;
+    };
 
-    template <typename T, typename... Ts>
-    static std::string getJNISignature(T x, Ts... xs) {
-        return getJNISignature(x) + getJNISignature(xs...);
+    template <typename Return, typename... Ts>
+    static constexpr const char* getJNIMethodSignature() {
+        return JniConcat<JniChars<'('>, typename JniSignature<Ts>::type..., JniChars<')'>, Return>::type::value;
     }
 
     static void reportError(const std::string& className, const std::string& methodName, const std::string& signature);
 };
 
+template <char... Cs>
+constexpr char JniHelper::JniChars<Cs...>::value[];
+
+template <> struct JniHelper::JniSignature<bool> { using type = JniChars<'Z'>; };
+// jchar is unsigned 16 bits, we do char => jchar conversion on purpose
+template <> struct JniHelper::JniSignature<char> { using type = JniChars<'C'>; };
+template <> struct JniHelper::JniSignature<unsigned char> { using type = JniChars<'B'>; }; // same as jbyte
+template <> struct JniHelper::JniSignature<jshort> { using type = JniChars<'S'>; };
+template <> struct JniHelper::JniSignature<jint> { using type = JniChars<'I'>; };
+template <> struct JniHelper::JniSignature<jlong> { using type = JniChars<'J'>; };
+template <> struct JniHelper::JniSignature<jfloat> { using type = JniChars<'F'>; };
+template <> struct JniHelper::JniSignature<jdouble> { using type = JniChars<'D'>; };
+template <> struct JniHelper::JniSignature<jbyteArray> { using type = JniChars<'[', 'B'>; };
+template <> struct JniHelper::JniSignature<jintArray> { using type = JniChars<'[', 'I'>; };
+template <> struct JniHelper::JniSignature<const char*> { using type = JniStringChars; };
+template <> struct JniHelper::JniSignature<char*> { using type = JniStringChars; };
+template <> struct JniHelper::JniSignature<jstring> { using type = JniStringChars; };
+template <> struct JniHelper::JniSignature<std::string> { using type = JniStringChars; };
+
 NS_CC_END
 
 #endif // __ANDROID_JNI_HELPER_H__
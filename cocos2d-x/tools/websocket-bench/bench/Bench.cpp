@@ -0,0 +1,196 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "Bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <regex>
+
+#include "Allocations.h"
+
+namespace bench {
+
+namespace {
+
+struct Benchmark {
+    std::string name;
+    Function function;
+};
+
+struct Counter {
+    std::string name;
+    std::function<uint64_t()> read;
+};
+
+// function-local so that registrations of other translation units may run first
+std::vector<Benchmark> &benchmarks() {
+    static std::vector<Benchmark> instance;
+    return instance;
+}
+
+std::vector<Counter> &counters() {
+    static std::vector<Counter> instance;
+    return instance;
+}
+
+void readCounters(std::vector<uint64_t> &values) {
+    values.clear();
+    values.push_back(host::getNativeAllocations().count);
+    for (const Counter &counter : counters()) {
+        values.push_back(counter.read());
+    }
+}
+
+} // namespace
+
+void State::start() {
+    // no allocation of the runner may fall between the two snapshots
+    _startCounters.reserve(counters().size() + 1);
+    _counters.reserve(counters().size() + 1);
+    readCounters(_startCounters);
+    _startTime = std::chrono::steady_clock::now();
+}
+
+void State::stop() {
+    _elapsed = std::chrono::steady_clock::now() - _startTime;
+    readCounters(_counters);
+    for (size_t i = 0; i < _counters.size(); ++i) {
+        _counters[i] -= _startCounters[i];
+    }
+}
+
+Registration::Registration(const std::string &name, Function function) {
+    benchmarks().push_back({name, std::move(function)});
+}
+
+Registration::Registration(const std::string &name, const std::vector<uint64_t> &arguments,
+                           std::function<void(State &state, uint64_t argument)> function) {
+    for (uint64_t argument : arguments) {
+        benchmarks().push_back({name + "/" + std::to_string(argument), [function, argument](State &state) {
+                                    function(state, argument);
+                                }});
+    }
+}
+
+void addCounter(const std::string &name, std::function<uint64_t()> read) {
+    counters().push_back({name, std::move(read)});
+}
+
+class Runner {
+public:
+    Runner(double minTime, uint64_t maxIterations) : _minTime(minTime), _maxIterations(maxIterations) {}
+
+    void printHeader() const {
+        printf("%-44s %12s %12s %10s", "Benchmark", "Time/op", "Iterations", "allocs/op");
+        for (const Counter &counter : counters()) {
+            printf(" %*s/op", static_cast<int>(std::max<size_t>(counter.name.size(), 7)), counter.name.c_str());
+        }
+        printf(" %10s\n", "MB/s");
+    }
+
+    void run(const Benchmark &benchmark) const {
+        // one iteration first, it warms caches and pools and tells how many fit into the minimum time
+        State state = runOnce(benchmark, 1);
+        if (!state._skipped.empty()) {
+            printf("%-44s skipped: %s\n", benchmark.name.c_str(), state._skipped.c_str());
+            return;
+        }
+        uint64_t iterations = 1;
+        while (seconds(state) < _minTime && iterations < _maxIterations) {
+            double perIteration = std::max(seconds(state) / static_cast<double>(iterations), 1e-9);
+            auto next = static_cast<uint64_t>(_minTime * 1.4 / perIteration);
+            iterations = std::min(_maxIterations, std::max(iterations * 2, std::min(next, iterations * 100)));
+            state = runOnce(benchmark, iterations);
+        }
+        report(benchmark.name, state);
+    }
+
+private:
+    static double seconds(const State &state) {
+        return std::chrono::duration<double>(state._elapsed).count();
+    }
+
+    static State runOnce(const Benchmark &benchmark, uint64_t iterations) {
+        State state(iterations);
+        benchmark.function(state);
+        if (state._skipped.empty() && state._remaining != static_cast<uint64_t>(-1)) {
+            fprintf(stderr, "%s: the benchmark didn't loop until keepRunning() returned false\n",
+                    benchmark.name.c_str());
+            abort();
+        }
+        return state;
+    }
+
+    static void report(const std::string &name, const State &state) {
+        double ops = static_cast<double>(state._iterations * state._itemsPerIteration);
+        std::string label = state._itemsPerIteration > 1 ? name + " (per msg)" : name;
+        printf("%-44s %9.1f ns %12llu %10.2f", label.c_str(), seconds(state) * 1e9 / ops,
+               static_cast<unsigned long long>(state._iterations), static_cast<double>(state._counters[0]) / ops);
+        for (size_t i = 0; i < counters().size(); ++i) {
+            printf(" %*.2f", static_cast<int>(std::max<size_t>(counters()[i].name.size(), 7) + 3),
+                   static_cast<double>(state._counters[i + 1]) / ops);
+        }
+        if (state._bytesPerIteration > 0) {
+            printf(" %10.1f", static_cast<double>(state._bytesPerIteration * state._iterations) / seconds(state) / 1e6);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    double _minTime;
+    uint64_t _maxIterations;
+};
+
+int runBenchmarks(int argc, char **argv) {
+    std::string filter = ".*";
+    double minTime = 0.5;
+    uint64_t maxIterations = 1000000000;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+            minTime = atof(argv[i] + 11);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            // a smoke run for ctest, every benchmark runs a few iterations
+            minTime = 0;
+            maxIterations = 8;
+        } else {
+            fprintf(stderr, "usage: %s [--filter=<regex>] [--min-time=<seconds>] [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::regex selected(filter);
+    Runner runner(minTime, maxIterations);
+    runner.printHeader();
+    for (const Benchmark &benchmark : benchmarks()) {
+        if (std::regex_search(benchmark.name, selected)) {
+            runner.run(benchmark);
+        }
+    }
+    return 0;
+}
+
+} // namespace bench
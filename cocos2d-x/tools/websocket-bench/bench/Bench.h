@@ -0,0 +1,114 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A small benchmark runner in the spirit of Google Benchmark, without the dependency. A benchmark loops over
+// State::keepRunning(), the runner grows the iteration count until a run takes --min-time and reports the time,
+// the native heap allocations and the registered counters per iteration.
+namespace bench {
+
+class State {
+public:
+    /** True while the benchmark should run another iteration, the first call starts the clock. */
+    bool keepRunning() {
+        if (_remaining == _iterations) {
+            start();
+        }
+        if (_remaining-- > 0) {
+            return true;
+        }
+        stop();
+        return false;
+    }
+
+    uint64_t getIterations() const { return _iterations; }
+
+    /** Payload bytes one iteration processes, reported as MB/s. */
+    void setBytesPerIteration(uint64_t bytes) { _bytesPerIteration = bytes; }
+
+    /** Messages (or other items) one iteration processes, the per-op columns are then reported per item. */
+    void setItemsPerIteration(uint64_t items) { _itemsPerIteration = items; }
+
+    void skip(const std::string &reason) { _skipped = reason; }
+
+private:
+    friend class Runner;
+
+    explicit State(uint64_t iterations) : _iterations(iterations), _remaining(iterations) {}
+    void start();
+    void stop();
+
+    uint64_t _iterations;
+    uint64_t _remaining;
+    uint64_t _bytesPerIteration{0};
+    uint64_t _itemsPerIteration{1};
+    std::string _skipped;
+    std::chrono::steady_clock::time_point _startTime;
+    std::chrono::steady_clock::duration _elapsed{0};
+    std::vector<uint64_t> _startCounters;
+    std::vector<uint64_t> _counters; // deltas over the timed loop, allocations first
+};
+
+using Function = std::function<void(State &state)>;
+
+/** Registers a benchmark at static initialization, see BENCHMARK. */
+struct Registration {
+    Registration(const std::string &name, Function function);
+    /** One benchmark per argument, named "name/argument". */
+    Registration(const std::string &name, const std::vector<uint64_t> &arguments,
+                 std::function<void(State &state, uint64_t argument)> function);
+};
+
+/** A counter which only grows, reported per iteration next to the native allocations, e.g. JNI calls. */
+void addCounter(const std::string &name, std::function<uint64_t()> read);
+
+/** Runs the benchmarks selected by the arguments: --filter=<regex>, --min-time=<seconds>, --quick. */
+int runBenchmarks(int argc, char **argv);
+
+/** Keeps the compiler from optimizing away a value the benchmark computes. */
+template <typename T>
+inline void doNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+
+#define BENCHMARK(name)                                                                          \
+    static void name(bench::State &state);                                                       \
+    static const bench::Registration BENCH_CONCAT(name, _registration)(#name, name);             \
+    static void name(bench::State &state)
+
+#define BENCHMARK_WITH_ARGS(name, ...)                                                                              \
+    static void name(bench::State &state, uint64_t argument);                                                       \
+    static const bench::Registration BENCH_CONCAT(name, _registration)(#name, std::vector<uint64_t>{__VA_ARGS__}, name); \
+    static void name(bench::State &state, uint64_t argument)
@@ -0,0 +1,87 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// The echo server of the loopback benchmark on its own, for a client on a device or another machine to connect
+// to (through adb reverse for example). Runs until interrupted.
+//
+// --deflate accepts permessage-deflate offers.
+//
+//   ws_echo_server [--port=18080] [--tls-port=18443] [--ca=ws_echo_ca.pem] [--deflate]
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "EchoServer.h"
+
+namespace {
+
+volatile sig_atomic_t g_interrupted = 0;
+
+void onSignal(int /*signal*/) {
+    g_interrupted = 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int port = 18080;
+    int tlsPort = 18443;
+    std::string caFilePath = "ws_echo_ca.pem";
+    bool deflate = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--port=", 7) == 0) {
+            port = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--tls-port=", 11) == 0) {
+            tlsPort = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--ca=", 5) == 0) {
+            caFilePath = argv[i] + 5;
+        } else if (strcmp(argv[i], "--deflate") == 0) {
+            deflate = true;
+        } else {
+            fprintf(stderr, "usage: %s [--port=18080] [--tls-port=18443] [--ca=ws_echo_ca.pem] [--deflate]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    host::EchoServer server;
+    server.setDeflate(deflate);
+    if (!server.start(static_cast<uint16_t>(port), static_cast<uint16_t>(tlsPort), caFilePath)) {
+        return 1;
+    }
+    printf("ws://127.0.0.1:%u/echo\nwss://127.0.0.1:%u/echo (CA: %s)\n", server.getPort(), server.getTlsPort(),
+           caFilePath.c_str());
+    fflush(stdout);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    while (!g_interrupted) {
+        pause();
+    }
+    server.stop();
+    return 0;
+}
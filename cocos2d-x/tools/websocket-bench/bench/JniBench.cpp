@@ -0,0 +1,339 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// Microbenchmarks of the JNI paths of WebSocket-okhttp_android.cpp and JniHelper on the fake JVM. Besides the time
+// they report per operation the native heap allocations, the JNI functions called and the Java objects the same
+// call allocates on a device (see FakeCocosWebSocket.h for the Java side).
+//
+//   jni_bench [--filter=<regex>] [--min-time=<seconds>]
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include "Bench.h"
+#include "FakeConnection.h"
+#include "base/ccUTF8.h"
+#include "platform/android/jni/JniHelper.h"
+
+using cocos2d::network::WebSocket;
+using fakejni::CocosWebSocket;
+using fakejni::Vm;
+
+namespace {
+
+const char *SINK_CLASS = "org/cocos2dx/bench/Sink";
+
+// static methods which take an argument of each type JniHelper converts and do nothing with it
+void defineSink() {
+    fakejni::Class *sink = Vm::get().defineClass(SINK_CLASS);
+    auto nothing = [](JNIEnv *, fakejni::Object *, const jvalue *) {
+        jvalue result;
+        result.j = 0;
+        return result;
+    };
+    sink->addStaticMethod("take", "(Ljava/lang/String;)V", nothing);
+    sink->addStaticMethod("take", "([Ljava/lang/String;)V", nothing);
+    sink->addStaticMethod("take", "([B)V", nothing);
+    sink->addStaticMethod("take", "([F)V", nothing);
+    sink->addStaticMethod("take", "(IJF)V", nothing);
+}
+
+std::string makeText(uint64_t size) {
+    std::string text(size, 'a');
+    for (size_t i = 0; i < text.size(); ++i) {
+        text[i] = static_cast<char>('a' + i % 26);
+    }
+    return text;
+}
+
+// what OkHttp hands to onOpen for a typical upgrade response
+const char *RESPONSE_HEADERS = "Connection: Upgrade\n"
+                               "Date: Mon, 05 Oct 2020 08:00:00 GMT\n"
+                               "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\n"
+                               "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=15\n"
+                               "Sec-WebSocket-Protocol: chat\n"
+                               "Server: nginx/1.18.0\n"
+                               "Set-Cookie: session=0123456789abcdef; Path=/; HttpOnly\n"
+                               "Upgrade: websocket\n";
+
+// messages of a batch, the size of an input or an ack
+const unsigned int BATCH_MESSAGE_SIZE = 32;
+
+void sendBatches(bench::State &state, uint64_t count, bool isBinary) {
+    host::FakeConnection connection;
+    std::string payload = makeText(BATCH_MESSAGE_SIZE);
+    std::vector<WebSocket::OutgoingMessage> messages(
+        count, {reinterpret_cast<const unsigned char *>(payload.data()), BATCH_MESSAGE_SIZE, isBinary});
+    while (state.keepRunning()) {
+        connection.socket().sendBatch(messages.data(), messages.size());
+    }
+    state.setItemsPerIteration(count);
+    state.setBytesPerIteration(count * BATCH_MESSAGE_SIZE);
+}
+
+void sendEach(bench::State &state, uint64_t count, bool isBinary) {
+    host::FakeConnection connection;
+    std::string payload = makeText(BATCH_MESSAGE_SIZE);
+    while (state.keepRunning()) {
+        for (uint64_t i = 0; i < count; ++i) {
+            if (isBinary) {
+                connection.socket().send(reinterpret_cast<const unsigned char *>(payload.data()), BATCH_MESSAGE_SIZE);
+            } else {
+                connection.socket().send(payload);
+            }
+        }
+    }
+    state.setItemsPerIteration(count);
+    state.setBytesPerIteration(count * BATCH_MESSAGE_SIZE);
+}
+
+} // namespace
+
+BENCHMARK_WITH_ARGS(send_string, 16, 1024, 65536) {
+    host::FakeConnection connection;
+    std::string message = makeText(argument);
+    while (state.keepRunning()) {
+        connection.socket().send(message);
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(send_binary, 16, 1024, 65536) {
+    host::FakeConnection connection;
+    std::string message = makeText(argument);
+    while (state.keepRunning()) {
+        connection.socket().send(reinterpret_cast<const unsigned char *>(message.data()),
+                                 static_cast<unsigned int>(message.size()));
+    }
+    state.setBytesPerIteration(argument);
+}
+
+// String sends through the method ID NativeInit resolved, as WebSocketImpl::send does, and through the generic
+// JniHelper::callObjectVoidMethod the backend used before, which looks the method up by name on every call
+BENCHMARK_WITH_ARGS(send_string_cached_method_id, 16, 1024) {
+    host::FakeConnection connection;
+    JNIEnv *env = cocos2d::JniHelper::getEnv();
+    jobject socket = fakejni::toRef(connection.java);
+    jclass socketClass = env->FindClass(CocosWebSocket::CLASS_NAME);
+    jmethodID sendID = env->GetMethodID(socketClass, "_send", "(Ljava/lang/String;)V");
+    env->DeleteLocalRef(socketClass);
+    std::string message = makeText(argument);
+    while (state.keepRunning()) {
+        jstring jMessage = cocos2d::StringUtils::newStringUTFJNI(env, message);
+        env->CallVoidMethod(socket, sendID, jMessage);
+        env->DeleteLocalRef(jMessage);
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(send_string_jni_helper, 16, 1024) {
+    host::FakeConnection connection;
+    jobject socket = fakejni::toRef(connection.java);
+    std::string message = makeText(argument);
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callObjectVoidMethod(socket, CocosWebSocket::CLASS_NAME, "_send", message);
+    }
+    state.setBytesPerIteration(argument);
+}
+
+// Binary sends as a byte[] per message through JniHelper, as before the backend copied them into its reused
+// direct ByteBuffer (send_binary): JniHelper allocates the array and ByteString.of(byte[]) copies it once more
+BENCHMARK_WITH_ARGS(send_binary_byte_array, 16, 1024, 65536) {
+    host::FakeConnection connection;
+    jobject socket = fakejni::toRef(connection.java);
+    std::string message = makeText(argument);
+    auto value = std::make_pair(reinterpret_cast<const unsigned char *>(message.data()), message.size());
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callObjectVoidMethod(socket, CocosWebSocket::CLASS_NAME, "_send", value);
+    }
+    state.setBytesPerIteration(argument);
+}
+
+// A frame's worth of small messages (inputs, acks) as one sendBatch, against one send per message. The argument is
+// the number of messages, the columns are per message.
+BENCHMARK_WITH_ARGS(send_batch_text, 1, 8, 64) {
+    sendBatches(state, argument, false);
+}
+
+BENCHMARK_WITH_ARGS(send_each_text, 1, 8, 64) {
+    sendEach(state, argument, false);
+}
+
+BENCHMARK_WITH_ARGS(send_batch_binary, 1, 8, 64) {
+    sendBatches(state, argument, true);
+}
+
+BENCHMARK_WITH_ARGS(send_each_binary, 1, 8, 64) {
+    sendEach(state, argument, true);
+}
+
+// the reader thread's onMessage and the delivery in the next frame
+BENCHMARK_WITH_ARGS(on_string_message, 16, 1024, 65536) {
+    host::FakeConnection connection;
+    std::string message = makeText(argument);
+    while (state.keepRunning()) {
+        connection.java->onMessage(message);
+        host::runFrame();
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(on_binary_message, 16, 1024, 65536) {
+    host::FakeConnection connection;
+    std::string message = makeText(argument);
+    while (state.keepRunning()) {
+        connection.java->onMessage(reinterpret_cast<const uint8_t *>(message.data()), message.size());
+        host::runFrame();
+    }
+    state.setBytesPerIteration(argument);
+}
+
+// nativeOnOpen, the delivery and the first lookup, which parses the header block
+BENCHMARK(on_open_headers) {
+    host::FakeConnection connection({}, false);
+    while (state.keepRunning()) {
+        connection.java->onOpen("http/1.1", RESPONSE_HEADERS);
+        host::runFrame();
+        bench::doNotOptimize(connection.socket().getResponseHeader("sec-websocket-protocol"));
+    }
+}
+
+// JniHelper::getEnv reads a thread_local (a pthread key before Android 10), before it looked the env up with
+// pthread_getspecific on every call
+BENCHMARK(jni_helper_get_env) {
+    while (state.keepRunning()) {
+        bench::doNotOptimize(cocos2d::JniHelper::getEnv());
+    }
+}
+
+// a thread JniHelper attached itself misses the owner-attached env and reads the detaching pthread key
+BENCHMARK(jni_helper_get_env_attached_thread) {
+    std::thread worker([&state]() {
+        cocos2d::JniHelper::getEnv();
+        while (state.keepRunning()) {
+            bench::doNotOptimize(cocos2d::JniHelper::getEnv());
+        }
+    });
+    worker.join();
+}
+
+BENCHMARK(jni_helper_get_env_pthread_key) {
+    static const pthread_key_t key = []() {
+        pthread_key_t created;
+        pthread_key_create(&created, nullptr);
+        return created;
+    }();
+    pthread_setspecific(key, cocos2d::JniHelper::getEnv());
+    while (state.keepRunning()) {
+        auto *env = static_cast<JNIEnv *>(pthread_getspecific(key));
+        if (env == nullptr) {
+            env = cocos2d::JniHelper::getEnv();
+        }
+        bench::doNotOptimize(env);
+    }
+}
+
+// JniHelper's method cache lookup while the argument's number of threads, the measured one included, look methods
+// up concurrently. Lookups read the table without a lock, before they built a key string and took a mutex.
+BENCHMARK_WITH_ARGS(jni_helper_cached_method_lookup, 1, 4) {
+    auto lookup = []() {
+        cocos2d::JniMethodInfo info;
+        cocos2d::JniHelper::getCachedMethodInfo(info, CocosWebSocket::CLASS_NAME, "_send", "(Ljava/lang/String;)V");
+        bench::doNotOptimize(info.methodID);
+    };
+    std::atomic<bool> done{false};
+    std::vector<std::thread> others;
+    for (uint64_t i = 1; i < argument; ++i) {
+        others.emplace_back([&]() {
+            while (!done.load(std::memory_order_relaxed)) {
+                lookup();
+            }
+        });
+    }
+    while (state.keepRunning()) {
+        lookup();
+    }
+    done = true;
+    for (auto &other : others) {
+        other.join();
+    }
+}
+
+BENCHMARK(jni_helper_convert_string) {
+    std::string value = makeText(32);
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callStaticVoidMethod(SINK_CLASS, "take", value);
+    }
+}
+
+BENCHMARK(jni_helper_convert_utf8_string) {
+    std::string value = "caf\xC3\xA9 \xE2\x82\xAC " + makeText(24);
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callStaticVoidMethod(SINK_CLASS, "take", value);
+    }
+}
+
+BENCHMARK(jni_helper_convert_chars) {
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callStaticVoidMethod(SINK_CLASS, "take", "abcdefghijklmnopqrstuvwxyz012345");
+    }
+}
+
+BENCHMARK(jni_helper_convert_string_vector) {
+    std::vector<std::string> value{"first", "second", "third", "fourth"};
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callStaticVoidMethod(SINK_CLASS, "take", value);
+    }
+}
+
+BENCHMARK(jni_helper_convert_byte_pair) {
+    std::string bytes = makeText(256);
+    auto value = std::make_pair(reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size());
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callStaticVoidMethod(SINK_CLASS, "take", value);
+    }
+}
+
+BENCHMARK(jni_helper_convert_float_vector) {
+    std::vector<float> value(16, 0.5F);
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callStaticVoidMethod(SINK_CLASS, "take", value);
+    }
+}
+
+BENCHMARK(jni_helper_convert_primitives) {
+    while (state.keepRunning()) {
+        cocos2d::JniHelper::callStaticVoidMethod(SINK_CLASS, "take", 1, static_cast<jlong>(2), 3.0F);
+    }
+}
+
+int main(int argc, char **argv) {
+    CocosWebSocket::install();
+    defineSink();
+    bench::addCounter("jni calls", []() { return Vm::get().getStats().jniCalls; });
+    bench::addCounter("java allocs", []() { return Vm::get().getStats().javaAllocations; });
+    return bench::runBenchmarks(argc, argv);
+}
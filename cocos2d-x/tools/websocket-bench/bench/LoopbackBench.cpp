@@ -0,0 +1,361 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// End-to-end benchmark of WebSocket-native.cpp through the public WebSocket API against the echo server, over
+// ws:// and wss:// (verified with the server's CA as caFilePath). Each connection keeps --window messages in
+// flight and sends the next one when an echo arrives on the game thread. Reports messages/s and payload MB/s
+// each way, and the round trip from send() to onMessage. --flood asks the server for a stream of messages
+// instead, for the receive path alone. Fails when a message doesn't come back intact.
+//
+// Every case also runs with permessage-deflate offered (".../deflate/..."). Against the server of its own the
+// benchmark reports the bytes on the wire as a percentage of the payload (100 without deflate), and the CPU time
+// of the whole process per message, which includes the server's half of the compression. The payloads are
+// repeating patterns, so the ratio is a best case, and the CPU cost is the number to compare.
+//
+//   ws_loopback_bench [--filter=<regex>] [--connections=4] [--window=1] [--flood] [--quick]
+//                     [--ws-url=<url>] [--wss-url=<url> --ca=<pem>]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "EchoServer.h"
+#include "HostEngine.h"
+#include "network/WebSocket.h"
+
+using cocos2d::network::WebSocket;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int OPEN_TIMEOUT_MS = 10000;
+const int RUN_TIMEOUT_MS = 120000;
+
+struct Config {
+    int connections{4};
+    int window{1};
+    bool flood{false};
+    std::vector<size_t> sizes{16, 256, 4096, 65536, 1024 * 1024};
+    // messages per connection: this many bytes, within [minMessages, maxMessages]
+    size_t bytesPerConnection{8 * 1024 * 1024};
+    size_t minMessages{20};
+    size_t maxMessages{2000};
+};
+
+std::string makePayload(size_t size, bool binary) {
+    std::string payload(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        // the flood server's pattern, binary payloads contain NUL bytes
+        payload[i] = binary ? static_cast<char>(i) : static_cast<char>('a' + i % 26);
+    }
+    return payload;
+}
+
+class Client : public WebSocket::Delegate {
+public:
+    Client(const Config &config, const std::string &payload, bool binary, size_t messages)
+    : _config(config), _payload(payload), _binary(binary), _messages(messages) {}
+
+    bool connect(const std::string &url, const std::string &caFilePath, bool deflate) {
+        WebSocket::Options options;
+        options.perMessageDeflate = deflate;
+        return _socket.init(*this, url, nullptr, caFilePath, options);
+    }
+
+    void start() {
+        if (_config.flood) {
+            _sendTimes.push_back(Clock::now());
+            _socket.send("flood " + std::to_string(_messages) + " " + std::to_string(_payload.size()) +
+                         (_binary ? " binary" : " text"));
+            return;
+        }
+        for (int i = 0; i < _config.window && _sent < _messages; ++i) {
+            sendNext();
+        }
+    }
+
+    void onOpen(WebSocket * /*ws*/) override { _opened = true; }
+
+    void onMessage(WebSocket * /*ws*/, const WebSocket::Data &data) override {
+        if (data.isBinary != _binary || static_cast<size_t>(data.len) != _payload.size() ||
+            memcmp(data.bytes, _payload.data(), _payload.size()) != 0) {
+            fprintf(stderr, "message %zu came back different (%zd bytes)\n", _received, data.len);
+            _failed = true;
+            return;
+        }
+        ++_received;
+        if (_config.flood) {
+            _lastReceived = Clock::now();
+            return;
+        }
+        auto now = Clock::now();
+        _roundTrips.push_back(std::chrono::duration<double, std::micro>(now - _sendTimes.front()).count());
+        _sendTimes.pop_front();
+        if (_sent < _messages) {
+            sendNext();
+        }
+    }
+
+    void onClose(WebSocket * /*ws*/) override { _closed = true; }
+
+    void onError(WebSocket * /*ws*/, const WebSocket::ErrorCode &error) override {
+        fprintf(stderr, "onError %d\n", static_cast<int>(error));
+        _failed = true;
+    }
+
+    WebSocket &socket() { return _socket; }
+    bool isOpen() const { return _opened; }
+    // a connection which failed reports no onClose
+    bool isClosed() const { return _closed || _socket.getReadyState() == WebSocket::State::CLOSED; }
+    bool hasFailed() const { return _failed; }
+    bool isDone() const { return _failed || _received == _messages; }
+    size_t getReceived() const { return _received; }
+    const std::vector<double> &getRoundTrips() const { return _roundTrips; }
+    Clock::time_point getLastReceived() const { return _lastReceived; }
+
+private:
+    void sendNext() {
+        _sendTimes.push_back(Clock::now());
+        ++_sent;
+        if (_binary) {
+            _socket.send(reinterpret_cast<const unsigned char *>(_payload.data()),
+                         static_cast<unsigned int>(_payload.size()));
+        } else {
+            _socket.send(_payload);
+        }
+    }
+
+    const Config &_config;
+    const std::string &_payload;
+    bool _binary;
+    size_t _messages;
+    size_t _sent{0};
+    size_t _received{0};
+    bool _opened{false};
+    bool _closed{false};
+    bool _failed{false};
+    std::deque<Clock::time_point> _sendTimes;
+    std::vector<double> _roundTrips;
+    Clock::time_point _lastReceived;
+    // last, destroyed first: it refers to the delegate
+    WebSocket _socket;
+};
+
+// nearest rank
+double percentile(const std::vector<double> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(fraction * static_cast<double>(sorted.size()) + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// user and system time of every thread of the process
+double getCpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+bool runAll(std::vector<std::unique_ptr<Client>> &clients, const std::function<bool(const Client &)> &done,
+            int timeoutMs) {
+    return host::runFramesUntil(
+        [&]() {
+            return std::all_of(clients.begin(), clients.end(),
+                               [&](const std::unique_ptr<Client> &client) { return done(*client); });
+        },
+        timeoutMs);
+}
+
+// server is null when it isn't ours and its wire bytes are unknown
+bool run(const Config &config, const std::string &name, const std::string &url, const std::string &caFilePath,
+         bool deflate, bool binary, size_t size, const host::EchoServer *server) {
+    std::string payload = makePayload(size, binary);
+    size_t messages = std::max(config.minMessages, std::min(config.maxMessages, config.bytesPerConnection / size));
+    std::vector<std::unique_ptr<Client>> clients;
+    for (int i = 0; i < config.connections; ++i) {
+        clients.emplace_back(new Client(config, payload, binary, messages));
+        if (!clients.back()->connect(url, caFilePath, deflate)) {
+            fprintf(stderr, "%s: init failed\n", name.c_str());
+            return false;
+        }
+    }
+
+    bool ok = runAll(clients, [](const Client &client) { return client.isOpen() || client.hasFailed(); },
+                     OPEN_TIMEOUT_MS);
+    for (auto &client : clients) {
+        // a server which declines the offer would measure the uncompressed case twice
+        if (ok && client->socket().getExtensions().empty() == deflate) {
+            fprintf(stderr, "%s: permessage-deflate %s\n", name.c_str(), deflate ? "declined" : "negotiated");
+            ok = false;
+        }
+    }
+    uint64_t wireStart = server != nullptr ? server->getWireBytes() : 0;
+    double cpuStart = getCpuSeconds();
+    Clock::time_point start = Clock::now();
+    if (ok) {
+        for (auto &client : clients) {
+            client->start();
+        }
+        ok = runAll(clients, [](const Client &client) { return client.isDone(); }, RUN_TIMEOUT_MS);
+    }
+    Clock::time_point end = Clock::now();
+    double cpuSeconds = getCpuSeconds() - cpuStart;
+    uint64_t wireBytes = server != nullptr ? server->getWireBytes() - wireStart : 0;
+    std::vector<double> roundTrips;
+    for (auto &client : clients) {
+        ok = ok && !client->hasFailed();
+        roundTrips.insert(roundTrips.end(), client->getRoundTrips().begin(), client->getRoundTrips().end());
+        if (config.flood) {
+            end = std::max(end, client->getLastReceived());
+        }
+        if (client->socket().getReadyState() == WebSocket::State::OPEN) {
+            client->socket().close();
+        }
+    }
+    runAll(clients, [](const Client &client) { return client.isClosed(); }, OPEN_TIMEOUT_MS);
+    if (!ok) {
+        fprintf(stderr, "%s: failed or timed out\n", name.c_str());
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double total = static_cast<double>(messages) * static_cast<double>(clients.size());
+    printf("%-32s %6d %9zu %12.0f %10.1f", name.c_str(), config.connections, messages, total / seconds,
+           total * static_cast<double>(size) / seconds / 1e6);
+    if (server != nullptr) {
+        // an echo crosses the wire twice, a flood once
+        double payloadBytes = total * static_cast<double>(size) * (config.flood ? 1 : 2);
+        printf(" %8.1f", 100.0 * static_cast<double>(wireBytes) / payloadBytes);
+    } else {
+        printf(" %8s", "-");
+    }
+    printf(" %10.2f", cpuSeconds * 1e6 / total);
+    if (config.flood) {
+        printf("\n");
+    } else {
+        std::sort(roundTrips.begin(), roundTrips.end());
+        printf(" %10.1f %10.1f %10.1f\n", percentile(roundTrips, 0.5), percentile(roundTrips, 0.99),
+               percentile(roundTrips, 0.999));
+    }
+    fflush(stdout);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Config config;
+    std::string filter = ".*";
+    std::string wsUrl;
+    std::string wssUrl;
+    std::string caFilePath;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--connections=", 14) == 0) {
+            config.connections = std::max(1, atoi(argv[i] + 14));
+        } else if (strncmp(argv[i], "--window=", 9) == 0) {
+            config.window = std::max(1, atoi(argv[i] + 9));
+        } else if (strcmp(argv[i], "--flood") == 0) {
+            config.flood = true;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            config.connections = 2;
+            config.bytesPerConnection = 256 * 1024;
+            config.minMessages = 4;
+            config.maxMessages = 50;
+        } else if (strncmp(argv[i], "--ws-url=", 9) == 0) {
+            wsUrl = argv[i] + 9;
+        } else if (strncmp(argv[i], "--wss-url=", 10) == 0) {
+            wssUrl = argv[i] + 10;
+        } else if (strncmp(argv[i], "--ca=", 5) == 0) {
+            caFilePath = argv[i] + 5;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--filter=<regex>] [--connections=4] [--window=1] [--flood] [--quick]\n"
+                    "       [--ws-url=<url>] [--wss-url=<url> --ca=<pem>]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    // without URLs, a server of our own on free ports
+    host::EchoServer server;
+    server.setDeflate(true);
+    if (wsUrl.empty() && wssUrl.empty()) {
+        const char *tmp = getenv("TMPDIR");
+        caFilePath = std::string(tmp != nullptr ? tmp : "/tmp") + "/ws_loopback_ca_" + std::to_string(getpid()) +
+                     ".pem";
+        if (!server.start(0, 0, caFilePath)) {
+            return 1;
+        }
+        wsUrl = "ws://127.0.0.1:" + std::to_string(server.getPort()) + "/echo";
+        wssUrl = "wss://127.0.0.1:" + std::to_string(server.getTlsPort()) + "/echo";
+    }
+
+    printf("%-32s %6s %9s %12s %10s %8s %10s", "Benchmark", "conns", "msgs/conn", "msgs/s", "MB/s", "wire %",
+           "cpu us/msg");
+    if (config.flood) {
+        printf("\n");
+    } else {
+        printf(" %10s %10s %10s\n", "p50 us", "p99 us", "p999 us");
+    }
+    std::regex selected(filter);
+    int failed = 0;
+    for (const std::string &url : {wsUrl, wssUrl}) {
+        if (url.empty()) {
+            continue;
+        }
+        std::string scheme = url.substr(0, url.find(':'));
+        for (bool deflate : {false, true}) {
+            for (bool binary : {false, true}) {
+                for (size_t size : config.sizes) {
+                    std::string name = scheme + (deflate ? "/deflate" : "") + (binary ? "/binary/" : "/text/") +
+                                       std::to_string(size);
+                    if (std::regex_search(name, selected) &&
+                        !run(config, name, url, caFilePath, deflate, binary, size,
+                             server.getPort() != 0 ? &server : nullptr)) {
+                        ++failed;
+                    }
+                }
+            }
+        }
+    }
+
+    server.stop();
+    if (!caFilePath.empty() && server.getPort() != 0) {
+        unlink(caFilePath.c_str());
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// Throughput of the frame masking and UTF-8 validation of WebSocketUtils, against the 64-bit loops they replaced
+// (the *_u64 benchmarks). The vectorized path is the one the CPU selects, AVX2 or SSE2 on x86-64.
+//
+//   utils_bench [--filter=<regex>] [--min-time=<seconds>]
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+#include "network/WebSocketUtils.h"
+
+namespace {
+
+const uint8_t KEY[4] = {0x37, 0xFA, 0x21, 0x3D};
+
+// the implementations before vectorization
+void applyMaskU64(uint8_t *data, size_t len, const uint8_t key[4]) {
+    uint64_t key64;
+    uint8_t repeated[8] = {key[0], key[1], key[2], key[3], key[0], key[1], key[2], key[3]};
+    memcpy(&key64, repeated, sizeof(key64));
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, data + i, sizeof(chunk));
+        chunk ^= key64;
+        memcpy(data + i, &chunk, sizeof(chunk));
+    }
+    for (; i < len; ++i) {
+        data[i] ^= key[i & 3];
+    }
+}
+
+bool isValidUTF8U64(const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        // skip ASCII eight bytes at a time, JSON payloads are mostly ASCII
+        if (i + 8 <= len) {
+            uint64_t chunk;
+            memcpy(&chunk, data + i, sizeof(chunk));
+            if ((chunk & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        uint8_t c = data[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+
+        size_t n;
+        uint8_t lo = 0x80;
+        uint8_t hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            if (c == 0xE0) {
+                lo = 0xA0; // overlong
+            } else if (c == 0xED) {
+                hi = 0x9F; // surrogates
+            }
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            if (c == 0xF0) {
+                lo = 0x90; // overlong
+            } else if (c == 0xF4) {
+                hi = 0x8F; // above U+10FFFF
+            }
+        } else {
+            return false;
+        }
+
+        if (len - i <= n) {
+            return false;
+        }
+        if (data[i + 1] < lo || data[i + 1] > hi) {
+            return false;
+        }
+        for (size_t k = 2; k <= n; ++k) {
+            if ((data[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+// a chat message in JSON, CJK text with ASCII keys and punctuation, repeated to size and cut at a character
+std::vector<uint8_t> makeMixedText(size_t size) {
+    const std::string unit = "{\"from\":\"player_42\",\"text\":\"\xE4\xBD\xA0\xE5\xA5\xBD\xEF\xBC\x8C"
+                             "\xE4\xB8\x80\xE8\xB5\xB7\xE7\x8E\xA9\xE5\x90\x97\xEF\xBC\x9F \xF0\x9F\x98\x80\"}\n";
+    std::string text;
+    while (text.size() + unit.size() <= size) {
+        text += unit;
+    }
+    text.append(size - text.size(), 'x');
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+std::vector<uint8_t> makeAsciiText(size_t size) {
+    std::vector<uint8_t> text(size);
+    for (size_t i = 0; i < size; ++i) {
+        text[i] = static_cast<uint8_t>('a' + i % 26);
+    }
+    return text;
+}
+
+} // namespace
+
+BENCHMARK_WITH_ARGS(mask, 64, 1024, 65536, 1048576) {
+    std::vector<uint8_t> payload = makeAsciiText(argument);
+    while (state.keepRunning()) {
+        cocos2d::network::WebSocketUtils::applyMask(payload.data(), payload.size(), KEY);
+        bench::doNotOptimize(payload.data());
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(mask_u64, 64, 1024, 65536, 1048576) {
+    std::vector<uint8_t> payload = makeAsciiText(argument);
+    while (state.keepRunning()) {
+        applyMaskU64(payload.data(), payload.size(), KEY);
+        bench::doNotOptimize(payload.data());
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(utf8_ascii, 64, 1024, 65536, 1048576) {
+    std::vector<uint8_t> text = makeAsciiText(argument);
+    while (state.keepRunning()) {
+        bench::doNotOptimize(cocos2d::network::WebSocketUtils::isValidUTF8(text.data(), text.size()));
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(utf8_ascii_u64, 64, 1024, 65536, 1048576) {
+    std::vector<uint8_t> text = makeAsciiText(argument);
+    while (state.keepRunning()) {
+        bench::doNotOptimize(isValidUTF8U64(text.data(), text.size()));
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(utf8_mixed, 64, 1024, 65536, 1048576) {
+    std::vector<uint8_t> text = makeMixedText(argument);
+    while (state.keepRunning()) {
+        bench::doNotOptimize(cocos2d::network::WebSocketUtils::isValidUTF8(text.data(), text.size()));
+    }
+    state.setBytesPerIteration(argument);
+}
+
+BENCHMARK_WITH_ARGS(utf8_mixed_u64, 64, 1024, 65536, 1048576) {
+    std::vector<uint8_t> text = makeMixedText(argument);
+    while (state.keepRunning()) {
+        bench::doNotOptimize(isValidUTF8U64(text.data(), text.size()));
+    }
+    state.setBytesPerIteration(argument);
+}
+
+int main(int argc, char **argv) {
+    return bench::runBenchmarks(argc, argv);
+}
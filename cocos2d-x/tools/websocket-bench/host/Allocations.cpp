@@ -0,0 +1,115 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "Allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_count{0};
+std::atomic<uint64_t> g_bytes{0};
+thread_local bool t_inVm = false;
+
+void *allocate(size_t size) {
+    if (!t_inVm) {
+        g_count.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return malloc(size != 0 ? size : 1);
+}
+
+} // namespace
+
+namespace host {
+
+AllocationCounts getNativeAllocations() {
+    AllocationCounts counts;
+    counts.count = g_count.load(std::memory_order_relaxed);
+    counts.bytes = g_bytes.load(std::memory_order_relaxed);
+    return counts;
+}
+
+VmAllocations::VmAllocations() : _previous(t_inVm) {
+    t_inVm = true;
+}
+
+VmAllocations::~VmAllocations() {
+    t_inVm = _previous;
+}
+
+NativeAllocations::NativeAllocations() : _previous(t_inVm) {
+    t_inVm = false;
+}
+
+NativeAllocations::~NativeAllocations() {
+    t_inVm = _previous;
+}
+
+} // namespace host
+
+void *operator new(size_t size) {
+    void *memory = allocate(size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t & /*tag*/) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t & /*tag*/) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t /*size*/) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t /*size*/) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t & /*tag*/) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t & /*tag*/) noexcept {
+    free(memory);
+}
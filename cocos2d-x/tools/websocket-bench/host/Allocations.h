@@ -0,0 +1,68 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <cstdint>
+
+namespace host {
+
+/**
+ * Native heap allocations made through operator new since the process started, counted by the operator new which
+ * the host harness links in. malloc is not counted. Allocations made by the fake JVM on behalf of Java code are
+ * counted by fakejni::Vm instead, see VmAllocations.
+ */
+struct AllocationCounts {
+    uint64_t count{0};
+    uint64_t bytes{0};
+};
+
+AllocationCounts getNativeAllocations();
+
+/**
+ * While alive, operator new on this thread counts as an allocation of the fake JVM and not of native code. The fake
+ * JVM holds one in every JNI function, NativeAllocations switches back when it calls into native code.
+ */
+class VmAllocations {
+public:
+    VmAllocations();
+    ~VmAllocations();
+    VmAllocations(const VmAllocations &) = delete;
+    VmAllocations &operator=(const VmAllocations &) = delete;
+
+private:
+    bool _previous;
+};
+
+class NativeAllocations {
+public:
+    NativeAllocations();
+    ~NativeAllocations();
+    NativeAllocations(const NativeAllocations &) = delete;
+    NativeAllocations &operator=(const NativeAllocations &) = delete;
+
+private:
+    bool _previous;
+};
+
+} // namespace host
@@ -0,0 +1,732 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "EchoServer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <zlib.h>
+
+namespace host {
+
+namespace {
+
+const char *WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const size_t MAX_HEADER_SIZE = 16 * 1024;
+const uint64_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+enum Opcode : uint8_t {
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xA,
+};
+
+EVP_PKEY *generateKey() {
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if (ctx != nullptr && EVP_PKEY_keygen_init(ctx) > 0 &&
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) > 0) {
+        EVP_PKEY_keygen(ctx, &key);
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+bool addExtension(X509 *cert, X509 *issuer, int nid, std::string value) {
+    X509V3_CTX v3;
+    X509V3_set_ctx(&v3, issuer, cert, nullptr, nullptr, 0);
+    // not const before OpenSSL 3
+    X509_EXTENSION *extension = X509V3_EXT_conf_nid(nullptr, &v3, nid, &value[0]);
+    if (extension == nullptr) {
+        return false;
+    }
+    bool added = X509_add_ext(cert, extension, -1) == 1;
+    X509_EXTENSION_free(extension);
+    return added;
+}
+
+// Certificate of key signed by issuerKey, self-signed when issuer is null, valid from an hour ago for 30 days.
+X509 *makeCertificate(EVP_PKEY *key, const char *commonName, long serial, X509 *issuer, EVP_PKEY *issuerKey) {
+    X509 *cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60 * 60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 30 * 24 * 60 * 60);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>(commonName), -1,
+                               -1, 0);
+    X509_set_issuer_name(cert, issuer != nullptr ? X509_get_subject_name(issuer) : name);
+
+    bool ok = addExtension(cert, cert, NID_subject_key_identifier, "hash");
+    if (issuer == nullptr) {
+        ok = ok && addExtension(cert, cert, NID_basic_constraints, "critical,CA:TRUE") &&
+             addExtension(cert, cert, NID_key_usage, "critical,keyCertSign,cRLSign");
+    } else {
+        ok = ok && addExtension(cert, issuer, NID_authority_key_identifier, "keyid") &&
+             addExtension(cert, issuer, NID_basic_constraints, "CA:FALSE") &&
+             addExtension(cert, issuer, NID_key_usage, "critical,digitalSignature") &&
+             addExtension(cert, issuer, NID_ext_key_usage, "serverAuth") &&
+             addExtension(cert, issuer, NID_subject_alt_name, "IP:127.0.0.1,DNS:localhost");
+    }
+    if (!ok || X509_sign(cert, issuerKey, EVP_sha256()) == 0) {
+        X509_free(cert);
+        return nullptr;
+    }
+    return cert;
+}
+
+// A server context with a new CA and a certificate for 127.0.0.1 signed by it, the CA is written to caFilePath.
+SSL_CTX *createContext(const std::string &caFilePath) {
+    OPENSSL_init_ssl(0, nullptr);
+    SSL_CTX *ctx = nullptr;
+    EVP_PKEY *caKey = generateKey();
+    EVP_PKEY *serverKey = generateKey();
+    X509 *ca = caKey != nullptr ? makeCertificate(caKey, "WebSocket bench CA", 1, nullptr, caKey) : nullptr;
+    X509 *cert = ca != nullptr && serverKey != nullptr
+                     ? makeCertificate(serverKey, "127.0.0.1", 2, ca, caKey)
+                     : nullptr;
+    BIO *file = cert != nullptr ? BIO_new_file(caFilePath.c_str(), "w") : nullptr;
+    if (file != nullptr && PEM_write_bio_X509(file, ca) == 1) {
+        ctx = SSL_CTX_new(TLS_server_method());
+        SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+        if (SSL_CTX_use_certificate(ctx, cert) != 1 || SSL_CTX_use_PrivateKey(ctx, serverKey) != 1) {
+            SSL_CTX_free(ctx);
+            ctx = nullptr;
+        }
+    }
+    if (ctx == nullptr) {
+        fprintf(stderr, "EchoServer: can't create the certificates or write %s\n", caFilePath.c_str());
+        ERR_print_errors_fp(stderr);
+    }
+    BIO_free(file);
+    X509_free(cert);
+    X509_free(ca);
+    EVP_PKEY_free(serverKey);
+    EVP_PKEY_free(caKey);
+    return ctx;
+}
+
+std::string base64(const unsigned char *data, size_t size) {
+    std::string encoded(4 * ((size + 2) / 3) + 1, '\0');
+    int length = EVP_EncodeBlock(reinterpret_cast<unsigned char *>(&encoded[0]), data, static_cast<int>(size));
+    encoded.resize(static_cast<size_t>(length));
+    return encoded;
+}
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+// value of a header in a request head, names compare case-insensitively, empty if missing
+std::string findHeader(const std::string &head, const std::string &name) {
+    size_t begin = head.find("\r\n");
+    while (begin != std::string::npos && begin + 2 < head.size()) {
+        begin += 2;
+        size_t end = head.find("\r\n", begin);
+        std::string line = head.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos && toLower(line.substr(0, colon)) == name) {
+            size_t first = line.find_first_not_of(" \t", colon + 1);
+            size_t last = line.find_last_not_of(" \t");
+            return first == std::string::npos ? std::string() : line.substr(first, last - first + 1);
+        }
+        begin = end;
+    }
+    return std::string();
+}
+
+std::string trim(const std::string &text) {
+    size_t first = text.find_first_not_of(" \t");
+    size_t last = text.find_last_not_of(" \t");
+    return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+}
+
+std::vector<std::string> split(const std::string &text, char separator) {
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (true) {
+        size_t end = text.find(separator, begin);
+        parts.push_back(trim(text.substr(begin, end == std::string::npos ? std::string::npos : end - begin)));
+        if (end == std::string::npos) {
+            return parts;
+        }
+        begin = end + 1;
+    }
+}
+
+// The server side of permessage-deflate (RFC 7692), on zlib directly rather than WebSocketDeflate so that a
+// misunderstanding of the RFC in one doesn't hide the same one in the other.
+class ServerDeflate {
+public:
+    ServerDeflate() {
+        memset(&_deflater, 0, sizeof(_deflater));
+        memset(&_inflater, 0, sizeof(_inflater));
+    }
+
+    ~ServerDeflate() {
+        if (_negotiated) {
+            deflateEnd(&_deflater);
+            inflateEnd(&_inflater);
+        }
+    }
+
+    ServerDeflate(const ServerDeflate &) = delete;
+    ServerDeflate &operator=(const ServerDeflate &) = delete;
+
+    // Accepts the first permessage-deflate offer of a Sec-WebSocket-Extensions header whose parameters are
+    // understood, returns the response header value or an empty string when none is.
+    std::string negotiate(const std::string &offers) {
+        for (const std::string &offer : split(offers, ',')) {
+            std::vector<std::string> params = split(offer, ';');
+            if (params[0] != "permessage-deflate") {
+                continue;
+            }
+            std::string response = "permessage-deflate";
+            int windowBits = 15;
+            bool understood = true;
+            for (size_t i = 1; i < params.size() && understood; ++i) {
+                size_t eq = params[i].find('=');
+                std::string key = trim(params[i].substr(0, eq));
+                std::string value = eq == std::string::npos ? "" : trim(params[i].substr(eq + 1));
+                if (key == "server_no_context_takeover" && value.empty()) {
+                    _resetDeflater = true;
+                    response += "; server_no_context_takeover";
+                } else if (key == "client_no_context_takeover" && value.empty()) {
+                    _resetInflater = true;
+                    response += "; client_no_context_takeover";
+                } else if (key == "server_max_window_bits") {
+                    // zlib can't deflate with a raw 8 bit window
+                    windowBits = atoi(value.c_str());
+                    understood = windowBits >= 9 && windowBits <= 15;
+                    response += "; server_max_window_bits=" + value;
+                } else if (key == "client_max_window_bits") {
+                    // inflating with the largest window accepts any the client picks
+                } else {
+                    understood = false;
+                }
+            }
+            if (!understood) {
+                _resetDeflater = _resetInflater = false;
+                continue;
+            }
+            if (deflateInit2(&_deflater, 6, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return std::string();
+            }
+            if (inflateInit2(&_inflater, -15) != Z_OK) {
+                deflateEnd(&_deflater);
+                return std::string();
+            }
+            _negotiated = true;
+            return response;
+        }
+        return std::string();
+    }
+
+    bool isNegotiated() const { return _negotiated; }
+
+    // a sync flush without its trailing 0x00 0x00 0xff 0xff
+    void compress(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+        if (size == 0) {
+            out.assign(1, 0x00);
+            return;
+        }
+        out.resize(deflateBound(&_deflater, static_cast<uLong>(size)) + 16);
+        _deflater.next_in = const_cast<Bytef *>(data);
+        _deflater.avail_in = static_cast<uInt>(size);
+        size_t produced = 0;
+        do {
+            if (produced == out.size()) {
+                out.resize(out.size() * 2);
+            }
+            _deflater.next_out = out.data() + produced;
+            _deflater.avail_out = static_cast<uInt>(out.size() - produced);
+            deflate(&_deflater, Z_SYNC_FLUSH);
+            produced = out.size() - _deflater.avail_out;
+        } while (_deflater.avail_in > 0 || _deflater.avail_out == 0);
+        out.resize(produced - 4);
+        if (_resetDeflater) {
+            deflateReset(&_deflater);
+        }
+    }
+
+    bool decompress(std::vector<uint8_t> &data, std::vector<uint8_t> &out) {
+        static const uint8_t TAIL[] = {0x00, 0x00, 0xff, 0xff};
+        data.insert(data.end(), TAIL, TAIL + sizeof(TAIL));
+        out.resize(std::max<size_t>(data.size() * 4, 4096));
+        _inflater.next_in = data.data();
+        _inflater.avail_in = static_cast<uInt>(data.size());
+        size_t produced = 0;
+        while (_inflater.avail_in > 0) {
+            if (produced == out.size()) {
+                if (out.size() >= MAX_MESSAGE_SIZE) {
+                    return false;
+                }
+                out.resize(out.size() * 2);
+            }
+            _inflater.next_out = out.data() + produced;
+            _inflater.avail_out = static_cast<uInt>(out.size() - produced);
+            int ret = inflate(&_inflater, Z_SYNC_FLUSH);
+            produced = out.size() - _inflater.avail_out;
+            if (ret == Z_STREAM_END) {
+                // a final block, the tail after it belongs to no stream
+                inflateReset(&_inflater);
+                break;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                return false;
+            }
+        }
+        out.resize(produced);
+        if (_resetInflater) {
+            inflateReset(&_inflater);
+        }
+        return true;
+    }
+
+private:
+    bool _negotiated{false};
+    bool _resetDeflater{false};
+    bool _resetInflater{false};
+    z_stream _deflater;
+    z_stream _inflater;
+};
+
+// One accepted socket, read through a buffer since the first frames may arrive with the request.
+class Connection {
+public:
+    Connection(int fd, SSL *ssl, bool deflate, std::atomic<uint64_t> &wireBytes,
+               const std::atomic<bool> &answerPings)
+    : _fd(fd), _ssl(ssl), _deflateAllowed(deflate), _wireBytes(wireBytes), _answerPings(answerPings),
+      _buffer(64 * 1024) {}
+
+    bool handshake() {
+        std::string head;
+        size_t end;
+        while ((end = head.find("\r\n\r\n")) == std::string::npos) {
+            if (head.size() > MAX_HEADER_SIZE || !fill()) {
+                return false;
+            }
+            head.append(reinterpret_cast<const char *>(&_buffer[_begin]), _end - _begin);
+            _begin = _end;
+        }
+        // bytes after the head are the first frames
+        _begin = _end - (head.size() - end - 4);
+        head.resize(end + 2);
+
+        std::string key = findHeader(head, "sec-websocket-key");
+        if (head.compare(0, 4, "GET ") != 0 || key.empty()) {
+            std::string response = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+            write(response.data(), response.size());
+            return false;
+        }
+        key += WEBSOCKET_GUID;
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        SHA1(reinterpret_cast<const unsigned char *>(key.data()), key.size(), digest);
+        std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                               "Upgrade: websocket\r\n"
+                               "Connection: Upgrade\r\n"
+                               "Sec-WebSocket-Accept: " + base64(digest, sizeof(digest)) + "\r\n";
+        // permessage-deflate is the only extension accepted, and only when enabled
+        std::string extensions = _deflateAllowed ? _deflate.negotiate(findHeader(head, "sec-websocket-extensions"))
+                                                 : std::string();
+        if (!extensions.empty()) {
+            response += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+        }
+        std::string protocols = findHeader(head, "sec-websocket-protocol");
+        if (!protocols.empty()) {
+            response += "Sec-WebSocket-Protocol: " + protocols.substr(0, protocols.find(',')) + "\r\n";
+        }
+        response += "\r\n";
+        return write(response.data(), response.size());
+    }
+
+    // Echoes messages until the client closes or the connection fails.
+    void run() {
+        std::vector<uint8_t> message;
+        uint8_t messageType = TEXT;
+        bool compressed = false;
+        std::vector<uint8_t> payload;
+        std::vector<uint8_t> inflated;
+        while (true) {
+            uint8_t head[2];
+            if (!read(head, 2)) {
+                return;
+            }
+            bool fin = (head[0] & 0x80) != 0;
+            bool rsv1 = (head[0] & 0x40) != 0;
+            auto opcode = static_cast<uint8_t>(head[0] & 0x0F);
+            // RSV1 marks the first frame of a compressed message, nothing else
+            if (rsv1 && (!_deflate.isNegotiated() || (opcode != TEXT && opcode != BINARY))) {
+                sendClose(1002);
+                return;
+            }
+            uint64_t length = head[1] & 0x7F;
+            if (length >= 126) {
+                uint8_t extended[8];
+                size_t size = length == 126 ? 2 : 8;
+                if (!read(extended, size)) {
+                    return;
+                }
+                length = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    length = (length << 8) | extended[i];
+                }
+            }
+            uint8_t mask[4] = {0, 0, 0, 0};
+            if ((head[1] & 0x80) != 0 && !read(mask, 4)) {
+                return;
+            }
+            if (length > MAX_MESSAGE_SIZE || message.size() + length > MAX_MESSAGE_SIZE) {
+                sendClose(1009);
+                return;
+            }
+            payload.resize(static_cast<size_t>(length));
+            if (!read(payload.data(), payload.size())) {
+                return;
+            }
+            for (size_t i = 0; i < payload.size(); ++i) {
+                payload[i] ^= mask[i & 3];
+            }
+
+            switch (opcode) {
+                case PING:
+                    if (_answerPings) {
+                        sendFrame(PONG, payload.data(), payload.size());
+                    }
+                    continue;
+                case PONG:
+                    continue;
+                case CLOSE:
+                    // echo the status code, the close handshake ends the connection
+                    sendFrame(CLOSE, payload.data(), std::min<size_t>(payload.size(), 2));
+                    return;
+                case TEXT:
+                case BINARY:
+                    messageType = opcode;
+                    compressed = rsv1;
+                    message.assign(payload.begin(), payload.end());
+                    break;
+                case CONTINUATION:
+                    message.insert(message.end(), payload.begin(), payload.end());
+                    break;
+                default:
+                    sendClose(1002);
+                    return;
+            }
+            _wireBytes.fetch_add(payload.size(), std::memory_order_relaxed);
+            if (!fin) {
+                continue;
+            }
+            if (compressed) {
+                if (!_deflate.decompress(message, inflated)) {
+                    sendClose(1007);
+                    return;
+                }
+                message.swap(inflated);
+            }
+            if (!onMessage(messageType, message)) {
+                return;
+            }
+        }
+    }
+
+private:
+    bool onMessage(uint8_t type, const std::vector<uint8_t> &message) {
+        static const char FLOOD[] = "flood ";
+        if (type == TEXT && message.size() < 64 &&
+            std::equal(FLOOD, FLOOD + sizeof(FLOOD) - 1, message.begin())) {
+            std::string command(message.begin(), message.end());
+            unsigned count = 0;
+            unsigned long size = 0;
+            char kind[8] = "text";
+            if (sscanf(command.c_str(), "flood %u %lu %7s", &count, &size, kind) < 2 || size > MAX_MESSAGE_SIZE) {
+                return sendClose(1003);
+            }
+            bool binary = strcmp(kind, "binary") == 0;
+            std::vector<uint8_t> payload(size);
+            for (size_t i = 0; i < payload.size(); ++i) {
+                payload[i] = binary ? static_cast<uint8_t>(i) : static_cast<uint8_t>('a' + i % 26);
+            }
+            for (unsigned i = 0; i < count; ++i) {
+                if (!sendMessage(binary ? BINARY : TEXT, payload.data(), payload.size())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return sendMessage(type, message.data(), message.size());
+    }
+
+    bool sendMessage(uint8_t type, const uint8_t *data, size_t size) {
+        if (_deflate.isNegotiated()) {
+            _deflate.compress(data, size, _compressed);
+            _wireBytes.fetch_add(_compressed.size(), std::memory_order_relaxed);
+            return sendFrame(type, _compressed.data(), _compressed.size(), true);
+        }
+        _wireBytes.fetch_add(size, std::memory_order_relaxed);
+        return sendFrame(type, data, size);
+    }
+
+    bool sendClose(uint16_t code) {
+        uint8_t payload[2] = {static_cast<uint8_t>(code >> 8), static_cast<uint8_t>(code)};
+        sendFrame(CLOSE, payload, sizeof(payload));
+        return false;
+    }
+
+    // servers don't mask, the head and the payload go out in one write
+    bool sendFrame(uint8_t opcode, const uint8_t *payload, size_t length, bool compressed = false) {
+        _frame.clear();
+        _frame.push_back(static_cast<uint8_t>(0x80 | (compressed ? 0x40 : 0) | opcode));
+        if (length < 126) {
+            _frame.push_back(static_cast<uint8_t>(length));
+        } else if (length <= 0xFFFF) {
+            _frame.push_back(126);
+            _frame.push_back(static_cast<uint8_t>(length >> 8));
+            _frame.push_back(static_cast<uint8_t>(length));
+        } else {
+            _frame.push_back(127);
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                _frame.push_back(static_cast<uint8_t>(static_cast<uint64_t>(length) >> shift));
+            }
+        }
+        _frame.insert(_frame.end(), payload, payload + length);
+        return write(_frame.data(), _frame.size());
+    }
+
+    bool fill() {
+        if (_begin == _end) {
+            _begin = _end = 0;
+        }
+        int received;
+        if (_ssl != nullptr) {
+            received = SSL_read(_ssl, &_buffer[_end], static_cast<int>(_buffer.size() - _end));
+        } else {
+            ssize_t result;
+            do {
+                result = recv(_fd, &_buffer[_end], _buffer.size() - _end, 0);
+            } while (result < 0 && errno == EINTR);
+            received = static_cast<int>(result);
+        }
+        if (received <= 0) {
+            return false;
+        }
+        _end += static_cast<size_t>(received);
+        return true;
+    }
+
+    bool read(uint8_t *out, size_t size) {
+        while (size > 0) {
+            if (_begin == _end && !fill()) {
+                return false;
+            }
+            size_t chunk = std::min(size, _end - _begin);
+            memcpy(out, &_buffer[_begin], chunk);
+            _begin += chunk;
+            out += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+    bool write(const void *data, size_t size) {
+        auto bytes = static_cast<const uint8_t *>(data);
+        while (size > 0) {
+            ssize_t written;
+            if (_ssl != nullptr) {
+                written = SSL_write(_ssl, bytes, static_cast<int>(std::min<size_t>(size, 1 << 30)));
+            } else {
+                written = send(_fd, bytes, size, MSG_NOSIGNAL);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+            }
+            if (written <= 0) {
+                return false;
+            }
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    int _fd;
+    SSL *_ssl;
+    bool _deflateAllowed;
+    std::atomic<uint64_t> &_wireBytes;
+    const std::atomic<bool> &_answerPings;
+    ServerDeflate _deflate;
+    std::vector<uint8_t> _buffer;
+    size_t _begin{0};
+    size_t _end{0};
+    std::vector<uint8_t> _frame;
+    std::vector<uint8_t> _compressed;
+};
+
+} // namespace
+
+EchoServer::~EchoServer() {
+    stop();
+}
+
+bool EchoServer::start(uint16_t port, uint16_t tlsPort, const std::string &caFilePath) {
+    // a client which goes away must not kill the process in SSL_write
+    signal(SIGPIPE, SIG_IGN);
+    _caFilePath = caFilePath;
+    _ctx = createContext(caFilePath);
+    if (_ctx == nullptr || !listenOn(port, _listenFd, _port) || !listenOn(tlsPort, _tlsListenFd, _tlsPort)) {
+        stop();
+        return false;
+    }
+    _stopping = false;
+    _acceptThreads.emplace_back(&EchoServer::acceptLoop, this, _listenFd, false);
+    _acceptThreads.emplace_back(&EchoServer::acceptLoop, this, _tlsListenFd, true);
+    return true;
+}
+
+void EchoServer::stop() {
+    _stopping = true;
+    for (int fd : {_listenFd, _tlsListenFd}) {
+        if (fd >= 0) {
+            // wakes up accept()
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto &thread : _acceptThreads) {
+        thread.join();
+    }
+    _acceptThreads.clear();
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int fd : _connectionFds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        threads.swap(_connectionThreads);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int *fd : {&_listenFd, &_tlsListenFd}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    if (_ctx != nullptr) {
+        SSL_CTX_free(_ctx);
+        _ctx = nullptr;
+    }
+}
+
+bool EchoServer::listenOn(uint16_t port, int &fd, uint16_t &boundPort) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 128) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        fprintf(stderr, "EchoServer: can't listen on port %u: %s\n", port, strerror(errno));
+        return false;
+    }
+    boundPort = ntohs(address.sin_port);
+    return true;
+}
+
+void EchoServer::acceptLoop(int listenFd, bool secure) {
+    while (!_stopping) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        // finished threads are joined by stop(), a benchmark opens few enough connections
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopping) {
+            close(fd);
+            return;
+        }
+        _connectionFds.push_back(fd);
+        _connectionThreads.emplace_back(&EchoServer::serve, this, fd, secure);
+    }
+}
+
+void EchoServer::serve(int fd, bool secure) {
+    SSL *ssl = nullptr;
+    if (secure) {
+        ssl = SSL_new(_ctx);
+        SSL_set_fd(ssl, fd);
+    }
+    if (ssl == nullptr || SSL_accept(ssl) == 1) {
+        Connection connection(fd, ssl, _deflate, _wireBytes, _answerPings);
+        if (connection.handshake()) {
+            connection.run();
+        }
+        if (ssl != nullptr) {
+            SSL_shutdown(ssl);
+        }
+    }
+    SSL_free(ssl);
+    ERR_clear_error();
+    {
+        // stop() mustn't shut down the number once another socket reuses it
+        std::lock_guard<std::mutex> lock(_mutex);
+        _connectionFds.erase(std::find(_connectionFds.begin(), _connectionFds.end(), fd));
+    }
+    close(fd);
+}
+
+} // namespace host
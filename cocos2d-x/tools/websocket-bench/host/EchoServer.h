@@ -0,0 +1,89 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct ssl_ctx_st SSL_CTX;
+
+// An offline WebSocket server for the native backend: echoes every message it receives, and on the text message
+// "flood <count> <size> <text|binary>" sends <count> messages of <size> bytes instead. wss:// uses a certificate
+// of a CA generated at start, written to a PEM file for the client's caFilePath, so verification really runs.
+// With setDeflate(true) it accepts permessage-deflate offers and compresses every message it sends.
+namespace host {
+
+class EchoServer {
+public:
+    EchoServer() = default;
+    ~EchoServer();
+    EchoServer(const EchoServer &) = delete;
+    EchoServer &operator=(const EchoServer &) = delete;
+
+    /**
+     * Listens on 127.0.0.1, ws:// on port and wss:// on tlsPort, 0 picks a free port. The PEM file of the CA
+     * is written to caFilePath. Returns false, after printing why, if either port can't be opened.
+     */
+    bool start(uint16_t port, uint16_t tlsPort, const std::string &caFilePath);
+    /** Closes the listening sockets and every connection, and waits for their threads. */
+    void stop();
+
+    /** Whether connections opened from now on accept permessage-deflate (RFC 7692), off by default. */
+    void setDeflate(bool enabled) { _deflate = enabled; }
+    /** Whether pings get a pong, for every connection and from now on. On by default, off plays a dead peer. */
+    void setAnswerPings(bool enabled) { _answerPings = enabled; }
+    /** Payload bytes of the data frames read and written, as sent on the wire (compressed with deflate). */
+    uint64_t getWireBytes() const { return _wireBytes.load(std::memory_order_relaxed); }
+
+    uint16_t getPort() const { return _port; }
+    uint16_t getTlsPort() const { return _tlsPort; }
+    const std::string &getCAFilePath() const { return _caFilePath; }
+
+private:
+    bool listenOn(uint16_t port, int &fd, uint16_t &boundPort);
+    void acceptLoop(int listenFd, bool secure);
+    void serve(int fd, bool secure);
+
+    uint16_t _port{0};
+    uint16_t _tlsPort{0};
+    std::string _caFilePath;
+    SSL_CTX *_ctx{nullptr};
+    int _listenFd{-1};
+    int _tlsListenFd{-1};
+    std::atomic<bool> _stopping{false};
+    std::atomic<bool> _deflate{false};
+    std::atomic<bool> _answerPings{true};
+    std::atomic<uint64_t> _wireBytes{0};
+    std::vector<std::thread> _acceptThreads;
+
+    std::mutex _mutex;
+    std::vector<std::thread> _connectionThreads; // guarded by _mutex
+    std::vector<int> _connectionFds;             // guarded by _mutex, open connections
+};
+
+} // namespace host
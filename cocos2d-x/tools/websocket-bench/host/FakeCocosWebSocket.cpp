@@ -0,0 +1,447 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "FakeCocosWebSocket.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "platform/android/jni/JniHelper.h"
+
+#define JNI_PATH(methodName) Java_org_cocos2dx_lib_websocket_CocosWebSocket_##methodName
+
+// the native methods of CocosWebSocket, implemented by WebSocket-okhttp_android.cpp
+extern "C" {
+JNIEXPORT void JNICALL JNI_PATH(NativeInit)(JNIEnv *env, jclass clazz);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnStringMessage)(JNIEnv *env, jobject ctx, jstring msg, jlong handle);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnBinaryMessage)(JNIEnv *env, jobject ctx, jbyteArray msg, jlong handle);
+JNIEXPORT jobject JNICALL JNI_PATH(nativeAcquireReceiveBuffer)(JNIEnv *env, jclass clazz, jint size);
+JNIEXPORT void JNICALL JNI_PATH(nativeReleaseReceiveBuffer)(JNIEnv *env, jclass clazz, jobject buffer);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnStringBuffer)(JNIEnv *env, jobject ctx, jobject msg, jint len, jlong handle);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnBinaryBuffer)(JNIEnv *env, jobject ctx, jobject msg, jint len, jlong handle);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnOpen)(JNIEnv *env, jobject ctx, jstring protocol, jstring header,
+                                              jboolean secure, jboolean tlsResumed, jint tlsRoundTrips,
+                                              jlong tlsHandshakeMicros, jlong connectMicros, jlong handle);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnClosed)(JNIEnv *env, jobject ctx, jint code, jstring reason, jlong handle);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnError)(JNIEnv *env, jobject ctx, jstring reason, jboolean timedOut,
+                                               jlong handle);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnRoundTrip)(JNIEnv *env, jobject ctx, jlong micros, jlong handle);
+JNIEXPORT void JNICALL JNI_PATH(nativeOnBufferedAmount)(JNIEnv *env, jobject ctx, jlong amount, jlong handle);
+}
+
+namespace fakejni {
+
+const char *CocosWebSocket::CLASS_NAME = "org/cocos2dx/lib/websocket/CocosWebSocket";
+
+namespace {
+
+Class *g_class = nullptr;
+std::mutex g_instancesMutex;
+std::vector<CocosWebSocket *> g_instances; // guarded by g_instancesMutex, each one retained
+std::vector<std::string> g_preloadedCAFiles; // guarded by g_instancesMutex
+
+// a reference which Java code holds while it uses the object, e.g. a buffer returned by a native method
+class Held {
+public:
+    explicit Held(Object *object) : _object(object) {
+        if (_object != nullptr) {
+            _object->retain();
+        }
+    }
+    ~Held() {
+        if (_object != nullptr) {
+            host::VmAllocations allocations;
+            _object->release();
+        }
+    }
+    Held(const Held &) = delete;
+    Held &operator=(const Held &) = delete;
+
+    template <typename T = Object>
+    T *get() const {
+        return static_cast<T *>(_object);
+    }
+
+private:
+    Object *_object;
+};
+
+CocosWebSocket *self(Object *object) {
+    return static_cast<CocosWebSocket *>(object);
+}
+
+jvalue none() {
+    jvalue result;
+    result.j = 0;
+    return result;
+}
+
+// new Message(...) queued by RealWebSocket.send
+void countOkHttpMessage() {
+    Vm::get().countJavaAllocation(0);
+}
+
+} // namespace
+
+void CocosWebSocket::install() {
+    static std::once_flag defined;
+    std::call_once(defined, defineClass);
+    cocos2d::JniHelper::setJavaVM(Vm::get().getJavaVM());
+    cocos2d::JniHelper::getEnv();
+    if (!cocos2d::JniHelper::setClassLoaderFrom(reinterpret_cast<jobject>(Vm::get().getActivity()))) {
+        fatal("JniHelper::setClassLoaderFrom failed");
+    }
+}
+
+void CocosWebSocket::defineClass() {
+    Vm &vm = Vm::get();
+    g_class = vm.defineClass(CLASS_NAME);
+    g_class->setAllocator([](Class *klass) -> Object * {
+        // the fields and the objects the constructor and the field initializers allocate: the lock and the encoder
+        Vm::get().countJavaAllocation(0);
+        Vm::get().countJavaAllocation(0);
+        auto *socket = Vm::get().newObject<CocosWebSocket>(0, klass);
+        std::lock_guard<std::mutex> lock(g_instancesMutex);
+        socket->retain();
+        g_instances.push_back(socket);
+        return socket;
+    });
+    g_class->setStaticInitializer([](JNIEnv *env, Class *klass) {
+        NativeFrame frame(env);
+        JNI_PATH(NativeInit)(env, frame.ref<jclass>(klass));
+    });
+
+    g_class->addMethod("<init>", "(J[Ljava/lang/String;ZJZJJ)V", [](JNIEnv *, Object *object, const jvalue *args) {
+        self(object)->_handle.store(args[0].j, std::memory_order_relaxed);
+        return none();
+    });
+
+    g_class->addStaticMethod("preloadCAFile", "(Ljava/lang/String;)V", [](JNIEnv *, Object *, const jvalue *args) {
+        std::lock_guard<std::mutex> lock(g_instancesMutex);
+        g_preloadedCAFiles.push_back(fromRef<String>(args[0].l)->toUTF8());
+        return none();
+    });
+
+    g_class->addMethod("_connect", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)V",
+                       [](JNIEnv *env, Object *object, const jvalue *args) {
+                           CocosWebSocket *socket = self(object);
+                           socket->_url = fromRef<String>(args[0].l)->toUTF8();
+                           socket->_protocols = fromRef<String>(args[1].l)->toUTF8();
+                           socket->_caFilePath = fromRef<String>(args[2].l)->toUTF8();
+                           ++socket->_connectCount;
+                           {
+                               std::lock_guard<std::mutex> lock(socket->_bufferedAmountLock);
+                               NativeFrame frame(env);
+                               JNI_PATH(nativeOnBufferedAmount)(env, frame.ref(socket), 0, socket->getHandle());
+                           }
+                           // Request.Builder rejects anything but ws, wss, http and https
+                           const std::string &url = socket->_url;
+                           if (url.compare(0, 5, "ws://") != 0 && url.compare(0, 6, "wss://") != 0) {
+                               String *message = Vm::get().newStringFromUTF8("invalid url");
+                               NativeFrame frame(env);
+                               JNI_PATH(nativeOnError)(env, frame.ref(socket), frame.ref<jstring>(message), JNI_FALSE,
+                                                       socket->getHandle());
+                               return none();
+                           }
+                           socket->_connected = true;
+                           return none();
+                       });
+
+    g_class->addMethod("_send", "(Ljava/lang/String;)V", [](JNIEnv *env, Object *object, const jvalue *args) {
+        CocosWebSocket *socket = self(object);
+        if (!socket->_connected) {
+            return none();
+        }
+        // RealWebSocket.send(String) encodes it with ByteString.encodeUtf8: a byte[] and a ByteString
+        std::string text = fromRef<String>(args[0].l)->toUTF8();
+        Vm::get().countJavaAllocation(text.size());
+        Vm::get().countJavaAllocation(0);
+        countOkHttpMessage();
+        socket->sent(false, reinterpret_cast<const uint8_t *>(text.data()), text.size());
+        socket->reportQueued(env);
+        return none();
+    });
+
+    g_class->addMethod("_send", "([B)V", [](JNIEnv *env, Object *object, const jvalue *args) {
+        CocosWebSocket *socket = self(object);
+        if (!socket->_connected) {
+            return none();
+        }
+        // ByteString.of(byte[]) clones the array
+        auto *array = fromRef<PrimitiveArray>(args[0].l);
+        Vm::get().countJavaAllocation(static_cast<size_t>(array->getLength()));
+        Vm::get().countJavaAllocation(0);
+        countOkHttpMessage();
+        socket->sent(true, array->getData(), static_cast<size_t>(array->getLength()));
+        socket->reportQueued(env);
+        return none();
+    });
+
+    g_class->addMethod("_sendBuffer", "(Ljava/nio/ByteBuffer;II)V", [](JNIEnv *env, Object *object, const jvalue *args) {
+        CocosWebSocket *socket = self(object);
+        if (!socket->_connected) {
+            return none();
+        }
+        auto *buffer = fromRef<DirectByteBuffer>(args[0].l);
+        jint offset = args[1].i;
+        jint length = args[2].i;
+        if (offset < 0 || length < 0 || offset + static_cast<jlong>(length) > buffer->getCapacity()) {
+            fatal("_sendBuffer(%d, %d) exceeds the buffer capacity %lld", offset, length,
+                  static_cast<long long>(buffer->getCapacity()));
+        }
+        // ByteString.of(ByteBuffer) copies the remaining bytes into a new byte[]
+        Vm::get().countJavaAllocation(static_cast<size_t>(length));
+        Vm::get().countJavaAllocation(0);
+        countOkHttpMessage();
+        socket->sent(true, buffer->getAddress() + offset, static_cast<size_t>(length));
+        socket->reportQueued(env);
+        return none();
+    });
+
+    g_class->addMethod("_sendBatch", "(Ljava/nio/ByteBuffer;I)V", [](JNIEnv *env, Object *object, const jvalue *args) {
+        CocosWebSocket *socket = self(object);
+        if (!socket->_connected) {
+            return none();
+        }
+        auto *buffer = fromRef<DirectByteBuffer>(args[0].l);
+        jint length = args[1].i;
+        if (length < 0 || length > buffer->getCapacity()) {
+            fatal("_sendBatch(%d) exceeds the buffer capacity %lld", length,
+                  static_cast<long long>(buffer->getCapacity()));
+        }
+        const uint8_t *data = buffer->getAddress();
+        jint position = 0;
+        while (position < length) {
+            int32_t header;
+            memcpy(&header, data + position, sizeof(header));
+            auto size = static_cast<jint>(header & INT32_MAX);
+            position += sizeof(header);
+            if (size > length - position) {
+                fatal("_sendBatch: message of %d bytes at %d exceeds the batch of %d bytes", size, position, length);
+            }
+            if (header < 0) {
+                // ByteString.of(ByteBuffer): a byte[] and a ByteString
+                Vm::get().countJavaAllocation(static_cast<size_t>(size));
+                Vm::get().countJavaAllocation(0);
+            } else {
+                // the reused _batchText array, the String decoded from it, which send(String) encodes again
+                if (static_cast<size_t>(size) > socket->_batchTextCapacity) {
+                    socket->_batchTextCapacity = std::max<size_t>(static_cast<size_t>(size), 256);
+                    Vm::get().countJavaAllocation(socket->_batchTextCapacity);
+                }
+                Vm::get().countJavaAllocation(static_cast<size_t>(size) * sizeof(char16_t));
+                Vm::get().countJavaAllocation(static_cast<size_t>(size));
+                Vm::get().countJavaAllocation(0);
+            }
+            countOkHttpMessage();
+            socket->sent(header < 0, data + position, static_cast<size_t>(size));
+            position += size;
+        }
+        socket->reportQueued(env);
+        return none();
+    });
+
+    g_class->addMethod("_close", "(ILjava/lang/String;)V", [](JNIEnv *, Object *object, const jvalue *args) {
+        CocosWebSocket *socket = self(object);
+        // OkHttp reports onClosed once the peer answered, the caller decides when that happens
+        if (socket->_connected) {
+            socket->_closeRequested = true;
+            socket->_closeCode = args[0].i;
+            socket->_closeReason = fromRef<String>(args[1].l)->toUTF8();
+        }
+        return none();
+    });
+
+    g_class->addMethod("_removeHandler", "()V", [](JNIEnv *, Object *object, const jvalue *) {
+        self(object)->_handle.store(0, std::memory_order_relaxed);
+        return none();
+    });
+}
+
+std::vector<CocosWebSocket *> CocosWebSocket::getInstances() {
+    std::lock_guard<std::mutex> lock(g_instancesMutex);
+    return g_instances;
+}
+
+CocosWebSocket *CocosWebSocket::getLastInstance() {
+    std::lock_guard<std::mutex> lock(g_instancesMutex);
+    return g_instances.empty() ? nullptr : g_instances.back();
+}
+
+void CocosWebSocket::clearInstances() {
+    std::vector<CocosWebSocket *> instances;
+    {
+        std::lock_guard<std::mutex> lock(g_instancesMutex);
+        instances.swap(g_instances);
+    }
+    for (CocosWebSocket *instance : instances) {
+        instance->release();
+    }
+}
+
+std::vector<std::string> CocosWebSocket::getPreloadedCAFiles() {
+    std::lock_guard<std::mutex> lock(g_instancesMutex);
+    return g_preloadedCAFiles;
+}
+
+void CocosWebSocket::onOpen(const std::string &protocol, const std::string &headers, bool secure) {
+    JNIEnv *env = Vm::get().getEnv();
+    host::VmAllocations allocations;
+    Held jProtocol(Vm::get().newStringFromUTF8(protocol));
+    Held jHeaders(Vm::get().newStringFromUTF8(headers));
+    NativeFrame frame(env);
+    JNI_PATH(nativeOnOpen)(env, frame.ref(this), frame.ref<jstring>(jProtocol.get()),
+                           frame.ref<jstring>(jHeaders.get()), secure ? JNI_TRUE : JNI_FALSE, JNI_FALSE,
+                           secure ? 2 : 0, 0, 0, getHandle());
+}
+
+void CocosWebSocket::onMessage(const std::string &text) {
+    JNIEnv *env = Vm::get().getEnv();
+    host::VmAllocations allocations;
+    // the String OkHttp decoded the frame into
+    Held jText(Vm::get().newStringFromUTF8(text));
+    auto size = static_cast<jint>(text.size());
+    Object *acquired;
+    {
+        NativeFrame frame(env);
+        acquired = fromRef(JNI_PATH(nativeAcquireReceiveBuffer)(env, frame.ref<jclass>(g_class), size + 1));
+        if (acquired != nullptr) {
+            acquired->retain();
+        }
+    }
+    if (acquired != nullptr) {
+        Held buffer(acquired);
+        acquired->release();
+        // CharBuffer.wrap for the encoder
+        Vm::get().countJavaAllocation(0);
+        auto *direct = buffer.get<DirectByteBuffer>();
+        if (direct->getCapacity() < size + 1) {
+            fatal("nativeAcquireReceiveBuffer(%d) returned a buffer of %lld bytes", size + 1,
+                  static_cast<long long>(direct->getCapacity()));
+        }
+        memcpy(direct->getAddress(), text.data(), text.size());
+        NativeFrame frame(env);
+        JNI_PATH(nativeOnStringBuffer)(env, frame.ref(this), frame.ref(direct), size, getHandle());
+        return;
+    }
+    NativeFrame frame(env);
+    JNI_PATH(nativeOnStringMessage)(env, frame.ref(this), frame.ref<jstring>(jText.get()), getHandle());
+}
+
+void CocosWebSocket::onMessage(const uint8_t *bytes, size_t len) {
+    JNIEnv *env = Vm::get().getEnv();
+    host::VmAllocations allocations;
+    // the ByteString OkHttp read the frame into
+    Vm::get().countJavaAllocation(len);
+    Vm::get().countJavaAllocation(0);
+    auto size = static_cast<jint>(len);
+    Object *acquired;
+    {
+        NativeFrame frame(env);
+        acquired = fromRef(JNI_PATH(nativeAcquireReceiveBuffer)(env, frame.ref<jclass>(g_class), size));
+        if (acquired != nullptr) {
+            acquired->retain();
+        }
+    }
+    if (acquired != nullptr) {
+        Held buffer(acquired);
+        acquired->release();
+        // bytes.asByteBuffer() wraps the payload
+        Vm::get().countJavaAllocation(0);
+        auto *direct = buffer.get<DirectByteBuffer>();
+        if (direct->getCapacity() < size) {
+            fatal("nativeAcquireReceiveBuffer(%d) returned a buffer of %lld bytes", size,
+                  static_cast<long long>(direct->getCapacity()));
+        }
+        memcpy(direct->getAddress(), bytes, len);
+        NativeFrame frame(env);
+        JNI_PATH(nativeOnBinaryBuffer)(env, frame.ref(this), frame.ref(direct), size, getHandle());
+        return;
+    }
+    // bytes.toByteArray()
+    Class *arrayClass = Vm::get().getArrayClass("[B");
+    Held array(Vm::get().newObject<PrimitiveArray>(len, arrayClass, 'B', sizeof(jbyte), size));
+    memcpy(array.get<PrimitiveArray>()->getData(), bytes, len);
+    NativeFrame frame(env);
+    JNI_PATH(nativeOnBinaryMessage)(env, frame.ref(this), frame.ref<jbyteArray>(array.get()), getHandle());
+}
+
+void CocosWebSocket::onClosed(int code, const std::string &reason) {
+    JNIEnv *env = Vm::get().getEnv();
+    host::VmAllocations allocations;
+    Held jReason(Vm::get().newStringFromUTF8(reason));
+    _connected = false;
+    NativeFrame frame(env);
+    JNI_PATH(nativeOnClosed)(env, frame.ref(this), code, frame.ref<jstring>(jReason.get()), getHandle());
+}
+
+void CocosWebSocket::onFailure(const std::string &message, bool timedOut) {
+    JNIEnv *env = Vm::get().getEnv();
+    host::VmAllocations allocations;
+    Held jMessage(Vm::get().newStringFromUTF8(message));
+    _connected = false;
+    NativeFrame frame(env);
+    JNI_PATH(nativeOnError)(env, frame.ref(this), frame.ref<jstring>(jMessage.get()),
+                            timedOut ? JNI_TRUE : JNI_FALSE, getHandle());
+}
+
+void CocosWebSocket::onRoundTrip(int64_t micros) {
+    JNIEnv *env = Vm::get().getEnv();
+    NativeFrame frame(env);
+    JNI_PATH(nativeOnRoundTrip)(env, frame.ref(this), micros, getHandle());
+}
+
+void CocosWebSocket::setRecording(bool recording) {
+    std::lock_guard<std::mutex> lock(_sentMutex);
+    _recording = recording;
+}
+
+std::vector<SentFrame> CocosWebSocket::takeSentFrames() {
+    host::VmAllocations allocations;
+    std::lock_guard<std::mutex> lock(_sentMutex);
+    std::vector<SentFrame> frames;
+    frames.swap(_sentFrames);
+    return frames;
+}
+
+void CocosWebSocket::sent(bool isBinary, const uint8_t *data, size_t len) {
+    _sentMessages.fetch_add(1, std::memory_order_relaxed);
+    _sentBytes.fetch_add(len, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(_sentMutex);
+    if (_recording) {
+        SentFrame frame;
+        frame.isBinary = isBinary;
+        frame.payload.assign(reinterpret_cast<const char *>(data), len);
+        _sentFrames.push_back(std::move(frame));
+    }
+}
+
+void CocosWebSocket::reportQueued(JNIEnv *env) {
+    std::lock_guard<std::mutex> lock(_bufferedAmountLock);
+    NativeFrame frame(env);
+    JNI_PATH(nativeOnBufferedAmount)(env, frame.ref(this), _queueSize.load(std::memory_order_relaxed), getHandle());
+}
+
+} // namespace fakejni
+
+#undef JNI_PATH
@@ -0,0 +1,123 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <jni.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FakeJni.h"
+
+namespace fakejni {
+
+/** A frame WebSocketImpl handed to the fake OkHttp socket. */
+struct SentFrame {
+    bool isBinary{false};
+    std::string payload;
+};
+
+/**
+ * org.cocos2dx.lib.websocket.CocosWebSocket without OkHttp: what WebSocket-okhttp_android.cpp calls is recorded,
+ * and the OkHttp listener callbacks are driven by the caller instead of a socket. Every method follows the Java
+ * class, including the order of its native calls and the Java objects it allocates per message on ART with OkHttp
+ * 3.12, so the Java allocation counts of the VM are the ones a device would see on these paths.
+ */
+class CocosWebSocket : public Object {
+public:
+    static const char *CLASS_NAME;
+
+    /**
+     * Defines the class and points JniHelper at the fake VM and its class loader, which attaches the calling
+     * thread. Call it once on the game thread before the first WebSocket is created.
+     */
+    static void install();
+
+    /** The instances WebSocketImpl created, in creation order. They stay alive until clearInstances(). */
+    static std::vector<CocosWebSocket *> getInstances();
+    static CocosWebSocket *getLastInstance();
+    static void clearInstances();
+
+    /** The CA files passed to the static preloadCAFile. */
+    static std::vector<std::string> getPreloadedCAFiles();
+
+    explicit CocosWebSocket(Class *klass) : Object(klass) {}
+
+    // The OkHttp listener, called on an attached thread like the OkHttp reader thread (see JavaThread) or on the
+    // game thread itself. The arguments are what OkHttp would pass.
+    void onOpen(const std::string &protocol, const std::string &headers, bool secure = false);
+    void onMessage(const std::string &text);
+    void onMessage(const uint8_t *bytes, size_t len);
+    void onClosed(int code, const std::string &reason);
+    void onFailure(const std::string &message, bool timedOut = false);
+    void onRoundTrip(int64_t micros);
+
+    /** The OkHttp queue size which the following sends report through nativeOnBufferedAmount, 0 by default. */
+    void setQueueSize(int64_t size) { _queueSize.store(size, std::memory_order_relaxed); }
+
+    /** Keeps a copy of every frame sent, off by default so that benchmarks measure the JNI path only. */
+    void setRecording(bool recording);
+    std::vector<SentFrame> takeSentFrames();
+    uint64_t getSentMessages() const { return _sentMessages.load(std::memory_order_relaxed); }
+    uint64_t getSentBytes() const { return _sentBytes.load(std::memory_order_relaxed); }
+
+    jlong getHandle() const { return _handle.load(std::memory_order_relaxed); }
+    const std::string &getUrl() const { return _url; }
+    const std::string &getProtocols() const { return _protocols; }
+    const std::string &getCaFilePath() const { return _caFilePath; }
+    int getConnectCount() const { return _connectCount; }
+    bool isCloseRequested() const { return _closeRequested; }
+    int getCloseCode() const { return _closeCode; }
+    const std::string &getCloseReason() const { return _closeReason; }
+
+private:
+    static void defineClass();
+
+    void sent(bool isBinary, const uint8_t *data, size_t len);
+    void reportQueued(JNIEnv *env);
+
+    std::atomic<jlong> _handle{0}; // volatile in Java, cleared by _removeHandler
+    std::atomic<bool> _connected{false};
+    std::string _url;
+    std::string _protocols;
+    std::string _caFilePath;
+    int _connectCount{0};
+    bool _closeRequested{false};
+    int _closeCode{0};
+    std::string _closeReason;
+    std::atomic<int64_t> _queueSize{0};
+    std::mutex _bufferedAmountLock; // the lock _reportQueued and _connect hold around nativeOnBufferedAmount
+    size_t _batchTextCapacity{0};  // length of the _batchText array of _sendBatch
+
+    std::mutex _sentMutex;
+    bool _recording{false};
+    std::vector<SentFrame> _sentFrames; // guarded by _sentMutex
+    std::atomic<uint64_t> _sentMessages{0};
+    std::atomic<uint64_t> _sentBytes{0};
+};
+
+} // namespace fakejni
@@ -0,0 +1,120 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FakeCocosWebSocket.h"
+#include "HostEngine.h"
+#include "network/WebSocket.h"
+
+namespace host {
+
+/** Counts what the WebSocket reported and, if asked to, keeps the messages. */
+class RecordingDelegate : public cocos2d::network::WebSocket::Delegate {
+public:
+    struct Message {
+        bool isBinary;
+        std::string payload;
+        bool terminated; // text only, the byte after the payload is NUL
+        std::thread::id thread;
+    };
+
+    void onOpen(cocos2d::network::WebSocket *ws) override {
+        ++opened;
+        if (whenOpened) {
+            whenOpened(ws);
+        }
+    }
+    void onMessage(cocos2d::network::WebSocket *ws, const cocos2d::network::WebSocket::Data &data) override {
+        ++received;
+        receivedBytes += static_cast<uint64_t>(data.len);
+        if (recording) {
+            messages.push_back({data.isBinary, std::string(data.bytes, static_cast<size_t>(data.len)),
+                                !data.isBinary && data.bytes[data.len] == '\0', std::this_thread::get_id()});
+        }
+        if (whenReceived) {
+            whenReceived(ws);
+        }
+    }
+    void onClose(cocos2d::network::WebSocket * /*ws*/) override { ++closed; }
+    void onError(cocos2d::network::WebSocket * /*ws*/, const cocos2d::network::WebSocket::ErrorCode &error) override {
+        ++errors;
+        lastError = error;
+    }
+    void onBufferedAmountHigh(cocos2d::network::WebSocket * /*ws*/, size_t /*bufferedAmount*/) override { ++high; }
+    void onBufferedAmountLow(cocos2d::network::WebSocket * /*ws*/, size_t /*bufferedAmount*/) override { ++low; }
+    void onReconnecting(cocos2d::network::WebSocket * /*ws*/, int attempt, float delay) override {
+        ++reconnecting;
+        lastAttempt = attempt;
+        lastDelay = delay;
+    }
+
+    bool recording{false};
+    std::function<void(cocos2d::network::WebSocket *)> whenOpened;   // called from onOpen if set
+    std::function<void(cocos2d::network::WebSocket *)> whenReceived; // called from onMessage if set
+    std::vector<Message> messages;
+    int opened{0};
+    int closed{0};
+    int errors{0};
+    int high{0};
+    int low{0};
+    int reconnecting{0};
+    int lastAttempt{0};
+    float lastDelay{0};
+    uint64_t received{0};
+    uint64_t receivedBytes{0};
+    cocos2d::network::WebSocket::ErrorCode lastError{cocos2d::network::WebSocket::ErrorCode::UNKNOWN};
+};
+
+/**
+ * A WebSocket of the Android backend and the fake CocosWebSocket behind it, opened unless told otherwise. Lives
+ * on the game thread, CocosWebSocket::install() must have run.
+ */
+class FakeConnection {
+public:
+    explicit FakeConnection(const cocos2d::network::WebSocket::Options &options = {}, bool open = true,
+                            const std::string &url = "ws://127.0.0.1:8080/echo") {
+        _socket.init(delegate, url, nullptr, "", options);
+        java = fakejni::CocosWebSocket::getLastInstance();
+        if (open) {
+            java->onOpen("http/1.1", "Upgrade: websocket\nConnection: Upgrade\n");
+            runFrame();
+        }
+    }
+
+    cocos2d::network::WebSocket &socket() { return _socket; }
+
+    RecordingDelegate delegate;
+    fakejni::CocosWebSocket *java{nullptr};
+
+private:
+    // after the delegate, which it refers to
+    cocos2d::network::WebSocket _socket;
+};
+
+} // namespace host
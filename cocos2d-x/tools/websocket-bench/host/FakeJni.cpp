@@ -0,0 +1,1199 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "FakeJni.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace fakejni {
+
+namespace {
+
+const size_t MAX_ARGUMENTS = 32;
+
+struct ThreadEnv : _JNIEnv {
+    std::vector<Object *> localRefs;
+    std::vector<size_t> frames;   // start of each frame in localRefs, the thread's base frame starts at 0
+    std::string pendingException; // class name of the pending exception, empty if there is none
+};
+
+// the JNIEnv of the thread while it is attached, a plain pointer so that it outlives the thread_local destructors
+// which run before the pthread key destructor of JniHelper detaches the thread
+thread_local ThreadEnv *t_env = nullptr;
+
+Vm &vm() {
+    return Vm::get();
+}
+
+void throwNew(ThreadEnv *env, const char *exceptionClass) {
+    env->pendingException = exceptionClass;
+}
+
+// modified UTF-8 as JNI uses it: U+0000 takes two bytes and supplementary characters are two 3-byte surrogates
+size_t modifiedUTF8Length(const char16_t *chars, size_t len) {
+    size_t size = 0;
+    for (size_t i = 0; i < len; ++i) {
+        char16_t c = chars[i];
+        size += (c != 0 && c < 0x80) ? 1 : (c < 0x800 ? 2 : 3);
+    }
+    return size;
+}
+
+char *encodeModifiedUTF8(const char16_t *chars, size_t len, char *out) {
+    for (size_t i = 0; i < len; ++i) {
+        char16_t c = chars[i];
+        if (c != 0 && c < 0x80) {
+            *out++ = static_cast<char>(c);
+        } else if (c < 0x800) {
+            *out++ = static_cast<char>(0xC0 | (c >> 6));
+            *out++ = static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            *out++ = static_cast<char>(0xE0 | (c >> 12));
+            *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+// also takes standard 4-byte sequences, which newer ART versions accept as well
+std::u16string decodeModifiedUTF8(const char *bytes) {
+    std::u16string chars;
+    auto *in = reinterpret_cast<const uint8_t *>(bytes);
+    while (*in != 0) {
+        uint32_t c = *in++;
+        if (c >= 0xF0 && (in[0] & 0xC0) == 0x80 && (in[1] & 0xC0) == 0x80 && (in[2] & 0xC0) == 0x80) {
+            c = ((c & 0x07) << 18) | ((in[0] & 0x3F) << 12) | ((in[1] & 0x3F) << 6) | (in[2] & 0x3F);
+            in += 3;
+            c -= 0x10000;
+            chars.push_back(static_cast<char16_t>(0xD800 + (c >> 10)));
+            chars.push_back(static_cast<char16_t>(0xDC00 + (c & 0x3FF)));
+            continue;
+        }
+        if (c >= 0xE0 && (in[0] & 0xC0) == 0x80 && (in[1] & 0xC0) == 0x80) {
+            c = ((c & 0x0F) << 12) | ((in[0] & 0x3F) << 6) | (in[1] & 0x3F);
+            in += 2;
+        } else if (c >= 0xC0 && (in[0] & 0xC0) == 0x80) {
+            c = ((c & 0x1F) << 6) | (in[0] & 0x3F);
+            in += 1;
+        } else if (c >= 0x80) {
+            fatal("NewStringUTF input is not valid modified UTF-8");
+        }
+        chars.push_back(static_cast<char16_t>(c));
+    }
+    return chars;
+}
+
+Class *checkClass(jclass clazz, const char *function) {
+    if (clazz == nullptr) {
+        fatal("JNI %s called with a null jclass", function);
+    }
+    auto *klass = dynamic_cast<Class *>(fromRef(clazz));
+    if (klass == nullptr) {
+        fatal("JNI %s called with a jclass which is not a class", function);
+    }
+    return klass;
+}
+
+Method *checkMethod(jmethodID methodID, const char *function) {
+    if (methodID == nullptr) {
+        fatal("JNI %s called with a null jmethodID", function);
+    }
+    return reinterpret_cast<Method *>(methodID);
+}
+
+template <typename T>
+T *checkObject(jobject ref, const char *function, const char *expected) {
+    if (ref == nullptr) {
+        fatal("JNI %s called with a null %s", function, expected);
+    }
+    auto *object = dynamic_cast<T *>(fromRef(ref));
+    if (object == nullptr) {
+        fatal("JNI %s called with a %s where a %s is expected", function, fromRef(ref)->getClass()->getName().c_str(),
+              expected);
+    }
+    return object;
+}
+
+void readArguments(const Method *method, va_list args, jvalue *out) {
+    if (method->parameters.size() > MAX_ARGUMENTS) {
+        fatal("%s.%s has too many parameters for the fake VM", method->owner->getName().c_str(), method->name.c_str());
+    }
+    for (size_t i = 0; i < method->parameters.size(); ++i) {
+        switch (method->parameters[i]) {
+            case 'Z': out[i].z = static_cast<jboolean>(va_arg(args, int)); break;
+            case 'B': out[i].b = static_cast<jbyte>(va_arg(args, int)); break;
+            case 'C': out[i].c = static_cast<jchar>(va_arg(args, int)); break;
+            case 'S': out[i].s = static_cast<jshort>(va_arg(args, int)); break;
+            case 'I': out[i].i = va_arg(args, jint); break;
+            case 'J': out[i].j = va_arg(args, jlong); break;
+            case 'F': out[i].f = static_cast<jfloat>(va_arg(args, double)); break;
+            case 'D': out[i].d = va_arg(args, double); break;
+            default: out[i].l = va_arg(args, jobject); break;
+        }
+    }
+}
+
+template <typename T>
+T unpack(const jvalue &value);
+template <> jobject unpack<jobject>(const jvalue &value) { return value.l; }
+template <> jboolean unpack<jboolean>(const jvalue &value) { return value.z; }
+template <> jbyte unpack<jbyte>(const jvalue &value) { return value.b; }
+template <> jchar unpack<jchar>(const jvalue &value) { return value.c; }
+template <> jshort unpack<jshort>(const jvalue &value) { return value.s; }
+template <> jint unpack<jint>(const jvalue &value) { return value.i; }
+template <> jlong unpack<jlong>(const jvalue &value) { return value.j; }
+template <> jfloat unpack<jfloat>(const jvalue &value) { return value.f; }
+template <> jdouble unpack<jdouble>(const jvalue &value) { return value.d; }
+
+} // namespace
+
+void fatal(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fputs("fakejni: ", stderr);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    abort();
+}
+
+void Object::release() {
+    if (_references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        host::VmAllocations allocations;
+        delete this;
+    }
+}
+
+std::string String::toUTF8() const {
+    // ASCII first, the common case of the benchmarks
+    if (std::all_of(_chars.begin(), _chars.end(), [](char16_t c) { return c < 0x80; })) {
+        return std::string(_chars.begin(), _chars.end());
+    }
+    std::string utf8;
+    utf8.reserve(_chars.size());
+    for (size_t i = 0; i < _chars.size(); ++i) {
+        uint32_t c = _chars[i];
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < _chars.size() && _chars[i + 1] >= 0xDC00 && _chars[i + 1] < 0xE000) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (_chars[++i] - 0xDC00);
+        }
+        if (c < 0x80) {
+            utf8.push_back(static_cast<char>(c));
+        } else if (c < 0x800) {
+            utf8.push_back(static_cast<char>(0xC0 | (c >> 6)));
+            utf8.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        } else if (c < 0x10000) {
+            utf8.push_back(static_cast<char>(0xE0 | (c >> 12)));
+            utf8.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            utf8.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        } else {
+            utf8.push_back(static_cast<char>(0xF0 | (c >> 18)));
+            utf8.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+            utf8.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            utf8.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        }
+    }
+    return utf8;
+}
+
+PrimitiveArray::PrimitiveArray(Class *klass, char type, size_t elementSize, jsize length)
+: Object(klass), _type(type), _elementSize(elementSize), _length(length), _data(elementSize * length) {}
+
+ObjectArray::ObjectArray(Class *klass, jsize length, Object *initial)
+: Object(klass), _elements(static_cast<size_t>(length), initial) {
+    if (initial != nullptr) {
+        for (jsize i = 0; i < length; ++i) {
+            initial->retain();
+        }
+    }
+}
+
+ObjectArray::~ObjectArray() {
+    for (Object *element : _elements) {
+        if (element != nullptr) {
+            element->release();
+        }
+    }
+}
+
+void ObjectArray::set(jsize index, Object *value) {
+    if (value != nullptr) {
+        value->retain();
+    }
+    if (_elements[index] != nullptr) {
+        _elements[index]->release();
+    }
+    _elements[index] = value;
+}
+
+Method *Class::addMethod(const std::string &name, const std::string &signature, MethodBody body) {
+    return add(name, signature, false, std::move(body));
+}
+
+Method *Class::addStaticMethod(const std::string &name, const std::string &signature, MethodBody body) {
+    return add(name, signature, true, std::move(body));
+}
+
+Method *Class::add(const std::string &name, const std::string &signature, bool isStatic, MethodBody body) {
+    std::unique_ptr<Method> method(new Method());
+    method->owner = this;
+    method->name = name;
+    method->signature = signature;
+    method->isStatic = isStatic;
+    method->body = std::move(body);
+    size_t i = 1;
+    while (i < signature.size() && signature[i] != ')') {
+        char type = signature[i];
+        while (signature[i] == '[') {
+            ++i;
+        }
+        if (signature[i] == 'L') {
+            i = signature.find(';', i);
+        }
+        ++i;
+        method->parameters.push_back(type == '[' ? 'L' : type);
+    }
+    if (signature.empty() || signature[0] != '(' || i + 1 >= signature.size()) {
+        fatal("malformed signature %s of %s.%s", signature.c_str(), _name.c_str(), name.c_str());
+    }
+    char returnType = signature[i + 1];
+    method->returnType = returnType == '[' ? 'L' : returnType;
+
+    Method *result = method.get();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _methods[name + "#" + signature] = std::move(method);
+    return result;
+}
+
+Method *Class::findMethod(const std::string &name, const std::string &signature, bool isStatic) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _methods.find(name + "#" + signature);
+    if (it == _methods.end() || it->second->isStatic != isStatic) {
+        return nullptr;
+    }
+    return it->second.get();
+}
+
+void Class::setStaticInitializer(std::function<void(JNIEnv *, Class *)> initializer) {
+    _initializer = std::move(initializer);
+}
+
+void Class::initialize(JNIEnv *env) {
+    if (_initialized.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_initializationMutex);
+    while (_initializingThread != std::thread::id()) {
+        if (_initializingThread == std::this_thread::get_id()) {
+            return; // the initializer itself uses the class
+        }
+        _initializationDone.wait(lock);
+    }
+    if (_initialized.load(std::memory_order_relaxed)) {
+        return;
+    }
+    _initializingThread = std::this_thread::get_id();
+    lock.unlock();
+    if (_initializer) {
+        _initializer(env, this);
+    }
+    lock.lock();
+    _initializingThread = std::thread::id();
+    _initialized.store(true, std::memory_order_release);
+    _initializationDone.notify_all();
+}
+
+void Class::setAllocator(std::function<Object *(Class *)> allocator) {
+    _allocator = std::move(allocator);
+}
+
+Object *Class::allocate() {
+    if (_allocator) {
+        return _allocator(this);
+    }
+    return Vm::get().newObject<Object>(0, this);
+}
+
+// The JNI functions, a friend of Vm.
+struct Natives {
+    // Every JNI function starts with an Entry. Like CheckJNI it checks the thread and rejects calls made while an
+    // exception is pending, allocations count as the VM's until it returns.
+    class Entry {
+    public:
+        Entry(JNIEnv *env, const char *function, bool allowsException = false) {
+            vm()._jniCalls.fetch_add(1, std::memory_order_relaxed);
+            _env = static_cast<ThreadEnv *>(env);
+            if (_env == nullptr || _env != t_env) {
+                fatal("JNI %s called with a JNIEnv of another thread or of a detached thread", function);
+            }
+            if (!allowsException && !_env->pendingException.empty()) {
+                fatal("JNI %s called with a pending %s", function, _env->pendingException.c_str());
+            }
+        }
+
+        ThreadEnv *operator->() const { return _env; }
+        ThreadEnv *get() const { return _env; }
+
+    private:
+        host::VmAllocations _allocations;
+        ThreadEnv *_env;
+    };
+
+    static jobject addLocalRef(ThreadEnv *env, Object *object) {
+        if (object == nullptr) {
+            return nullptr;
+        }
+        object->retain();
+        env->localRefs.push_back(object);
+        vm()._localRefs.fetch_add(1, std::memory_order_relaxed);
+        return reinterpret_cast<jobject>(object);
+    }
+
+    static void popLocalRefs(ThreadEnv *env, size_t begin) {
+        while (env->localRefs.size() > begin) {
+            Object *object = env->localRefs.back();
+            env->localRefs.pop_back();
+            vm()._localRefs.fetch_sub(1, std::memory_order_relaxed);
+            object->release();
+        }
+    }
+
+    static jvalue invoke(ThreadEnv *env, jobject self, Method *method, bool isStatic, char returnType, const jvalue *args,
+                             const char *function) {
+        if (method->isStatic != isStatic) {
+            fatal("JNI %s called with the %s method %s.%s", function, method->isStatic ? "static" : "instance",
+                  method->owner->getName().c_str(), method->name.c_str());
+        }
+        if (method->returnType != returnType) {
+            fatal("JNI %s called for %s.%s%s, which returns '%c'", function, method->owner->getName().c_str(),
+                  method->name.c_str(), method->signature.c_str(), method->returnType);
+        }
+        Object *object = fromRef(self);
+        if (!isStatic) {
+            if (object == nullptr) {
+                fatal("JNI %s called on a null object for %s.%s", function, method->owner->getName().c_str(),
+                      method->name.c_str());
+            }
+            if (object->getClass() != method->owner) {
+                fatal("JNI %s called on a %s for a method of %s", function, object->getClass()->getName().c_str(),
+                      method->owner->getName().c_str());
+            }
+        }
+        vm()._javaCalls.fetch_add(1, std::memory_order_relaxed);
+        jvalue result = method->body(env, object, args);
+        if (returnType == 'L') {
+            result.l = addLocalRef(env, fromRef(result.l));
+        }
+        return result;
+    }
+
+    static jclass FindClass(JNIEnv *env, const char *name) {
+        Entry entry(env, "FindClass");
+        Class *klass = vm().findClass(name);
+        if (klass == nullptr) {
+            throwNew(entry.get(), "java/lang/NoClassDefFoundError");
+            return nullptr;
+        }
+        klass->initialize(env);
+        return static_cast<jclass>(addLocalRef(entry.get(), klass));
+    }
+
+    static jclass GetObjectClass(JNIEnv *env, jobject obj) {
+        Entry entry(env, "GetObjectClass");
+        return static_cast<jclass>(addLocalRef(entry.get(), checkObject<Object>(obj, "GetObjectClass", "object")->getClass()));
+    }
+
+    static jboolean IsSameObject(JNIEnv *env, jobject a, jobject b) {
+        Entry entry(env, "IsSameObject");
+        return a == b ? JNI_TRUE : JNI_FALSE;
+    }
+
+    static jboolean ExceptionCheck(JNIEnv *env) {
+        Entry entry(env, "ExceptionCheck", true);
+        return entry->pendingException.empty() ? JNI_FALSE : JNI_TRUE;
+    }
+
+    static void ExceptionDescribe(JNIEnv *env) {
+        Entry entry(env, "ExceptionDescribe", true);
+        if (!entry->pendingException.empty()) {
+            fprintf(stderr, "fakejni: pending %s\n", entry->pendingException.c_str());
+        }
+    }
+
+    static void ExceptionClear(JNIEnv *env) {
+        Entry entry(env, "ExceptionClear", true);
+        entry->pendingException.clear();
+    }
+
+    static jint PushLocalFrame(JNIEnv *env, jint /*capacity*/) {
+        Entry entry(env, "PushLocalFrame");
+        entry->frames.push_back(entry->localRefs.size());
+        return JNI_OK;
+    }
+
+    static jobject PopLocalFrame(JNIEnv *env, jobject result) {
+        Entry entry(env, "PopLocalFrame", true);
+        if (entry->frames.empty()) {
+            fatal("PopLocalFrame without PushLocalFrame");
+        }
+        Object *object = fromRef(result);
+        if (object != nullptr) {
+            object->retain();
+        }
+        popLocalRefs(entry.get(), entry->frames.back());
+        entry->frames.pop_back();
+        jobject ref = addLocalRef(entry.get(), object);
+        if (object != nullptr) {
+            object->release();
+        }
+        return ref;
+    }
+
+    static jint EnsureLocalCapacity(JNIEnv *env, jint /*capacity*/) {
+        Entry entry(env, "EnsureLocalCapacity");
+        return JNI_OK;
+    }
+
+    static jobject NewGlobalRef(JNIEnv *env, jobject obj) {
+        Entry entry(env, "NewGlobalRef");
+        Object *object = fromRef(obj);
+        if (object == nullptr) {
+            return nullptr;
+        }
+        object->retain();
+        std::lock_guard<std::mutex> lock(vm()._mutex);
+        ++vm()._globalRefs[object];
+        vm()._globalRefCount.fetch_add(1, std::memory_order_relaxed);
+        return obj;
+    }
+
+    static void DeleteGlobalRef(JNIEnv *env, jobject ref) {
+        Entry entry(env, "DeleteGlobalRef", true);
+        Object *object = fromRef(ref);
+        if (object == nullptr) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(vm()._mutex);
+            auto it = vm()._globalRefs.find(object);
+            if (it == vm()._globalRefs.end()) {
+                fatal("DeleteGlobalRef(%p) is not a global reference", static_cast<void *>(ref));
+            }
+            if (--it->second == 0) {
+                vm()._globalRefs.erase(it);
+            }
+            vm()._globalRefCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+        object->release();
+    }
+
+    static jobject NewLocalRef(JNIEnv *env, jobject ref) {
+        Entry entry(env, "NewLocalRef");
+        return addLocalRef(entry.get(), fromRef(ref));
+    }
+
+    static void DeleteLocalRef(JNIEnv *env, jobject ref) {
+        Entry entry(env, "DeleteLocalRef", true);
+        Object *object = fromRef(ref);
+        if (object == nullptr) {
+            return;
+        }
+        size_t begin = entry->frames.empty() ? 0 : entry->frames.back();
+        auto &refs = entry->localRefs;
+        for (size_t i = refs.size(); i > begin; --i) {
+            if (refs[i - 1] == object) {
+                refs.erase(refs.begin() + static_cast<ptrdiff_t>(i - 1));
+                vm()._localRefs.fetch_sub(1, std::memory_order_relaxed);
+                object->release();
+                return;
+            }
+        }
+        fatal("DeleteLocalRef(%p) is not a local reference of the current frame", static_cast<void *>(ref));
+    }
+
+    static jmethodID getMethodID(JNIEnv *env, jclass clazz, const char *name, const char *sig, bool isStatic) {
+        const char *function = isStatic ? "GetStaticMethodID" : "GetMethodID";
+        Entry entry(env, function);
+        Class *klass = checkClass(clazz, function);
+        klass->initialize(env);
+        Method *method = klass->findMethod(name, sig, isStatic);
+        if (method == nullptr) {
+            throwNew(entry.get(), "java/lang/NoSuchMethodError");
+        }
+        return reinterpret_cast<jmethodID>(method);
+    }
+
+    static jmethodID GetMethodID(JNIEnv *env, jclass clazz, const char *name, const char *sig) {
+        return getMethodID(env, clazz, name, sig, false);
+    }
+
+    static jmethodID GetStaticMethodID(JNIEnv *env, jclass clazz, const char *name, const char *sig) {
+        return getMethodID(env, clazz, name, sig, true);
+    }
+
+    static jobject newObject(JNIEnv *env, jclass clazz, jmethodID methodID, const jvalue *args) {
+        Entry entry(env, "NewObject");
+        Class *klass = checkClass(clazz, "NewObject");
+        Method *method = checkMethod(methodID, "NewObject");
+        if (method->owner != klass || method->name != "<init>") {
+            fatal("NewObject called with a method which is not a constructor of %s", klass->getName().c_str());
+        }
+        klass->initialize(env);
+        Object *object = klass->allocate();
+        jobject ref = addLocalRef(entry.get(), object);
+        invoke(entry.get(), ref, method, false, 'V', args, "NewObject");
+        return ref;
+    }
+
+    static jobject NewObjectV(JNIEnv *env, jclass clazz, jmethodID methodID, va_list args) {
+        jvalue values[MAX_ARGUMENTS];
+        readArguments(checkMethod(methodID, "NewObjectV"), args, values);
+        return newObject(env, clazz, methodID, values);
+    }
+
+    static jobject NewObjectA(JNIEnv *env, jclass clazz, jmethodID methodID, const jvalue *args) {
+        return newObject(env, clazz, methodID, args);
+    }
+
+    static jvalue call(JNIEnv *env, jobject obj, jmethodID methodID, const jvalue *args, char returnType,
+                       const char *function) {
+        Entry entry(env, function);
+        return invoke(entry.get(), obj, checkMethod(methodID, function), false, returnType, args, function);
+    }
+
+    static jvalue callStatic(JNIEnv *env, jclass clazz, jmethodID methodID, const jvalue *args, char returnType,
+                             const char *function) {
+        Entry entry(env, function);
+        Class *klass = checkClass(clazz, function);
+        Method *method = checkMethod(methodID, function);
+        if (method->owner != klass) {
+            fatal("JNI %s called with a method of %s on %s", function, method->owner->getName().c_str(),
+                  klass->getName().c_str());
+        }
+        klass->initialize(env);
+        return invoke(entry.get(), nullptr, method, true, returnType, args, function);
+    }
+
+#define FAKE_CALLS(Name, type, returnType)                                                                       \
+    static type Call##Name##MethodV(JNIEnv *env, jobject obj, jmethodID methodID, va_list args) {               \
+        jvalue values[MAX_ARGUMENTS];                                                                            \
+        readArguments(checkMethod(methodID, "Call" #Name "Method"), args, values);                               \
+        return unpack<type>(call(env, obj, methodID, values, returnType, "Call" #Name "Method"));               \
+    }                                                                                                            \
+    static type Call##Name##MethodA(JNIEnv *env, jobject obj, jmethodID methodID, const jvalue *args) {          \
+        return unpack<type>(call(env, obj, methodID, args, returnType, "Call" #Name "MethodA"));                 \
+    }                                                                                                            \
+    static type CallStatic##Name##MethodV(JNIEnv *env, jclass clazz, jmethodID methodID, va_list args) {        \
+        jvalue values[MAX_ARGUMENTS];                                                                            \
+        readArguments(checkMethod(methodID, "CallStatic" #Name "Method"), args, values);                         \
+        return unpack<type>(callStatic(env, clazz, methodID, values, returnType, "CallStatic" #Name "Method")); \
+    }                                                                                                            \
+    static type CallStatic##Name##MethodA(JNIEnv *env, jclass clazz, jmethodID methodID, const jvalue *args) {   \
+        return unpack<type>(callStatic(env, clazz, methodID, args, returnType, "CallStatic" #Name "MethodA"));  \
+    }
+    FAKE_CALLS(Object, jobject, 'L')
+    FAKE_CALLS(Boolean, jboolean, 'Z')
+    FAKE_CALLS(Byte, jbyte, 'B')
+    FAKE_CALLS(Char, jchar, 'C')
+    FAKE_CALLS(Short, jshort, 'S')
+    FAKE_CALLS(Int, jint, 'I')
+    FAKE_CALLS(Long, jlong, 'J')
+    FAKE_CALLS(Float, jfloat, 'F')
+    FAKE_CALLS(Double, jdouble, 'D')
+#undef FAKE_CALLS
+
+    static void CallVoidMethodV(JNIEnv *env, jobject obj, jmethodID methodID, va_list args) {
+        jvalue values[MAX_ARGUMENTS];
+        readArguments(checkMethod(methodID, "CallVoidMethod"), args, values);
+        call(env, obj, methodID, values, 'V', "CallVoidMethod");
+    }
+
+    static void CallVoidMethodA(JNIEnv *env, jobject obj, jmethodID methodID, const jvalue *args) {
+        call(env, obj, methodID, args, 'V', "CallVoidMethodA");
+    }
+
+    static void CallStaticVoidMethodV(JNIEnv *env, jclass clazz, jmethodID methodID, va_list args) {
+        jvalue values[MAX_ARGUMENTS];
+        readArguments(checkMethod(methodID, "CallStaticVoidMethod"), args, values);
+        callStatic(env, clazz, methodID, values, 'V', "CallStaticVoidMethod");
+    }
+
+    static void CallStaticVoidMethodA(JNIEnv *env, jclass clazz, jmethodID methodID, const jvalue *args) {
+        callStatic(env, clazz, methodID, args, 'V', "CallStaticVoidMethodA");
+    }
+
+    static jstring NewString(JNIEnv *env, const jchar *chars, jsize len) {
+        Entry entry(env, "NewString");
+        String *string = vm().newString(std::u16string(reinterpret_cast<const char16_t *>(chars), static_cast<size_t>(len)));
+        return static_cast<jstring>(addLocalRef(entry.get(), string));
+    }
+
+    static jsize GetStringLength(JNIEnv *env, jstring str) {
+        Entry entry(env, "GetStringLength");
+        return static_cast<jsize>(checkObject<String>(str, "GetStringLength", "java.lang.String")->getChars().size());
+    }
+
+    // always a copy, as ART makes for compressed strings
+    static const jchar *GetStringChars(JNIEnv *env, jstring str, jboolean *isCopy) {
+        Entry entry(env, "GetStringChars");
+        const std::u16string &chars = checkObject<String>(str, "GetStringChars", "java.lang.String")->getChars();
+        auto *copy = new jchar[chars.size() + 1];
+        memcpy(copy, chars.data(), chars.size() * sizeof(jchar));
+        copy[chars.size()] = 0;
+        if (isCopy != nullptr) {
+            *isCopy = JNI_TRUE;
+        }
+        return copy;
+    }
+
+    static void ReleaseStringChars(JNIEnv *env, jstring /*str*/, const jchar *chars) {
+        Entry entry(env, "ReleaseStringChars", true);
+        delete[] chars;
+    }
+
+    static jstring NewStringUTF(JNIEnv *env, const char *bytes) {
+        Entry entry(env, "NewStringUTF");
+        if (bytes == nullptr) {
+            return nullptr;
+        }
+        return static_cast<jstring>(addLocalRef(entry.get(), vm().newString(decodeModifiedUTF8(bytes))));
+    }
+
+    static jsize GetStringUTFLength(JNIEnv *env, jstring str) {
+        Entry entry(env, "GetStringUTFLength");
+        const std::u16string &chars = checkObject<String>(str, "GetStringUTFLength", "java.lang.String")->getChars();
+        return static_cast<jsize>(modifiedUTF8Length(chars.data(), chars.size()));
+    }
+
+    static const char *GetStringUTFChars(JNIEnv *env, jstring str, jboolean *isCopy) {
+        Entry entry(env, "GetStringUTFChars");
+        const std::u16string &chars = checkObject<String>(str, "GetStringUTFChars", "java.lang.String")->getChars();
+        auto *utf = new char[modifiedUTF8Length(chars.data(), chars.size()) + 1];
+        *encodeModifiedUTF8(chars.data(), chars.size(), utf) = '\0';
+        if (isCopy != nullptr) {
+            *isCopy = JNI_TRUE;
+        }
+        return utf;
+    }
+
+    static void ReleaseStringUTFChars(JNIEnv *env, jstring /*str*/, const char *chars) {
+        Entry entry(env, "ReleaseStringUTFChars", true);
+        delete[] chars;
+    }
+
+    static void GetStringRegion(JNIEnv *env, jstring str, jsize start, jsize len, jchar *buf) {
+        Entry entry(env, "GetStringRegion");
+        const std::u16string &chars = checkObject<String>(str, "GetStringRegion", "java.lang.String")->getChars();
+        if (start < 0 || len < 0 || static_cast<size_t>(start) + len > chars.size()) {
+            throwNew(entry.get(), "java/lang/StringIndexOutOfBoundsException");
+            return;
+        }
+        memcpy(buf, chars.data() + start, static_cast<size_t>(len) * sizeof(jchar));
+    }
+
+    static void GetStringUTFRegion(JNIEnv *env, jstring str, jsize start, jsize len, char *buf) {
+        Entry entry(env, "GetStringUTFRegion");
+        const std::u16string &chars = checkObject<String>(str, "GetStringUTFRegion", "java.lang.String")->getChars();
+        if (start < 0 || len < 0 || static_cast<size_t>(start) + len > chars.size()) {
+            throwNew(entry.get(), "java/lang/StringIndexOutOfBoundsException");
+            return;
+        }
+        *encodeModifiedUTF8(chars.data() + start, static_cast<size_t>(len), buf) = '\0';
+    }
+
+    static jsize GetArrayLength(JNIEnv *env, jarray array) {
+        Entry entry(env, "GetArrayLength");
+        Object *object = checkObject<Object>(array, "GetArrayLength", "array");
+        if (auto *primitive = dynamic_cast<PrimitiveArray *>(object)) {
+            return primitive->getLength();
+        }
+        if (auto *objects = dynamic_cast<ObjectArray *>(object)) {
+            return objects->getLength();
+        }
+        fatal("GetArrayLength called with a %s", object->getClass()->getName().c_str());
+    }
+
+    static jobjectArray NewObjectArray(JNIEnv *env, jsize length, jclass elementClass, jobject initialElement) {
+        Entry entry(env, "NewObjectArray");
+        Class *element = checkClass(elementClass, "NewObjectArray");
+        if (length < 0) {
+            throwNew(entry.get(), "java/lang/NegativeArraySizeException");
+            return nullptr;
+        }
+        Class *arrayClass = vm().getArrayClass("[L" + element->getName() + ";");
+        auto *array = vm().newObject<ObjectArray>(sizeof(jobject) * length, arrayClass, length, fromRef(initialElement));
+        return static_cast<jobjectArray>(addLocalRef(entry.get(), array));
+    }
+
+    static jobject GetObjectArrayElement(JNIEnv *env, jobjectArray array, jsize index) {
+        Entry entry(env, "GetObjectArrayElement");
+        auto *objects = checkObject<ObjectArray>(array, "GetObjectArrayElement", "object array");
+        if (index < 0 || index >= objects->getLength()) {
+            throwNew(entry.get(), "java/lang/ArrayIndexOutOfBoundsException");
+            return nullptr;
+        }
+        return addLocalRef(entry.get(), objects->get(index));
+    }
+
+    static void SetObjectArrayElement(JNIEnv *env, jobjectArray array, jsize index, jobject value) {
+        Entry entry(env, "SetObjectArrayElement");
+        auto *objects = checkObject<ObjectArray>(array, "SetObjectArrayElement", "object array");
+        if (index < 0 || index >= objects->getLength()) {
+            throwNew(entry.get(), "java/lang/ArrayIndexOutOfBoundsException");
+            return;
+        }
+        objects->set(index, fromRef(value));
+    }
+
+    static PrimitiveArray *checkArray(jarray array, char type, const char *function) {
+        auto *primitive = checkObject<PrimitiveArray>(array, function, "primitive array");
+        if (primitive->getType() != type) {
+            fatal("JNI %s called with a %s", function, primitive->getClass()->getName().c_str());
+        }
+        return primitive;
+    }
+
+    template <typename T, char Type>
+    static jarray newArray(JNIEnv *env, jsize length, const char *function) {
+        Entry entry(env, function);
+        if (length < 0) {
+            throwNew(entry.get(), "java/lang/NegativeArraySizeException");
+            return nullptr;
+        }
+        const char name[] = {'[', Type, '\0'};
+        auto *array = vm().newObject<PrimitiveArray>(sizeof(T) * length, vm().getArrayClass(name), Type, sizeof(T),
+                                                     length);
+        return static_cast<jarray>(addLocalRef(entry.get(), array));
+    }
+
+    // always a copy, written back on release unless JNI_ABORT
+    template <typename T, char Type>
+    static T *getArrayElements(JNIEnv *env, jarray array, jboolean *isCopy, const char *function) {
+        Entry entry(env, function);
+        PrimitiveArray *primitive = checkArray(array, Type, function);
+        auto *copy = new T[primitive->getLength() > 0 ? primitive->getLength() : 1];
+        memcpy(copy, primitive->getData(), sizeof(T) * primitive->getLength());
+        if (isCopy != nullptr) {
+            *isCopy = JNI_TRUE;
+        }
+        return copy;
+    }
+
+    template <typename T, char Type>
+    static void releaseArrayElements(JNIEnv *env, jarray array, T *elems, jint mode, const char *function) {
+        Entry entry(env, function, true);
+        PrimitiveArray *primitive = checkArray(array, Type, function);
+        if (mode != JNI_ABORT) {
+            memcpy(primitive->getData(), elems, sizeof(T) * primitive->getLength());
+        }
+        if (mode != JNI_COMMIT) {
+            delete[] elems;
+        }
+    }
+
+    template <typename T, char Type>
+    static void getArrayRegion(JNIEnv *env, jarray array, jsize start, jsize len, T *buf, const char *function) {
+        Entry entry(env, function);
+        PrimitiveArray *primitive = checkArray(array, Type, function);
+        if (start < 0 || len < 0 || start > primitive->getLength() - len) {
+            throwNew(entry.get(), "java/lang/ArrayIndexOutOfBoundsException");
+            return;
+        }
+        memcpy(buf, primitive->getData() + sizeof(T) * start, sizeof(T) * len);
+    }
+
+    template <typename T, char Type>
+    static void setArrayRegion(JNIEnv *env, jarray array, jsize start, jsize len, const T *buf, const char *function) {
+        Entry entry(env, function);
+        PrimitiveArray *primitive = checkArray(array, Type, function);
+        if (start < 0 || len < 0 || start > primitive->getLength() - len) {
+            throwNew(entry.get(), "java/lang/ArrayIndexOutOfBoundsException");
+            return;
+        }
+        memcpy(primitive->getData() + sizeof(T) * start, buf, sizeof(T) * len);
+    }
+
+#define FAKE_ARRAYS(Name, type, arrayType, signature)                                                              \
+    static arrayType New##Name##Array(JNIEnv *env, jsize length) {                                                 \
+        return static_cast<arrayType>(newArray<type, signature>(env, length, "New" #Name "Array"));               \
+    }                                                                                                              \
+    static type *Get##Name##ArrayElements(JNIEnv *env, arrayType array, jboolean *isCopy) {                       \
+        return getArrayElements<type, signature>(env, array, isCopy, "Get" #Name "ArrayElements");                \
+    }                                                                                                              \
+    static void Release##Name##ArrayElements(JNIEnv *env, arrayType array, type *elems, jint mode) {              \
+        releaseArrayElements<type, signature>(env, array, elems, mode, "Release" #Name "ArrayElements");          \
+    }                                                                                                              \
+    static void Get##Name##ArrayRegion(JNIEnv *env, arrayType array, jsize start, jsize len, type *buf) {         \
+        getArrayRegion<type, signature>(env, array, start, len, buf, "Get" #Name "ArrayRegion");                  \
+    }                                                                                                              \
+    static void Set##Name##ArrayRegion(JNIEnv *env, arrayType array, jsize start, jsize len, const type *buf) {   \
+        setArrayRegion<type, signature>(env, array, start, len, buf, "Set" #Name "ArrayRegion");                  \
+    }
+    FAKE_ARRAYS(Boolean, jboolean, jbooleanArray, 'Z')
+    FAKE_ARRAYS(Byte, jbyte, jbyteArray, 'B')
+    FAKE_ARRAYS(Char, jchar, jcharArray, 'C')
+    FAKE_ARRAYS(Short, jshort, jshortArray, 'S')
+    FAKE_ARRAYS(Int, jint, jintArray, 'I')
+    FAKE_ARRAYS(Long, jlong, jlongArray, 'J')
+    FAKE_ARRAYS(Float, jfloat, jfloatArray, 'F')
+    FAKE_ARRAYS(Double, jdouble, jdoubleArray, 'D')
+#undef FAKE_ARRAYS
+
+    static void *GetPrimitiveArrayCritical(JNIEnv *env, jarray array, jboolean *isCopy) {
+        Entry entry(env, "GetPrimitiveArrayCritical");
+        if (isCopy != nullptr) {
+            *isCopy = JNI_FALSE;
+        }
+        return checkObject<PrimitiveArray>(array, "GetPrimitiveArrayCritical", "primitive array")->getData();
+    }
+
+    static void ReleasePrimitiveArrayCritical(JNIEnv *env, jarray /*array*/, void * /*carray*/, jint /*mode*/) {
+        Entry entry(env, "ReleasePrimitiveArrayCritical", true);
+    }
+
+    static jobject NewDirectByteBuffer(JNIEnv *env, void *address, jlong capacity) {
+        Entry entry(env, "NewDirectByteBuffer");
+        auto *buffer = vm().newObject<DirectByteBuffer>(0, vm().getByteBufferClass(), address, capacity);
+        return addLocalRef(entry.get(), buffer);
+    }
+
+    static void *GetDirectBufferAddress(JNIEnv *env, jobject buf) {
+        Entry entry(env, "GetDirectBufferAddress");
+        auto *buffer = dynamic_cast<DirectByteBuffer *>(fromRef(buf));
+        return buffer != nullptr ? buffer->getAddress() : nullptr;
+    }
+
+    static jlong GetDirectBufferCapacity(JNIEnv *env, jobject buf) {
+        Entry entry(env, "GetDirectBufferCapacity");
+        auto *buffer = dynamic_cast<DirectByteBuffer *>(fromRef(buf));
+        return buffer != nullptr ? buffer->getCapacity() : -1;
+    }
+
+    static jint GetJavaVM(JNIEnv *env, JavaVM **javaVM) {
+        Entry entry(env, "GetJavaVM");
+        *javaVM = vm().getJavaVM();
+        return JNI_OK;
+    }
+
+    static jint DestroyJavaVM(JavaVM * /*javaVM*/) {
+        return JNI_ERR;
+    }
+
+    static jint AttachCurrentThread(JavaVM * /*javaVM*/, JNIEnv **env, void * /*args*/) {
+        if (t_env == nullptr) {
+            host::VmAllocations allocations;
+            t_env = new ThreadEnv();
+            t_env->functions = &INTERFACE;
+            vm()._attaches.fetch_add(1, std::memory_order_relaxed);
+        }
+        *env = t_env;
+        return JNI_OK;
+    }
+
+    static jint DetachCurrentThread(JavaVM * /*javaVM*/) {
+        if (t_env == nullptr) {
+            return JNI_ERR;
+        }
+        if (!t_env->frames.empty()) {
+            fatal("DetachCurrentThread called from native code called by Java");
+        }
+        host::VmAllocations allocations;
+        popLocalRefs(t_env, 0);
+        delete t_env;
+        t_env = nullptr;
+        vm()._detaches.fetch_add(1, std::memory_order_relaxed);
+        return JNI_OK;
+    }
+
+    static jint GetEnv(JavaVM * /*javaVM*/, void **env, jint version) {
+        if (version > JNI_VERSION_1_6) {
+            *env = nullptr;
+            return JNI_EVERSION;
+        }
+        *env = t_env;
+        return t_env != nullptr ? JNI_OK : JNI_EDETACHED;
+    }
+
+    static const JNINativeInterface INTERFACE;
+    static const JNIInvokeInterface INVOKE_INTERFACE;
+};
+
+#define FAKE_CALL_ENTRIES(Name, type) \
+    Natives::Call##Name##MethodV, Natives::Call##Name##MethodA, Natives::CallStatic##Name##MethodV, Natives::CallStatic##Name##MethodA,
+#define FAKE_ARRAY_ENTRIES(Name, type, arrayType)                                                        \
+    Natives::New##Name##Array, Natives::Get##Name##ArrayElements, Natives::Release##Name##ArrayElements, \
+        Natives::Get##Name##ArrayRegion, Natives::Set##Name##ArrayRegion,
+
+const JNINativeInterface Natives::INTERFACE = {
+    Natives::FindClass,
+    Natives::GetObjectClass,
+    Natives::IsSameObject,
+    Natives::ExceptionCheck,
+    Natives::ExceptionDescribe,
+    Natives::ExceptionClear,
+    Natives::PushLocalFrame,
+    Natives::PopLocalFrame,
+    Natives::EnsureLocalCapacity,
+    Natives::NewGlobalRef,
+    Natives::DeleteGlobalRef,
+    Natives::NewLocalRef,
+    Natives::DeleteLocalRef,
+    Natives::GetMethodID,
+    Natives::GetStaticMethodID,
+    Natives::NewObjectV,
+    Natives::NewObjectA,
+    JNI_FOR_EACH_RETURN_TYPE(FAKE_CALL_ENTRIES)
+    Natives::CallVoidMethodV,
+    Natives::CallVoidMethodA,
+    Natives::CallStaticVoidMethodV,
+    Natives::CallStaticVoidMethodA,
+    Natives::NewString,
+    Natives::GetStringLength,
+    Natives::GetStringChars,
+    Natives::ReleaseStringChars,
+    Natives::NewStringUTF,
+    Natives::GetStringUTFLength,
+    Natives::GetStringUTFChars,
+    Natives::ReleaseStringUTFChars,
+    Natives::GetStringRegion,
+    Natives::GetStringUTFRegion,
+    Natives::GetArrayLength,
+    Natives::NewObjectArray,
+    Natives::GetObjectArrayElement,
+    Natives::SetObjectArrayElement,
+    JNI_FOR_EACH_PRIMITIVE(FAKE_ARRAY_ENTRIES)
+    Natives::GetPrimitiveArrayCritical,
+    Natives::ReleasePrimitiveArrayCritical,
+    Natives::NewDirectByteBuffer,
+    Natives::GetDirectBufferAddress,
+    Natives::GetDirectBufferCapacity,
+    Natives::GetJavaVM,
+};
+
+const JNIInvokeInterface Natives::INVOKE_INTERFACE = {
+    Natives::DestroyJavaVM,
+    Natives::AttachCurrentThread,
+    Natives::DetachCurrentThread,
+    Natives::GetEnv,
+    Natives::AttachCurrentThread,
+};
+
+#undef FAKE_CALL_ENTRIES
+#undef FAKE_ARRAY_ENTRIES
+
+NativeFrame::NativeFrame(JNIEnv *env) : _env(env) {
+    host::VmAllocations allocations;
+    auto *threadEnv = static_cast<ThreadEnv *>(env);
+    if (threadEnv != t_env) {
+        fatal("native method called with a JNIEnv of another thread");
+    }
+    _frame = threadEnv->localRefs.size();
+    threadEnv->frames.push_back(_frame);
+}
+
+NativeFrame::~NativeFrame() {
+    host::VmAllocations allocations;
+    auto *threadEnv = static_cast<ThreadEnv *>(_env);
+    if (!threadEnv->pendingException.empty()) {
+        fatal("native method returned with a pending %s, the fake Java code doesn't catch",
+              threadEnv->pendingException.c_str());
+    }
+    if (threadEnv->frames.empty() || threadEnv->frames.back() != _frame) {
+        fatal("native frames were not released in order");
+    }
+    Natives::popLocalRefs(threadEnv, _frame);
+    threadEnv->frames.pop_back();
+}
+
+jobject NativeFrame::newLocalRef(Object *object) {
+    host::VmAllocations allocations;
+    return Natives::addLocalRef(static_cast<ThreadEnv *>(_env), object);
+}
+
+JavaThread::JavaThread() {
+    JavaVM *javaVM = Vm::get().getJavaVM();
+    if (javaVM->AttachCurrentThread(&_env, nullptr) != JNI_OK) {
+        fatal("AttachCurrentThread failed");
+    }
+}
+
+JavaThread::~JavaThread() {
+    Vm::get().getJavaVM()->DetachCurrentThread();
+}
+
+Vm &Vm::get() {
+    // never destroyed, threads may still detach while the process exits
+    static Vm *instance = new Vm();
+    return *instance;
+}
+
+Vm::Vm() {
+    host::VmAllocations allocations;
+    _javaVM.functions = &Natives::INVOKE_INTERFACE;
+
+    _classClass = new Class(nullptr, "java/lang/Class");
+    _classClass->retain();
+    _classes[_classClass->getName()] = _classClass;
+    defineClass("java/lang/Object");
+    _stringClass = defineClass("java/lang/String");
+    _byteBufferClass = defineClass("java/nio/ByteBuffer");
+
+    // JniHelper::setClassLoaderFrom(activity) resolves classes through activity.getClassLoader().loadClass(name)
+    Class *classLoaderClass = defineClass("java/lang/ClassLoader");
+    auto *classLoader = new Object(classLoaderClass);
+    classLoader->retain();
+    classLoaderClass->addMethod("loadClass", "(Ljava/lang/String;)Ljava/lang/Class;",
+                                [this](JNIEnv *env, Object * /*self*/, const jvalue *args) {
+                                    jvalue result;
+                                    std::string name = fromRef<String>(args[0].l)->toUTF8();
+                                    for (char &c : name) {
+                                        c = c == '.' ? '/' : c;
+                                    }
+                                    Class *klass = findClass(name);
+                                    if (klass == nullptr) {
+                                        throwNew(static_cast<ThreadEnv *>(env), "java/lang/ClassNotFoundException");
+                                    }
+                                    result.l = reinterpret_cast<jobject>(klass);
+                                    return result;
+                                });
+    Class *contextClass = defineClass("android/content/Context");
+    contextClass->addMethod("getClassLoader", "()Ljava/lang/ClassLoader;",
+                            [classLoader](JNIEnv * /*env*/, Object * /*self*/, const jvalue * /*args*/) {
+                                jvalue result;
+                                result.l = reinterpret_cast<jobject>(classLoader);
+                                return result;
+                            });
+    _activity = new Object(contextClass);
+    _activity->retain();
+}
+
+JNIEnv *Vm::getEnv() {
+    if (t_env == nullptr) {
+        fatal("the calling thread is not attached to the VM");
+    }
+    return t_env;
+}
+
+Class *Vm::defineClass(const std::string &name) {
+    host::VmAllocations allocations;
+    auto *klass = new Class(_classClass, name);
+    klass->retain();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_classes.emplace(name, klass).second) {
+        fatal("class %s is defined twice", name.c_str());
+    }
+    return klass;
+}
+
+Class *Vm::findClass(const std::string &name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _classes.find(name);
+    return it != _classes.end() ? it->second : nullptr;
+}
+
+Class *Vm::getArrayClass(const std::string &name) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _classes.find(name);
+        if (it != _classes.end()) {
+            return it->second;
+        }
+    }
+    host::VmAllocations allocations;
+    auto *klass = new Class(_classClass, name);
+    klass->retain();
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto result = _classes.emplace(name, klass);
+    if (!result.second) {
+        // created concurrently by another thread, classes are never released so keep this one too
+        return result.first->second;
+    }
+    return klass;
+}
+
+String *Vm::newString(std::u16string chars) {
+    size_t bytes = chars.size() * sizeof(char16_t);
+    return newObject<String>(bytes, _stringClass, std::move(chars));
+}
+
+String *Vm::newStringFromUTF8(const std::string &utf8) {
+    host::VmAllocations allocations;
+    // widens the ASCII prefix in one pass, most messages are all ASCII
+    std::u16string chars(utf8.size(), u'\0');
+    size_t i = 0;
+    uint8_t high = 0;
+    for (; i < utf8.size(); ++i) {
+        auto c = static_cast<uint8_t>(utf8[i]);
+        high |= c;
+        chars[i] = c;
+    }
+    if (high < 0x80) {
+        return newString(std::move(chars));
+    }
+    chars.clear();
+    for (i = 0; i < utf8.size();) {
+        auto c = static_cast<uint8_t>(utf8[i]);
+        uint32_t cp = c;
+        size_t extra = c < 0x80 ? 0 : (c < 0xE0 ? 1 : (c < 0xF0 ? 2 : 3));
+        if (extra > 0) {
+            cp = c & (0x3F >> extra);
+            for (size_t k = 1; k <= extra && i + k < utf8.size(); ++k) {
+                cp = (cp << 6) | (static_cast<uint8_t>(utf8[i + k]) & 0x3F);
+            }
+        }
+        i += extra + 1;
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            chars.push_back(static_cast<char16_t>(0xD800 + (cp >> 10)));
+            chars.push_back(static_cast<char16_t>(0xDC00 + (cp & 0x3FF)));
+        } else {
+            chars.push_back(static_cast<char16_t>(cp));
+        }
+    }
+    return newString(std::move(chars));
+}
+
+void Vm::countJavaAllocation(size_t payloadBytes) {
+    _javaAllocations.fetch_add(1, std::memory_order_relaxed);
+    _javaBytes.fetch_add(payloadBytes, std::memory_order_relaxed);
+}
+
+Stats Vm::getStats() const {
+    Stats stats;
+    stats.jniCalls = _jniCalls.load(std::memory_order_relaxed);
+    stats.javaCalls = _javaCalls.load(std::memory_order_relaxed);
+    stats.javaAllocations = _javaAllocations.load(std::memory_order_relaxed);
+    stats.javaBytes = _javaBytes.load(std::memory_order_relaxed);
+    stats.localRefs = _localRefs.load(std::memory_order_relaxed);
+    stats.globalRefs = _globalRefCount.load(std::memory_order_relaxed);
+    stats.attaches = _attaches.load(std::memory_order_relaxed);
+    stats.detaches = _detaches.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace fakejni
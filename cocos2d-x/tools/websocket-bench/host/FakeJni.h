@@ -0,0 +1,305 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <jni.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Allocations.h"
+
+// A small JVM behind the JNI interface of the host <jni.h>, enough to run the engine's JNI code on Linux.
+// Java classes are written in C++: a Class holds Methods whose bodies receive the arguments as jvalues.
+// References are checked like CheckJNI does, misuse aborts with a message instead of corrupting memory.
+namespace fakejni {
+
+class Class;
+class Vm;
+
+/** Prints the message and aborts, like CheckJNI does on a JNI error. */
+[[noreturn]] void fatal(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Base of every Java object. A JNI reference is the object pointer itself and holds one count, which is dropped by
+ * DeleteLocalRef / DeleteGlobalRef or when the native frame which owns a local reference returns. Java code (the C++
+ * bodies of fake classes) holds objects with retain() / release().
+ */
+class Object {
+public:
+    explicit Object(Class *klass) : _class(klass) {}
+    virtual ~Object() = default;
+    Object(const Object &) = delete;
+    Object &operator=(const Object &) = delete;
+
+    Class *getClass() const { return _class; }
+
+    void retain() { _references.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+
+private:
+    Class *_class;
+    std::atomic<int> _references{0};
+};
+
+class String : public Object {
+public:
+    String(Class *klass, std::u16string chars) : Object(klass), _chars(std::move(chars)) {}
+    const std::u16string &getChars() const { return _chars; }
+    /** Standard UTF-8 (not the modified UTF-8 of GetStringUTFChars), as a String.getBytes(UTF_8) would give. */
+    std::string toUTF8() const;
+
+private:
+    std::u16string _chars;
+};
+
+/** Array of a primitive type, 'type' is the signature character of the element type. */
+class PrimitiveArray : public Object {
+public:
+    PrimitiveArray(Class *klass, char type, size_t elementSize, jsize length);
+    char getType() const { return _type; }
+    size_t getElementSize() const { return _elementSize; }
+    jsize getLength() const { return _length; }
+    uint8_t *getData() { return _data.data(); }
+
+private:
+    char _type;
+    size_t _elementSize;
+    jsize _length;
+    std::vector<uint8_t> _data;
+};
+
+class ObjectArray : public Object {
+public:
+    ObjectArray(Class *klass, jsize length, Object *initial);
+    ~ObjectArray() override;
+    jsize getLength() const { return static_cast<jsize>(_elements.size()); }
+    Object *get(jsize index) const { return _elements[index]; }
+    void set(jsize index, Object *value);
+
+private:
+    std::vector<Object *> _elements;
+};
+
+/** A direct java.nio.ByteBuffer, the memory belongs to native code. */
+class DirectByteBuffer : public Object {
+public:
+    DirectByteBuffer(Class *klass, void *address, jlong capacity)
+    : Object(klass), _address(address), _capacity(capacity) {}
+    uint8_t *getAddress() const { return static_cast<uint8_t *>(_address); }
+    jlong getCapacity() const { return _capacity; }
+
+private:
+    void *_address;
+    jlong _capacity;
+};
+
+/** The body of a Java method, self is null for static methods. Object results are returned without a reference. */
+using MethodBody = std::function<jvalue(JNIEnv *env, Object *self, const jvalue *args)>;
+
+struct Method {
+    Class *owner{nullptr};
+    std::string name;
+    std::string signature;
+    bool isStatic{false};
+    std::string parameters; // one signature character per parameter, 'L' for objects and arrays
+    char returnType{'V'};
+    MethodBody body;
+};
+
+class Class : public Object {
+public:
+    Class(Class *classClass, std::string name) : Object(classClass), _name(std::move(name)) {}
+
+    const std::string &getName() const { return _name; }
+
+    Method *addMethod(const std::string &name, const std::string &signature, MethodBody body);
+    Method *addStaticMethod(const std::string &name, const std::string &signature, MethodBody body);
+    Method *findMethod(const std::string &name, const std::string &signature, bool isStatic) const;
+
+    /**
+     * Runs once before the first method lookup, object creation or static call, like a static {} block. As in Java
+     * the thread running it may use the class meanwhile, other threads wait for it to finish.
+     */
+    void setStaticInitializer(std::function<void(JNIEnv *env, Class *klass)> initializer);
+    void initialize(JNIEnv *env);
+
+    /** Creates the instances of NewObject, before the constructor runs. Plain Objects by default. */
+    void setAllocator(std::function<Object *(Class *klass)> allocator);
+    Object *allocate();
+
+private:
+    Method *add(const std::string &name, const std::string &signature, bool isStatic, MethodBody body);
+
+    std::string _name;
+    std::function<Object *(Class *)> _allocator;
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, std::unique_ptr<Method>> _methods; // "name#signature", guarded by _mutex
+    std::function<void(JNIEnv *, Class *)> _initializer;
+    std::atomic<bool> _initialized{false};
+    std::mutex _initializationMutex;
+    std::condition_variable _initializationDone;
+    std::thread::id _initializingThread; // guarded by _initializationMutex, set while the initializer runs
+};
+
+/**
+ * Calls into native code the way the VM calls a native method: allocations count as native again, and the
+ * references created by ref() and by the native code are local references of a frame released on destruction.
+ */
+class NativeFrame {
+public:
+    explicit NativeFrame(JNIEnv *env);
+    ~NativeFrame();
+    NativeFrame(const NativeFrame &) = delete;
+    NativeFrame &operator=(const NativeFrame &) = delete;
+
+    template <typename T = jobject>
+    T ref(Object *object) {
+        return static_cast<T>(newLocalRef(object));
+    }
+
+private:
+    jobject newLocalRef(Object *object);
+
+    JNIEnv *_env;
+    size_t _frame;
+    host::NativeAllocations _allocations;
+};
+
+/**
+ * Attaches the calling thread for the lifetime of the object like a thread started by Java, for example the OkHttp
+ * reader thread. Native code which runs on it finds it attached and leaves detaching to its owner.
+ */
+class JavaThread {
+public:
+    JavaThread();
+    ~JavaThread();
+    JavaThread(const JavaThread &) = delete;
+    JavaThread &operator=(const JavaThread &) = delete;
+
+    JNIEnv *getEnv() const { return _env; }
+
+private:
+    JNIEnv *_env;
+};
+
+/** Counters of the VM, they only grow except the live reference counts. */
+struct Stats {
+    uint64_t jniCalls{0};          // JNI functions called by native code
+    uint64_t javaCalls{0};         // Java methods called through Call*Method / NewObject
+    uint64_t javaAllocations{0};   // Java objects allocated, by JNI functions or by fake Java code
+    uint64_t javaBytes{0};         // payload bytes of those objects
+    int64_t localRefs{0};          // live local references of all threads
+    int64_t globalRefs{0};         // live global references
+    uint64_t attaches{0};          // AttachCurrentThread calls which attached a thread
+    uint64_t detaches{0};          // DetachCurrentThread calls which detached one
+};
+
+class Vm {
+public:
+    /** The process-wide VM, created on first use. */
+    static Vm &get();
+
+    JavaVM *getJavaVM() { return &_javaVM; }
+
+    /** The JNIEnv of the calling thread, which must be attached. */
+    JNIEnv *getEnv();
+
+    /** Defines a class, which becomes visible to FindClass and to the class loader of the fake activity. */
+    Class *defineClass(const std::string &name);
+    Class *findClass(const std::string &name);
+
+    /** A Context whose getClassLoader() returns the loader of every defined class, for setClassLoaderFrom. */
+    Object *getActivity() const { return _activity; }
+
+    /** Allocates a Java object and counts it. The object has no references yet. */
+    template <typename T, typename... Args>
+    T *newObject(size_t payloadBytes, Args &&... args) {
+        host::VmAllocations allocations;
+        countJavaAllocation(payloadBytes);
+        return new T(std::forward<Args>(args)...);
+    }
+    String *newString(std::u16string chars);
+    String *newStringFromUTF8(const std::string &utf8);
+
+    /** Counts an allocation made by Java code which the fake doesn't materialize, e.g. an OkHttp frame. */
+    void countJavaAllocation(size_t payloadBytes);
+
+    Stats getStats() const;
+
+    Class *getStringClass() const { return _stringClass; }
+    Class *getByteBufferClass() const { return _byteBufferClass; }
+    Class *getArrayClass(const std::string &name);
+
+private:
+    Vm();
+
+    friend struct Natives;
+    friend class NativeFrame;
+    friend class Object;
+
+    _JavaVM _javaVM;
+    Class *_classClass{nullptr};
+    Class *_stringClass{nullptr};
+    Class *_byteBufferClass{nullptr};
+    Object *_activity{nullptr};
+
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, Class *> _classes; // guarded by _mutex, classes are never unloaded
+    std::unordered_map<Object *, int> _globalRefs;    // guarded by _mutex
+
+    std::atomic<uint64_t> _jniCalls{0};
+    std::atomic<uint64_t> _javaCalls{0};
+    std::atomic<uint64_t> _javaAllocations{0};
+    std::atomic<uint64_t> _javaBytes{0};
+    std::atomic<int64_t> _localRefs{0};
+    std::atomic<int64_t> _globalRefCount{0};
+    std::atomic<uint64_t> _attaches{0};
+    std::atomic<uint64_t> _detaches{0};
+};
+
+/** The object a reference refers to, null for a null reference. */
+inline Object *fromRef(jobject ref) {
+    return reinterpret_cast<Object *>(ref);
+}
+
+template <typename T>
+T *fromRef(jobject ref) {
+    return static_cast<T *>(reinterpret_cast<Object *>(ref));
+}
+
+/** A reference to an object Java code holds, valid while it does, e.g. for calling its methods from a benchmark. */
+inline jobject toRef(Object *object) {
+    return reinterpret_cast<jobject>(object);
+}
+
+} // namespace fakejni
@@ -0,0 +1,323 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#include "HostEngine.h"
+
+#include <android/log.h>
+#include <jni.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/CCScheduler.h"
+#include "base/ccUTF8.h"
+#include "platform/CCApplication.h"
+#include "platform/CCFileUtils.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Timer {
+    Clock::time_point due;
+    Clock::time_point last; // when it was scheduled or last ran, for the dt passed to the callback
+    float interval;
+    unsigned int repeat; // runs left after the next one, UINT32_MAX (CC_REPEAT_FOREVER) never ends
+    cocos2d::ccSchedulerFunc callback;
+    void *target;
+    std::string key;
+};
+
+std::mutex g_mutex;
+std::condition_variable g_queued;
+std::vector<std::function<void()>> g_functions; // guarded by g_mutex
+// game thread only, swapped with g_functions so that neither reallocates once they grew: the allocation counts
+// of a benchmark are those of the network code and not of this loop
+std::vector<std::function<void()>> g_running;
+std::vector<Timer> g_timers;                    // game thread only
+
+Clock::duration secondsToDuration(float seconds) {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(seconds));
+}
+
+// UTF-8 <-> UTF-16 as the engine's StringUtils does it, invalid input is rejected
+bool utf8ToUtf16(const std::string &utf8, std::u16string &utf16) {
+    if (std::all_of(utf8.begin(), utf8.end(), [](char c) { return static_cast<uint8_t>(c) < 0x80; })) {
+        utf16 = std::u16string(utf8.begin(), utf8.end());
+        return true;
+    }
+    utf16.clear();
+    utf16.reserve(utf8.size());
+    size_t i = 0;
+    while (i < utf8.size()) {
+        auto c = static_cast<uint8_t>(utf8[i]);
+        uint32_t cp = 0;
+        size_t extra = 0;
+        if (c < 0x80) {
+            cp = c;
+        } else if ((c & 0xE0) == 0xC0) {
+            cp = c & 0x1F;
+            extra = 1;
+        } else if ((c & 0xF0) == 0xE0) {
+            cp = c & 0x0F;
+            extra = 2;
+        } else if ((c & 0xF8) == 0xF0) {
+            cp = c & 0x07;
+            extra = 3;
+        } else {
+            return false;
+        }
+        if (i + extra >= utf8.size() && extra != 0) {
+            return false;
+        }
+        for (size_t k = 1; k <= extra; ++k) {
+            auto next = static_cast<uint8_t>(utf8[i + k]);
+            if ((next & 0xC0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (next & 0x3F);
+        }
+        i += extra + 1;
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            utf16.push_back(static_cast<char16_t>(0xD800 + (cp >> 10)));
+            utf16.push_back(static_cast<char16_t>(0xDC00 + (cp & 0x3FF)));
+        } else {
+            utf16.push_back(static_cast<char16_t>(cp));
+        }
+    }
+    return true;
+}
+
+void utf16ToUtf8(const char16_t *utf16, size_t len, std::string &utf8) {
+    if (std::all_of(utf16, utf16 + len, [](char16_t c) { return c < 0x80; })) {
+        utf8 = std::string(utf16, utf16 + len);
+        return;
+    }
+    utf8.clear();
+    utf8.reserve(len);
+    for (size_t i = 0; i < len; ++i) {
+        uint32_t cp = utf16[i];
+        if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < len && utf16[i + 1] >= 0xDC00 && utf16[i + 1] < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (utf16[++i] - 0xDC00);
+        }
+        if (cp < 0x80) {
+            utf8.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            utf8.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            utf8.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            utf8.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            utf8.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            utf8.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            utf8.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            utf8.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+}
+
+} // namespace
+
+extern "C" int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    static const char PRIORITIES[] = "??VDIWEF";
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%c/%s: ", prio >= 0 && prio < 8 ? PRIORITIES[prio] : '?', tag);
+    int written = vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return written;
+}
+
+namespace cocos2d {
+
+void log(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+void Scheduler::schedule(const ccSchedulerFunc &callback, void *target, float interval, unsigned int repeat,
+                         float delay, bool /*paused*/, const std::string &key) {
+    unschedule(key, target);
+    auto now = Clock::now();
+    g_timers.push_back({now + secondsToDuration(delay), now, interval, repeat, callback, target, key});
+}
+
+void Scheduler::schedule(const ccSchedulerFunc &callback, void *target, float interval, bool paused,
+                         const std::string &key) {
+    schedule(callback, target, interval, UINT32_MAX, interval, paused, key);
+}
+
+void Scheduler::unschedule(const std::string &key, void *target) {
+    for (auto it = g_timers.begin(); it != g_timers.end(); ++it) {
+        if (it->key == key && it->target == target) {
+            g_timers.erase(it);
+            return;
+        }
+    }
+}
+
+void Scheduler::performFunctionInCocosThread(const std::function<void()> &function) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_functions.push_back(function);
+    g_queued.notify_one();
+}
+
+Application *Application::getInstance() {
+    static Application instance;
+    return &instance;
+}
+
+FileUtils *FileUtils::getInstance() {
+    static FileUtils instance;
+    return &instance;
+}
+
+std::string FileUtils::getStringFromFile(const std::string &filename) const {
+    std::ifstream file(filename, std::ios::binary);
+    std::ostringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+std::string FileUtils::fullPathForFilename(const std::string &filename) const {
+    return filename;
+}
+
+std::string FileUtils::getWritablePath() const {
+    return _writablePath;
+}
+
+void FileUtils::setWritablePath(const std::string &path) {
+    _writablePath = path;
+}
+
+namespace StringUtils {
+
+std::string getStringUTFCharsJNI(JNIEnv *env, jstring srcjStr, bool *ret) {
+    std::string utf8Str;
+    const jchar *unicodeChars = env->GetStringChars(srcjStr, nullptr);
+    if (unicodeChars == nullptr) {
+        if (ret != nullptr) {
+            *ret = false;
+        }
+        return utf8Str;
+    }
+    utf16ToUtf8(reinterpret_cast<const char16_t *>(unicodeChars), static_cast<size_t>(env->GetStringLength(srcjStr)),
+                utf8Str);
+    env->ReleaseStringChars(srcjStr, unicodeChars);
+    if (ret != nullptr) {
+        *ret = true;
+    }
+    return utf8Str;
+}
+
+jstring newStringUTFJNI(JNIEnv *env, const std::string &utf8Str, bool *ret) {
+    std::u16string utf16;
+    bool converted = utf8ToUtf16(utf8Str, utf16);
+    if (ret != nullptr) {
+        *ret = converted;
+    }
+    return env->NewString(reinterpret_cast<const jchar *>(utf16.data()), static_cast<jsize>(utf16.length()));
+}
+
+} // namespace StringUtils
+
+} // namespace cocos2d
+
+namespace host {
+
+void runFrame() {
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_running.swap(g_functions);
+    }
+    for (auto &function : g_running) {
+        function();
+    }
+    g_running.clear();
+
+    auto now = Clock::now();
+    // a timer callback may (un)schedule timers, take the due ones out first
+    std::vector<Timer> due;
+    for (auto it = g_timers.begin(); it != g_timers.end();) {
+        if (it->due <= now) {
+            due.push_back(*it);
+            it = g_timers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto &timer : due) {
+        if (timer.repeat > 0) {
+            Timer next = timer;
+            next.due = now + secondsToDuration(timer.interval);
+            next.last = now;
+            if (next.repeat != UINT32_MAX) {
+                --next.repeat;
+            }
+            g_timers.push_back(next);
+        }
+        timer.callback(std::chrono::duration<float>(now - timer.last).count());
+    }
+}
+
+bool runFramesUntil(const std::function<bool()> &done, int timeoutMs) {
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        runFrame();
+        if (done()) {
+            return true;
+        }
+        auto now = Clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        auto wakeUp = deadline;
+        for (auto &timer : g_timers) {
+            wakeUp = std::min(wakeUp, timer.due);
+        }
+        // functions queued from other threads wake this up, done() may also depend on state those threads
+        // change without queueing anything, so don't sleep for long
+        wakeUp = std::min(wakeUp, now + std::chrono::milliseconds(1));
+        std::unique_lock<std::mutex> lock(g_mutex);
+        g_queued.wait_until(lock, wakeUp, []() { return !g_functions.empty(); });
+    }
+}
+
+} // namespace host
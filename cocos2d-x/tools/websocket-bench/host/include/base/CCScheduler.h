@@ -0,0 +1,24 @@
+#pragma once
+
+// Host stand-in for the engine's base/CCScheduler.h. Functions and timers run when the harness drives a frame,
+// see host::runFrame() in HostEngine.h.
+
+#include <functional>
+#include <string>
+
+#include "base/ccMacros.h"
+
+NS_CC_BEGIN
+
+typedef std::function<void(float)> ccSchedulerFunc;
+
+class CC_DLL Scheduler {
+public:
+    void schedule(const ccSchedulerFunc &callback, void *target, float interval, unsigned int repeat, float delay,
+                  bool paused, const std::string &key);
+    void schedule(const ccSchedulerFunc &callback, void *target, float interval, bool paused, const std::string &key);
+    void unschedule(const std::string &key, void *target);
+    void performFunctionInCocosThread(const std::function<void()> &function);
+};
+
+NS_CC_END
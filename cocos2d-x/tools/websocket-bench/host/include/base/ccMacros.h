@@ -0,0 +1,48 @@
+#pragma once
+
+// Host stand-in for the engine's base/ccMacros.h, only the macros used by the network sources.
+// As in the engine the log macros compile to nothing unless COCOS2D_DEBUG is set.
+
+#include <cassert>
+
+#include "platform/CCStdC.h"
+
+#define NS_CC_BEGIN namespace cocos2d {
+#define NS_CC_END }
+#define USING_NS_CC using namespace cocos2d
+
+#define CC_DLL
+
+namespace cocos2d {
+void log(const char *format, ...) __attribute__((format(printf, 1, 2)));
+}
+
+#if !defined(COCOS2D_DEBUG) || COCOS2D_DEBUG == 0
+    #define CCLOG(...) \
+        do {           \
+        } while (0)
+    #define CCLOGINFO(...) \
+        do {               \
+        } while (0)
+    #define CCLOGERROR(...) \
+        do {                \
+        } while (0)
+    #define CCLOGWARN(...) \
+        do {               \
+        } while (0)
+#else
+    #define CCLOG(format, ...) cocos2d::log(format, ##__VA_ARGS__)
+    #define CCLOGINFO(format, ...) cocos2d::log(format, ##__VA_ARGS__)
+    #define CCLOGERROR(format, ...) cocos2d::log(format, ##__VA_ARGS__)
+    #define CCLOGWARN(...) __CCLOGWITHFUNCTION(__VA_ARGS__)
+    #define __CCLOGWITHFUNCTION(s, ...) cocos2d::log("%s : %s", __FUNCTION__, s, ##__VA_ARGS__)
+#endif
+
+#define CC_ASSERT(cond) assert(cond)
+#define CCASSERT(cond, msg) assert(cond)
+
+#define CC_SAFE_DELETE(p) \
+    do {                  \
+        delete (p);       \
+        (p) = nullptr;    \
+    } while (0)
@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for the JNI part of the engine's base/ccUTF8.h. The conversions go through UTF-16 like the engine's,
+// so their cost stays comparable.
+
+#include <jni.h>
+#include <string>
+
+#include "base/ccMacros.h"
+
+NS_CC_BEGIN
+
+namespace StringUtils {
+
+CC_DLL std::string getStringUTFCharsJNI(JNIEnv *env, jstring srcjStr, bool *ret = nullptr);
+CC_DLL jstring newStringUTFJNI(JNIEnv *env, const std::string &utf8Str, bool *ret = nullptr);
+
+} // namespace StringUtils
+
+NS_CC_END
@@ -0,0 +1,380 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+// Host stand-in for the NDK <jni.h>, implemented by FakeJni.cpp. It keeps the layout of the real header: the C++
+// JNIEnv and JavaVM methods are inline wrappers which call through a function table, and the variadic calls go
+// through the va_list variants, so a call costs what it costs on a device before it enters the VM.
+// Only the part of the interface used by the engine code built on the host is declared.
+
+#include <cstdarg>
+#include <cstdint>
+
+typedef uint8_t jboolean;
+typedef int8_t jbyte;
+typedef uint16_t jchar;
+typedef int16_t jshort;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef float jfloat;
+typedef double jdouble;
+typedef jint jsize;
+
+class _jobject {};
+class _jclass : public _jobject {};
+class _jstring : public _jobject {};
+class _jarray : public _jobject {};
+class _jobjectArray : public _jarray {};
+class _jbooleanArray : public _jarray {};
+class _jbyteArray : public _jarray {};
+class _jcharArray : public _jarray {};
+class _jshortArray : public _jarray {};
+class _jintArray : public _jarray {};
+class _jlongArray : public _jarray {};
+class _jfloatArray : public _jarray {};
+class _jdoubleArray : public _jarray {};
+class _jthrowable : public _jobject {};
+
+typedef _jobject *jobject;
+typedef _jclass *jclass;
+typedef _jstring *jstring;
+typedef _jarray *jarray;
+typedef _jobjectArray *jobjectArray;
+typedef _jbooleanArray *jbooleanArray;
+typedef _jbyteArray *jbyteArray;
+typedef _jcharArray *jcharArray;
+typedef _jshortArray *jshortArray;
+typedef _jintArray *jintArray;
+typedef _jlongArray *jlongArray;
+typedef _jfloatArray *jfloatArray;
+typedef _jdoubleArray *jdoubleArray;
+typedef _jthrowable *jthrowable;
+
+struct _jfieldID;
+typedef struct _jfieldID *jfieldID;
+struct _jmethodID;
+typedef struct _jmethodID *jmethodID;
+
+typedef union jvalue {
+    jboolean z;
+    jbyte b;
+    jchar c;
+    jshort s;
+    jint i;
+    jlong j;
+    jfloat f;
+    jdouble d;
+    jobject l;
+} jvalue;
+
+#define JNI_FALSE 0
+#define JNI_TRUE 1
+
+#define JNI_VERSION_1_4 0x00010004
+#define JNI_VERSION_1_6 0x00010006
+
+#define JNI_OK (0)
+#define JNI_ERR (-1)
+#define JNI_EDETACHED (-2)
+#define JNI_EVERSION (-3)
+
+#define JNI_COMMIT 1
+#define JNI_ABORT 2
+
+#define JNIEXPORT __attribute__((visibility("default")))
+#define JNICALL
+
+struct _JNIEnv;
+struct _JavaVM;
+typedef _JNIEnv JNIEnv;
+typedef _JavaVM JavaVM;
+
+// X(Name, type, arrayType) for the primitive types with typed Call*, New*Array and *ArrayRegion functions
+#define JNI_FOR_EACH_PRIMITIVE(X)               \
+    X(Boolean, jboolean, jbooleanArray)         \
+    X(Byte, jbyte, jbyteArray)                  \
+    X(Char, jchar, jcharArray)                  \
+    X(Short, jshort, jshortArray)               \
+    X(Int, jint, jintArray)                     \
+    X(Long, jlong, jlongArray)                  \
+    X(Float, jfloat, jfloatArray)               \
+    X(Double, jdouble, jdoubleArray)
+
+// X(Name, type) for the return types of the Call*Method families
+#define JNI_FOR_EACH_RETURN_TYPE(X) \
+    X(Object, jobject)              \
+    X(Boolean, jboolean)            \
+    X(Byte, jbyte)                  \
+    X(Char, jchar)                  \
+    X(Short, jshort)                \
+    X(Int, jint)                    \
+    X(Long, jlong)                  \
+    X(Float, jfloat)                \
+    X(Double, jdouble)
+
+struct JNINativeInterface {
+    jclass (*FindClass)(JNIEnv *, const char *);
+    jclass (*GetObjectClass)(JNIEnv *, jobject);
+    jboolean (*IsSameObject)(JNIEnv *, jobject, jobject);
+
+    jboolean (*ExceptionCheck)(JNIEnv *);
+    void (*ExceptionDescribe)(JNIEnv *);
+    void (*ExceptionClear)(JNIEnv *);
+
+    jint (*PushLocalFrame)(JNIEnv *, jint);
+    jobject (*PopLocalFrame)(JNIEnv *, jobject);
+    jint (*EnsureLocalCapacity)(JNIEnv *, jint);
+    jobject (*NewGlobalRef)(JNIEnv *, jobject);
+    void (*DeleteGlobalRef)(JNIEnv *, jobject);
+    jobject (*NewLocalRef)(JNIEnv *, jobject);
+    void (*DeleteLocalRef)(JNIEnv *, jobject);
+
+    jmethodID (*GetMethodID)(JNIEnv *, jclass, const char *, const char *);
+    jmethodID (*GetStaticMethodID)(JNIEnv *, jclass, const char *, const char *);
+
+    jobject (*NewObjectV)(JNIEnv *, jclass, jmethodID, va_list);
+    jobject (*NewObjectA)(JNIEnv *, jclass, jmethodID, const jvalue *);
+
+#define JNI_DECLARE_CALLS(Name, type)                                                   \
+    type (*Call##Name##MethodV)(JNIEnv *, jobject, jmethodID, va_list);                 \
+    type (*Call##Name##MethodA)(JNIEnv *, jobject, jmethodID, const jvalue *);          \
+    type (*CallStatic##Name##MethodV)(JNIEnv *, jclass, jmethodID, va_list);            \
+    type (*CallStatic##Name##MethodA)(JNIEnv *, jclass, jmethodID, const jvalue *);
+    JNI_FOR_EACH_RETURN_TYPE(JNI_DECLARE_CALLS)
+#undef JNI_DECLARE_CALLS
+    void (*CallVoidMethodV)(JNIEnv *, jobject, jmethodID, va_list);
+    void (*CallVoidMethodA)(JNIEnv *, jobject, jmethodID, const jvalue *);
+    void (*CallStaticVoidMethodV)(JNIEnv *, jclass, jmethodID, va_list);
+    void (*CallStaticVoidMethodA)(JNIEnv *, jclass, jmethodID, const jvalue *);
+
+    jstring (*NewString)(JNIEnv *, const jchar *, jsize);
+    jsize (*GetStringLength)(JNIEnv *, jstring);
+    const jchar *(*GetStringChars)(JNIEnv *, jstring, jboolean *);
+    void (*ReleaseStringChars)(JNIEnv *, jstring, const jchar *);
+    jstring (*NewStringUTF)(JNIEnv *, const char *);
+    jsize (*GetStringUTFLength)(JNIEnv *, jstring);
+    const char *(*GetStringUTFChars)(JNIEnv *, jstring, jboolean *);
+    void (*ReleaseStringUTFChars)(JNIEnv *, jstring, const char *);
+    void (*GetStringRegion)(JNIEnv *, jstring, jsize, jsize, jchar *);
+    void (*GetStringUTFRegion)(JNIEnv *, jstring, jsize, jsize, char *);
+
+    jsize (*GetArrayLength)(JNIEnv *, jarray);
+    jobjectArray (*NewObjectArray)(JNIEnv *, jsize, jclass, jobject);
+    jobject (*GetObjectArrayElement)(JNIEnv *, jobjectArray, jsize);
+    void (*SetObjectArrayElement)(JNIEnv *, jobjectArray, jsize, jobject);
+
+#define JNI_DECLARE_ARRAYS(Name, type, arrayType)                                       \
+    arrayType (*New##Name##Array)(JNIEnv *, jsize);                                     \
+    type *(*Get##Name##ArrayElements)(JNIEnv *, arrayType, jboolean *);                 \
+    void (*Release##Name##ArrayElements)(JNIEnv *, arrayType, type *, jint);            \
+    void (*Get##Name##ArrayRegion)(JNIEnv *, arrayType, jsize, jsize, type *);          \
+    void (*Set##Name##ArrayRegion)(JNIEnv *, arrayType, jsize, jsize, const type *);
+    JNI_FOR_EACH_PRIMITIVE(JNI_DECLARE_ARRAYS)
+#undef JNI_DECLARE_ARRAYS
+
+    void *(*GetPrimitiveArrayCritical)(JNIEnv *, jarray, jboolean *);
+    void (*ReleasePrimitiveArrayCritical)(JNIEnv *, jarray, void *, jint);
+
+    jobject (*NewDirectByteBuffer)(JNIEnv *, void *, jlong);
+    void *(*GetDirectBufferAddress)(JNIEnv *, jobject);
+    jlong (*GetDirectBufferCapacity)(JNIEnv *, jobject);
+
+    jint (*GetJavaVM)(JNIEnv *, JavaVM **);
+};
+
+struct _JNIEnv {
+    const JNINativeInterface *functions;
+
+    jclass FindClass(const char *name) { return functions->FindClass(this, name); }
+    jclass GetObjectClass(jobject obj) { return functions->GetObjectClass(this, obj); }
+    jboolean IsSameObject(jobject a, jobject b) { return functions->IsSameObject(this, a, b); }
+
+    jboolean ExceptionCheck() { return functions->ExceptionCheck(this); }
+    void ExceptionDescribe() { functions->ExceptionDescribe(this); }
+    void ExceptionClear() { functions->ExceptionClear(this); }
+
+    jint PushLocalFrame(jint capacity) { return functions->PushLocalFrame(this, capacity); }
+    jobject PopLocalFrame(jobject result) { return functions->PopLocalFrame(this, result); }
+    jint EnsureLocalCapacity(jint capacity) { return functions->EnsureLocalCapacity(this, capacity); }
+    jobject NewGlobalRef(jobject obj) { return functions->NewGlobalRef(this, obj); }
+    void DeleteGlobalRef(jobject ref) { functions->DeleteGlobalRef(this, ref); }
+    jobject NewLocalRef(jobject ref) { return functions->NewLocalRef(this, ref); }
+    void DeleteLocalRef(jobject ref) { functions->DeleteLocalRef(this, ref); }
+
+    jmethodID GetMethodID(jclass clazz, const char *name, const char *sig) {
+        return functions->GetMethodID(this, clazz, name, sig);
+    }
+    jmethodID GetStaticMethodID(jclass clazz, const char *name, const char *sig) {
+        return functions->GetStaticMethodID(this, clazz, name, sig);
+    }
+
+    jobject NewObject(jclass clazz, jmethodID methodID, ...) {
+        va_list args;
+        va_start(args, methodID);
+        jobject result = functions->NewObjectV(this, clazz, methodID, args);
+        va_end(args);
+        return result;
+    }
+    jobject NewObjectV(jclass clazz, jmethodID methodID, va_list args) {
+        return functions->NewObjectV(this, clazz, methodID, args);
+    }
+    jobject NewObjectA(jclass clazz, jmethodID methodID, const jvalue *args) {
+        return functions->NewObjectA(this, clazz, methodID, args);
+    }
+
+#define JNI_DEFINE_CALLS(Name, type)                                                    \
+    type Call##Name##Method(jobject obj, jmethodID methodID, ...) {                     \
+        va_list args;                                                                   \
+        va_start(args, methodID);                                                       \
+        type result = functions->Call##Name##MethodV(this, obj, methodID, args);        \
+        va_end(args);                                                                   \
+        return result;                                                                  \
+    }                                                                                   \
+    type Call##Name##MethodV(jobject obj, jmethodID methodID, va_list args) {           \
+        return functions->Call##Name##MethodV(this, obj, methodID, args);               \
+    }                                                                                   \
+    type Call##Name##MethodA(jobject obj, jmethodID methodID, const jvalue *args) {     \
+        return functions->Call##Name##MethodA(this, obj, methodID, args);               \
+    }                                                                                   \
+    type CallStatic##Name##Method(jclass clazz, jmethodID methodID, ...) {              \
+        va_list args;                                                                   \
+        va_start(args, methodID);                                                       \
+        type result = functions->CallStatic##Name##MethodV(this, clazz, methodID, args); \
+        va_end(args);                                                                   \
+        return result;                                                                  \
+    }                                                                                   \
+    type CallStatic##Name##MethodV(jclass clazz, jmethodID methodID, va_list args) {    \
+        return functions->CallStatic##Name##MethodV(this, clazz, methodID, args);       \
+    }                                                                                   \
+    type CallStatic##Name##MethodA(jclass clazz, jmethodID methodID, const jvalue *args) { \
+        return functions->CallStatic##Name##MethodA(this, clazz, methodID, args);       \
+    }
+    JNI_FOR_EACH_RETURN_TYPE(JNI_DEFINE_CALLS)
+#undef JNI_DEFINE_CALLS
+
+    void CallVoidMethod(jobject obj, jmethodID methodID, ...) {
+        va_list args;
+        va_start(args, methodID);
+        functions->CallVoidMethodV(this, obj, methodID, args);
+        va_end(args);
+    }
+    void CallVoidMethodV(jobject obj, jmethodID methodID, va_list args) {
+        functions->CallVoidMethodV(this, obj, methodID, args);
+    }
+    void CallVoidMethodA(jobject obj, jmethodID methodID, const jvalue *args) {
+        functions->CallVoidMethodA(this, obj, methodID, args);
+    }
+    void CallStaticVoidMethod(jclass clazz, jmethodID methodID, ...) {
+        va_list args;
+        va_start(args, methodID);
+        functions->CallStaticVoidMethodV(this, clazz, methodID, args);
+        va_end(args);
+    }
+    void CallStaticVoidMethodV(jclass clazz, jmethodID methodID, va_list args) {
+        functions->CallStaticVoidMethodV(this, clazz, methodID, args);
+    }
+    void CallStaticVoidMethodA(jclass clazz, jmethodID methodID, const jvalue *args) {
+        functions->CallStaticVoidMethodA(this, clazz, methodID, args);
+    }
+
+    jstring NewString(const jchar *chars, jsize len) { return functions->NewString(this, chars, len); }
+    jsize GetStringLength(jstring str) { return functions->GetStringLength(this, str); }
+    const jchar *GetStringChars(jstring str, jboolean *isCopy) { return functions->GetStringChars(this, str, isCopy); }
+    void ReleaseStringChars(jstring str, const jchar *chars) { functions->ReleaseStringChars(this, str, chars); }
+    jstring NewStringUTF(const char *bytes) { return functions->NewStringUTF(this, bytes); }
+    jsize GetStringUTFLength(jstring str) { return functions->GetStringUTFLength(this, str); }
+    const char *GetStringUTFChars(jstring str, jboolean *isCopy) {
+        return functions->GetStringUTFChars(this, str, isCopy);
+    }
+    void ReleaseStringUTFChars(jstring str, const char *chars) { functions->ReleaseStringUTFChars(this, str, chars); }
+    void GetStringRegion(jstring str, jsize start, jsize len, jchar *buf) {
+        functions->GetStringRegion(this, str, start, len, buf);
+    }
+    void GetStringUTFRegion(jstring str, jsize start, jsize len, char *buf) {
+        functions->GetStringUTFRegion(this, str, start, len, buf);
+    }
+
+    jsize GetArrayLength(jarray array) { return functions->GetArrayLength(this, array); }
+    jobjectArray NewObjectArray(jsize length, jclass elementClass, jobject initialElement) {
+        return functions->NewObjectArray(this, length, elementClass, initialElement);
+    }
+    jobject GetObjectArrayElement(jobjectArray array, jsize index) {
+        return functions->GetObjectArrayElement(this, array, index);
+    }
+    void SetObjectArrayElement(jobjectArray array, jsize index, jobject value) {
+        functions->SetObjectArrayElement(this, array, index, value);
+    }
+
+#define JNI_DEFINE_ARRAYS(Name, type, arrayType)                                                \
+    arrayType New##Name##Array(jsize length) { return functions->New##Name##Array(this, length); } \
+    type *Get##Name##ArrayElements(arrayType array, jboolean *isCopy) {                        \
+        return functions->Get##Name##ArrayElements(this, array, isCopy);                       \
+    }                                                                                           \
+    void Release##Name##ArrayElements(arrayType array, type *elems, jint mode) {               \
+        functions->Release##Name##ArrayElements(this, array, elems, mode);                     \
+    }                                                                                           \
+    void Get##Name##ArrayRegion(arrayType array, jsize start, jsize len, type *buf) {          \
+        functions->Get##Name##ArrayRegion(this, array, start, len, buf);                       \
+    }                                                                                           \
+    void Set##Name##ArrayRegion(arrayType array, jsize start, jsize len, const type *buf) {    \
+        functions->Set##Name##ArrayRegion(this, array, start, len, buf);                       \
+    }
+    JNI_FOR_EACH_PRIMITIVE(JNI_DEFINE_ARRAYS)
+#undef JNI_DEFINE_ARRAYS
+
+    void *GetPrimitiveArrayCritical(jarray array, jboolean *isCopy) {
+        return functions->GetPrimitiveArrayCritical(this, array, isCopy);
+    }
+    void ReleasePrimitiveArrayCritical(jarray array, void *carray, jint mode) {
+        functions->ReleasePrimitiveArrayCritical(this, array, carray, mode);
+    }
+
+    jobject NewDirectByteBuffer(void *address, jlong capacity) {
+        return functions->NewDirectByteBuffer(this, address, capacity);
+    }
+    void *GetDirectBufferAddress(jobject buf) { return functions->GetDirectBufferAddress(this, buf); }
+    jlong GetDirectBufferCapacity(jobject buf) { return functions->GetDirectBufferCapacity(this, buf); }
+
+    jint GetJavaVM(JavaVM **vm) { return functions->GetJavaVM(this, vm); }
+};
+
+struct JNIInvokeInterface {
+    jint (*DestroyJavaVM)(JavaVM *);
+    jint (*AttachCurrentThread)(JavaVM *, JNIEnv **, void *);
+    jint (*DetachCurrentThread)(JavaVM *);
+    jint (*GetEnv)(JavaVM *, void **, jint);
+    jint (*AttachCurrentThreadAsDaemon)(JavaVM *, JNIEnv **, void *);
+};
+
+struct _JavaVM {
+    const JNIInvokeInterface *functions;
+
+    jint DestroyJavaVM() { return functions->DestroyJavaVM(this); }
+    jint AttachCurrentThread(JNIEnv **env, void *args) { return functions->AttachCurrentThread(this, env, args); }
+    jint DetachCurrentThread() { return functions->DetachCurrentThread(this); }
+    jint GetEnv(void **env, jint version) { return functions->GetEnv(this, env, version); }
+    jint AttachCurrentThreadAsDaemon(JNIEnv **env, void *args) {
+        return functions->AttachCurrentThreadAsDaemon(this, env, args);
+    }
+};
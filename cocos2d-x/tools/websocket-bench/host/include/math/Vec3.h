@@ -0,0 +1,16 @@
+#pragma once
+
+// Host stand-in for the engine's math/Vec3.h, only what JniHelper.h needs.
+
+#include "base/ccMacros.h"
+
+NS_CC_BEGIN
+
+class CC_DLL Vec3 {
+public:
+    float x{0};
+    float y{0};
+    float z{0};
+};
+
+NS_CC_END
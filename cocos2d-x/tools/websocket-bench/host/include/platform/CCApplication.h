@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for the engine's platform/CCApplication.h, only the scheduler is provided.
+
+#include <memory>
+
+#include "base/CCScheduler.h"
+
+NS_CC_BEGIN
+
+class CC_DLL Application {
+public:
+    static Application *getInstance();
+    std::shared_ptr<Scheduler> getScheduler() const { return _scheduler; }
+
+private:
+    std::shared_ptr<Scheduler> _scheduler{std::make_shared<Scheduler>()};
+};
+
+NS_CC_END
@@ -0,0 +1,24 @@
+#pragma once
+
+// Host stand-in for the engine's platform/CCFileUtils.h, paths are plain file system paths.
+
+#include <string>
+
+#include "base/ccMacros.h"
+
+NS_CC_BEGIN
+
+class CC_DLL FileUtils {
+public:
+    static FileUtils *getInstance();
+
+    std::string getStringFromFile(const std::string &filename) const;
+    std::string fullPathForFilename(const std::string &filename) const;
+    std::string getWritablePath() const;
+    void setWritablePath(const std::string &path);
+
+private:
+    std::string _writablePath;
+};
+
+NS_CC_END
@@ -0,0 +1,12 @@
+#pragma once
+
+// Host stand-in for the engine's platform/CCPlatformConfig.h, the host builds as Linux.
+
+#define CC_PLATFORM_UNKNOWN 0
+#define CC_PLATFORM_IOS 1
+#define CC_PLATFORM_ANDROID 2
+#define CC_PLATFORM_WIN32 3
+#define CC_PLATFORM_LINUX 5
+#define CC_PLATFORM_MAC 8
+
+#define CC_TARGET_PLATFORM CC_PLATFORM_LINUX
@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for the engine's platform/CCPlatformDefine.h.
+
+#include "base/ccMacros.h"
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for the engine's platform/CCPlatformMacros.h.
+
+#include "base/ccMacros.h"
+#include "platform/CCPlatformConfig.h"
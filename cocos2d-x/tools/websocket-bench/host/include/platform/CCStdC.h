@@ -0,0 +1,10 @@
+#pragma once
+
+// Host stand-in for the engine's platform/CCStdC.h: ssize_t for WebSocket.h, and the C headers which the engine's
+// version includes on Android and which JniHelper.h relies on (memcpy).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
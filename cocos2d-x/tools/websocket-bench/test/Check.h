@@ -0,0 +1,107 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Just enough of a test framework for the harness: TEST registers a case, CHECK reports a failed condition and
+// lets the case go on, REQUIRE ends it. runTests runs the cases whose names contain the first argument.
+namespace check {
+
+struct Failure {};
+
+struct TestCase {
+    const char *name;
+    std::function<void()> body;
+};
+
+inline std::vector<TestCase> &testCases() {
+    static std::vector<TestCase> instance;
+    return instance;
+}
+
+inline int &failures() {
+    static int count = 0;
+    return count;
+}
+
+struct Registration {
+    Registration(const char *name, std::function<void()> body) { testCases().push_back({name, std::move(body)}); }
+};
+
+inline void fail(const char *file, int line, const char *expression) {
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+    ++failures();
+}
+
+inline int runTests(int argc, char **argv) {
+    const char *filter = argc > 1 ? argv[1] : "";
+    int failedCases = 0;
+    int ran = 0;
+    for (const TestCase &testCase : testCases()) {
+        if (std::string(testCase.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        int before = failures();
+        try {
+            testCase.body();
+        } catch (const Failure &) {
+        }
+        bool passed = failures() == before;
+        failedCases += passed ? 0 : 1;
+        ++ran;
+        printf("[%s] %s\n", passed ? "  OK  " : " FAIL ", testCase.name);
+        fflush(stdout);
+    }
+    printf("%d of %d test cases passed\n", ran - failedCases, ran);
+    return failedCases == 0 ? 0 : 1;
+}
+
+} // namespace check
+
+#define CHECK_CONCAT_(a, b) a##b
+#define CHECK_CONCAT(a, b) CHECK_CONCAT_(a, b)
+
+#define TEST(name)                                                                        \
+    static void name();                                                                   \
+    static const check::Registration CHECK_CONCAT(name, _registration)(#name, name);      \
+    static void name()
+
+#define CHECK(condition)                                   \
+    do {                                                   \
+        if (!(condition)) {                                \
+            check::fail(__FILE__, __LINE__, #condition);   \
+        }                                                  \
+    } while (0)
+
+#define REQUIRE(condition)                                 \
+    do {                                                   \
+        if (!(condition)) {                                \
+            check::fail(__FILE__, __LINE__, #condition);   \
+            throw check::Failure();                        \
+        }                                                  \
+    } while (0)
@@ -0,0 +1,261 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// Checks WebSocketDeflate: the negotiation of the server's Sec-WebSocket-Extensions response and whole messages
+// through compress() and decompress(), one instance compressing for another the way client and server do.
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "Check.h"
+#include "network/WebSocketDeflate.h"
+
+using cocos2d::network::WebSocketDeflate;
+
+namespace {
+
+const uint8_t DEFLATE_TAIL[] = {0x00, 0x00, 0xff, 0xff};
+
+bool accepts(const std::string &response, const WebSocketDeflate::Config &config = WebSocketDeflate::Config()) {
+    WebSocketDeflate deflate(config);
+    return deflate.accept(response);
+}
+
+std::unique_ptr<WebSocketDeflate> negotiate(const std::string &response,
+                                            const WebSocketDeflate::Config &config = WebSocketDeflate::Config()) {
+    std::unique_ptr<WebSocketDeflate> deflate(new WebSocketDeflate(config));
+    REQUIRE(deflate->accept(response));
+    REQUIRE(deflate->isNegotiated());
+    return deflate;
+}
+
+// compressible but not trivially: a chat message with a counter
+std::string makeMessage(int index, size_t size) {
+    std::string message;
+    for (; message.size() < size; ++index) {
+        message += "{\"from\":\"player" + std::to_string(index % 7) + "\",\"seq\":" + std::to_string(index) +
+                   ",\"text\":\"hello there\"}";
+    }
+    message.resize(size);
+    return message;
+}
+
+std::vector<uint8_t> compress(WebSocketDeflate &deflate, const std::string &text) {
+    std::vector<uint8_t> out;
+    REQUIRE(deflate.compress(reinterpret_cast<const uint8_t *>(text.data()), text.size(), out));
+    return out;
+}
+
+bool decompress(WebSocketDeflate &deflate, const std::vector<uint8_t> &data, std::string &text,
+                size_t maxSize = 1 << 20) {
+    std::vector<uint8_t> out;
+    if (!deflate.decompress(data.data(), data.size(), out, maxSize)) {
+        return false;
+    }
+    text.assign(out.begin(), out.end());
+    return true;
+}
+
+// a raw deflate stream of text, finished with BFINAL or sync flushed with the tail stripped
+std::vector<uint8_t> rawDeflate(const std::string &text, bool final) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    REQUIRE(deflateInit2(&stream, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    std::vector<uint8_t> out(deflateBound(&stream, static_cast<uLong>(text.size())) + 16);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    int ret = deflate(&stream, final ? Z_FINISH : Z_SYNC_FLUSH);
+    REQUIRE(ret == (final ? Z_STREAM_END : Z_OK));
+    out.resize(out.size() - stream.avail_out);
+    deflateEnd(&stream);
+    if (!final) {
+        REQUIRE(out.size() >= sizeof(DEFLATE_TAIL));
+        out.resize(out.size() - sizeof(DEFLATE_TAIL));
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(deflateOffersTheConfiguredParameters) {
+    CHECK(WebSocketDeflate(WebSocketDeflate::Config()).getOffer() == "permessage-deflate; client_max_window_bits");
+    WebSocketDeflate::Config config;
+    config.clientMaxWindowBits = 10;
+    config.serverMaxWindowBits = 8; // raised to 9, zlib can't inflate raw 8 bit windows
+    config.clientNoContextTakeover = true;
+    config.serverNoContextTakeover = true;
+    CHECK(WebSocketDeflate(config).getOffer() ==
+          "permessage-deflate; client_max_window_bits=10; server_max_window_bits=9; client_no_context_takeover; "
+          "server_no_context_takeover");
+}
+
+TEST(deflateAcceptsTheOfferedExtension) {
+    WebSocketDeflate none((WebSocketDeflate::Config()));
+    CHECK(none.accept(""));
+    CHECK(!none.isNegotiated());
+
+    std::unique_ptr<WebSocketDeflate> deflate = negotiate("permessage-deflate");
+    CHECK(deflate->getExtensions() == "permessage-deflate");
+    CHECK(accepts("permessage-deflate; client_max_window_bits=12"));
+    CHECK(accepts("permessage-deflate; client_max_window_bits=\"12\""));
+    CHECK(accepts("permessage-deflate;client_max_window_bits=15 ;  server_max_window_bits=10"));
+    CHECK(accepts("permessage-deflate; client_no_context_takeover; server_no_context_takeover"));
+}
+
+TEST(deflateRejectsUnknownOrRepeatedExtensions) {
+    CHECK(!accepts("x-webkit-deflate-frame"));
+    CHECK(!accepts("permessage-deflate, x-webkit-deflate-frame"));
+    CHECK(!accepts("permessage-deflate, permessage-deflate"));
+    CHECK(!accepts("permessage-deflate; client_max_window_bits=12, permessage-deflate"));
+}
+
+TEST(deflateRejectsUnknownOrRepeatedParameters) {
+    CHECK(!accepts("permessage-deflate; max_window_bits=12"));
+    CHECK(!accepts("permessage-deflate; client_no_context_takeover=1"));
+    CHECK(!accepts("permessage-deflate; server_no_context_takeover=true"));
+    CHECK(!accepts("permessage-deflate; client_no_context_takeover; client_no_context_takeover"));
+    CHECK(!accepts("permessage-deflate; server_no_context_takeover; server_no_context_takeover"));
+    CHECK(!accepts("permessage-deflate; client_max_window_bits=12; client_max_window_bits=12"));
+    CHECK(!accepts("permessage-deflate; server_max_window_bits=12; server_max_window_bits=10"));
+}
+
+TEST(deflateRejectsMissingOrOutOfRangeWindowBits) {
+    // the response must carry a value, the bare form is only for the offer
+    CHECK(!accepts("permessage-deflate; client_max_window_bits"));
+    CHECK(!accepts("permessage-deflate; server_max_window_bits"));
+    // zlib can't compress with a raw 8 bit window, the server would be given a wider one than it allowed
+    CHECK(!accepts("permessage-deflate; client_max_window_bits=8"));
+    for (const char *bits : {"7", "16", "0", "-9", "abc", "12x", "\"\""}) {
+        CHECK(!accepts(std::string("permessage-deflate; client_max_window_bits=") + bits));
+        CHECK(!accepts(std::string("permessage-deflate; server_max_window_bits=") + bits));
+    }
+    // wider than offered
+    WebSocketDeflate::Config config;
+    config.serverMaxWindowBits = 10;
+    CHECK(accepts("permessage-deflate; server_max_window_bits=10", config));
+    CHECK(!accepts("permessage-deflate; server_max_window_bits=11", config));
+}
+
+TEST(deflateRequiresServerNoContextTakeoverWhenAsked) {
+    WebSocketDeflate::Config config;
+    config.serverNoContextTakeover = true;
+    CHECK(!accepts("permessage-deflate", config));
+    CHECK(accepts("permessage-deflate; server_no_context_takeover", config));
+    // the server may reset its compressor without being asked
+    CHECK(accepts("permessage-deflate; server_no_context_takeover"));
+}
+
+TEST(deflateRoundTripsWithoutTheTail) {
+    std::unique_ptr<WebSocketDeflate> sender = negotiate("permessage-deflate");
+    std::unique_ptr<WebSocketDeflate> receiver = negotiate("permessage-deflate");
+    for (size_t size : {1, 100, 4096, 300000}) {
+        std::string message = makeMessage(static_cast<int>(size), size);
+        std::vector<uint8_t> compressed = compress(*sender, message);
+        CHECK(compressed.size() < sizeof(DEFLATE_TAIL) ||
+              memcmp(compressed.data() + compressed.size() - sizeof(DEFLATE_TAIL), DEFLATE_TAIL,
+                     sizeof(DEFLATE_TAIL)) != 0);
+        std::string text;
+        REQUIRE(decompress(*receiver, compressed, text));
+        CHECK(text == message);
+    }
+    // an empty message is the header byte of the empty stored block whose rest is the stripped tail
+    std::string text = "x";
+    std::vector<uint8_t> empty = compress(*sender, "");
+    CHECK(empty == std::vector<uint8_t>{0x00});
+    REQUIRE(decompress(*receiver, empty, text));
+    CHECK(text.empty());
+    // and leaves the receiver at a block boundary
+    std::string message = makeMessage(3, 500);
+    REQUIRE(decompress(*receiver, compress(*sender, message), text));
+    CHECK(text == message);
+}
+
+TEST(deflateKeepsTheContextBetweenMessages) {
+    std::string message = makeMessage(1, 2000);
+    std::unique_ptr<WebSocketDeflate> sender = negotiate("permessage-deflate");
+    std::unique_ptr<WebSocketDeflate> receiver = negotiate("permessage-deflate");
+    std::vector<uint8_t> first = compress(*sender, message);
+    std::vector<uint8_t> second = compress(*sender, message);
+    // the repeat is a back reference into the window
+    CHECK(second.size() * 4 < first.size());
+    std::string text;
+    REQUIRE(decompress(*receiver, first, text));
+    REQUIRE(decompress(*receiver, second, text));
+    CHECK(text == message);
+
+    // a receiver which reset its window can't resolve that reference
+    std::unique_ptr<WebSocketDeflate> resetting = negotiate("permessage-deflate; server_no_context_takeover");
+    REQUIRE(decompress(*resetting, first, text));
+    CHECK(!decompress(*resetting, second, text) || text != message);
+}
+
+TEST(deflateResetsTheContextWithoutTakeover) {
+    std::string message = makeMessage(1, 2000);
+    std::unique_ptr<WebSocketDeflate> sender = negotiate("permessage-deflate; client_no_context_takeover");
+    std::unique_ptr<WebSocketDeflate> receiver = negotiate("permessage-deflate; server_no_context_takeover");
+    std::vector<uint8_t> first = compress(*sender, message);
+    std::vector<uint8_t> second = compress(*sender, message);
+    CHECK(first == second);
+    std::string text;
+    REQUIRE(decompress(*receiver, first, text));
+    REQUIRE(decompress(*receiver, second, text));
+    CHECK(text == message);
+}
+
+TEST(deflateCapsTheDecompressedSize) {
+    std::string message(100000, 'z');
+    std::unique_ptr<WebSocketDeflate> sender = negotiate("permessage-deflate; client_no_context_takeover");
+    std::vector<uint8_t> compressed = compress(*sender, message);
+    // a compression bomb: a few hundred bytes on the wire
+    CHECK(compressed.size() < 1000);
+    std::string text;
+    CHECK(!decompress(*negotiate("permessage-deflate"), compressed, text, message.size() - 1));
+    CHECK(!decompress(*negotiate("permessage-deflate"), compressed, text, 1000));
+    REQUIRE(decompress(*negotiate("permessage-deflate"), compressed, text, message.size()));
+    CHECK(text == message);
+}
+
+TEST(deflateContinuesAfterAFinalBlock) {
+    std::unique_ptr<WebSocketDeflate> receiver = negotiate("permessage-deflate");
+    std::string text;
+    // a sender may end the stream with BFINAL, the appended tail must not start a new one
+    REQUIRE(decompress(*receiver, rawDeflate("hello", true), text));
+    CHECK(text == "hello");
+    // more compressed data after the final block of the same message is a new stream too
+    std::vector<uint8_t> joined = rawDeflate("hello ", true);
+    std::vector<uint8_t> rest = rawDeflate("world", false);
+    joined.insert(joined.end(), rest.begin(), rest.end());
+    REQUIRE(decompress(*receiver, joined, text));
+    CHECK(text == "hello world");
+    // the next message starts from an empty window
+    REQUIRE(decompress(*receiver, rawDeflate("again", false), text));
+    CHECK(text == "again");
+    // but not garbage, 0xff is a block of the reserved type 3
+    std::vector<uint8_t> garbage = rawDeflate("hello", true);
+    garbage.push_back(0xff);
+    CHECK(!decompress(*receiver, garbage, text));
+}
@@ -0,0 +1,586 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// Runs WebSocket-okhttp_android.cpp and JniHelper.cpp on the fake JVM: every JNI call is checked like CheckJNI
+// does, and the tests also check that no local or global reference leaks.
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "Check.h"
+#include "FakeConnection.h"
+#include "platform/android/jni/JniHelper.h"
+
+using cocos2d::network::WebSocket;
+using fakejni::CocosWebSocket;
+using fakejni::Vm;
+
+namespace {
+
+// what the last call to a method of org/cocos2dx/bench/Sink received
+std::vector<std::string> g_sunk;
+
+void defineSink() {
+    static bool defined = false;
+    if (defined) {
+        return;
+    }
+    defined = true;
+    fakejni::Class *sink = Vm::get().defineClass("org/cocos2dx/bench/Sink");
+    auto record = [](std::string value) {
+        g_sunk.push_back(std::move(value));
+        jvalue result;
+        result.j = 0;
+        return result;
+    };
+    for (int i = 0; i < 200; ++i) {
+        sink->addStaticMethod("m" + std::to_string(i), "()V", [record](JNIEnv *, fakejni::Object *, const jvalue *) {
+            return record("m");
+        });
+    }
+    sink->addStaticMethod("take", "(Ljava/lang/String;I)V", [record](JNIEnv *, fakejni::Object *, const jvalue *args) {
+        return record(fakejni::fromRef<fakejni::String>(args[0].l)->toUTF8() + "#" + std::to_string(args[1].i));
+    });
+    sink->addStaticMethod("take", "([Ljava/lang/String;)V", [record](JNIEnv *, fakejni::Object *, const jvalue *args) {
+        auto *array = fakejni::fromRef<fakejni::ObjectArray>(args[0].l);
+        std::string joined;
+        for (jsize i = 0; i < array->getLength(); ++i) {
+            joined += static_cast<fakejni::String *>(array->get(i))->toUTF8() + ";";
+        }
+        return record(joined);
+    });
+    sink->addStaticMethod("take", "([B)V", [record](JNIEnv *, fakejni::Object *, const jvalue *args) {
+        auto *array = fakejni::fromRef<fakejni::PrimitiveArray>(args[0].l);
+        return record(std::string(reinterpret_cast<const char *>(array->getData()), array->getLength()));
+    });
+    sink->addStaticMethod("take", "([F)V", [record](JNIEnv *, fakejni::Object *, const jvalue *args) {
+        auto *array = fakejni::fromRef<fakejni::PrimitiveArray>(args[0].l);
+        std::string joined;
+        for (jsize i = 0; i < array->getLength(); ++i) {
+            joined += std::to_string(reinterpret_cast<const float *>(array->getData())[i]) + ";";
+        }
+        return record(joined);
+    });
+}
+
+// references the engine holds for good: the JniHelper class cache, the pools and the class of NativeInit
+struct References {
+    int64_t local;
+    int64_t global;
+};
+
+References references() {
+    fakejni::Stats stats = Vm::get().getStats();
+    return {stats.localRefs, stats.globalRefs};
+}
+
+// retries twice, 10 ms and then 20 ms after a failure
+WebSocket::Options reconnectOptions() {
+    WebSocket::Options options;
+    options.reconnect.enabled = true;
+    options.reconnect.maxAttempts = 2;
+    options.reconnect.initialDelay = 0.01F;
+    options.reconnect.jitter = 0;
+    return options;
+}
+
+bool near(float a, float b) {
+    return std::fabs(a - b) < 1e-6F;
+}
+
+} // namespace
+
+TEST(initConnectsTheJavaSocket) {
+    std::vector<std::string> protocols{"chat", "superchat"};
+    host::RecordingDelegate delegate;
+    {
+        WebSocket socket;
+        REQUIRE(socket.init(delegate, "wss://example.com/socket", &protocols, "certs/ca.pem"));
+        CocosWebSocket *java = CocosWebSocket::getLastInstance();
+        REQUIRE(java != nullptr);
+        CHECK(java->getHandle() != 0);
+        CHECK(java->getConnectCount() == 1);
+        CHECK(java->getUrl() == "wss://example.com/socket");
+        CHECK(java->getProtocols() == "chat, superchat");
+        CHECK(java->getCaFilePath() == "certs/ca.pem");
+        CHECK(socket.getReadyState() == WebSocket::State::CONNECTING);
+    }
+    CHECK(CocosWebSocket::getLastInstance()->getHandle() == 0);
+}
+
+TEST(invalidUrlReportsAnError) {
+    host::RecordingDelegate delegate;
+    WebSocket socket;
+    REQUIRE(socket.init(delegate, "http//broken", nullptr, ""));
+    host::runFrame();
+    CHECK(delegate.errors == 1);
+    CHECK(delegate.closed == 1);
+    CHECK(socket.getReadyState() == WebSocket::State::CLOSED);
+}
+
+TEST(openParsesTheResponseHeaders) {
+    host::FakeConnection connection({}, false);
+    connection.java->onOpen("http/1.1",
+                            "Upgrade: websocket\nSec-WebSocket-Extensions: x-test\nSec-WebSocket-Accept: abc=\n", true);
+    CHECK(connection.delegate.opened == 0); // delivered on the game thread
+    host::runFrame();
+    CHECK(connection.delegate.opened == 1);
+    CHECK(connection.socket().getReadyState() == WebSocket::State::OPEN);
+    CHECK(connection.socket().getResponseHeader("sec-websocket-accept") == "abc=");
+    CHECK(connection.socket().getExtensions() == "x-test");
+    CHECK(connection.socket().getHandshakeInfo().secure);
+    CHECK(connection.socket().getHandshakeInfo().tlsRoundTrips == 2);
+}
+
+TEST(sendsReachJavaInOrder) {
+    host::FakeConnection connection;
+    connection.java->setRecording(true);
+    const unsigned char binary[] = {0, 1, 2, 0xFF};
+    connection.socket().send("h\xC3\xA9llo \xF0\x9F\x98\x80");
+    connection.socket().send(binary, sizeof(binary));
+    std::string large(100000, 'x');
+    connection.socket().send(reinterpret_cast<const unsigned char *>(large.data()), large.size());
+    WebSocket::OutgoingMessage batch[] = {
+        {reinterpret_cast<const unsigned char *>("one"), 3, false},
+        {binary, sizeof(binary), true},
+        {reinterpret_cast<const unsigned char *>(""), 0, false},
+    };
+    connection.socket().sendBatch(batch, 3);
+
+    std::vector<fakejni::SentFrame> frames = connection.java->takeSentFrames();
+    REQUIRE(frames.size() == 6);
+    CHECK(!frames[0].isBinary && frames[0].payload == "h\xC3\xA9llo \xF0\x9F\x98\x80");
+    CHECK(frames[1].isBinary && frames[1].payload == std::string("\0\1\2\xFF", 4));
+    CHECK(frames[2].isBinary && frames[2].payload == large);
+    CHECK(!frames[3].isBinary && frames[3].payload == "one");
+    CHECK(frames[4].isBinary && frames[4].payload == std::string("\0\1\2\xFF", 4));
+    CHECK(!frames[5].isBinary && frames[5].payload.empty());
+    WebSocket::Metrics metrics = connection.socket().getMetrics();
+    CHECK(metrics.messagesSent == 6 && metrics.binaryMessagesSent == 3);
+    // the 4096 byte minimum, grown for the large message, the batch fits
+    CHECK(metrics.sendBufferAllocations == 2);
+}
+
+TEST(sendsReportTheBufferedAmount) {
+    WebSocket::Options options;
+    options.bufferedAmountHighWaterMark = 1000;
+    options.bufferedAmountLowWaterMark = 100;
+    host::FakeConnection connection(options);
+    connection.java->setQueueSize(4096);
+    connection.socket().send("a");
+    CHECK(connection.socket().getBufferedAmount() == 4096);
+    host::runFrame();
+    CHECK(connection.delegate.high == 1);
+    connection.java->setQueueSize(0);
+    connection.socket().send("b");
+    host::runFrame();
+    CHECK(connection.socket().getBufferedAmount() == 0);
+    CHECK(connection.delegate.low == 1);
+}
+
+TEST(messagesFromTheReaderThreadArriveOnTheGameThread) {
+    host::FakeConnection connection;
+    connection.delegate.recording = true;
+    std::string text = "caf\xC3\xA9 \xE2\x82\xAC";
+    std::string large(5 * 1024 * 1024, 'y'); // above the largest pooled receive buffer
+    std::string binary("\0\x80\xFF", 3);
+    std::thread reader([&]() {
+        fakejni::JavaThread thread;
+        connection.java->onMessage(text);
+        connection.java->onMessage(reinterpret_cast<const uint8_t *>(binary.data()), binary.size());
+        connection.java->onMessage(large);
+        connection.java->onMessage(std::string());
+    });
+    reader.join();
+    CHECK(host::runFramesUntil([&]() { return connection.delegate.received == 4; }, 1000));
+    REQUIRE(connection.delegate.messages.size() == 4);
+    CHECK(!connection.delegate.messages[0].isBinary && connection.delegate.messages[0].payload == text);
+    CHECK(connection.delegate.messages[0].terminated);
+    CHECK(connection.delegate.messages[1].isBinary && connection.delegate.messages[1].payload == binary);
+    CHECK(connection.delegate.messages[2].payload == large && connection.delegate.messages[2].terminated);
+    CHECK(connection.delegate.messages[3].payload.empty() && connection.delegate.messages[3].terminated);
+}
+
+TEST(transportThreadDeliveryIsInOrderOnTheReaderThread) {
+    WebSocket::Options options;
+    options.messageDelivery = WebSocket::MessageDelivery::TRANSPORT_THREAD;
+    host::FakeConnection connection(options);
+    connection.delegate.recording = true;
+    std::thread::id readerId;
+    std::thread reader([&]() {
+        fakejni::JavaThread thread;
+        readerId = std::this_thread::get_id();
+        for (int i = 0; i < 100; ++i) {
+            std::string payload = std::to_string(i);
+            if (i % 2 == 0) {
+                connection.java->onMessage(payload);
+            } else {
+                connection.java->onMessage(reinterpret_cast<const uint8_t *>(payload.data()), payload.size());
+            }
+        }
+    });
+    reader.join();
+    // delivered before the reader returned, no frame ran
+    REQUIRE(connection.delegate.messages.size() == 100);
+    for (int i = 0; i < 100; ++i) {
+        const host::RecordingDelegate::Message &message = connection.delegate.messages[i];
+        CHECK(message.payload == std::to_string(i));
+        CHECK(message.isBinary == (i % 2 != 0));
+        CHECK(message.isBinary || message.terminated);
+        CHECK(message.thread == readerId);
+    }
+    host::runFrame();
+    CHECK(connection.delegate.received == 100);
+}
+
+TEST(destructionWaitsForATransportThreadOnMessage) {
+    WebSocket::Options options;
+    options.messageDelivery = WebSocket::MessageDelivery::TRANSPORT_THREAD;
+    std::unique_ptr<host::FakeConnection> connection(new host::FakeConnection(options));
+    CocosWebSocket *java = connection->java;
+    std::atomic<bool> inside{false};
+    std::atomic<bool> release{false};
+    std::atomic<bool> returned{false};
+    std::atomic<bool> destroyed{false};
+    std::atomic<bool> destroyedTooEarly{false};
+    connection->delegate.whenReceived = [&](WebSocket * /*ws*/) {
+        inside = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+        returned = true;
+    };
+    std::thread reader([&]() {
+        fakejni::JavaThread thread;
+        java->onMessage("slow");
+        // the handle is gone now
+        java->onMessage("late");
+    });
+    while (!inside) {
+        std::this_thread::yield();
+    }
+    std::thread releaser([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        destroyedTooEarly = destroyed.load();
+        release = true;
+    });
+    connection.reset();
+    destroyed = true;
+    CHECK(returned);
+    releaser.join();
+    reader.join();
+    CHECK(!destroyedTooEarly);
+}
+
+TEST(closeAndErrorReachTheDelegate) {
+    {
+        host::FakeConnection connection;
+        connection.socket().closeAsync(4000, "bye");
+        CHECK(connection.java->isCloseRequested());
+        CHECK(connection.java->getCloseCode() == 4000);
+        CHECK(connection.java->getCloseReason() == "bye");
+        CHECK(connection.socket().getReadyState() == WebSocket::State::CLOSING);
+        connection.java->onClosed(4000, "bye");
+        host::runFrame();
+        CHECK(connection.delegate.closed == 1);
+        CHECK(connection.socket().getReadyState() == WebSocket::State::CLOSED);
+    }
+    {
+        host::FakeConnection connection;
+        connection.java->onFailure("no pong within 5000ms", true);
+        host::runFrame();
+        CHECK(connection.delegate.errors == 1);
+        CHECK(connection.delegate.lastError == WebSocket::ErrorCode::TIME_OUT);
+        CHECK(connection.delegate.closed == 1);
+    }
+}
+
+TEST(errorsReconnectWithGrowingDelays) {
+    host::FakeConnection connection(reconnectOptions());
+    connection.java->onFailure("connection reset");
+    host::runFrame();
+    CHECK(connection.delegate.errors == 0);
+    CHECK(connection.delegate.closed == 0);
+    CHECK(connection.delegate.reconnecting == 1);
+    CHECK(connection.delegate.lastAttempt == 1);
+    CHECK(near(connection.delegate.lastDelay, 0.01F));
+    CHECK(connection.socket().getReadyState() == WebSocket::State::CONNECTING);
+    REQUIRE(host::runFramesUntil([&]() { return connection.java->getConnectCount() == 2; }, 1000));
+
+    connection.java->onClosed(1001, "going away");
+    host::runFrame();
+    CHECK(connection.delegate.closed == 0);
+    CHECK(connection.delegate.lastAttempt == 2);
+    CHECK(near(connection.delegate.lastDelay, 0.02F));
+    REQUIRE(host::runFramesUntil([&]() { return connection.java->getConnectCount() == 3; }, 1000));
+    connection.java->onOpen("http/1.1", "Upgrade: websocket\n");
+    host::runFrame();
+    CHECK(connection.delegate.opened == 2);
+    CHECK(connection.socket().getReadyState() == WebSocket::State::OPEN);
+    CHECK(connection.socket().getMetrics().reconnects == 2);
+
+    // an open connection starts counting again, then gives up after maxAttempts
+    connection.java->onFailure("connection reset");
+    host::runFrame();
+    CHECK(connection.delegate.lastAttempt == 1);
+    for (int attempt = 2; attempt <= 3; ++attempt) {
+        REQUIRE(host::runFramesUntil([&]() { return connection.java->getConnectCount() == 2 + attempt; }, 1000));
+        connection.java->onFailure("connection refused");
+        host::runFrame();
+    }
+    CHECK(connection.delegate.reconnecting == 4);
+    CHECK(connection.delegate.errors == 1);
+    CHECK(connection.delegate.closed == 1);
+    CHECK(connection.socket().getReadyState() == WebSocket::State::CLOSED);
+}
+
+TEST(messagesQueuedWhileConnectingGoOutBeforeOnOpen) {
+    host::RecordingDelegate delegate;
+    delegate.whenOpened = [](WebSocket *ws) { ws->send("from onOpen"); };
+    WebSocket socket;
+    REQUIRE(socket.init(delegate, "ws://127.0.0.1:8080/echo", nullptr, "", reconnectOptions()));
+    CocosWebSocket *java = CocosWebSocket::getLastInstance();
+    java->setRecording(true);
+    const unsigned char binary[] = {1, 0, 2};
+    socket.send("first");
+    socket.send(binary, sizeof(binary));
+    socket.send("second");
+    CHECK(java->takeSentFrames().empty());
+    java->onOpen("http/1.1", "Upgrade: websocket\n");
+    host::runFrame();
+    std::vector<fakejni::SentFrame> frames = java->takeSentFrames();
+    REQUIRE(frames.size() == 4);
+    CHECK(!frames[0].isBinary && frames[0].payload == "first");
+    CHECK(frames[1].isBinary && frames[1].payload == std::string("\1\0\2", 3));
+    CHECK(!frames[2].isBinary && frames[2].payload == "second");
+    CHECK(frames[3].payload == "from onOpen");
+
+    // and again on the connection which replaces a lost one
+    java->onFailure("connection reset");
+    host::runFrame();
+    socket.send("while reconnecting");
+    REQUIRE(host::runFramesUntil([&]() { return java->getConnectCount() == 2; }, 1000));
+    java->onOpen("http/1.1", "Upgrade: websocket\n");
+    host::runFrame();
+    frames = java->takeSentFrames();
+    REQUIRE(frames.size() == 2);
+    CHECK(frames[0].payload == "while reconnecting");
+    CHECK(frames[1].payload == "from onOpen");
+}
+
+TEST(closeAsyncDropsTheQueueAndTheReconnect) {
+    host::FakeConnection connection(reconnectOptions());
+    connection.java->setRecording(true);
+    connection.java->onFailure("connection reset");
+    host::runFrame();
+    REQUIRE(connection.delegate.reconnecting == 1);
+    connection.socket().send("dropped");
+    connection.socket().closeAsync();
+    host::runFrame();
+    CHECK(connection.delegate.closed == 1);
+    CHECK(connection.delegate.errors == 0);
+    CHECK(connection.socket().getReadyState() == WebSocket::State::CLOSED);
+    // well past the reconnect delay
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    host::runFrame();
+    CHECK(connection.java->getConnectCount() == 1);
+    connection.socket().send("after close");
+    CHECK(connection.java->takeSentFrames().empty());
+}
+
+TEST(callbacksAfterDestructionAreIgnored) {
+    CocosWebSocket *java;
+    {
+        host::FakeConnection connection;
+        java = connection.java;
+    }
+    CHECK(java->getHandle() == 0);
+    java->onMessage("late");
+    java->onMessage(reinterpret_cast<const uint8_t *>("late"), 4);
+    java->onClosed(1000, "late");
+    host::runFrame();
+}
+
+TEST(noReferenceLeaks) {
+    { host::FakeConnection warmUp; } // the lazily created class, method and pool references
+    References before = references();
+    {
+        host::FakeConnection connection;
+        const unsigned char binary[] = {1, 2, 3};
+        for (int i = 0; i < 100; ++i) {
+            connection.socket().send("text");
+            connection.socket().send(binary, sizeof(binary));
+            connection.java->onMessage("text");
+            connection.java->onMessage(binary, sizeof(binary));
+            host::runFrame();
+        }
+        CHECK(connection.delegate.received == 200);
+        CHECK(references().local == before.local);
+        connection.socket().closeAsync();
+        connection.java->onClosed(1000, "normal closure");
+        host::runFrame();
+    }
+    References after = references();
+    CHECK(after.local == before.local);
+    // the receive buffers stay pooled
+    CHECK(after.global <= before.global + 2);
+}
+
+TEST(steadyStateBinarySendsDoNotAllocate) {
+    host::FakeConnection connection;
+    std::string payload(64 * 1024, 'b');
+    auto data = reinterpret_cast<const unsigned char *>(payload.data());
+    // the first send grows the send buffer to the largest message
+    connection.socket().send(data, static_cast<unsigned int>(payload.size()));
+    host::AllocationCounts before = host::getNativeAllocations();
+    uint64_t javaBefore = Vm::get().getStats().javaAllocations;
+    for (unsigned int len : {1U, 100U, 4096U, 65536U}) {
+        for (int i = 0; i < 25; ++i) {
+            connection.socket().send(data, len);
+        }
+    }
+    CHECK(host::getNativeAllocations().count == before.count);
+    CHECK(connection.socket().getMetrics().sendBufferAllocations == 1);
+    // per message the ByteString and the byte[] of ByteString.of(ByteBuffer), and OkHttp's Message
+    CHECK(Vm::get().getStats().javaAllocations - javaBefore == 100 * 3);
+}
+
+TEST(workerThreadsAreAttachedOnceAndDetachedOnExit) {
+    fakejni::Stats before = Vm::get().getStats();
+    JNIEnv *first = nullptr;
+    JNIEnv *second = nullptr;
+    std::thread worker([&]() {
+        first = cocos2d::JniHelper::getEnv();
+        second = cocos2d::JniHelper::getEnv();
+    });
+    worker.join();
+    fakejni::Stats after = Vm::get().getStats();
+    CHECK(first != nullptr);
+    CHECK(second == first);
+    CHECK(after.attaches == before.attaches + 1);
+    CHECK(after.detaches == before.detaches + 1);
+}
+
+TEST(threadsAttachedByJavaKeepTheirAttachment) {
+    fakejni::Stats before = Vm::get().getStats();
+    std::thread worker([]() {
+        fakejni::JavaThread javaThread;
+        CHECK(cocos2d::JniHelper::getEnv() == javaThread.getEnv());
+        CHECK(cocos2d::JniHelper::getEnv() == javaThread.getEnv());
+    });
+    worker.join();
+    fakejni::Stats after = Vm::get().getStats();
+    // only the JavaThread attached and detached
+    CHECK(after.attaches == before.attaches + 1);
+    CHECK(after.detaches == before.detaches + 1);
+}
+
+TEST(preloadCAFileCallsJava) {
+    WebSocket::preloadCAFile("certs/ca.pem");
+    std::vector<std::string> files = CocosWebSocket::getPreloadedCAFiles();
+    REQUIRE(!files.empty());
+    CHECK(files.back() == "certs/ca.pem");
+}
+
+TEST(jniHelperConvertsArguments) {
+    defineSink();
+    const char *sink = "org/cocos2dx/bench/Sink";
+    const unsigned char bytes[] = {'b', 0, 'c'};
+    char mutableChars[] = "chars";
+    auto callAll = [&]() {
+        g_sunk.clear();
+        cocos2d::JniHelper::callStaticVoidMethod(sink, "take", std::string("caf\xC3\xA9"), 7);
+        cocos2d::JniHelper::callStaticVoidMethod(sink, "take", "ascii", 8);
+        cocos2d::JniHelper::callStaticVoidMethod(sink, "take", mutableChars, 9);
+        cocos2d::JniHelper::callStaticVoidMethod(sink, "take", std::vector<std::string>{"a", "\xE2\x82\xAC"});
+        cocos2d::JniHelper::callStaticVoidMethod(sink, "take", std::make_pair(bytes, sizeof(bytes)));
+        cocos2d::JniHelper::callStaticVoidMethod(sink, "take", std::vector<float>{0.5F, 2.0F});
+    };
+    callAll(); // caches the classes of Sink and String
+    References before = references();
+    callAll();
+    References after = references();
+    REQUIRE(g_sunk.size() == 6);
+    CHECK(g_sunk[0] == "caf\xC3\xA9#7");
+    CHECK(g_sunk[1] == "ascii#8");
+    CHECK(g_sunk[2] == "chars#9");
+    CHECK(g_sunk[3] == "a;\xE2\x82\xAC;");
+    CHECK(g_sunk[4] == std::string("b\0c", 3));
+    CHECK(g_sunk[5] == "0.500000;2.000000;");
+    CHECK(after.local == before.local);
+    CHECK(after.global == before.global);
+}
+
+TEST(classLoaderChangesFreeTheReferencesTheyReplaced) {
+    defineSink();
+    const char *sink = "org/cocos2dx/bench/Sink";
+    jobject activity = reinterpret_cast<jobject>(Vm::get().getActivity());
+    auto change = [&]() {
+        REQUIRE(cocos2d::JniHelper::setClassLoaderFrom(activity));
+        g_sunk.clear();
+        cocos2d::JniHelper::callStaticVoidMethod(sink, "take", "after", 1);
+        REQUIRE(g_sunk.size() == 1);
+        CHECK(g_sunk[0] == "after#1");
+    };
+    // the first change retires whatever the earlier tests cached, the second frees it
+    change();
+    change();
+    References before = references();
+    // each change keeps the previous generation alive and frees the one before it
+    for (int i = 0; i < 3; ++i) {
+        change();
+        CHECK(references().global == before.global);
+    }
+}
+
+TEST(cachedMethodLookupsRaceWithTheirResolution) {
+    defineSink();
+    const char *sink = "org/cocos2dx/bench/Sink";
+    std::atomic<int> found{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            // enough distinct methods to grow the table while the other threads read it
+            for (int i = 0; i < 200; ++i) {
+                cocos2d::JniMethodInfo info;
+                std::string name = "m" + std::to_string((i + t * 50) % 200);
+                if (cocos2d::JniHelper::getCachedStaticMethodInfo(info, sink, name.c_str(), "()V") &&
+                    info.methodID == cocos2d::JniHelper::getEnv()->GetStaticMethodID(info.classID, name.c_str(), "()V")) {
+                    ++found;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    CHECK(found == 800);
+}
+
+int main(int argc, char **argv) {
+    CocosWebSocket::install();
+    return check::runTests(argc, argv);
+}
@@ -0,0 +1,207 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// Runs WebSocket-native.cpp through the public WebSocket API against the echo server on 127.0.0.1, for what needs
+// a real peer: a peer which stops answering pings, and messages delivered on the network thread.
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Check.h"
+#include "EchoServer.h"
+#include "HostEngine.h"
+#include "network/WebSocket.h"
+
+using cocos2d::network::WebSocket;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int OPEN_TIMEOUT_MS = 5000;
+
+host::EchoServer g_server;
+
+std::string echoUrl() {
+    return "ws://127.0.0.1:" + std::to_string(g_server.getPort()) + "/echo";
+}
+
+// onMessage may run on the network thread, the rest on the game thread
+class Delegate : public WebSocket::Delegate {
+public:
+    struct Message {
+        std::string payload;
+        std::thread::id thread;
+    };
+
+    void onOpen(WebSocket * /*ws*/) override { ++opened; }
+    void onMessage(WebSocket * /*ws*/, const WebSocket::Data &data) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            messages.push_back({std::string(data.bytes, static_cast<size_t>(data.len)), std::this_thread::get_id()});
+        }
+        if (whenReceived) {
+            whenReceived();
+        }
+        ++received;
+    }
+    void onClose(WebSocket * /*ws*/) override { ++closed; }
+    void onError(WebSocket * /*ws*/, const WebSocket::ErrorCode &error) override {
+        ++errors;
+        lastError = error;
+    }
+
+    std::function<void()> whenReceived; // called from onMessage if set
+    std::mutex mutex;
+    std::vector<Message> messages; // guarded by mutex
+    int opened{0};
+    std::atomic<int> received{0};
+    int closed{0};
+    int errors{0};
+    WebSocket::ErrorCode lastError{WebSocket::ErrorCode::UNKNOWN};
+};
+
+} // namespace
+
+TEST(pongsAreMeasuredAndTheirAbsenceTimesOut) {
+    WebSocket::Options options;
+    options.pingInterval = 0.05F;
+    options.deadPeerTimeout = 0.2F;
+    Delegate delegate;
+    WebSocket socket;
+    REQUIRE(socket.init(delegate, echoUrl(), nullptr, "", options));
+    REQUIRE(host::runFramesUntil([&]() { return delegate.opened == 1; }, OPEN_TIMEOUT_MS));
+    REQUIRE(host::runFramesUntil([&]() { return socket.getRoundTripTime().samples >= 3; }, 2000));
+    WebSocket::RoundTripTime rtt = socket.getRoundTripTime();
+    CHECK(rtt.min >= 0 && rtt.min <= rtt.avg && rtt.min <= rtt.p95);
+    CHECK(rtt.p95 < options.deadPeerTimeout * 1000);
+
+    // the connection stays open, only the pongs stop
+    g_server.setAnswerPings(false);
+    Clock::time_point silent = Clock::now();
+    bool failed = host::runFramesUntil([&]() { return delegate.errors != 0; }, 5000);
+    g_server.setAnswerPings(true);
+    REQUIRE(failed);
+    // a ping in flight when the pongs stopped may be the one that times out, hence not the full timeout
+    CHECK(Clock::now() - silent >= std::chrono::milliseconds(100));
+    CHECK(delegate.errors == 1);
+    CHECK(delegate.lastError == WebSocket::ErrorCode::TIME_OUT);
+    CHECK(host::runFramesUntil([&]() { return delegate.closed == 1; }, 1000));
+    CHECK(socket.getReadyState() == WebSocket::State::CLOSED);
+}
+
+TEST(answeredPingsKeepTheConnectionOpen) {
+    WebSocket::Options options;
+    options.pingInterval = 0.02F;
+    options.deadPeerTimeout = 0.5F;
+    Delegate delegate;
+    WebSocket socket;
+    REQUIRE(socket.init(delegate, echoUrl(), nullptr, "", options));
+    REQUIRE(host::runFramesUntil([&]() { return delegate.opened == 1; }, OPEN_TIMEOUT_MS));
+    // several timeouts long
+    host::runFramesUntil([]() { return false; }, 1500);
+    CHECK(delegate.errors == 0);
+    CHECK(socket.getReadyState() == WebSocket::State::OPEN);
+    CHECK(socket.getRoundTripTime().samples >= 10);
+    socket.close();
+    CHECK(host::runFramesUntil([&]() { return delegate.closed == 1; }, 1000));
+}
+
+TEST(transportThreadDeliveryIsInOrderOffTheGameThread) {
+    WebSocket::Options options;
+    options.messageDelivery = WebSocket::MessageDelivery::TRANSPORT_THREAD;
+    Delegate delegate;
+    WebSocket socket;
+    REQUIRE(socket.init(delegate, echoUrl(), nullptr, "", options));
+    REQUIRE(host::runFramesUntil([&]() { return delegate.opened == 1; }, OPEN_TIMEOUT_MS));
+    for (int i = 0; i < 200; ++i) {
+        socket.send(std::to_string(i));
+    }
+    REQUIRE(host::runFramesUntil([&]() { return delegate.received == 200; }, 5000));
+    {
+        std::lock_guard<std::mutex> lock(delegate.mutex);
+        for (int i = 0; i < 200; ++i) {
+            CHECK(delegate.messages[i].payload == std::to_string(i));
+            CHECK(delegate.messages[i].thread != std::this_thread::get_id());
+            CHECK(delegate.messages[i].thread == delegate.messages[0].thread);
+        }
+    }
+    socket.close();
+    CHECK(host::runFramesUntil([&]() { return delegate.closed == 1; }, 1000));
+}
+
+TEST(destructionWaitsForATransportThreadOnMessage) {
+    WebSocket::Options options;
+    options.messageDelivery = WebSocket::MessageDelivery::TRANSPORT_THREAD;
+    Delegate delegate;
+    std::unique_ptr<WebSocket> socket(new WebSocket());
+    REQUIRE(socket->init(delegate, echoUrl(), nullptr, "", options));
+    REQUIRE(host::runFramesUntil([&]() { return delegate.opened == 1; }, OPEN_TIMEOUT_MS));
+    std::atomic<bool> inside{false};
+    std::atomic<bool> release{false};
+    std::atomic<bool> destroyed{false};
+    std::atomic<bool> destroyedTooEarly{false};
+    delegate.whenReceived = [&]() {
+        inside = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+    };
+    socket->send("slow");
+    REQUIRE(host::runFramesUntil([&]() { return inside.load(); }, 5000));
+    std::thread releaser([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        destroyedTooEarly = destroyed.load();
+        release = true;
+    });
+    socket.reset();
+    destroyed = true;
+    // onMessage counts the message once the hook returned
+    CHECK(delegate.received == 1);
+    releaser.join();
+    CHECK(!destroyedTooEarly);
+    // and nothing reaches the delegate of the destroyed socket
+    host::runFramesUntil([]() { return false; }, 100);
+    CHECK(delegate.received == 1);
+    CHECK(delegate.closed == 0);
+}
+
+int main(int argc, char **argv) {
+    const char *tmp = getenv("TMPDIR");
+    std::string caFilePath = std::string(tmp != nullptr ? tmp : "/tmp") + "/ws_loopback_test_ca_" +
+                             std::to_string(getpid()) + ".pem";
+    if (!g_server.start(0, 0, caFilePath)) {
+        return 1;
+    }
+    int result = check::runTests(argc, argv);
+    g_server.stop();
+    unlink(caFilePath.c_str());
+    return result;
+}
@@ -0,0 +1,562 @@
+/****************************************************************************
+ Copyright (c) 2020 Xiamen Yaji Software Co., Ltd.
+
+ http://www.cocos2d-x.org
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ****************************************************************************/
+// Checks the helpers of WebSocketUtils. The vectorized frame masking and UTF-8 validation are compared with plain
+// byte loops, at every length and alignment around the vector widths, so that multi-byte characters straddle the
+// block boundaries. Only the path the CPU selects is covered: AVX2 where available, SSE2 otherwise. NEON needs an
+// ARM host.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "network/WebSocketUtils.h"
+
+using cocos2d::network::WebSocket;
+using cocos2d::network::WebSocketUtils::applyMask;
+using cocos2d::network::WebSocketUtils::getReconnectDelay;
+using cocos2d::network::WebSocketUtils::LatencyHistogram;
+using cocos2d::network::WebSocketUtils::MetricsRecorder;
+using cocos2d::network::WebSocketUtils::RoundTripEstimator;
+using Table = cocos2d::network::WebSocketUtils::HandleTable<int>;
+using cocos2d::network::WebSocketUtils::isValidUTF8;
+
+namespace {
+
+void referenceMask(uint8_t *data, size_t len, const uint8_t key[4]) {
+    for (size_t i = 0; i < len; ++i) {
+        data[i] ^= key[i & 3];
+    }
+}
+
+// decodes every sequence, RFC 3629
+bool referenceIsValidUTF8(const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        uint8_t c = data[i];
+        size_t extra;
+        uint32_t codePoint;
+        uint32_t minimum;
+        if (c < 0x80) {
+            ++i;
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            extra = 1;
+            codePoint = c & 0x1F;
+            minimum = 0x80;
+        } else if ((c & 0xF0) == 0xE0) {
+            extra = 2;
+            codePoint = c & 0x0F;
+            minimum = 0x800;
+        } else if ((c & 0xF8) == 0xF0) {
+            extra = 3;
+            codePoint = c & 0x07;
+            minimum = 0x10000;
+        } else {
+            return false;
+        }
+        if (len - i <= extra) {
+            return false;
+        }
+        for (size_t k = 1; k <= extra; ++k) {
+            if ((data[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (data[i + k] & 0x3F);
+        }
+        if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+            return false;
+        }
+        i += extra + 1;
+    }
+    return true;
+}
+
+bool isValid(const std::string &text) {
+    return isValidUTF8(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+}
+
+bool isValidByReference(const std::string &text) {
+    return referenceIsValidUTF8(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+}
+
+// ASCII, then 2, 3 and 4 byte characters and the boundaries between the lengths
+const char *VALID_TEXT = "{\"chat\":\"h\xC3\xA9llo \xE4\xBD\xA0\xE5\xA5\xBD \xF0\x9F\x98\x80\","
+                         "\"edges\":\"\x7F\xC2\x80\xDF\xBF\xE0\xA0\x80\xEF\xBF\xBF\xF0\x90\x80\x80\xF4\x8F\xBF\xBF\"}";
+
+const char *MALFORMED[] = {
+    "\x80",             // continuation without a lead byte
+    "\xC0\x80",         // overlong NUL
+    "\xC1\xBF",         // overlong 2 bytes
+    "\xE0\x80\x80",     // overlong 3 bytes
+    "\xE0\x9F\xBF",     // overlong U+07FF
+    "\xF0\x80\x80\x80", // overlong 4 bytes
+    "\xF0\x8F\xBF\xBF", // overlong U+FFFF
+    "\xED\xA0\x80",     // high surrogate
+    "\xED\xBF\xBF",     // low surrogate
+    "\xF4\x90\x80\x80", // above U+10FFFF
+    "\xF5\x80\x80\x80", // lead byte above U+10FFFF
+    "\xF8\x88\x80\x80\x80",
+    "\xFF",
+    "\xC3",             // truncated
+    "\xE4\xBD",         // truncated
+    "\xF0\x9F\x98",     // truncated
+    "\xC3\x28",         // continuation missing
+    "\xE4\x28\xA0",
+    "\xF0\x9F\x28\x80",
+};
+
+} // namespace
+
+TEST(maskMatchesTheByteLoop) {
+    std::mt19937 random(1);
+    std::vector<uint8_t> buffer(70000);
+    for (auto &byte : buffer) {
+        byte = static_cast<uint8_t>(random());
+    }
+    std::vector<size_t> lengths;
+    for (size_t len = 0; len <= 260; ++len) {
+        lengths.push_back(len);
+    }
+    for (size_t len : {4095, 4096, 4097, 65536, 65539}) {
+        lengths.push_back(len);
+    }
+    for (size_t len : lengths) {
+        for (size_t offset = 0; offset < 4; ++offset) {
+            const uint8_t key[4] = {static_cast<uint8_t>(random()), static_cast<uint8_t>(random()),
+                                    static_cast<uint8_t>(random()), static_cast<uint8_t>(random())};
+            std::vector<uint8_t> expected(buffer.begin(), buffer.begin() + len + offset + 1);
+            std::vector<uint8_t> actual(expected);
+            referenceMask(expected.data() + offset, len, key);
+            applyMask(actual.data() + offset, len, key);
+            REQUIRE(actual == expected);
+            // its own inverse
+            applyMask(actual.data() + offset, len, key);
+            REQUIRE(std::equal(actual.begin(), actual.end(), buffer.begin()));
+        }
+    }
+}
+
+TEST(utf8AcceptsValidTextAtEveryOffset) {
+    std::string text = VALID_TEXT;
+    CHECK(isValidByReference(text));
+    for (size_t padding = 0; padding < 70; ++padding) {
+        std::string padded = std::string(padding, 'a') + text + std::string(padding % 7, 'z');
+        REQUIRE(isValid(padded));
+        REQUIRE(isValid(padded + padded + padded));
+    }
+    CHECK(isValid(""));
+}
+
+TEST(utf8RejectsMalformedTextAtEveryOffset) {
+    for (const char *malformed : MALFORMED) {
+        std::string sequence = malformed;
+        CHECK(!isValidByReference(sequence));
+        for (size_t padding = 0; padding < 70; ++padding) {
+            std::string text = std::string(padding, 'a') + sequence;
+            REQUIRE(!isValid(text));
+            // in the middle of a long valid text, not only at the end
+            std::string embedded = text + std::string(VALID_TEXT) + std::string(64, 'b');
+            REQUIRE(!isValid(embedded));
+        }
+    }
+}
+
+TEST(utf8MatchesTheByteLoopOnCorruptedText) {
+    std::mt19937 random(2);
+    std::string valid;
+    while (valid.size() < 300) {
+        valid += VALID_TEXT;
+    }
+    for (int round = 0; round < 50000; ++round) {
+        size_t len = random() % valid.size();
+        size_t begin = random() % (valid.size() - len);
+        std::string text = valid.substr(begin, len);
+        for (int flips = random() % 3; flips > 0 && !text.empty(); --flips) {
+            text[random() % text.size()] = static_cast<char>(random());
+        }
+        if (isValid(text) != isValidByReference(text)) {
+            fprintf(stderr, "differs on a text of %zu bytes, round %d\n", text.size(), round);
+            REQUIRE(false);
+        }
+    }
+}
+
+TEST(reconnectDelaysDoubleUpToTheMaximum) {
+    WebSocket::ReconnectPolicy policy;
+    policy.initialDelay = 0.5F;
+    policy.maxDelay = 30.0F;
+    policy.jitter = 0;
+    const float expected[] = {0.5F, 1, 2, 4, 8, 16, 30, 30};
+    for (int attempt = 1; attempt <= 8; ++attempt) {
+        CHECK(std::fabs(getReconnectDelay(policy, attempt) - expected[attempt - 1]) < 1e-6F);
+    }
+    // no overflow however long it retries
+    CHECK(getReconnectDelay(policy, 1000) == 30.0F);
+}
+
+TEST(reconnectJitterStaysWithinItsFraction) {
+    WebSocket::ReconnectPolicy policy;
+    policy.initialDelay = 1;
+    policy.jitter = 0.2F;
+    float lowest = 2;
+    float highest = 0;
+    for (int i = 0; i < 1000; ++i) {
+        float delay = getReconnectDelay(policy, 1);
+        lowest = std::min(lowest, delay);
+        highest = std::max(highest, delay);
+    }
+    CHECK(lowest >= 0.8F && highest <= 1.2F);
+    CHECK(highest - lowest > 0.2F); // it does randomize
+    // out of range fractions are clamped, the delay never goes negative
+    policy.jitter = 5;
+    for (int i = 0; i < 1000; ++i) {
+        float delay = getReconnectDelay(policy, 1);
+        CHECK(delay >= 0 && delay <= 2);
+    }
+}
+
+TEST(handlesGoStaleWhenRemovedAndStayStaleOnceReused) {
+    Table table;
+    int first = 1;
+    int second = 2;
+    uint64_t handle = table.add(&first);
+    REQUIRE(handle != 0);
+    CHECK(table.get(handle) == &first);
+    CHECK(Table::Pin(table, handle).get() == &first);
+
+    table.remove(handle);
+    CHECK(table.get(handle) == nullptr);
+    CHECK(Table::Pin(table, handle).get() == nullptr);
+    table.remove(handle); // twice is harmless
+
+    // same slot, next generation
+    uint64_t reused = table.add(&second);
+    CHECK((reused & 0xFFFFFFFF) == (handle & 0xFFFFFFFF));
+    CHECK(reused != handle);
+    CHECK(table.get(handle) == nullptr);
+    CHECK(Table::Pin(table, handle).get() == nullptr);
+    table.remove(handle); // removes nothing
+    CHECK(table.get(reused) == &second);
+    CHECK(Table::Pin(table, reused).get() == &second);
+
+    // handles no table ever returned
+    CHECK(table.get(0) == nullptr);
+    CHECK(table.get(reused + 1) == nullptr);
+    CHECK(Table::Pin(table, 0xFFFFFFFF).get() == nullptr);
+}
+
+TEST(getHandlesListsTheLiveObjects) {
+    Table table;
+    int objects[5] = {};
+    std::vector<uint64_t> handles;
+    for (int &object : objects) {
+        handles.push_back(table.add(&object));
+    }
+    table.remove(handles[1]);
+    table.remove(handles[3]);
+    uint64_t reused = table.add(&objects[3]);
+    std::vector<uint64_t> live = table.getHandles();
+    std::sort(live.begin(), live.end());
+    std::vector<uint64_t> expected{handles[0], handles[2], handles[4], reused};
+    std::sort(expected.begin(), expected.end());
+    CHECK(live == expected);
+    CHECK(Table().getHandles().empty());
+}
+
+TEST(addFailsOnceEverySlotIsTaken) {
+    Table table;
+    int object = 0;
+    std::vector<uint64_t> handles;
+    while (true) {
+        uint64_t handle = table.add(&object);
+        if (handle == 0) {
+            break;
+        }
+        handles.push_back(handle);
+        REQUIRE(handles.size() <= 1000000);
+    }
+    CHECK(handles.size() == 256 * 64); // MAX_CHUNKS chunks of CHUNK_SIZE slots
+    CHECK(table.add(&object) == 0);
+    CHECK(table.get(handles.back()) == &object);
+    // a removed object frees its slot for the next one
+    table.remove(handles[100]);
+    uint64_t handle = table.add(&object);
+    CHECK(handle != 0 && (handle & 0xFFFFFFFF) == (handles[100] & 0xFFFFFFFF));
+    CHECK(table.add(&object) == 0);
+}
+
+TEST(removeWaitsForThePinsOfOtherThreads) {
+    Table table;
+    int object = 0;
+    uint64_t handle = table.add(&object);
+    std::atomic<bool> pinned{false};
+    std::atomic<bool> release{false};
+    std::atomic<bool> removed{false};
+    // what the pins resolved to, checked on this thread
+    std::atomic<int *> first{nullptr};
+    std::atomic<int *> whileRemoving{nullptr};
+    std::atomic<int *> late{&object};
+    std::thread reader([&]() {
+        Table::Pin pin(table, handle);
+        first = pin.get();
+        pinned = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+        whileRemoving = pin.get();
+    });
+    while (!pinned) {
+        std::this_thread::yield();
+    }
+    std::thread remover([&]() {
+        table.remove(handle);
+        removed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!removed);
+    // a pin taken once the removal began gets nothing
+    std::thread([&]() { late = Table::Pin(table, handle).get(); }).join();
+    CHECK(late == nullptr);
+    CHECK(!removed);
+    release = true;
+    reader.join();
+    remover.join();
+    CHECK(removed);
+    CHECK(first == &object);
+    CHECK(whileRemoving == &object);
+    CHECK(table.get(handle) == nullptr);
+}
+
+TEST(roundTripsTrackTheMinimumAndASmoothedAverage) {
+    RoundTripEstimator estimator;
+    WebSocket::RoundTripTime empty = estimator.get();
+    CHECK(empty.samples == 0 && empty.min == 0 && empty.avg == 0 && empty.p95 == 0);
+
+    estimator.addSample(10);
+    WebSocket::RoundTripTime rtt = estimator.get();
+    CHECK(rtt.samples == 1 && rtt.min == 10 && rtt.avg == 10 && rtt.p95 == 10);
+
+    // each sample moves the average by 1/8 of its distance
+    const float samples[] = {20, 4, 4, 100};
+    float smoothed = 10;
+    float minimum = 10;
+    for (float sample : samples) {
+        estimator.addSample(sample);
+        smoothed += (sample - smoothed) / 8;
+        minimum = std::min(minimum, sample);
+        rtt = estimator.get();
+        CHECK(std::fabs(rtt.avg - smoothed) < 1e-4F);
+        CHECK(rtt.min == minimum);
+    }
+    CHECK(rtt.samples == 5);
+
+    estimator.reset();
+    rtt = estimator.get();
+    CHECK(rtt.samples == 0 && rtt.min == 0 && rtt.avg == 0 && rtt.p95 == 0);
+    estimator.addSample(7);
+    CHECK(estimator.get().min == 7 && estimator.get().p95 == 7);
+}
+
+TEST(roundTripPercentileCoversTheLast64Samples) {
+    RoundTripEstimator estimator;
+    // nearest rank: the 95th percentile of 1..20 is the 19th value
+    for (int i = 20; i >= 1; --i) {
+        estimator.addSample(static_cast<float>(i));
+    }
+    CHECK(estimator.get().p95 == 19);
+
+    // 1..100 keeps 37..100, the 61st of those is 97, while the minimum remembers every sample
+    estimator.reset();
+    for (int i = 1; i <= 100; ++i) {
+        estimator.addSample(static_cast<float>(i));
+    }
+    WebSocket::RoundTripTime rtt = estimator.get();
+    CHECK(rtt.samples == 100);
+    CHECK(rtt.p95 == 97);
+    CHECK(rtt.min == 1);
+
+    // one slow pong in 64 is below the 95th percentile, four are not
+    estimator.reset();
+    for (int i = 0; i < 64; ++i) {
+        estimator.addSample(i == 0 ? 500.0F : 5.0F);
+    }
+    CHECK(estimator.get().p95 == 5);
+    // these replace the oldest four, the first slow one among them
+    for (int i = 0; i < 4; ++i) {
+        estimator.addSample(500);
+    }
+    CHECK(estimator.get().p95 == 500);
+}
+
+float toMs(uint64_t micros) {
+    return static_cast<float>(micros) / 1000.0F;
+}
+
+TEST(latencyBucketsAreExactBelow16AndLinearWithinEachOctave) {
+    struct Row {
+        uint64_t micros;
+        int bucket;
+        uint64_t value; // middle of the bucket
+    };
+    const uint64_t octave35 = 1ULL << 35;
+    const Row rows[] = {
+        {0, 0, 0},
+        {1, 1, 1},
+        {15, 15, 15},
+        // 16..31 in buckets of 2
+        {16, 16, 17},
+        {17, 16, 17},
+        {18, 17, 19},
+        {31, 23, 31},
+        // 32..63 in buckets of 4
+        {32, 24, 34},
+        {35, 24, 34},
+        {36, 25, 38},
+        {63, 31, 62},
+        {64, 32, 68},
+        {1000, 16 + 5 * 8 + 7, 992}, // 960..1023
+        // the last octave, 2^35..2^36-1 in buckets of 2^32
+        {octave35, 264, 8 * (1ULL << 32) + (1ULL << 31)},
+        {2 * octave35 - 1, 271, 15 * (1ULL << 32) + (1ULL << 31)},
+        // and everything above in the last bucket
+        {2 * octave35, 271, 15 * (1ULL << 32) + (1ULL << 31)},
+        {UINT64_MAX, 271, 15 * (1ULL << 32) + (1ULL << 31)},
+    };
+    CHECK(LatencyHistogram::BUCKETS == 272);
+    for (const Row &row : rows) {
+        int bucket = LatencyHistogram::getBucket(row.micros);
+        if (bucket != row.bucket || LatencyHistogram::getBucketValue(bucket) != row.value) {
+            fprintf(stderr, "%llu us: bucket %d, value %llu\n", static_cast<unsigned long long>(row.micros), bucket,
+                    static_cast<unsigned long long>(LatencyHistogram::getBucketValue(bucket)));
+            CHECK(false);
+        }
+    }
+    // every octave starts a new bucket and ends 8 buckets later
+    for (int exponent = 4; exponent <= LatencyHistogram::MAX_EXPONENT; ++exponent) {
+        int first = 16 + (exponent - 4) * 8;
+        CHECK(LatencyHistogram::getBucket(1ULL << exponent) == first);
+        CHECK(LatencyHistogram::getBucket((1ULL << exponent) - 1) == first - 1);
+        CHECK(LatencyHistogram::getBucket((2ULL << exponent) - 1) == first + 7);
+    }
+    // the value of a bucket lies in it
+    for (int bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+        CHECK(LatencyHistogram::getBucket(LatencyHistogram::getBucketValue(bucket)) == bucket);
+    }
+}
+
+TEST(latencySnapshotsReportMillisecondsCappedAtTheMaximum) {
+    struct Row {
+        int64_t micros;
+        float p50; // the bucket's middle, but never above the largest sample
+    };
+    const Row rows[] = {
+        {-5, 0},
+        {0, 0},
+        {15, toMs(15)},
+        {16, toMs(16)},
+        {17, toMs(17)},
+        {18, toMs(18)},
+        {19, toMs(19)},
+        {1LL << 35, toMs(1ULL << 35)},
+        {1LL << 40, toMs(15 * (1ULL << 32) + (1ULL << 31))},
+    };
+    for (const Row &row : rows) {
+        LatencyHistogram histogram;
+        histogram.record(row.micros);
+        WebSocket::LatencyStats stats = histogram.snapshot();
+        uint64_t micros = row.micros > 0 ? static_cast<uint64_t>(row.micros) : 0;
+        CHECK(stats.count == 1);
+        CHECK(stats.mean == toMs(micros));
+        CHECK(stats.max == toMs(micros));
+        CHECK(stats.p50 == row.p50 && stats.p90 == row.p50 && stats.p99 == row.p50);
+    }
+
+    WebSocket::LatencyStats empty = LatencyHistogram().snapshot();
+    CHECK(empty.count == 0 && empty.mean == 0 && empty.p50 == 0 && empty.max == 0);
+
+    // 1..100us once each: the 50th, 90th and 99th samples land in the buckets of 48-51, 88-95 and 96-103
+    LatencyHistogram histogram;
+    for (int micros = 100; micros >= 1; --micros) {
+        histogram.record(micros);
+    }
+    WebSocket::LatencyStats stats = histogram.snapshot();
+    CHECK(stats.count == 100);
+    CHECK(std::fabs(stats.mean - 0.0505F) < 1e-6F);
+    CHECK(stats.p50 == toMs(50));
+    CHECK(stats.p90 == toMs(92));
+    CHECK(stats.p99 == toMs(100));
+    CHECK(stats.max == toMs(100));
+}
+
+TEST(metricsAddUpInTheGlobalRecorder) {
+    WebSocket::Metrics globalBefore = MetricsRecorder::getGlobal().snapshot();
+    MetricsRecorder first;
+    MetricsRecorder second;
+    first.onMessageSent(10, false);
+    first.onMessageSent(5, true);
+    first.onMessageReceived(7, 100);
+    first.onJniCall(3);
+    first.onOpen(2000);
+    second.onMessageSent(1, false);
+    second.onSendBufferAllocation();
+    second.onReconnect();
+    second.onOpen(4000);
+
+    WebSocket::Metrics metrics = first.snapshot();
+    CHECK(metrics.messagesSent == 2 && metrics.bytesSent == 15 && metrics.binaryMessagesSent == 1);
+    CHECK(metrics.sendBufferAllocations == 0);
+    CHECK(metrics.messagesReceived == 1 && metrics.bytesReceived == 7);
+    CHECK(metrics.connections == 1 && metrics.reconnects == 0);
+    CHECK(metrics.deliveryLatency.count == 1 && metrics.deliveryLatency.max == toMs(100));
+    CHECK(metrics.jniCallTime.count == 1 && metrics.handshakeTime.count == 1);
+    metrics = second.snapshot();
+    CHECK(metrics.messagesSent == 1 && metrics.bytesSent == 1 && metrics.messagesReceived == 0);
+    CHECK(metrics.connections == 1 && metrics.reconnects == 1 && metrics.sendBufferAllocations == 1);
+
+    WebSocket::Metrics global = MetricsRecorder::getGlobal().snapshot();
+    CHECK(global.messagesSent - globalBefore.messagesSent == 3);
+    CHECK(global.bytesSent - globalBefore.bytesSent == 16);
+    CHECK(global.messagesReceived - globalBefore.messagesReceived == 1);
+    CHECK(global.bytesReceived - globalBefore.bytesReceived == 7);
+    CHECK(global.connections - globalBefore.connections == 2);
+    CHECK(global.reconnects - globalBefore.reconnects == 1);
+    CHECK(global.binaryMessagesSent - globalBefore.binaryMessagesSent == 1);
+    CHECK(global.sendBufferAllocations - globalBefore.sendBufferAllocations == 1);
+    CHECK(global.handshakeTime.count - globalBefore.handshakeTime.count == 2);
+    CHECK(global.deliveryLatency.count - globalBefore.deliveryLatency.count == 1);
+    CHECK(global.jniCallTime.count - globalBefore.jniCallTime.count == 1);
+    CHECK(global.handshakeTime.max >= toMs(4000));
+}
+
+int main(int argc, char **argv) {
+    return check::runTests(argc, argv);
+}